@@ -0,0 +1,473 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file libnfc-bench.c
+ * @brief Micro and macro benchmarks of libnfc hot paths
+ *
+ * Each case is run with a growing iteration count until it lasts at least the
+ * requested minimal time, then its cost is reported as JSON on stdout:
+ *   { "libnfc_version": "...", "benchmarks": [
+ *     { "name": "...", "iterations": N, "ns_per_op": X, "allocs_per_op": Y }, ... ] }
+ * allocs_per_op is null when allocations can not be counted on this platform.
+ *
+ * Macro cases need a device: by default the in-process simulator
+ * ("pn53x_sim", see --with-drivers/LIBNFC_DRIVER_PN53X_SIM), they are skipped
+ * when it can not be opened.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "target-subr.h"
+#include "chips/pn53x.h"
+
+#define LOG_CATEGORY "libnfc.bench"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+#define BENCH_DEFAULT_CONNSTRING "pn53x_sim"
+#define BENCH_DEFAULT_MIN_TIME_MS 200
+#define BENCH_MAX_ITERATIONS (1UL << 30)
+
+/*
+ * Allocation counting: with glibc, malloc & co. defined here interpose the
+ * ones used by libnfc.
+ */
+#if defined(__GLIBC__)
+#  define BENCH_COUNT_ALLOCS 1
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static size_t bench_allocs;
+
+void *
+malloc(size_t size)
+{
+  bench_allocs++;
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+  bench_allocs++;
+  return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  bench_allocs++;
+  return __libc_realloc(ptr, size);
+}
+#else
+static size_t bench_allocs;
+#endif
+
+// Keep the compiler from optimizing benchmarked calls away
+static volatile uint8_t bench_sink;
+
+static nfc_context *context;
+static nfc_device *pnd;
+static const char *connstring = BENCH_DEFAULT_CONNSTRING;
+static const char *bench_error;
+
+static uint8_t abtData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+static uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD] = { 0x00, 0x00, 0xff };
+static uint8_t abtWrapped[PN53x_EXTENDED_FRAME__DATA_MAX_LEN * 2];
+static uint8_t abtPar[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+static char acText[4096];
+
+// InListPassiveTarget answer payload (Tg excluded) of an ISO14443-4 target with ATS
+static const uint8_t abtTargetData[] = {
+  0x01, 0x00, 0x04, 0x20, 0x07, 0x04, 0xa1, 0xb2, 0xc3, 0xd4, 0xe5, 0xf6,
+  0x06, 0x75, 0x77, 0x81, 0x02, 0x80
+};
+
+static void
+bench_build_frame_normal(size_t n)
+{
+  size_t szFrame;
+  for (size_t i = 0; i < n; i++) {
+    pn53x_build_frame(abtFrame, &szFrame, abtData, 16);
+  }
+  bench_sink = abtFrame[szFrame - 2];
+}
+
+static void
+bench_build_frame_extended(size_t n)
+{
+  size_t szFrame;
+  for (size_t i = 0; i < n; i++) {
+    pn53x_build_frame(abtFrame, &szFrame, abtData, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  }
+  bench_sink = abtFrame[szFrame - 2];
+}
+
+static void
+bench_wrap_frame(size_t n)
+{
+  int res = 0;
+  for (size_t i = 0; i < n; i++) {
+    res = pn53x_wrap_frame(abtData, 16 * 8, abtPar, abtWrapped);
+  }
+  bench_sink = abtWrapped[res / 8];
+}
+
+static void
+bench_unwrap_frame(size_t n)
+{
+  const int szWrappedBits = pn53x_wrap_frame(abtData, 16 * 8, abtPar, abtWrapped);
+  uint8_t abtRx[16];
+  for (size_t i = 0; i < n; i++) {
+    pn53x_unwrap_frame(abtWrapped, szWrappedBits, abtRx, abtPar);
+  }
+  bench_sink = abtRx[15];
+}
+
+static void
+bench_iso14443a_crc(size_t n)
+{
+  uint8_t abtCrc[2];
+  for (size_t i = 0; i < n; i++) {
+    iso14443a_crc(abtData, 16, abtCrc);
+  }
+  bench_sink = abtCrc[0];
+}
+
+static void
+bench_iso14443b_crc(size_t n)
+{
+  uint8_t abtCrc[2];
+  for (size_t i = 0; i < n; i++) {
+    iso14443b_crc(abtData, 16, abtCrc);
+  }
+  bench_sink = abtCrc[0];
+}
+
+static void
+bench_decode_target_data(size_t n)
+{
+  nfc_target_info nti;
+  for (size_t i = 0; i < n; i++) {
+    pn53x_decode_target_data(abtTargetData, sizeof(abtTargetData), PN532, NMT_ISO14443A, &nti);
+  }
+  bench_sink = nti.nai.abtUid[0];
+}
+
+static void
+bench_snprint_nfc_target(size_t n)
+{
+  nfc_target nt;
+  nt.nm.nmt = NMT_ISO14443A;
+  nt.nm.nbr = NBR_106;
+  pn53x_decode_target_data(abtTargetData, sizeof(abtTargetData), PN532, NMT_ISO14443A, &(nt.nti));
+  for (size_t i = 0; i < n; i++) {
+    snprint_nfc_target(acText, sizeof(acText), &nt, true);
+  }
+  bench_sink = acText[0];
+}
+
+static void
+bench_log_put_disabled(size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s: %u", "bench", (unsigned int) i);
+  }
+}
+
+static void
+bench_log_hex_disabled(size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    LOG_HEX(LOG_GROUP, "TX", abtData, 16);
+  }
+}
+
+static void
+bench_open_close(size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    nfc_device *pndTmp = nfc_open(context, connstring);
+    if (!pndTmp) {
+      bench_error = "nfc_open failed";
+      return;
+    }
+    nfc_close(pndTmp);
+  }
+}
+
+static void
+bench_list_passive_targets(size_t n)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_target ant[4];
+  for (size_t i = 0; i < n; i++) {
+    // Cycle the field so previously listed (thus halted) targets answer again
+    if ((nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false) < 0) ||
+        (nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true) < 0)) {
+      bench_error = nfc_strerror(pnd);
+      return;
+    }
+    if (nfc_initiator_list_passive_targets(pnd, nm, ant, sizeof(ant) / sizeof(ant[0])) <= 0) {
+      bench_error = "no target found";
+      return;
+    }
+  }
+}
+
+static void
+bench_transceive_bytes(size_t n)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  // Previous run left the target halted
+  if ((nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false) < 0) ||
+      (nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true) < 0)) {
+    bench_error = nfc_strerror(pnd);
+    return;
+  }
+  if (nfc_initiator_select_passive_target(pnd, nm, NULL, 0, NULL) <= 0) {
+    bench_error = "no target found";
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (nfc_initiator_transceive_bytes(pnd, abtData, 16, abtRx, sizeof(abtRx), 0) < 0) {
+      bench_error = nfc_strerror(pnd);
+      return;
+    }
+  }
+  nfc_initiator_deselect_target(pnd);
+  bench_sink = abtRx[0];
+}
+
+static void
+bench_transceive_batch(size_t n)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  uint8_t abtRx[16][PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  nfc_transceive_op ops[16];
+  if ((nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false) < 0) ||
+      (nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true) < 0)) {
+    bench_error = nfc_strerror(pnd);
+    return;
+  }
+  if (nfc_initiator_select_passive_target(pnd, nm, NULL, 0, NULL) <= 0) {
+    bench_error = "no target found";
+    return;
+  }
+  for (size_t i = 0; i < 16; i++) {
+    ops[i] = (nfc_transceive_op) {
+      .pbtTx = abtData, .szTx = 16, .pbtRx = abtRx[i], .szRx = sizeof(abtRx[i])
+    };
+  }
+  // One iteration is one exchange, as for nfc_initiator_transceive_bytes/16
+  for (size_t i = 0; i < n; i += 16) {
+    if (nfc_initiator_transceive_batch(pnd, ops, 16, NFC_BATCH_STOP_ON_ERROR, 0) != 16) {
+      bench_error = nfc_strerror(pnd);
+      return;
+    }
+  }
+  nfc_initiator_deselect_target(pnd);
+  bench_sink = abtRx[0][0];
+}
+
+static void
+bench_transceive_bytes_traced(size_t n)
+{
+  if (nfc_device_set_trace(pnd, 1024) < 0) {
+    bench_error = nfc_strerror(pnd);
+    return;
+  }
+  bench_transceive_bytes(n);
+  nfc_device_set_trace(pnd, 0);
+}
+
+typedef enum {
+  BENCH_MICRO,
+  // Macro cases opening the device by themselves
+  BENCH_CONNSTRING,
+  // Macro cases using an already opened initiator
+  BENCH_INITIATOR,
+} bench_kind;
+
+struct bench_case {
+  const char *name;
+  void (*run)(size_t n);
+  bench_kind kind;
+};
+
+static const struct bench_case bench_cases[] = {
+  { "pn53x_build_frame/normal_16", bench_build_frame_normal, BENCH_MICRO },
+  { "pn53x_build_frame/extended_264", bench_build_frame_extended, BENCH_MICRO },
+  { "pn53x_wrap_frame/16", bench_wrap_frame, BENCH_MICRO },
+  { "pn53x_unwrap_frame/16", bench_unwrap_frame, BENCH_MICRO },
+  { "iso14443a_crc/16", bench_iso14443a_crc, BENCH_MICRO },
+  { "iso14443b_crc/16", bench_iso14443b_crc, BENCH_MICRO },
+  { "pn53x_decode_target_data/iso14443a_ats", bench_decode_target_data, BENCH_MICRO },
+  { "snprint_nfc_target/iso14443a_verbose", bench_snprint_nfc_target, BENCH_MICRO },
+  { "log_put/disabled", bench_log_put_disabled, BENCH_MICRO },
+  { "LOG_HEX/disabled", bench_log_hex_disabled, BENCH_MICRO },
+  { "nfc_open_close", bench_open_close, BENCH_CONNSTRING },
+  { "nfc_initiator_list_passive_targets/iso14443a", bench_list_passive_targets, BENCH_INITIATOR },
+  { "nfc_initiator_transceive_bytes/16", bench_transceive_bytes, BENCH_INITIATOR },
+  { "nfc_initiator_transceive_bytes/16_traced", bench_transceive_bytes_traced, BENCH_INITIATOR },
+  { "nfc_initiator_transceive_batch/16x16", bench_transceive_batch, BENCH_INITIATOR },
+};
+
+static uint64_t
+bench_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+bench_run(const struct bench_case *bc, const uint64_t min_time_ns, bool *first)
+{
+  size_t n = 1;
+  uint64_t elapsed;
+  size_t allocs;
+
+  bench_error = NULL;
+  for (;;) {
+    const size_t allocs_start = bench_allocs;
+    const uint64_t start = bench_now_ns();
+    bc->run(n);
+    elapsed = bench_now_ns() - start;
+    allocs = bench_allocs - allocs_start;
+    if ((bench_error) || (elapsed >= min_time_ns) || (n >= BENCH_MAX_ITERATIONS))
+      break;
+    n *= 2;
+  }
+
+  printf("%s\n    { \"name\": \"%s\"", *first ? "" : ",", bc->name);
+  *first = false;
+  if (bench_error) {
+    printf(", \"error\": \"%s\" }", bench_error);
+    return;
+  }
+  printf(", \"iterations\": %lu, \"ns_per_op\": %.1f", (unsigned long) n, (double) elapsed / n);
+#if defined(BENCH_COUNT_ALLOCS)
+  printf(", \"allocs_per_op\": %.2f }", (double) allocs / n);
+#else
+  (void) allocs;
+  printf(", \"allocs_per_op\": null }");
+#endif
+}
+
+static void
+print_usage(const char *progname)
+{
+  fprintf(stderr, "Usage: %s [OPTIONS]\n", progname);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "\t-h\t\tPrint this help message.\n");
+  fprintf(stderr, "\t-d CONNSTRING\tDevice used by macro benchmarks (default: %s).\n", BENCH_DEFAULT_CONNSTRING);
+  fprintf(stderr, "\t-t MS\t\tMinimal duration of each benchmark (default: %d ms).\n", BENCH_DEFAULT_MIN_TIME_MS);
+  fprintf(stderr, "\t-f FILTER\tOnly run benchmarks whose name contains FILTER.\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *filter = NULL;
+  unsigned long min_time_ms = BENCH_DEFAULT_MIN_TIME_MS;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if ((0 == strcmp(argv[arg], "-d")) && (arg + 1 < argc)) {
+      connstring = argv[++arg];
+    } else if ((0 == strcmp(argv[arg], "-t")) && (arg + 1 < argc)) {
+      min_time_ms = strtoul(argv[++arg], NULL, 10);
+    } else if ((0 == strcmp(argv[arg], "-f")) && (arg + 1 < argc)) {
+      filter = argv[++arg];
+    } else {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(abtData); i++)
+    abtData[i] = (uint8_t) i;
+
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc (malloc)\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Check once the device is there, it is only kept opened for initiator cases
+  bool device_available = false;
+  if ((pnd = nfc_open(context, connstring)) != NULL) {
+    device_available = true;
+    nfc_close(pnd);
+    pnd = NULL;
+  } else {
+    fprintf(stderr, "Unable to open %s: macro benchmarks skipped\n", connstring);
+  }
+
+  bool first = true;
+  printf("{\n  \"libnfc_version\": \"%s\",\n  \"connstring\": \"%s\",\n  \"benchmarks\": [", nfc_version(), connstring);
+  for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+    const struct bench_case *bc = &bench_cases[i];
+    if ((filter) && (strstr(bc->name, filter) == NULL))
+      continue;
+    if ((bc->kind != BENCH_MICRO) && (!device_available))
+      continue;
+    if (bc->kind == BENCH_INITIATOR) {
+      if ((pnd == NULL) && ((pnd = nfc_open(context, connstring)) == NULL))
+        continue;
+      if (nfc_initiator_init(pnd) < 0) {
+        nfc_perror(pnd, "nfc_initiator_init");
+        continue;
+      }
+    } else if (pnd) {
+      nfc_close(pnd);
+      pnd = NULL;
+    }
+    bench_run(bc, (uint64_t) min_time_ms * 1000000, &first);
+  }
+  printf("\n  ]\n}\n");
+
+  if (pnd)
+    nfc_close(pnd);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
@@ -3,3 +3,4 @@
 #cmakedefine PACKAGE_STRING "@PACKAGE_STRING@"
 #cmakedefine _XOPEN_SOURCE @_XOPEN_SOURCE@
 #cmakedefine SYSCONFDIR "@SYSCONFDIR@"
+#cmakedefine HAVE_PTHREAD @HAVE_PTHREAD@
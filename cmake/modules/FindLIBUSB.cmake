@@ -49,7 +49,11 @@ IF(NOT LIBUSB_FOUND)
     # If not under Windows we use PkgConfig
     FIND_PACKAGE (PkgConfig)
     IF(PKG_CONFIG_FOUND)
-      PKG_CHECK_MODULES(LIBUSB REQUIRED libusb)
+      IF(LIBNFC_LIBUSB1)
+        PKG_CHECK_MODULES(LIBUSB REQUIRED libusb-1.0)
+      ELSE(LIBNFC_LIBUSB1)
+        PKG_CHECK_MODULES(LIBUSB REQUIRED libusb)
+      ENDIF(LIBNFC_LIBUSB1)
     ELSE(PKG_CONFIG_FOUND)
       MESSAGE(FATAL_ERROR "Could not find PkgConfig")
     ENDIF(PKG_CONFIG_FOUND)
@@ -11,6 +11,17 @@ ELSE(WIN32)
 ENDIF(WIN32)
 SET(LIBNFC_DRIVER_PN532_UART ON CACHE BOOL "Enable PN532 UART support (Use serial port)")
 SET(LIBNFC_DRIVER_PN53X_USB ON CACHE BOOL "Enable PN531 and PN531 USB support (Depends on libusb)")
+SET(LIBNFC_DRIVER_PN53X_SIM OFF CACHE BOOL "Enable in-process PN53x simulator (No hardware needed)")
+IF(WIN32)
+  SET(LIBNFC_DRIVER_BROKER OFF CACHE BOOL "Enable devices shared by the nfcd broker (Use local socket)")
+ELSE(WIN32)
+  SET(LIBNFC_DRIVER_BROKER ON CACHE BOOL "Enable devices shared by the nfcd broker (Use local socket)")
+ENDIF(WIN32)
+SET(LIBNFC_LIBUSB1 OFF CACHE BOOL "Use libusb-1.0 asynchronous transfers instead of libusb 0.1 for USB drivers")
+
+IF(LIBNFC_LIBUSB1)
+  ADD_DEFINITIONS("-DHAVE_LIBUSB1")
+ENDIF(LIBNFC_LIBUSB1)
 
 IF(LIBNFC_DRIVER_ACR122_PCSC)
   FIND_PACKAGE(PCSC REQUIRED)
@@ -61,4 +72,14 @@ IF(LIBNFC_DRIVER_PN53X_USB)
   SET(USB_REQUIRED TRUE)
 ENDIF(LIBNFC_DRIVER_PN53X_USB)
 
+IF(LIBNFC_DRIVER_PN53X_SIM)
+  ADD_DEFINITIONS("-DDRIVER_PN53X_SIM_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/pn53x_sim")
+ENDIF(LIBNFC_DRIVER_PN53X_SIM)
+
+IF(LIBNFC_DRIVER_BROKER)
+  ADD_DEFINITIONS("-DDRIVER_BROKER_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/broker")
+ENDIF(LIBNFC_DRIVER_BROKER)
+
 INCLUDE_DIRECTORIES(${CMAKE_CURRENT_SOURCE_DIR}/libnfc/drivers)
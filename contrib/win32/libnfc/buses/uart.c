@@ -49,10 +49,15 @@
 #include "contrib/windows.h"
 #define delay_ms( X ) Sleep( X )
 
+// Receive buffer used by uart_peek(), large enough for a PN53x extended frame
+#define UART_RX_BUFFER_LEN 512
+
 struct serial_port_windows {
   HANDLE  hPort;                // Serial port handle
   DCB     dcb;                  // Device control settings
   COMMTIMEOUTS ct;              // Serial port time-out configuration
+  uint8_t abtRx[UART_RX_BUFFER_LEN]; // Bytes peeked but not consumed yet
+  size_t  szRx;                 // Count of bytes in abtRx
 };
 
 serial_port
@@ -63,6 +68,7 @@ uart_open(const char *pcPortName)
 
   if (sp == 0)
     return INVALID_SERIAL_PORT;
+  sp->szRx = 0;
 
   // Copy the input "com?" to "\\.\COM?" format
   sprintf(acPortName, "\\\\.\\%s", pcPortName);
@@ -115,10 +121,11 @@ uart_close(const serial_port sp)
 void
 uart_flush_input(const serial_port sp, bool wait)
 {
+  ((struct serial_port_windows *) sp)->szRx = 0;
   PurgeComm(((struct serial_port_windows *) sp)->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
 }
 
-void
+int
 uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
 {
   struct serial_port_windows *spw;
@@ -133,10 +140,12 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     case 115200:
     case 230400:
     case 460800:
+    case 921600:
+    case 1288000:
       break;
     default:
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d baud. Speed value must be one of these constants: 9600 (default), 19200, 38400, 57600, 115200, 230400 or 460800.", uiPortSpeed);
-      return;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d baud. Speed value must be one of these constants: 9600 (default), 19200, 38400, 57600, 115200, 230400, 460800, 921600 or 1288000.", uiPortSpeed);
+      return NFC_EINVARG;
   };
   spw = (struct serial_port_windows *) sp;
 
@@ -144,9 +153,10 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
   spw->dcb.BaudRate = uiPortSpeed;
   if (!SetCommState(spw->hPort, &spw->dcb)) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to apply new speed settings.");
-    return;
+    return NFC_EIO;
   }
   PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  return NFC_SUCCESS;
 }
 
 uint32_t
@@ -160,7 +170,68 @@ uart_get_speed(const serial_port sp)
 }
 
 int
-uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
+uart_get_fd(const serial_port sp)
+{
+  (void) sp;
+  // A serial port HANDLE can not be polled
+  return -1;
+}
+
+static int uart_receive_port(serial_port sp, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout);
+
+int
+uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout)
+{
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+  // Serve bytes left by uart_peek() first
+  const size_t szBuffered = MIN(szRx, spw->szRx);
+  if (szBuffered) {
+    memcpy(pbtRx, spw->abtRx, szBuffered);
+    uart_consume(sp, szBuffered);
+  }
+  if (szRx == szBuffered)
+    return 0;
+  return uart_receive_port(sp, pbtRx + szBuffered, szRx - szBuffered, cancel, timeout);
+}
+
+int
+uart_peek(serial_port sp, const uint8_t **ppbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout)
+{
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+  int res;
+
+  if (szRx > sizeof(spw->abtRx))
+    return NFC_EINVARG;
+  if (szRx > spw->szRx) {
+    if ((res = uart_receive_port(sp, spw->abtRx + spw->szRx, szRx - spw->szRx, cancel, timeout)) < 0)
+      return res;
+    spw->szRx = szRx;
+  }
+  *ppbtRx = spw->abtRx;
+  return (int) spw->szRx;
+}
+
+int
+uart_peek_nowait(serial_port sp, const uint8_t **ppbtRx)
+{
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+  // Without a pollable descriptor, only bytes already peeked are reported
+  *ppbtRx = spw->abtRx;
+  return (int) spw->szRx;
+}
+
+void
+uart_consume(serial_port sp, const size_t szRx)
+{
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+  const size_t szConsumed = MIN(szRx, spw->szRx);
+
+  memmove(spw->abtRx, spw->abtRx + szConsumed, spw->szRx - szConsumed);
+  spw->szRx -= szConsumed;
+}
+
+static int
+uart_receive_port(serial_port sp, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout)
 {
   DWORD dwBytesToGet = (DWORD)szRx;
   DWORD dwBytesReceived = 0;
@@ -184,7 +255,6 @@ uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, i
 
   // TODO Enhance the reception method
   // - According to MSDN, it could be better to implement nfc_abort_command() mecanism using Cancello()
-  volatile bool *abort_flag_p = (volatile bool *)abort_p;
   do {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "ReadFile");
     res = ReadFile(((struct serial_port_windows *) sp)->hPort, pbtRx + dwTotalBytesReceived,
@@ -205,7 +275,7 @@ uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, i
       dwBytesToGet -= dwBytesReceived;
     }
 
-    if (abort_flag_p != NULL && (*abort_flag_p) && dwTotalBytesReceived == 0) {
+    if (cancel != NULL && dwTotalBytesReceived == 0 && nfc_cancel_take(cancel)) {
       return NFC_EOPABORTED;
     }
   } while (((DWORD)szRx) > dwTotalBytesReceived);
@@ -282,3 +352,26 @@ uart_list_ports(void)
 
   return availablePorts;
 }
+
+size_t
+uart_scan_ports(const nfc_context *context, uart_probe probe, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  char **acPorts = uart_list_ports();
+  const uint64_t ui64Deadline = monotonic_time_ns() + (uint64_t) UART_SCAN_DEADLINE_MS * 1000000;
+  size_t device_found = 0;
+  int res = 0;
+
+  if (!acPorts)
+    return 0;
+  // Ports are probed one after the other here
+  for (size_t i = 0; acPorts[i]; i++) {
+    if ((res >= 0) && (device_found < connstrings_len) && (monotonic_time_ns() < ui64Deadline)) {
+      res = probe(context, acPorts[i], connstrings[device_found]);
+      if (res > 0)
+        device_found++;
+    }
+    free(acPorts[i]);
+  }
+  free(acPorts);
+  return (res < 0) ? 0 : device_found;
+}
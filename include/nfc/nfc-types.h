@@ -56,6 +56,11 @@ typedef struct nfc_device nfc_device;
  */
 typedef struct nfc_driver nfc_driver;
 
+/**
+ * NFC reader pool
+ */
+typedef struct nfc_reader_pool nfc_reader_pool;
+
 /**
  * Connection string
  */
@@ -141,6 +146,86 @@ typedef enum {
   NP_FORCE_SPEED_106,
 } nfc_property;
 
+/**
+ * @struct nfc_property_setting
+ * @brief Property value, for nfc_device_set_properties()
+ */
+typedef struct {
+  nfc_property property;
+  /** Integer value for NP_TIMEOUT_* properties, 0 (false) or 1 (true) for boolean ones */
+  int value;
+} nfc_property_setting;
+
+/**
+ * @enum nfc_log_sink
+ * @brief Destination of the log messages handled by the background log writer
+ */
+typedef enum {
+  /** Standard error output */
+  NFC_LOG_SINK_STDERR = 0,
+  /** Log callback set with nfc_set_log_callback() */
+  NFC_LOG_SINK_CALLBACK,
+  /** File, appended */
+  NFC_LOG_SINK_FILE,
+  /** syslog(3) */
+  NFC_LOG_SINK_SYSLOG,
+  /** systemd journal, using its native protocol */
+  NFC_LOG_SINK_JOURNALD,
+} nfc_log_sink;
+
+/**
+ * @brief Log callback
+ * @param priority NFC_LOG_PRIORITY_ERROR, NFC_LOG_PRIORITY_INFO or NFC_LOG_PRIORITY_DEBUG (NFC_LOG_PRIORITY_NONE for messages that are always printed)
+ * @param category category of the message, e.g. "libnfc.chip.pn53x"
+ * @param message formatted message, without trailing newline
+ * @param user_data pointer given to nfc_set_log_callback()
+ */
+typedef void (*nfc_log_callback)(int priority, const char *category, const char *message, void *user_data);
+
+/**
+ * Number of latency histogram buckets in \a nfc_command_stats
+ */
+#define NFC_STATS_BUCKETS 64
+
+/**
+ * Maximum number of distinct commands tracked per device
+ */
+#define NFC_STATS_MAX_COMMANDS 48
+
+/**
+ * Lower bound, in microseconds, of latency histogram bucket \a i.
+ * Buckets are log-linear: two buckets per power of two, i.e. 0, 1, 2, 3, 4, 6, 8, 12, 16, 24...
+ * Bucket \a i holds latencies from NFC_STATS_BUCKET_LOWER_US(i) up to NFC_STATS_BUCKET_LOWER_US(i + 1) excluded.
+ */
+#define NFC_STATS_BUCKET_LOWER_US(i) (((i) < 2) ? (uint64_t)(i) : ((uint64_t)(2 | ((i) & 1)) << ((i) / 2 - 1)))
+
+/**
+ * @struct nfc_command_stats
+ * @brief Statistics of a chip command
+ */
+typedef struct {
+  /** Chip command code (e.g. 0x4A for PN53x InListPassiveTarget) */
+  uint8_t command;
+  /** Number of exchanges */
+  uint32_t count;
+  /** Exchanges which timed out */
+  uint32_t timeouts;
+  /** Exchanges which failed at driver level (I/O error, abort...), timeouts excluded */
+  uint32_t io_errors;
+  /** Exchanges for which the chip reported an error status */
+  uint32_t chip_errors;
+  /** Bytes sent to the chip, command code included */
+  uint64_t bytes_sent;
+  /** Bytes received from the chip, status byte included */
+  uint64_t bytes_received;
+  /** Sum of exchange latencies, in microseconds */
+  uint64_t total_us;
+  /** Highest exchange latency, in microseconds */
+  uint64_t max_us;
+  /** Latency histogram, see NFC_STATS_BUCKET_LOWER_US() */
+  uint32_t histogram[NFC_STATS_BUCKETS];
+} nfc_command_stats;
+
 // Compiler directive, set struct alignment to 1 uint8_t for compatibility
 #  pragma pack(1)
 
@@ -341,6 +426,56 @@ typedef struct {
   nfc_modulation nm;
 } nfc_target;
 
+/**
+ * @struct nfc_transceive_op
+ * @brief One exchange of a nfc_initiator_transceive_batch() call
+ */
+typedef struct {
+  /** Bytes to transmit */
+  const uint8_t *pbtTx;
+  /** Number of bytes to transmit */
+  size_t szTx;
+  /** Buffer receiving the answer, may be NULL to discard it */
+  uint8_t *pbtRx;
+  /** Size of \a pbtRx */
+  size_t szRx;
+  /** Expected answer length, 0 to accept any length */
+  size_t szRxExpected;
+  /** [out] Received bytes count, or libnfc's error code if this exchange failed */
+  int res;
+} nfc_transceive_op;
+
+/** Stop a nfc_initiator_transceive_batch() call at the first failing exchange */
+#define NFC_BATCH_STOP_ON_ERROR 0x01
+
+/**
+ * @brief Reader pool job
+ * @param pnd device that selected \a pnt, NULL when the job is discarded by nfc_reader_pool_free()
+ * @param pnt selected target, NULL when the job is discarded
+ * @param user_data pointer given to nfc_reader_pool_submit()
+ * @return 0 on success, otherwise a libnfc's error code (negative value), accounted in \a nfc_reader_stats
+ */
+typedef int (*nfc_reader_job)(nfc_device *pnd, const nfc_target *pnt, void *user_data);
+
+/**
+ * @struct nfc_reader_stats
+ * @brief Statistics of a reader of a \a nfc_reader_pool
+ */
+typedef struct {
+  /** Jobs run on this reader */
+  uint64_t jobs;
+  /** Jobs that returned an error */
+  uint64_t jobs_failed;
+  /** Targets selected, including those no job was left for */
+  uint64_t targets;
+  /** Select attempts that failed with an error (not just without target) */
+  uint64_t select_errors;
+  /** Time spent in jobs, in microseconds */
+  uint64_t busy_us;
+  /** Last error reported by the reader, 0 if none */
+  int last_error;
+} nfc_reader_stats;
+
 // Reset struct alignment to default
 #  pragma pack()
 
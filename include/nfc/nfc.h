@@ -102,6 +102,7 @@ NFC_EXPORT int nfc_initiator_select_dep_target(nfc_device *pnd, const nfc_dep_mo
 NFC_EXPORT int nfc_initiator_poll_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_deselect_target(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+NFC_EXPORT int nfc_initiator_transceive_batch(nfc_device *pnd, nfc_transceive_op ops[], const size_t szOps, const int flags, int timeout);
 NFC_EXPORT int nfc_initiator_transceive_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
 NFC_EXPORT int nfc_initiator_transceive_bytes_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
 NFC_EXPORT int nfc_initiator_transceive_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles);
@@ -114,6 +115,14 @@ NFC_EXPORT int nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const s
 NFC_EXPORT int nfc_target_send_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 NFC_EXPORT int nfc_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
 
+/* Non-blocking operations */
+NFC_EXPORT int nfc_device_get_pollfd(nfc_device *pnd);
+NFC_EXPORT int nfc_device_submit_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
+NFC_EXPORT int nfc_device_submit_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx);
+NFC_EXPORT int nfc_device_submit_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx);
+NFC_EXPORT int nfc_device_submit_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx);
+NFC_EXPORT int nfc_device_complete(nfc_device *pnd);
+
 /* Error reporting */
 NFC_EXPORT const char *nfc_strerror(const nfc_device *pnd);
 NFC_EXPORT int nfc_strerror_r(const nfc_device *pnd, char *buf, size_t buflen);
@@ -126,10 +135,31 @@ NFC_EXPORT const char *nfc_device_get_connstring(nfc_device *pnd);
 NFC_EXPORT int nfc_device_get_supported_modulation(nfc_device *pnd, const nfc_mode mode,  const nfc_modulation_type **const supported_mt);
 NFC_EXPORT int nfc_device_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
 NFC_EXPORT int nfc_device_get_supported_baud_rate_target_mode(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
+NFC_EXPORT int nfc_device_get_stats(nfc_device *pnd, nfc_command_stats stats[], const size_t szStats);
+NFC_EXPORT int nfc_device_reset_stats(nfc_device *pnd);
 
 /* Properties accessors */
 NFC_EXPORT int nfc_device_set_property_int(nfc_device *pnd, const nfc_property property, const int value);
 NFC_EXPORT int nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable);
+NFC_EXPORT int nfc_device_set_properties(nfc_device *pnd, const nfc_property_setting *settings, const size_t szSettings);
+
+/* Log sinks */
+NFC_EXPORT void nfc_set_log_level(nfc_context *context, const uint32_t log_level);
+NFC_EXPORT void nfc_set_log_callback(nfc_context *context, nfc_log_callback callback, void *user_data);
+NFC_EXPORT int nfc_start_log_writer(nfc_context *context, const nfc_log_sink sink, const char *path, const size_t queue_len);
+NFC_EXPORT void nfc_stop_log_writer(nfc_context *context);
+NFC_EXPORT unsigned long nfc_get_log_dropped(const nfc_context *context);
+
+/* Frame trace */
+NFC_EXPORT int nfc_device_set_trace(nfc_device *pnd, const size_t frames);
+NFC_EXPORT int nfc_device_save_trace(nfc_device *pnd, const char *filename);
+
+/* Reader pool */
+NFC_EXPORT nfc_reader_pool *nfc_reader_pool_new(nfc_context *context, const nfc_connstring connstrings[], const size_t szReaders, const nfc_modulation nm, const size_t szQueue) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_reader_pool_submit(nfc_reader_pool *pool, nfc_reader_job job, void *user_data, const int timeout);
+NFC_EXPORT size_t nfc_reader_pool_pending(nfc_reader_pool *pool);
+NFC_EXPORT int nfc_reader_pool_get_stats(nfc_reader_pool *pool, nfc_reader_stats stats[], const size_t szStats);
+NFC_EXPORT void nfc_reader_pool_free(nfc_reader_pool *pool);
 
 /* Misc. functions */
 NFC_EXPORT void iso14443a_crc(uint8_t *pbtData, size_t szLen, uint8_t *pbtCrc);
@@ -147,6 +177,28 @@ NFC_EXPORT const char *str_nfc_modulation_type(const nfc_modulation_type nmt);
 NFC_EXPORT const char *str_nfc_baud_rate(const nfc_baud_rate nbr);
 NFC_EXPORT int str_nfc_target(char **buf, const nfc_target *pnt, bool verbose);
 
+/* Log priorities */
+/** @ingroup log
+ * @hideinitializer
+ * Message printed whatever the log level is, unless logs are disabled
+ */
+#define NFC_LOG_PRIORITY_NONE   0
+/** @ingroup log
+ * @hideinitializer
+ * Error message
+ */
+#define NFC_LOG_PRIORITY_ERROR  1
+/** @ingroup log
+ * @hideinitializer
+ * Informational message
+ */
+#define NFC_LOG_PRIORITY_INFO   2
+/** @ingroup log
+ * @hideinitializer
+ * Debug message
+ */
+#define NFC_LOG_PRIORITY_DEBUG  3
+
 /* Error codes */
 /** @ingroup error
  * @hideinitializer
@@ -193,6 +245,11 @@ NFC_EXPORT int str_nfc_target(char **buf, const nfc_target *pnt, bool verbose);
  * Not (yet) implemented
  */
 #define NFC_ENOTIMPL			-8
+/** @ingroup error
+ * @hideinitializer
+ * Non-blocking operation not completed yet, try again when the device descriptor is readable
+ */
+#define NFC_EAGAIN			-9
 /** @ingroup error
  * @hideinitializer
  * Target released
@@ -52,6 +52,8 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include <linux/i2c.h>
+
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
 
@@ -68,6 +70,7 @@ const char *i2c_ports_device_radix[] =
 
 struct i2c_device_unix {
   int fd;             // I2C device file descriptor
+  uint16_t addr;      // I2C device address, for combined transactions
 };
 
 #define I2C_DATA( X ) ((struct i2c_device_unix *) X)
@@ -87,6 +90,8 @@ i2c_open(const char *pcI2C_busName, uint32_t devAddr)
   if (id == 0)
     return INVALID_I2C_BUS ;
 
+  id->addr = devAddr;
+
   id->fd = open(pcI2C_busName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (id->fd == -1) {
     perror("Cannot open I2C bus");
@@ -174,6 +179,51 @@ i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx)
   }
 }
 
+/**
+ * @brief Run \a szSegments messages as one combined I2C transaction
+ *
+ * Messages are chained with repeated START conditions and a single STOP
+ * ends the transaction, so the bus is not released between them.
+ *
+ * @param id I2C device.
+ * @param segments messages to write or read, in bus order
+ * @param szSegments number of messages
+ * @return NFC_SUCCESS on success, otherwise driver error code
+ */
+int
+i2c_transfer(i2c_device id, struct i2c_segment *segments, const size_t szSegments)
+{
+  struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+
+  if ((szSegments == 0) || (szSegments > I2C_RDWR_IOCTL_MAX_MSGS))
+    return NFC_EINVARG;
+
+  for (size_t i = 0; i < szSegments; i++) {
+    if (!segments[i].bRead)
+      LOG_HEX(LOG_GROUP, "TX", segments[i].pbtData, segments[i].szLen);
+    msgs[i].addr = I2C_DATA(id) ->addr;
+    msgs[i].flags = segments[i].bRead ? I2C_M_RD : 0;
+    msgs[i].len = segments[i].szLen;
+    msgs[i].buf = segments[i].pbtData;
+  }
+
+  struct i2c_rdwr_ioctl_data rdwr = {
+    .msgs = msgs,
+    .nmsgs = szSegments,
+  };
+  if (ioctl(I2C_DATA(id) ->fd, I2C_RDWR, &rdwr) != (int) szSegments) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR,
+            "Error: combined transaction of %d messages failed (%s).", (int) szSegments, strerror(errno));
+    return NFC_EIO;
+  }
+
+  for (size_t i = 0; i < szSegments; i++) {
+    if (segments[i].bRead)
+      LOG_HEX(LOG_GROUP, "RX", segments[i].pbtData, segments[i].szLen);
+  }
+  return NFC_SUCCESS;
+}
+
 /**
  * @brief Get the path of all I2C bus devices.
  *
@@ -47,6 +47,13 @@ typedef void *i2c_device;
 #  define INVALID_I2C_BUS (void*)(~1)
 #  define INVALID_I2C_ADDRESS (void*)(~2)
 
+// One message of an i2c_transfer() combined transaction
+struct i2c_segment {
+  uint8_t *pbtData;             // Bytes to send, or buffer for received bytes when bRead is set
+  size_t szLen;
+  bool bRead;
+};
+
 i2c_device i2c_open(const char *pcI2C_busName, uint32_t devAddr);
 
 void       i2c_close(const i2c_device id);
@@ -55,6 +62,8 @@ ssize_t    i2c_read(i2c_device id, uint8_t *pbtRx, const size_t szRx);
 
 int        i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx);
 
+int        i2c_transfer(i2c_device id, struct i2c_segment *segments, const size_t szSegments);
+
 char     **i2c_list_ports(void);
 
 #endif // __NFC_BUS_I2C_H__
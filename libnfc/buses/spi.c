@@ -48,10 +48,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
 
+#if defined(__has_include)
+#  if __has_include(<linux/gpio.h>)
+#    include <linux/gpio.h>
+#    define SPI_HAVE_GPIO_IRQ 1
+#  endif
+#endif
+
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
 
@@ -71,6 +79,8 @@ const char *spi_ports_device_radix[] = { "spidev", NULL };
 
 struct spi_port_unix {
   int 			fd; 			// Serial port file descriptor
+  int 			irq_fd; 		// GPIO line event file descriptor, -1 when no IRQ line is used
+  int 			lsb_first; 		// Kernel SPI_LSB_FIRST state: 1 set, 0 clear, -1 not supported by the controller
   //~ struct termios 	termios_backup; 	// Terminal info before using the port
   //~ struct termios 	termios_new; 		// Terminal info during the transaction
 };
@@ -86,6 +96,8 @@ spi_open(const char *pcPortName)
   if (sp == 0)
     return INVALID_SPI_PORT;
 
+  sp->irq_fd = -1;
+  sp->lsb_first = 0;
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (sp->fd == -1) {
     spi_close(sp);
@@ -117,7 +129,14 @@ spi_set_mode(spi_port sp, const uint32_t uiPortMode)
   int ret;
   ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &uiPortMode);
 
-  if (ret == -1)  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error setting SPI mode.");
+  if (ret == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error setting SPI mode.");
+  } else if (uiPortMode & SPI_LSB_FIRST) {
+    // The mode byte carries SPI_LSB_FIRST too: the controller accepted it
+    SPI_DATA(sp)->lsb_first = 1;
+  } else if (SPI_DATA(sp)->lsb_first > 0) {
+    SPI_DATA(sp)->lsb_first = 0;
+  }
 
 }
 
@@ -138,10 +157,124 @@ spi_get_speed(spi_port sp)
 void
 spi_close(const spi_port sp)
 {
+  if (SPI_DATA(sp)->irq_fd >= 0)
+    close(SPI_DATA(sp)->irq_fd);
   close(SPI_DATA(sp)->fd);
   free(sp);
 }
 
+/**
+ * @brief Attach the interrupt line \a uiLine of GPIO chip \a pcChipName to \a sp
+ *
+ * The line is requested as an input reporting falling edges, which matches
+ * active-low "data ready" outputs such as the PN532 P70_IRQ pin.
+ *
+ * @return 0 on success, otherwise a driver error is returned
+ */
+int
+spi_irq_open(spi_port sp, const char *pcChipName, const uint32_t uiLine)
+{
+#ifdef SPI_HAVE_GPIO_IRQ
+  int chip_fd = open(pcChipName, O_RDONLY);
+  if (chip_fd == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open GPIO chip %s: %s", pcChipName, strerror(errno));
+    return NFC_EIO;
+  }
+
+  struct gpioevent_request req;
+  memset(&req, 0, sizeof(req));
+  req.lineoffset = uiLine;
+  req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+  req.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+  snprintf(req.consumer_label, sizeof(req.consumer_label), "libnfc");
+
+  int ret = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+  close(chip_fd);
+  if (ret == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to request line %u of GPIO chip %s: %s", uiLine, pcChipName, strerror(errno));
+    return NFC_EIO;
+  }
+
+  if (SPI_DATA(sp)->irq_fd >= 0)
+    close(SPI_DATA(sp)->irq_fd);
+  SPI_DATA(sp)->irq_fd = req.fd;
+  return NFC_SUCCESS;
+#else
+  (void) sp;
+  (void) uiLine;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "GPIO interrupt line %s requested but GPIO support is not available", pcChipName);
+  return NFC_EDEVNOTSUPP;
+#endif
+}
+
+/**
+ * @brief Wait up to \a timeout ms (-1 for ever) for the interrupt line attached
+ * to \a sp to be asserted, or for \a iAbortFd (-1 if none) to be readable
+ *
+ * The line level is checked first because the edge may have fired before the
+ * call; a pending edge event only means the caller should look again.
+ *
+ * @return 0 when the line is (or just went) low, NFC_ETIMEOUT when nothing
+ * happened, NFC_EOPABORTED when \a iAbortFd is readable (it is not read),
+ * otherwise a driver error is returned
+ */
+int
+spi_irq_wait(spi_port sp, int iAbortFd, int timeout)
+{
+#ifdef SPI_HAVE_GPIO_IRQ
+  const int fd = SPI_DATA(sp)->irq_fd;
+  if (fd < 0)
+    return NFC_EDEVNOTSUPP;
+
+  struct gpiohandle_data data;
+  memset(&data, 0, sizeof(data));
+  if (ioctl(fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read GPIO line value: %s", strerror(errno));
+    return NFC_EIO;
+  }
+  if (data.values[0] == 0)
+    return NFC_SUCCESS;
+
+  struct pollfd pfds[2] = {
+    { .fd = fd, .events = POLLIN, .revents = 0 },
+    { .fd = iAbortFd, .events = POLLIN, .revents = 0 },
+  };
+  int res = poll(pfds, (iAbortFd >= 0) ? 2 : 1, timeout);
+  if (res < 0) {
+    if (errno == EINTR)
+      return NFC_ETIMEOUT;
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to poll GPIO line: %s", strerror(errno));
+    return NFC_EIO;
+  }
+  if (res == 0)
+    return NFC_ETIMEOUT;
+  if ((iAbortFd >= 0) && pfds[1].revents)
+    return NFC_EOPABORTED;
+
+  // Consume the edge so it does not wake the next wait
+  struct gpioevent_data event;
+  if (read(fd, &event, sizeof(event)) != (ssize_t) sizeof(event)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to read GPIO line event");
+    return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+#else
+  (void) sp;
+  (void) iAbortFd;
+  (void) timeout;
+  return NFC_EDEVNOTSUPP;
+#endif
+}
+
+/**
+ * @brief Tell whether an interrupt line is attached to \a sp
+ */
+bool
+spi_has_irq(const spi_port sp)
+{
+  return SPI_DATA(sp)->irq_fd >= 0;
+}
+
 
 /**
  * @brief Perform bit reversal on one byte \a x
@@ -164,91 +297,135 @@ bit_reversal(const uint8_t x)
 
 
 /**
- * @brief Send \a pbtTx content to SPI then receive data from SPI and copy data to \a pbtRx. CS line stays active	 between transfers as well as during transfers.
+ * @brief Set the kernel bit order to \a lsb_first when the controller supports it
+ *
+ * @return true if the controller now shifts bits in the requested order,
+ * false if bytes have to be mirrored in software
+ */
+static bool
+spi_set_lsb_first(spi_port sp, bool lsb_first)
+{
+  struct spi_port_unix *spu = SPI_DATA(sp);
+
+  if (spu->lsb_first < 0)
+    return !lsb_first;
+  if (spu->lsb_first == (lsb_first ? 1 : 0))
+    return true;
+
+  uint8_t lsb = lsb_first ? 1 : 0;
+  if (ioctl(spu->fd, SPI_IOC_WR_LSB_FIRST, &lsb) == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "SPI controller does not support LSB first, reversing bits in software.");
+    spu->lsb_first = -1;
+    return !lsb_first;
+  }
+  spu->lsb_first = lsb;
+  return true;
+}
+
+/**
+ * @brief Run \a szSegments transfer segments as a single SPI message
+ *
+ * Each segment sends \a pbtTx (or zeros when NULL) and/or receives into
+ * \a pbtRx (when not NULL) \a szLen bytes. CS stays active across segments
+ * unless \a bCsChange is set on a segment, as with the kernel cs_change flag.
  *
  * @return 0 on success, otherwise a driver error is returned
  */
 int
-spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first)
+spi_transfer(spi_port sp, const struct spi_segment *segments, const size_t szSegments, bool lsb_first)
 {
+  struct spi_ioc_transfer tr[SPI_MAX_SEGMENTS];
   size_t transfers = 0;
-  struct spi_ioc_transfer tr[2];
+  size_t szTotal = 0;
+  size_t szTxTotal = 0;
 
+  if (szSegments > SPI_MAX_SEGMENTS)
+    return NFC_EINVARG;
 
-  uint8_t *pbtTxLSB = 0;
+  const bool mirror = !spi_set_lsb_first(sp, lsb_first);
 
-  if (szTx) {
-    LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-    if (lsb_first) {
-      pbtTxLSB = malloc(szTx * sizeof(uint8_t));
-      if (!pbtTxLSB) {
-        return NFC_ESOFT;
-      }
-
-      size_t i;
-      for (i = 0; i < szTx; ++i) {
-        pbtTxLSB[i] = bit_reversal(pbtTx[i]);
-      }
+  for (size_t i = 0; i < szSegments; i++) {
+    if (segments[i].pbtTx)
+      szTxTotal += segments[i].szLen;
+  }
 
-      pbtTx = pbtTxLSB;
+  uint8_t *pbtTxLSB = NULL;
+  if (mirror && szTxTotal) {
+    pbtTxLSB = malloc(szTxTotal);
+    if (!pbtTxLSB) {
+      return NFC_ESOFT;
     }
+  }
 
-    struct spi_ioc_transfer tr_send = {
-      .tx_buf = (unsigned long) pbtTx,
-      .rx_buf = 0,
-      .len = szTx,
-      .delay_usecs = 0,
-      .speed_hz = 0,
-      .bits_per_word = 0,
-    };
-    tr[transfers] = tr_send;
+  size_t szTxPos = 0;
+  for (size_t i = 0; i < szSegments; i++) {
+    const struct spi_segment *seg = &segments[i];
+    if (!seg->szLen)
+      continue;
 
-    ++transfers;
-  }
+    const uint8_t *pbtTx = seg->pbtTx;
+    if (pbtTx) {
+      LOG_HEX(LOG_GROUP, "TX", pbtTx, seg->szLen);
+      if (mirror) {
+        for (size_t j = 0; j < seg->szLen; ++j) {
+          pbtTxLSB[szTxPos + j] = bit_reversal(pbtTx[j]);
+        }
+        pbtTx = pbtTxLSB + szTxPos;
+        szTxPos += seg->szLen;
+      }
+    }
 
-  if (szRx) {
-    struct spi_ioc_transfer tr_receive = {
-      .tx_buf = 0,
-      .rx_buf = (unsigned long) pbtRx,
-      .len = szRx,
-      .delay_usecs = 0,
-      .speed_hz = 0,
-      .bits_per_word = 0,
-    };
-    tr[transfers] = tr_receive;
+    memset(&tr[transfers], 0, sizeof(tr[transfers]));
+    tr[transfers].tx_buf = (unsigned long) pbtTx;
+    tr[transfers].rx_buf = (unsigned long) seg->pbtRx;
+    tr[transfers].len = seg->szLen;
+    tr[transfers].cs_change = seg->bCsChange ? 1 : 0;
+    szTotal += seg->szLen;
     ++transfers;
   }
 
-
-
   if (transfers) {
     int ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_MESSAGE(transfers), tr);
-    if (szTx && lsb_first) {
-      free(pbtTxLSB);
-    }
+    free(pbtTxLSB);
 
-    if (ret != (int)(szRx + szTx)) {
+    if (ret != (int) szTotal) {
       return NFC_EIO;
     }
 
-    // Reverse received bytes if needed
-    if (szRx) {
-      if (lsb_first) {
-        size_t i;
-        for (i = 0; i < szRx; ++i) {
-          pbtRx[i] = bit_reversal(pbtRx[i]);
+    for (size_t i = 0; i < szSegments; i++) {
+      const struct spi_segment *seg = &segments[i];
+      if (!seg->pbtRx || !seg->szLen)
+        continue;
+      // Reverse received bytes if needed
+      if (mirror) {
+        for (size_t j = 0; j < seg->szLen; ++j) {
+          seg->pbtRx[j] = bit_reversal(seg->pbtRx[j]);
         }
       }
-
-      LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
+      LOG_HEX(LOG_GROUP, "RX", seg->pbtRx, seg->szLen);
     }
   }
 
-
   return NFC_SUCCESS;
 }
 
 
+/**
+ * @brief Send \a pbtTx content to SPI then receive data from SPI and copy data to \a pbtRx. CS line stays active	 between transfers as well as during transfers.
+ *
+ * @return 0 on success, otherwise a driver error is returned
+ */
+int
+spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first)
+{
+  const struct spi_segment segments[2] = {
+    { .pbtTx = pbtTx, .pbtRx = NULL, .szLen = szTx, .bCsChange = false },
+    { .pbtTx = NULL, .pbtRx = pbtRx, .szLen = szRx, .bCsChange = false },
+  };
+  return spi_transfer(sp, segments, 2, lsb_first);
+}
+
+
 /**
  * @brief Receive data from SPI and copy data to \a pbtRx
  *
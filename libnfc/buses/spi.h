@@ -49,6 +49,16 @@ typedef void *spi_port;
 #  define INVALID_SPI_PORT (void*)(~1)
 #  define CLAIMED_SPI_PORT (void*)(~2)
 
+#  define SPI_MAX_SEGMENTS 8
+
+// One segment of a spi_transfer() message
+struct spi_segment {
+  const uint8_t *pbtTx;         // Bytes to send, NULL to clock out zeros
+  uint8_t *pbtRx;               // Where to store received bytes, NULL to drop them
+  size_t szLen;
+  bool bCsChange;               // Deassert CS after this segment
+};
+
 spi_port spi_open(const char *pcPortName);
 void    spi_close(const spi_port sp);
 
@@ -56,8 +66,13 @@ void    spi_set_speed(spi_port sp, const uint32_t uiPortSpeed);
 void    spi_set_mode(spi_port sp, const uint32_t uiPortMode);
 uint32_t spi_get_speed(const spi_port sp);
 
+int     spi_irq_open(spi_port sp, const char *pcChipName, const uint32_t uiLine);
+int     spi_irq_wait(spi_port sp, int iAbortFd, int timeout);
+bool    spi_has_irq(const spi_port sp);
+
 int     spi_receive(spi_port sp, uint8_t *pbtRx, const size_t szRx, bool lsb_first);
 int     spi_send(spi_port sp, const uint8_t *pbtTx, const size_t szTx, bool lsb_first);
+int     spi_transfer(spi_port sp, const struct spi_segment *segments, const size_t szSegments, bool lsb_first);
 int     spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first);
 
 char  **spi_list_ports(void);
@@ -37,7 +37,11 @@
 #include "uart.h"
 
 #include <sys/ioctl.h>
-#include <sys/select.h>
+#if defined(__APPLE__)
+#  include <sys/select.h>
+#else
+#  include <poll.h>
+#endif
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -50,6 +54,9 @@
 #include <termios.h>
 #include <unistd.h>
 #include <stdlib.h>
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
@@ -92,13 +99,42 @@ const char *serial_ports_device_radix[] = { "ttyUSB", "ttyS", "ttyACM", "ttyAMA"
 #  define FIONREAD TIOCINQ
 #endif
 
+// Linux accepts any baud rate through termios2 and BOTHER. <asm/termbits.h> can not
+// be included along with <termios.h>, so the asm-generic layout is declared here;
+// architectures with their own termbits layout are left out.
+#if defined(__linux__) && !defined(__alpha__) && !defined(__mips__) && !defined(__powerpc__) && !defined(__sparc__)
+#  define UART_HAVE_TERMIOS2
+struct uart_termios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+#  define UART_TCGETS2  _IOR('T', 0x2A, struct uart_termios2)
+#  define UART_TCSETSW2 _IOW('T', 0x2C, struct uart_termios2)
+#  define UART_CBAUD    0010017
+#  define UART_BOTHER   0010000
+#  define UART_IBSHIFT  16
+#endif
+
 // Work-around to claim uart interface using the c_iflag (software input processing) from the termios struct
 #  define CCLAIMED 0x80000000
 
+// Receive buffer, large enough for an ACK frame followed by a PN53x extended frame
+#define UART_RX_BUFFER_LEN 512
+
 struct serial_port_unix {
   int 			fd; 			// Serial port file descriptor
   struct termios 	termios_backup; 	// Terminal info before using the port
   struct termios 	termios_new; 		// Terminal info during the transaction
+  uint32_t		uiCustomSpeed;		// Non-standard speed set through termios2, 0 if none
+  uint8_t		abtRx[UART_RX_BUFFER_LEN];	// Bytes drained from the port but not consumed yet
+  size_t		szRxStart;		// Offset of the first unconsumed byte in abtRx
+  size_t		szRxEnd;		// Offset past the last unconsumed byte in abtRx
 };
 
 #define UART_DATA( X ) ((struct serial_port_unix *) X)
@@ -113,6 +149,8 @@ uart_open(const char *pcPortName)
   if (sp == 0)
     return INVALID_SERIAL_PORT;
 
+  sp->szRxStart = sp->szRxEnd = 0;
+  sp->uiCustomSpeed = 0;
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (sp->fd == -1) {
     uart_close_ext(sp, false);
@@ -157,6 +195,11 @@ uart_flush_input(serial_port sp, bool wait)
     msleep(50); // 50 ms
   }
 
+  if (UART_DATA(sp)->szRxEnd > UART_DATA(sp)->szRxStart) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%u buffered bytes have eaten.", (unsigned int)(UART_DATA(sp)->szRxEnd - UART_DATA(sp)->szRxStart));
+  }
+  UART_DATA(sp)->szRxStart = UART_DATA(sp)->szRxEnd = 0;
+
   // This line seems to produce absolutely no effect on my system (GNU/Linux 2.6.35)
   tcflush(UART_DATA(sp)->fd, TCIFLUSH);
   // So, I wrote this byte-eater
@@ -185,7 +228,29 @@ uart_flush_input(serial_port sp, bool wait)
   free(rx);
 }
 
-void
+#if defined(UART_HAVE_TERMIOS2)
+static int
+uart_set_custom_speed(serial_port sp, const uint32_t uiPortSpeed)
+{
+  struct uart_termios2 tio;
+
+  if (ioctl(UART_DATA(sp)->fd, UART_TCGETS2, &tio) == -1) {
+    return NFC_EIO;
+  }
+  tio.c_cflag &= ~(UART_CBAUD | (UART_CBAUD << UART_IBSHIFT));
+  tio.c_cflag |= UART_BOTHER | (UART_BOTHER << UART_IBSHIFT);
+  tio.c_ispeed = uiPortSpeed;
+  tio.c_ospeed = uiPortSpeed;
+  // Same as TCSADRAIN: pending output is sent at the previous speed
+  if (ioctl(UART_DATA(sp)->fd, UART_TCSETSW2, &tio) == -1) {
+    return NFC_EIO;
+  }
+  UART_DATA(sp)->uiCustomSpeed = uiPortSpeed;
+  return NFC_SUCCESS;
+}
+#endif
+
+int
 uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
 {
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Serial port speed requested to be set to %d baud.", uiPortSpeed);
@@ -222,11 +287,21 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     case 460800:
       stPortSpeed = B460800;
       break;
+#  endif
+#  ifdef B921600
+    case 921600:
+      stPortSpeed = B921600;
+      break;
 #  endif
     default:
+#  if defined(UART_HAVE_TERMIOS2)
+      if (uart_set_custom_speed(sp, uiPortSpeed) == NFC_SUCCESS) {
+        return NFC_SUCCESS;
+      }
+#  endif
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d baud. Speed value must be one of those defined in termios(3).",
               uiPortSpeed);
-      return;
+      return NFC_EINVARG;
   };
 
   // Set port speed (Input and Output)
@@ -234,13 +309,18 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
   cfsetospeed(&(UART_DATA(sp)->termios_new), stPortSpeed);
   if (tcsetattr(UART_DATA(sp)->fd, TCSADRAIN, &(UART_DATA(sp)->termios_new)) == -1) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to apply new speed settings.");
+    return NFC_EIO;
   }
+  UART_DATA(sp)->uiCustomSpeed = 0;
+  return NFC_SUCCESS;
 }
 
 uint32_t
 uart_get_speed(serial_port sp)
 {
   uint32_t uiPortSpeed = 0;
+  if (UART_DATA(sp)->uiCustomSpeed)
+    return UART_DATA(sp)->uiCustomSpeed;
   switch (cfgetispeed(&UART_DATA(sp)->termios_new)) {
     case B9600:
       uiPortSpeed = 9600;
@@ -270,6 +350,11 @@ uart_get_speed(serial_port sp)
     case B460800:
       uiPortSpeed = 460800;
       break;
+#  endif
+#  ifdef B921600
+    case B921600:
+      uiPortSpeed = 921600;
+      break;
 #  endif
   }
 
@@ -293,80 +378,223 @@ uart_close(const serial_port sp)
   uart_close_ext(sp, true);
 }
 
-/**
- * @brief Receive data from UART and copy data to \a pbtRx
- *
- * @return 0 on success, otherwise driver error code
+/*
+ * Wait for the port to be readable or for \a cancel (NULL if none) to be
+ * raised. The cancellation is consumed.
  */
-int
-uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
+static int
+uart_wait(struct serial_port_unix *spu, struct nfc_cancel *cancel, int timeout)
 {
-  int iAbortFd = abort_p ? *((int *)abort_p) : 0;
-  int received_bytes_count = 0;
-  int available_bytes_count = 0;
-  const int expected_bytes_count = (int)szRx;
+  const int iAbortFd = cancel ? nfc_cancel_fd(cancel) : -1;
+  bool bAbort;
+  bool bReadable;
   int res;
+#if defined(__APPLE__)
+  // Darwin poll() does not support tty devices
   fd_set rfds;
+  if ((spu->fd >= FD_SETSIZE) || (iAbortFd >= FD_SETSIZE)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "File descriptor too high for select()");
+    return NFC_EIO;
+  }
   do {
-select:
     // Reset file descriptor
     FD_ZERO(&rfds);
-    FD_SET(UART_DATA(sp)->fd, &rfds);
-
-    if (iAbortFd) {
+    FD_SET(spu->fd, &rfds);
+    if (iAbortFd >= 0) {
       FD_SET(iAbortFd, &rfds);
     }
 
     struct timeval timeout_tv;
-    if (timeout > 0) {
-      timeout_tv.tv_sec = (timeout / 1000);
-      timeout_tv.tv_usec = ((timeout % 1000) * 1000);
-    }
-
-    res = select(MAX(UART_DATA(sp)->fd, iAbortFd) + 1, &rfds, NULL, NULL, timeout ? &timeout_tv : NULL);
-
-    if ((res < 0) && (EINTR == errno)) {
-      // The system call was interupted by a signal and a signal handler was
-      // run.  Restart the interupted system call.
-      goto select;
-    }
+    timeout_tv.tv_sec = (timeout / 1000);
+    timeout_tv.tv_usec = ((timeout % 1000) * 1000);
+
+    res = select(MAX(spu->fd, iAbortFd) + 1, &rfds, NULL, NULL, (timeout > 0) ? &timeout_tv : NULL);
+    // The system call was interupted by a signal and a signal handler was
+    // run.  Restart the interupted system call.
+  } while ((res < 0) && (EINTR == errno));
+  bAbort = (res > 0) && (iAbortFd >= 0) && FD_ISSET(iAbortFd, &rfds);
+  bReadable = (res > 0) && FD_ISSET(spu->fd, &rfds);
+#else
+  // Unlike select(), poll() copes with any descriptor value and needs no set rebuilt
+  struct pollfd pfds[2] = {
+    { .fd = spu->fd, .events = POLLIN },
+    { .fd = iAbortFd, .events = POLLIN },
+  };
+  do {
+    res = poll(pfds, (iAbortFd >= 0) ? 2 : 1, (timeout > 0) ? timeout : -1);
+    // The system call was interupted by a signal and a signal handler was
+    // run.  Restart the interupted system call.
+  } while ((res < 0) && (EINTR == errno));
+  bAbort = (res > 0) && (iAbortFd >= 0) && pfds[1].revents;
+  bReadable = (res > 0) && pfds[0].revents;
+#endif
 
-    // Read error
-    if (res < 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error: %s", strerror(errno));
-      return NFC_EIO;
-    }
-    // Read time-out
-    if (res == 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Timeout!");
-      return NFC_ETIMEOUT;
-    }
+  // Read error
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error: %s", strerror(errno));
+    return NFC_EIO;
+  }
+  // Read time-out
+  if (res == 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Timeout!");
+    return NFC_ETIMEOUT;
+  }
 
-    if (FD_ISSET(iAbortFd, &rfds)) {
+  if (bAbort) {
+    if (nfc_cancel_take(cancel)) {
       // Abort requested
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Abort!");
-      close(iAbortFd);
       return NFC_EOPABORTED;
     }
+    // Wake-up left by a cancellation already consumed, now cleared
+    if (!bReadable)
+      return uart_wait(spu, cancel, timeout);
+  }
+  return NFC_SUCCESS;
+}
 
-    // Retrieve the count of the incoming bytes
-    res = ioctl(UART_DATA(sp)->fd, FIONREAD, &available_bytes_count);
-    if (res != 0) {
-      return NFC_EIO;
+/**
+ * @brief Wait until at least \a szMin bytes are buffered
+ *
+ * Each time the port is readable, everything it holds is drained at once into
+ * the receive buffer, so a whole frame usually costs a single read().
+ *
+ * @return 0 on success, otherwise driver error code
+ */
+static int
+uart_fill(serial_port sp, const size_t szMin, struct nfc_cancel *cancel, int timeout)
+{
+  struct serial_port_unix *spu = UART_DATA(sp);
+  int res;
+
+  if (szMin > sizeof(spu->abtRx))
+    return NFC_EINVARG;
+  // Make room at the end of the buffer for the missing bytes
+  if (spu->szRxStart + szMin > sizeof(spu->abtRx)) {
+    memmove(spu->abtRx, spu->abtRx + spu->szRxStart, spu->szRxEnd - spu->szRxStart);
+    spu->szRxEnd -= spu->szRxStart;
+    spu->szRxStart = 0;
+  }
+
+  while (spu->szRxEnd - spu->szRxStart < szMin) {
+    if ((res = uart_wait(spu, cancel, timeout)) < 0)
+      return res;
+
+    // Drain everything the port holds, up to the end of the buffer
+    res = read(spu->fd, spu->abtRx + spu->szRxEnd, sizeof(spu->abtRx) - spu->szRxEnd);
+    if ((res < 0) && ((EAGAIN == errno) || (EINTR == errno))) {
+      continue;
     }
-    // There is something available, read the data
-    res = read(UART_DATA(sp)->fd, pbtRx + received_bytes_count, MIN(available_bytes_count, (expected_bytes_count - received_bytes_count)));
     // Stop if the OS has some troubles reading the data
     if (res <= 0) {
       return NFC_EIO;
     }
-    received_bytes_count += res;
+    spu->szRxEnd += res;
+  }
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Receive data from UART and copy data to \a pbtRx
+ *
+ * @return 0 on success, otherwise driver error code
+ */
+int
+uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout)
+{
+  struct serial_port_unix *spu = UART_DATA(sp);
+  size_t szReceived = 0;
+  int res;
 
-  } while (expected_bytes_count > received_bytes_count);
+  while (szReceived < szRx) {
+    const size_t szChunk = MIN(szRx - szReceived, sizeof(spu->abtRx));
+    if ((res = uart_fill(sp, szChunk, cancel, timeout)) < 0)
+      return res;
+    memcpy(pbtRx + szReceived, spu->abtRx + spu->szRxStart, szChunk);
+    spu->szRxStart += szChunk;
+    szReceived += szChunk;
+  }
   LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
   return NFC_SUCCESS;
 }
 
+/**
+ * @brief Wait until at least \a szRx bytes are received and expose them in place
+ *
+ * Bytes stay buffered until uart_consume() is called, which lets a caller
+ * parse a frame incrementally without copying it.
+ *
+ * @return number of bytes available at *\a ppbtRx (at least \a szRx), otherwise driver error code
+ */
+int
+uart_peek(serial_port sp, const uint8_t **ppbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout)
+{
+  struct serial_port_unix *spu = UART_DATA(sp);
+  int res;
+
+  if ((res = uart_fill(sp, szRx, cancel, timeout)) < 0)
+    return res;
+  *ppbtRx = spu->abtRx + spu->szRxStart;
+  return (int)(spu->szRxEnd - spu->szRxStart);
+}
+
+/**
+ * @brief Expose in place the bytes received so far, without waiting for more
+ *
+ * Whatever the port holds is drained into the receive buffer first. As with
+ * uart_peek(), bytes stay buffered until uart_consume() is called.
+ *
+ * @return number of bytes available at *\a ppbtRx (possibly 0), otherwise driver error code
+ */
+int
+uart_peek_nowait(serial_port sp, const uint8_t **ppbtRx)
+{
+  struct serial_port_unix *spu = UART_DATA(sp);
+  int available_bytes_count = 0;
+  int res;
+
+  if (spu->szRxStart > 0) {
+    memmove(spu->abtRx, spu->abtRx + spu->szRxStart, spu->szRxEnd - spu->szRxStart);
+    spu->szRxEnd -= spu->szRxStart;
+    spu->szRxStart = 0;
+  }
+  if (ioctl(spu->fd, FIONREAD, &available_bytes_count) < 0)
+    return NFC_EIO;
+  if ((available_bytes_count > 0) && (spu->szRxEnd < sizeof(spu->abtRx))) {
+    res = read(spu->fd, spu->abtRx + spu->szRxEnd, sizeof(spu->abtRx) - spu->szRxEnd);
+    if ((res < 0) && (EAGAIN != errno) && (EINTR != errno))
+      return NFC_EIO;
+    if (res > 0)
+      spu->szRxEnd += res;
+  }
+  *ppbtRx = spu->abtRx;
+  return (int) spu->szRxEnd;
+}
+
+/**
+ * @brief Drop \a szRx bytes previously exposed by uart_peek()
+ */
+void
+uart_consume(serial_port sp, const size_t szRx)
+{
+  struct serial_port_unix *spu = UART_DATA(sp);
+  const size_t szConsumed = MIN(szRx, spu->szRxEnd - spu->szRxStart);
+
+  LOG_HEX(LOG_GROUP, "RX", spu->abtRx + spu->szRxStart, szConsumed);
+  spu->szRxStart += szConsumed;
+  if (spu->szRxStart == spu->szRxEnd)
+    spu->szRxStart = spu->szRxEnd = 0;
+}
+
+/**
+ * @brief File descriptor of the port, readable when bytes are waiting to be received
+ */
+int
+uart_get_fd(const serial_port sp)
+{
+  return UART_DATA(sp)->fd;
+}
+
 /**
  * @brief Send \a pbtTx content to UART
  *
@@ -431,3 +659,134 @@ oom:
 
   return res;
 }
+
+struct uart_scan {
+  const nfc_context *context;
+  uart_probe probe;
+  char **acPorts;
+  size_t szPorts;
+  int *aiResults;             // Probe result per port, 0 when not probed
+  nfc_connstring *acConnstrings; // Connstring per port, when found
+  size_t szNext;              // Next port to probe
+  size_t szFound;             // Devices found so far
+  size_t szMax;               // No port is probed once this many devices are found
+  uint64_t ui64Deadline;      // No port is probed after this date (ns)
+  bool bFailed;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex;
+#endif
+};
+
+static void *
+uart_scan_worker(void *arg)
+{
+  struct uart_scan *scan = arg;
+
+  for (;;) {
+    size_t i;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&scan->mutex);
+#endif
+    i = scan->szNext;
+    if ((i < scan->szPorts) && (!scan->bFailed) && (scan->szFound < scan->szMax) && (monotonic_time_ns() < scan->ui64Deadline))
+      scan->szNext++;
+    else
+      i = scan->szPorts;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&scan->mutex);
+#endif
+    if (i == scan->szPorts)
+      break;
+
+    scan->aiResults[i] = scan->probe(scan->context, scan->acPorts[i], scan->acConnstrings[i]);
+    if (scan->aiResults[i] != 0) {
+#ifdef HAVE_PTHREAD
+      pthread_mutex_lock(&scan->mutex);
+#endif
+      if (scan->aiResults[i] < 0)
+        scan->bFailed = true;
+      else
+        scan->szFound++;
+#ifdef HAVE_PTHREAD
+      pthread_mutex_unlock(&scan->mutex);
+#endif
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Probe every serial port with \a probe and list where a device answers
+ *
+ * Up to UART_SCAN_MAX_THREADS ports are probed concurrently, no port is probed
+ * once UART_SCAN_DEADLINE_MS have elapsed or once \a connstrings_len devices
+ * are found. Found devices are listed in uart_list_ports() order, whatever the
+ * order probes complete in: ports are handed out in that order, so the ports
+ * left unprobed all come after the ones listed.
+ *
+ * \a probe returns 1 and fills its connstring if a device is found, 0 if not,
+ * and a negative value on fatal error, which aborts the scan.
+ *
+ * @return number of devices found
+ */
+size_t
+uart_scan_ports(const nfc_context *context, uart_probe probe, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  struct uart_scan scan = {
+    .context = context,
+    .probe = probe,
+    .acPorts = uart_list_ports(),
+    .szMax = connstrings_len,
+    .ui64Deadline = monotonic_time_ns() + (uint64_t) UART_SCAN_DEADLINE_MS * 1000000,
+  };
+  size_t device_found = 0;
+
+  if (!scan.acPorts)
+    return 0;
+  while (scan.acPorts[scan.szPorts])
+    scan.szPorts++;
+
+  scan.aiResults = calloc(scan.szPorts, sizeof(int));
+  scan.acConnstrings = malloc(scan.szPorts * sizeof(nfc_connstring));
+  if ((scan.szPorts) && ((!scan.aiResults) || (!scan.acConnstrings))) {
+    perror("malloc");
+    scan.bFailed = true;
+  }
+
+  if (!scan.bFailed) {
+#ifdef HAVE_PTHREAD
+    pthread_t threads[UART_SCAN_MAX_THREADS - 1];
+    size_t szThreads = 0;
+    pthread_mutex_init(&scan.mutex, NULL);
+    // The calling thread is one of the workers
+    while ((szThreads < UART_SCAN_MAX_THREADS - 1) && (szThreads + 1 < scan.szPorts)) {
+      if (pthread_create(&threads[szThreads], NULL, uart_scan_worker, &scan) != 0)
+        break;
+      szThreads++;
+    }
+    uart_scan_worker(&scan);
+    for (size_t i = 0; i < szThreads; i++)
+      pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&scan.mutex);
+#else
+    uart_scan_worker(&scan);
+#endif
+    if ((!scan.bFailed) && (scan.szFound < scan.szMax) && (scan.szNext < scan.szPorts)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Serial ports scan deadline reached, %u port(s) not probed", (unsigned int)(scan.szPorts - scan.szNext));
+    }
+  }
+
+  for (size_t i = 0; (i < scan.szPorts) && (device_found < connstrings_len) && (!scan.bFailed); i++) {
+    if (scan.aiResults[i] > 0) {
+      memcpy(connstrings[device_found], scan.acConnstrings[i], sizeof(nfc_connstring));
+      device_found++;
+    }
+  }
+
+  for (size_t i = 0; i < scan.szPorts; i++)
+    free(scan.acPorts[i]);
+  free(scan.acPorts);
+  free(scan.aiResults);
+  free(scan.acConnstrings);
+  return device_found;
+}
@@ -51,12 +51,25 @@ serial_port uart_open(const char *pcPortName);
 void    uart_close(const serial_port sp);
 void    uart_flush_input(const serial_port sp, bool wait);
 
-void    uart_set_speed(serial_port sp, const uint32_t uiPortSpeed);
+int     uart_set_speed(serial_port sp, const uint32_t uiPortSpeed);
 uint32_t uart_get_speed(const serial_port sp);
+int     uart_get_fd(const serial_port sp);
 
-int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout);
+// Raising cancel (if not NULL) makes a pending receive return NFC_EOPABORTED, see cancel.h
+struct nfc_cancel;
+int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout);
+int     uart_peek(serial_port sp, const uint8_t **ppbtRx, const size_t szRx, struct nfc_cancel *cancel, int timeout);
+int     uart_peek_nowait(serial_port sp, const uint8_t **ppbtRx);
+void    uart_consume(serial_port sp, const size_t szRx);
 int     uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout);
 
 char  **uart_list_ports(void);
 
+// Serial ports scan, see uart_scan_ports()
+#  define UART_SCAN_MAX_THREADS 8
+#  define UART_SCAN_DEADLINE_MS 10000
+
+typedef int (*uart_probe)(const nfc_context *context, const char *pcPortName, nfc_connstring connstring);
+size_t  uart_scan_ports(const nfc_context *context, uart_probe probe, nfc_connstring connstrings[], const size_t connstrings_len);
+
 #endif // __NFC_BUS_UART_H__
@@ -27,43 +27,145 @@
 
 /**
  * @file usbbus.c
- * @brief libusb 0.1 driver wrapper
+ * @brief USB bus wrapper, on top of libusb 0.1 or libusb-1.0
+ *
+ * With libusb 0.1 transfers are synchronous: a cancellable read waits in
+ * USBBUS_ABORT_PASS chunks so that a cancellation is noticed between them.
+ * With libusb-1.0 (HAVE_LIBUSB1) each handle keeps an asynchronous IN
+ * transfer submitted between reads: the device's reply is taken as soon as it
+ * is sent, and handed over by the read asking for it. Events are pumped by the
+ * waiting threads, one at a time as libusb requires. The one handling events
+ * also polls its cancellation descriptor (see cancel.h): raising it ends the
+ * read at once, and waits without waking up. A read which is aborted or times
+ * out leaves the transfer submitted; it is only cancelled when the device is
+ * reconfigured or closed.
+ *
+ * When libusb-1.0 supports hotplug, usbbus_list_devices() answers from a
+ * device table kept up to date by hotplug events, and usbbus_check_device()
+ * only probes a device once while it stays plugged. Otherwise every listing
+ * rescans the buses.
  */
 
 #ifdef HAVE_CONFIG_H
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#ifdef HAVE_LIBUSB1
+#  include <libusb.h>
+#  ifndef _WIN32
+#    include <poll.h>
+#  endif
+#elif !defined(_WIN32)
+// Under POSIX system, we use libusb (>= 0.1.12)
+#  include <usb.h>
+#  define USB_TIMEDOUT ETIMEDOUT
+#  define _usb_strerror( X ) strerror(-X)
+#else
+// Under Windows we use libusb-win32 (>= 1.2.5)
+#  include <lusb0_usb.h>
+#  define USB_TIMEDOUT 116
+#  define _usb_strerror( X ) usb_strerror()
+#endif
+
+#include <nfc/nfc.h>
 
+#include "nfc-internal.h"
 #include "usbbus.h"
 #include "log.h"
 #define LOG_CATEGORY "libnfc.buses.usbbus"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
-int usb_prepare(void)
+// Longest blocking libusb 0.1 read while a cancellation may be requested (ms)
+#define USBBUS_ABORT_PASS 200
+// libusb-1.0 event slice when the cancellation can not be polled (ms)
+#define USBBUS_CANCEL_SLICE 50
+// Most libusb-1.0 descriptors watched along with the cancellation descriptor
+#define USBBUS_MAX_POLLFDS 8
+// libusb-1.0 IN transfer length: whole packets, more than any frame read
+#define USBBUS_RX_LEN 512
+
+struct usbbus_handle {
+#ifdef HAVE_LIBUSB1
+  libusb_device_handle *udh;
+  struct libusb_transfer *transfer; // IN transfer, allocated once and kept submitted between reads
+  bool submitted;                   // transfer is submitted, or completed but not handed over yet
+  int completed;                    // transfer is completed
+  uint8_t abtRx[USBBUS_RX_LEN];
+#else
+  usb_dev_handle *udh;
+#endif
+  uint16_t idVendor;
+  uint16_t idProduct;
+};
+
+#ifdef HAVE_LIBUSB1
+static libusb_context *usbbus_context = NULL;
+static void usbbus_hotplug_start(void);
+static void usbbus_cancel_read(usbbus_handle *h);
+
+#  define usbbus_strerror(X) libusb_error_name(X)
+#  define USBBUS_EACCES      LIBUSB_ERROR_ACCESS
+#else
+#  define usbbus_strerror(X) _usb_strerror(X)
+#  define USBBUS_EACCES      (-EPERM)
+#endif
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t usbbus_prepare_mutex = PTHREAD_MUTEX_INITIALIZER;
+#  define usbbus_prepare_lock()   pthread_mutex_lock(&usbbus_prepare_mutex)
+#  define usbbus_prepare_unlock() pthread_mutex_unlock(&usbbus_prepare_mutex)
+#else
+#  define usbbus_prepare_lock()   ((void) 0)
+#  define usbbus_prepare_unlock() ((void) 0)
+#endif
+
+int
+usbbus_prepare(void)
 {
   static bool usb_initialized = false;
+  usbbus_prepare_lock();
   if (!usb_initialized) {
-
-#ifdef ENVVARS
-    char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
     // Set libusb debug only if asked explicitely:
-    // LIBUSB_LOG_LEVEL=12288 (= NFC_LOG_PRIORITY_DEBUG * 2 ^ NFC_LOG_GROUP_LIBUSB)
-    if (env_log_level && (((atoi(env_log_level) >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG)) {
-      setenv("USB_DEBUG", "255", 1);
-    }
-#endif
+    // LIBNFC_LOG_LEVEL=12288 (= NFC_LOG_PRIORITY_DEBUG * 2 ^ NFC_LOG_GROUP_LIBUSB)
+    const bool debug = log_enabled(NFC_LOG_GROUP_LIBUSB, NFC_LOG_PRIORITY_DEBUG);
 
+#ifdef HAVE_LIBUSB1
+    int res;
+    if ((res = libusb_init(&usbbus_context)) < 0) {
+      usbbus_prepare_unlock();
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to initialize libusb (%s)", usbbus_strerror(res));
+      return -1;
+    }
+    if (debug) {
+#  if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000106)
+      libusb_set_option(usbbus_context, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);
+#  else
+      libusb_set_debug(usbbus_context, 4);
+#  endif
+    }
+    usbbus_hotplug_start();
+#else
     usb_init();
+    if (debug)
+      usb_set_debug(255);
+#endif
     usb_initialized = true;
   }
 
+#ifndef HAVE_LIBUSB1
   int res;
   // usb_find_busses will find all of the busses on the system. Returns the
   // number of changes since previous call to this function (total of new
   // busses and busses removed).
   if ((res = usb_find_busses()) < 0) {
+    usbbus_prepare_unlock();
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB busses (%s)", _usb_strerror(res));
     return -1;
   }
@@ -71,9 +173,740 @@ int usb_prepare(void)
   // called after usb_find_busses. Returns the number of changes since the
   // previous call to this function (total of new device and devices removed).
   if ((res = usb_find_devices()) < 0) {
+    usbbus_prepare_unlock();
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB devices (%s)", _usb_strerror(res));
     return -1;
   }
+#endif
+  usbbus_prepare_unlock();
+  return 0;
+}
+
+#ifdef HAVE_LIBUSB1
+// Find transfer endpoints for bulk transfers
+static void
+usbbus_get_end_points(struct usbbus_device *device, const struct libusb_interface_descriptor *puid)
+{
+  device->bNumEndpoints = puid->bNumEndpoints;
+  for (uint8_t uiIndex = 0; uiIndex < puid->bNumEndpoints; uiIndex++) {
+    // Only accept bulk transfer endpoints (ignore interrupt endpoints)
+    if (puid->endpoint[uiIndex].bmAttributes != LIBUSB_TRANSFER_TYPE_BULK)
+      continue;
+
+    const uint8_t uiEndPoint = puid->endpoint[uiIndex].bEndpointAddress;
+    if ((uiEndPoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
+      device->uiEndPointIn = uiEndPoint;
+    else
+      device->uiEndPointOut = uiEndPoint;
+    device->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
+  }
+}
+
+// Describe dev in device, which keeps a reference on it
+static bool
+usbbus_describe(libusb_device *dev, struct usbbus_device *device)
+{
+  struct libusb_device_descriptor descriptor;
+  struct libusb_config_descriptor *config;
+
+  if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+    return false;
+  memset(device, 0, sizeof(*device));
+  snprintf(device->dirname, sizeof(device->dirname), "%03u", libusb_get_bus_number(dev));
+  snprintf(device->filename, sizeof(device->filename), "%03u", libusb_get_device_address(dev));
+  device->idVendor = descriptor.idVendor;
+  device->idProduct = descriptor.idProduct;
+  device->iManufacturer = descriptor.iManufacturer;
+  device->iProduct = descriptor.iProduct;
+  if (libusb_get_config_descriptor(dev, 0, &config) == 0) {
+    device->bHasConfig = true;
+    if ((config->bNumInterfaces > 0) && (config->interface[0].num_altsetting > 0))
+      usbbus_get_end_points(device, &config->interface[0].altsetting[0]);
+    libusb_free_config_descriptor(config);
+  }
+  device->dev = libusb_ref_device(dev);
+  return true;
+}
+
+// Device table, only used when hotplug events keep it up to date
+static bool usbbus_hotplug = false;
+static struct usbbus_device *usbbus_table = NULL;
+static size_t usbbus_table_len = 0;
+static size_t usbbus_table_size = 0;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t usbbus_table_mutex = PTHREAD_MUTEX_INITIALIZER;
+#  define usbbus_table_lock()   pthread_mutex_lock(&usbbus_table_mutex)
+#  define usbbus_table_unlock() pthread_mutex_unlock(&usbbus_table_mutex)
+#else
+#  define usbbus_table_lock()   ((void) 0)
+#  define usbbus_table_unlock() ((void) 0)
+#endif
+
+static int LIBUSB_CALL
+usbbus_hotplug_event(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+  (void) ctx;
+  (void) user_data;
+
+  usbbus_table_lock();
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+    if (usbbus_table_len == usbbus_table_size) {
+      const size_t size = usbbus_table_size ? 2 * usbbus_table_size : 16;
+      struct usbbus_device *table = realloc(usbbus_table, size * sizeof(struct usbbus_device));
+      if (!table) {
+        perror("realloc");
+        usbbus_table_unlock();
+        return 0;
+      }
+      usbbus_table = table;
+      usbbus_table_size = size;
+    }
+    if (usbbus_describe(dev, &usbbus_table[usbbus_table_len])) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "USB device %04x:%04x plugged (Bus %s Device %s)", usbbus_table[usbbus_table_len].idVendor, usbbus_table[usbbus_table_len].idProduct, usbbus_table[usbbus_table_len].dirname, usbbus_table[usbbus_table_len].filename);
+      usbbus_table_len++;
+    }
+  } else {
+    for (size_t i = 0; i < usbbus_table_len; i++) {
+      if (usbbus_table[i].dev == dev) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "USB device %04x:%04x unplugged (Bus %s Device %s)", usbbus_table[i].idVendor, usbbus_table[i].idProduct, usbbus_table[i].dirname, usbbus_table[i].filename);
+        libusb_unref_device(usbbus_table[i].dev);
+        memmove(&usbbus_table[i], &usbbus_table[i + 1], (usbbus_table_len - i - 1) * sizeof(struct usbbus_device));
+        usbbus_table_len--;
+        break;
+      }
+    }
+  }
+  usbbus_table_unlock();
+  return 0;
+}
+
+static void
+usbbus_hotplug_start(void)
+{
+  int res;
+
+  if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "No USB hotplug support: USB buses are rescanned on each listing");
+    return;
+  }
+  // Devices already plugged are reported before this returns
+  res = libusb_hotplug_register_callback(usbbus_context, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                         LIBUSB_HOTPLUG_ENUMERATE, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                                         usbbus_hotplug_event, NULL, NULL);
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unable to register USB hotplug callback (%s)", usbbus_strerror(res));
+    return;
+  }
+  usbbus_hotplug = true;
+}
+
+size_t
+usbbus_list_devices(struct usbbus_device **pdevices)
+{
+  *pdevices = NULL;
+
+  if (usbbus_hotplug) {
+    // Deliver pending hotplug events, without waiting for new ones
+    struct timeval tv = { 0, 0 };
+    libusb_handle_events_timeout_completed(usbbus_context, &tv, NULL);
+
+    size_t szDevices = 0;
+    usbbus_table_lock();
+    if ((usbbus_table_len > 0) && (*pdevices = malloc(usbbus_table_len * sizeof(struct usbbus_device)))) {
+      szDevices = usbbus_table_len;
+      memcpy(*pdevices, usbbus_table, szDevices * sizeof(struct usbbus_device));
+      for (size_t i = 0; i < szDevices; i++)
+        libusb_ref_device((*pdevices)[i].dev);
+    }
+    usbbus_table_unlock();
+    return szDevices;
+  }
+
+  libusb_device **list;
+  ssize_t szList;
+  if ((szList = libusb_get_device_list(usbbus_context, &list)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB devices (%s)", usbbus_strerror((int) szList));
+    return 0;
+  }
+  if ((szList == 0) || !(*pdevices = calloc(szList, sizeof(struct usbbus_device)))) {
+    libusb_free_device_list(list, 1);
+    return 0;
+  }
+
+  size_t szDevices = 0;
+  for (ssize_t i = 0; i < szList; i++) {
+    if (usbbus_describe(list[i], &(*pdevices)[szDevices]))
+      szDevices++;
+  }
+  libusb_free_device_list(list, 1);
+  return szDevices;
+}
+
+void
+usbbus_free_devices(struct usbbus_device *devices, const size_t szDevices)
+{
+  for (size_t i = 0; i < szDevices; i++)
+    libusb_unref_device(devices[i].dev);
+  free(devices);
+}
+
+int
+usbbus_check_device(const struct usbbus_device *device, const int configuration)
+{
+  usbbus_handle *h;
+  int res = 0;
+
+  if (device->bChecked)
+    return 0;
+  if ((h = usbbus_open(device)) == NULL)
+    return -1;
+  if (configuration > 0)
+    res = usbbus_set_configuration(h, configuration);
+  usbbus_close(h);
+
+  // Only success is remembered: a device may become usable (eg. permissions fixed)
+  if ((res >= 0) && (usbbus_hotplug)) {
+    usbbus_table_lock();
+    for (size_t i = 0; i < usbbus_table_len; i++) {
+      if (usbbus_table[i].dev == device->dev)
+        usbbus_table[i].bChecked = true;
+    }
+    usbbus_table_unlock();
+  }
+  return res;
+}
+
+usbbus_handle *
+usbbus_open(const struct usbbus_device *device)
+{
+  usbbus_handle *h;
+  int res;
+
+  if (!(h = calloc(1, sizeof(*h)))) {
+    perror("malloc");
+    return NULL;
+  }
+  if ((res = libusb_open(device->dev, &h->udh)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open USB device %s:%s (%s)", device->dirname, device->filename, usbbus_strerror(res));
+    free(h);
+    return NULL;
+  }
+  if (!(h->transfer = libusb_alloc_transfer(0))) {
+    perror("malloc");
+    libusb_close(h->udh);
+    free(h);
+    return NULL;
+  }
+  h->idVendor = device->idVendor;
+  h->idProduct = device->idProduct;
+  return h;
+}
+
+int
+usbbus_close(usbbus_handle *h)
+{
+  usbbus_cancel_read(h);
+  libusb_free_transfer(h->transfer);
+  libusb_close(h->udh);
+  free(h);
   return 0;
 }
 
+int
+usbbus_reset(usbbus_handle *h)
+{
+  usbbus_cancel_read(h);
+  return libusb_reset_device(h->udh);
+}
+
+int
+usbbus_set_configuration(usbbus_handle *h, const int configuration)
+{
+  usbbus_cancel_read(h);
+  int res = libusb_set_configuration(h->udh, configuration);
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", usbbus_strerror(res));
+    if (USBBUS_EACCES == res) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: Please double check USB permissions for device %04x:%04x", h->idVendor, h->idProduct);
+    }
+  }
+  return res;
+}
+
+int
+usbbus_claim_interface(usbbus_handle *h, const int interface)
+{
+  int res = libusb_claim_interface(h->udh, interface);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", usbbus_strerror(res));
+  return res;
+}
+
+int
+usbbus_release_interface(usbbus_handle *h, const int interface)
+{
+  usbbus_cancel_read(h);
+  int res = libusb_release_interface(h->udh, interface);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", usbbus_strerror(res));
+  return res;
+}
+
+int
+usbbus_set_altinterface(usbbus_handle *h, const int alternate)
+{
+  usbbus_cancel_read(h);
+  int res = libusb_set_interface_alt_setting(h->udh, 0, alternate);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set alternate setting on USB interface (%s)", usbbus_strerror(res));
+  return res;
+}
+
+int
+usbbus_get_string(usbbus_handle *h, const uint8_t index, char *buffer, const size_t len)
+{
+  return libusb_get_string_descriptor_ascii(h->udh, index, (unsigned char *) buffer, (int) len);
+}
+
+static void LIBUSB_CALL
+usbbus_transfer_done(struct libusb_transfer *transfer)
+{
+  *(int *) transfer->user_data = 1;
+}
+
+// Submit the IN transfer, it stays submitted until a read takes what it got
+static int
+usbbus_submit_read(usbbus_handle *h, const uint8_t ep)
+{
+  int res;
+
+  libusb_fill_bulk_transfer(h->transfer, h->udh, ep, h->abtRx, sizeof(h->abtRx), usbbus_transfer_done, &h->completed, 0);
+  h->completed = 0;
+  if ((res = libusb_submit_transfer(h->transfer)) < 0) {
+    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", usbbus_strerror(res));
+    return NFC_EIO;
+  }
+  h->submitted = true;
+  return NFC_SUCCESS;
+}
+
+// Cancel the IN transfer, if submitted, and drop what it got: the events lock must not be held
+static void
+usbbus_cancel_read(usbbus_handle *h)
+{
+  if (!h->submitted)
+    return;
+  if (!h->completed)
+    libusb_cancel_transfer(h->transfer);
+  // The transfer belongs to libusb until its callback ran
+  while (!h->completed)
+    libusb_handle_events_completed(usbbus_context, &h->completed);
+  h->submitted = false;
+}
+
+// Milliseconds left before deadline (monotonic time in ns), -1 without deadline
+static int
+usbbus_time_left(const uint64_t deadline)
+{
+  if (!deadline)
+    return -1;
+  const uint64_t now = monotonic_time_ns();
+  return (now >= deadline) ? 0 : (int)((deadline - now + 999999) / 1000000);
+}
+
+// Event slice (ms), cut short by the deadline
+static int
+usbbus_slice(const uint64_t deadline)
+{
+  const int left = usbbus_time_left(deadline);
+  return ((left >= 0) && (left < USBBUS_CANCEL_SLICE)) ? left : USBBUS_CANCEL_SLICE;
+}
+
+// Handle libusb events, for every transfer, until ours completes, cancel is raised or the deadline
+// passes: the events lock is held
+static int
+usbbus_handle_events(usbbus_handle *h, struct nfc_cancel *cancel, const uint64_t deadline)
+{
+#ifndef _WIN32
+  const struct libusb_pollfd **pollfds = libusb_get_pollfds(usbbus_context);
+#else
+  // No poll(2): the cancellation is checked between event slices
+  const struct libusb_pollfd **pollfds = NULL;
+#endif
+  int res = NFC_SUCCESS;
+
+  // Give the lock up when another thread needs it, e.g. to close a device
+  while (!h->completed && !nfc_cancel_pending(cancel) && (usbbus_time_left(deadline) != 0) &&
+         libusb_event_handling_ok(usbbus_context)) {
+    if (pollfds == NULL) {
+      // No descriptors to watch: plain event pumping
+      struct timeval tv = { 0, usbbus_slice(deadline) * 1000 };
+      if (libusb_handle_events_locked(usbbus_context, &tv) < 0) {
+        res = NFC_EIO;
+        break;
+      }
+      continue;
+    }
+#ifndef _WIN32
+    // Sleep on libusb descriptors and the cancellation descriptor together
+    struct pollfd pfds[USBBUS_MAX_POLLFDS + 1];
+    nfds_t nfds = 0;
+    for (size_t i = 0; (pollfds[i] != NULL) && (nfds < USBBUS_MAX_POLLFDS); i++) {
+      pfds[nfds].fd = pollfds[i]->fd;
+      pfds[nfds].events = pollfds[i]->events;
+      pfds[nfds].revents = 0;
+      nfds++;
+    }
+    if (nfc_cancel_fd(cancel) >= 0) {
+      pfds[nfds].fd = nfc_cancel_fd(cancel);
+      pfds[nfds].events = POLLIN;
+      pfds[nfds].revents = 0;
+      nfds++;
+    }
+    int poll_timeout = (nfc_cancel_fd(cancel) >= 0) ? usbbus_time_left(deadline) : usbbus_slice(deadline);
+    struct timeval next;
+    if (libusb_get_next_timeout(usbbus_context, &next) > 0) {
+      const int next_ms = (int)(next.tv_sec * 1000 + (next.tv_usec + 999) / 1000);
+      if ((poll_timeout < 0) || (next_ms < poll_timeout))
+        poll_timeout = next_ms;
+    }
+    struct timeval zero = { 0, 0 };
+    if (((poll(pfds, nfds, poll_timeout) < 0) && (errno != EINTR)) ||
+        (libusb_handle_events_locked(usbbus_context, &zero) < 0)) {
+      res = NFC_EIO;
+      break;
+    }
+    if ((nfc_cancel_fd(cancel) >= 0) && pfds[nfds - 1].revents && !nfc_cancel_pending(cancel)) {
+      // Wake-up left by a cancellation already consumed: clear it, raising
+      // again a cancellation which would have landed meanwhile
+      if (nfc_cancel_take(cancel))
+        nfc_cancel_signal(cancel);
+    }
+#endif
+  }
+  if (pollfds != NULL)
+    libusb_free_pollfds(pollfds);
+  return res;
+}
+
+/*
+ * Wait for the transfer to complete, until cancel gets raised or the
+ * deadline (monotonic time in ns, 0 for none) passes.
+ *
+ * Devices used from several threads share the libusb context, so this
+ * follows libusb's event handling protocol: one waiting thread holds the
+ * events lock and handles the events of every transfer, and the others sleep
+ * until an event got handled. Those check their cancellation every
+ * USBBUS_CANCEL_SLICE ms, and take over when the event handler is done.
+ */
+static int
+usbbus_wait_cancellable(usbbus_handle *h, struct nfc_cancel *cancel, const uint64_t deadline)
+{
+  int res;
+
+  while (!h->completed && !nfc_cancel_pending(cancel) && (usbbus_time_left(deadline) != 0)) {
+    if (libusb_try_lock_events(usbbus_context) == 0) {
+      res = usbbus_handle_events(h, cancel, deadline);
+      libusb_unlock_events(usbbus_context);
+      if (res < 0)
+        return res;
+      continue;
+    }
+    libusb_lock_event_waiters(usbbus_context);
+    if (!h->completed && libusb_event_handler_active(usbbus_context)) {
+      struct timeval tv = { 0, usbbus_slice(deadline) * 1000 };
+      libusb_wait_for_event(usbbus_context, &tv);
+    }
+    libusb_unlock_event_waiters(usbbus_context);
+  }
+  return NFC_SUCCESS;
+}
+
+// Wait for the transfer to complete until the deadline (monotonic time in ns, 0 for none) passes
+static int
+usbbus_wait(usbbus_handle *h, const uint64_t deadline)
+{
+  int res;
+
+  // Events are pumped by the caller: no wake-up until the transfer is over
+  while (!h->completed) {
+    const int left = usbbus_time_left(deadline);
+    if (left == 0)
+      break;
+    if (left < 0) {
+      res = libusb_handle_events_completed(usbbus_context, &h->completed);
+    } else {
+      struct timeval tv = { left / 1000, (left % 1000) * 1000 };
+      res = libusb_handle_events_timeout_completed(usbbus_context, &tv, &h->completed);
+    }
+    if ((res < 0) && (res != LIBUSB_ERROR_INTERRUPTED))
+      return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+int
+usbbus_bulk_read(usbbus_handle *h, const uint8_t ep, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, const int timeout)
+{
+  const uint64_t deadline = (timeout > 0) ? monotonic_time_ns() + (uint64_t) timeout * 1000000 : 0;
+  int res;
+
+  if (cancel && nfc_cancel_take(cancel))
+    return NFC_EOPABORTED;
+
+  if (h->submitted && (h->transfer->endpoint != ep))
+    usbbus_cancel_read(h);
+  if (!h->submitted && ((res = usbbus_submit_read(h, ep)) < 0))
+    return res;
+  res = (cancel) ? usbbus_wait_cancellable(h, cancel, deadline) : usbbus_wait(h, deadline);
+  if (res < 0) {
+    usbbus_cancel_read(h);
+    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (event handling failed)");
+    return res;
+  }
+  if (!h->completed) {
+    // Left submitted: what the device sends meanwhile is handed over to the next read
+    if (cancel && nfc_cancel_take(cancel))
+      return NFC_EOPABORTED;
+    return NFC_ETIMEOUT;
+  }
+
+  h->submitted = false;
+  // An abort raised too late for this transfer is left for the caller
+  if (h->transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+    const size_t len = (size_t) h->transfer->actual_length;
+    if (len > szRx) {
+      log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%d bytes received for %d)", (int) len, (int) szRx);
+      res = NFC_EIO;
+    } else {
+      memcpy(pbtRx, h->abtRx, len);
+      res = (int) len;
+    }
+    // Submitted again at once, so that the next reply is already being read when asked for;
+    // on failure, the next read submits it
+    usbbus_submit_read(h, ep);
+    return res;
+  }
+  log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (transfer status %d)", (int) h->transfer->status);
+  return NFC_EIO;
+}
+
+int
+usbbus_bulk_write(usbbus_handle *h, const uint8_t ep, const uint8_t *pbtTx, const size_t szTx, const int timeout)
+{
+  int transferred = 0;
+  int res = libusb_bulk_transfer(h->udh, ep, (unsigned char *) pbtTx, (int) szTx, &transferred, (timeout < 0) ? 0 : (unsigned int) timeout);
+  if (res < 0) {
+    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", usbbus_strerror(res));
+    return (res == LIBUSB_ERROR_TIMEOUT) ? NFC_ETIMEOUT : NFC_EIO;
+  }
+  return transferred;
+}
+
+#else // HAVE_LIBUSB1
+
+// Find transfer endpoints for bulk transfers
+static void
+usbbus_get_end_points(struct usbbus_device *device, const struct usb_interface_descriptor *puid)
+{
+  device->bNumEndpoints = puid->bNumEndpoints;
+  for (uint8_t uiIndex = 0; uiIndex < puid->bNumEndpoints; uiIndex++) {
+    // Only accept bulk transfer endpoints (ignore interrupt endpoints)
+    if (puid->endpoint[uiIndex].bmAttributes != USB_ENDPOINT_TYPE_BULK)
+      continue;
+
+    const uint8_t uiEndPoint = puid->endpoint[uiIndex].bEndpointAddress;
+    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_IN)
+      device->uiEndPointIn = uiEndPoint;
+    else
+      device->uiEndPointOut = uiEndPoint;
+    device->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
+  }
+}
+
+size_t
+usbbus_list_devices(struct usbbus_device **pdevices)
+{
+  size_t szList = 0;
+  struct usb_bus *bus;
+  struct usb_device *dev;
+
+  *pdevices = NULL;
+  for (bus = usb_get_busses(); bus; bus = bus->next)
+    for (dev = bus->devices; dev; dev = dev->next)
+      szList++;
+  if ((szList == 0) || !(*pdevices = calloc(szList, sizeof(struct usbbus_device))))
+    return 0;
+
+  size_t szDevices = 0;
+  for (bus = usb_get_busses(); bus; bus = bus->next) {
+    for (dev = bus->devices; (dev) && (szDevices < szList); dev = dev->next) {
+      struct usbbus_device *device = &(*pdevices)[szDevices++];
+
+      // devices are zeroed, so names stay NUL-terminated
+      strncpy(device->dirname, bus->dirname, sizeof(device->dirname) - 1);
+      strncpy(device->filename, dev->filename, sizeof(device->filename) - 1);
+      device->idVendor = dev->descriptor.idVendor;
+      device->idProduct = dev->descriptor.idProduct;
+      device->iManufacturer = dev->descriptor.iManufacturer;
+      device->iProduct = dev->descriptor.iProduct;
+      // with libusb-win32 we got some null pointers so be robust before looking at endpoints
+      if (dev->config != NULL) {
+        device->bHasConfig = true;
+        if ((dev->config->interface != NULL) && (dev->config->interface->altsetting != NULL))
+          usbbus_get_end_points(device, dev->config->interface->altsetting);
+      }
+      device->dev = dev;
+    }
+  }
+  return szDevices;
+}
+
+void
+usbbus_free_devices(struct usbbus_device *devices, const size_t szDevices)
+{
+  (void) szDevices;
+  // Devices belong to libusb until the next usbbus_prepare()
+  free(devices);
+}
+
+int
+usbbus_check_device(const struct usbbus_device *device, const int configuration)
+{
+  usbbus_handle *h;
+  int res = 0;
+
+  if ((h = usbbus_open(device)) == NULL)
+    return -1;
+  if (configuration > 0)
+    res = usbbus_set_configuration(h, configuration);
+  usbbus_close(h);
+  return res;
+}
+
+usbbus_handle *
+usbbus_open(const struct usbbus_device *device)
+{
+  usbbus_handle *h;
+
+  if (!(h = calloc(1, sizeof(*h)))) {
+    perror("malloc");
+    return NULL;
+  }
+  if ((h->udh = usb_open(device->dev)) == NULL) {
+    free(h);
+    return NULL;
+  }
+  h->idVendor = device->idVendor;
+  h->idProduct = device->idProduct;
+  return h;
+}
+
+int
+usbbus_close(usbbus_handle *h)
+{
+  int res;
+  if ((res = usb_close(h->udh)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to close USB connection (%s)", _usb_strerror(res));
+  }
+  free(h);
+  return res;
+}
+
+int
+usbbus_reset(usbbus_handle *h)
+{
+  return usb_reset(h->udh);
+}
+
+int
+usbbus_set_configuration(usbbus_handle *h, const int configuration)
+{
+  int res = usb_set_configuration(h->udh, configuration);
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
+    if (USBBUS_EACCES == res) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: Please double check USB permissions for device %04x:%04x", h->idVendor, h->idProduct);
+    }
+  }
+  return res;
+}
+
+int
+usbbus_claim_interface(usbbus_handle *h, const int interface)
+{
+  int res = usb_claim_interface(h->udh, interface);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", _usb_strerror(res));
+  return res;
+}
+
+int
+usbbus_release_interface(usbbus_handle *h, const int interface)
+{
+  int res = usb_release_interface(h->udh, interface);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", _usb_strerror(res));
+  return res;
+}
+
+int
+usbbus_set_altinterface(usbbus_handle *h, const int alternate)
+{
+  int res = usb_set_altinterface(h->udh, alternate);
+  if (res < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set alternate setting on USB interface (%s)", _usb_strerror(res));
+  return res;
+}
+
+int
+usbbus_get_string(usbbus_handle *h, const uint8_t index, char *buffer, const size_t len)
+{
+  return usb_get_string_simple(h->udh, index, buffer, len);
+}
+
+int
+usbbus_bulk_read(usbbus_handle *h, const uint8_t ep, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, const int timeout)
+{
+  int remaining_time = timeout;
+  int res;
+
+  for (;;) {
+    int usb_timeout = timeout;
+    if (cancel) {
+      if (nfc_cancel_take(cancel))
+        return NFC_EOPABORTED;
+      // libusb 0.1 can not cancel a transfer: wait in short passes to notice the cancellation
+      usb_timeout = (timeout <= 0) ? USBBUS_ABORT_PASS : MIN(remaining_time, USBBUS_ABORT_PASS);
+    }
+    res = usb_bulk_read(h->udh, ep, (char *) pbtRx, szRx, usb_timeout);
+    if ((res != -USB_TIMEDOUT) || (!cancel))
+      break;
+    if (timeout > 0) {
+      remaining_time -= usb_timeout;
+      if (remaining_time <= 0)
+        break;
+    }
+  }
+
+  if (res < 0) {
+    if (res == -USB_TIMEDOUT)
+      return NFC_ETIMEOUT;
+    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", _usb_strerror(res));
+    return NFC_EIO;
+  }
+  return res;
+}
+
+int
+usbbus_bulk_write(usbbus_handle *h, const uint8_t ep, const uint8_t *pbtTx, const size_t szTx, const int timeout)
+{
+  int res = usb_bulk_write(h->udh, ep, (char *) pbtTx, szTx, timeout);
+  if (res < 0) {
+    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", _usb_strerror(res));
+    return (res == -USB_TIMEDOUT) ? NFC_ETIMEOUT : NFC_EIO;
+  }
+  return res;
+}
+
+#endif // HAVE_LIBUSB1
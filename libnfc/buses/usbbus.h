@@ -27,27 +27,55 @@
 
 /**
  * @file usbbus.h
- * @brief libusb 0.1 driver header
+ * @brief USB bus wrapper header (libusb 0.1 or libusb-1.0)
  */
 
 #ifndef __NFC_BUS_USB_H__
 #  define __NFC_BUS_USB_H__
 
-#ifndef _WIN32
-// Under POSIX system, we use libusb (>= 0.1.12)
-#include <usb.h>
-#define USB_TIMEDOUT ETIMEDOUT
-#define _usb_strerror( X ) strerror(-X)
-#else
-// Under Windows we use libusb-win32 (>= 1.2.5)
-#include <lusb0_usb.h>
-#define USB_TIMEDOUT 116
-#define _usb_strerror( X ) usb_strerror()
-#endif
-
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
-int usb_prepare(void);
+#define USBBUS_NAME_LEN 32
+
+// USB device found on a bus, only its interface 0 is described
+struct usbbus_device {
+  char     dirname[USBBUS_NAME_LEN];  // Bus name, as used in connstrings
+  char     filename[USBBUS_NAME_LEN]; // Device name on its bus, as used in connstrings
+  uint16_t idVendor;
+  uint16_t idProduct;
+  uint8_t  iManufacturer;
+  uint8_t  iProduct;
+  bool     bHasConfig;                // false when the configuration descriptor is not available
+  uint8_t  bNumEndpoints;             // 0 when interface 0 is not described
+  uint8_t  uiEndPointIn;              // Bulk IN endpoint, if any
+  uint8_t  uiEndPointOut;             // Bulk OUT endpoint, if any
+  uint16_t uiMaxPacketSize;
+  bool     bChecked;                  // usbbus_check_device() already succeeded
+  void    *dev;                       // Backend's device reference
+};
+
+typedef struct usbbus_handle usbbus_handle;
+
+int     usbbus_prepare(void);
+size_t  usbbus_list_devices(struct usbbus_device **pdevices);
+void    usbbus_free_devices(struct usbbus_device *devices, const size_t szDevices);
+// Check device can be opened and, if configuration > 0, configured
+int     usbbus_check_device(const struct usbbus_device *device, const int configuration);
+
+usbbus_handle *usbbus_open(const struct usbbus_device *device);
+int     usbbus_close(usbbus_handle *h);
+int     usbbus_reset(usbbus_handle *h);
+int     usbbus_set_configuration(usbbus_handle *h, const int configuration);
+int     usbbus_claim_interface(usbbus_handle *h, const int interface);
+int     usbbus_release_interface(usbbus_handle *h, const int interface);
+int     usbbus_set_altinterface(usbbus_handle *h, const int alternate);
+int     usbbus_get_string(usbbus_handle *h, const uint8_t index, char *buffer, const size_t len);
+
+struct nfc_cancel;
+// Raising cancel (if not NULL) makes a pending read return NFC_EOPABORTED, see cancel.h
+int     usbbus_bulk_read(usbbus_handle *h, const uint8_t ep, uint8_t *pbtRx, const size_t szRx, struct nfc_cancel *cancel, const int timeout);
+int     usbbus_bulk_write(usbbus_handle *h, const uint8_t ep, const uint8_t *pbtTx, const size_t szTx, const int timeout);
 
 #endif // __NFC_BUS_USB_H__
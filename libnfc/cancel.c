@@ -0,0 +1,268 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file cancel.c
+ * @brief Per-device cancellation of pending I/O waits
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <time.h>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#  if defined(__linux__)
+#    include <sys/eventfd.h>
+#    define CANCEL_EVENTFD 1
+#  endif
+#else
+#  include <windows.h>
+#endif
+
+#include <nfc/nfc.h>
+
+#include "cancel.h"
+#include "nfc-internal.h"
+
+#if defined(__GNUC__)
+#  define cancel_store(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#  define cancel_load(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#  define cancel_take(p)      __atomic_exchange_n((p), false, __ATOMIC_ACQ_REL)
+#else
+#  define cancel_store(p, v)  (*(volatile bool *)(p) = (v))
+#  define cancel_load(p)      (*(volatile bool *)(p))
+static bool
+cancel_take(volatile bool *p)
+{
+  const bool b = *p;
+  *p = false;
+  return b;
+}
+#endif
+
+// Longest sleep between two cancellation checks where no descriptor can be waited on (ms)
+#define CANCEL_SLEEP_SLICE 1
+
+int
+nfc_cancel_init(struct nfc_cancel *cancel)
+{
+  cancel->pending = false;
+#ifndef _WIN32
+#  ifdef CANCEL_EVENTFD
+  cancel->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (cancel->fd < 0)
+    return NFC_ESOFT;
+  cancel->fd_write = cancel->fd;
+#  else
+  int fds[2];
+  if (pipe(fds) < 0)
+    return NFC_ESOFT;
+  for (int i = 0; i < 2; i++) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  cancel->fd = fds[0];
+  cancel->fd_write = fds[1];
+#  endif
+#endif
+  return NFC_SUCCESS;
+}
+
+void
+nfc_cancel_destroy(struct nfc_cancel *cancel)
+{
+#ifndef _WIN32
+  if (cancel->fd_write != cancel->fd)
+    close(cancel->fd_write);
+  close(cancel->fd);
+  cancel->fd = cancel->fd_write = -1;
+#else
+  (void) cancel;
+#endif
+}
+
+/**
+ * @brief Request the cancellation of the pending (or next) wait
+ *
+ * Only an atomic store and a write(), so it is safe to call from another
+ * thread or from a signal handler.
+ */
+void
+nfc_cancel_signal(struct nfc_cancel *cancel)
+{
+  cancel_store(&cancel->pending, true);
+#ifndef _WIN32
+  const int saved_errno = errno;
+#  ifdef CANCEL_EVENTFD
+  const uint64_t one = 1;
+#  else
+  const uint8_t one = 1;
+#  endif
+  // A full pipe or a saturated counter already means readable
+  if (write(cancel->fd_write, &one, sizeof(one)) < 0) {
+    errno = saved_errno;
+  }
+#endif
+}
+
+bool
+nfc_cancel_pending(struct nfc_cancel *cancel)
+{
+  return cancel_load(&cancel->pending);
+}
+
+/**
+ * @brief Consume a pending cancellation
+ *
+ * The descriptor is drained after the state is cleared, then written again if
+ * a cancellation got raised meanwhile, so that it never stays pending with
+ * an empty descriptor. A cancellation raised while this runs may be consumed
+ * along with the pending one and leave the descriptor readable: a wait woken
+ * up by the descriptor has to check nfc_cancel_take(), which clears such a
+ * stale wake-up and returns false.
+ *
+ * @return true if a cancellation was pending
+ */
+bool
+nfc_cancel_take(struct nfc_cancel *cancel)
+{
+  const bool bPending = cancel_take(&cancel->pending);
+#ifndef _WIN32
+  uint8_t abtDrain[16];
+  const int saved_errno = errno;
+  while (read(cancel->fd, abtDrain, sizeof(abtDrain)) > 0)
+    ;
+  if (cancel_load(&cancel->pending)) {
+#  ifdef CANCEL_EVENTFD
+    const uint64_t one = 1;
+#  else
+    const uint8_t one = 1;
+#  endif
+    if (write(cancel->fd_write, &one, sizeof(one)) < 0) {
+      // A full pipe or a saturated counter already means readable
+    }
+  }
+  errno = saved_errno;
+#endif
+  return bPending;
+}
+
+/**
+ * @brief Descriptor readable while a cancellation is pending, -1 if there is none
+ */
+int
+nfc_cancel_fd(const struct nfc_cancel *cancel)
+{
+#ifndef _WIN32
+  return cancel->fd;
+#else
+  (void) cancel;
+  return -1;
+#endif
+}
+
+/**
+ * @brief Sleep for \a uiMicroseconds unless a cancellation is, or gets, pending
+ *
+ * The cancellation is not consumed.
+ *
+ * @return NFC_SUCCESS after a full sleep, NFC_EOPABORTED if cancelled
+ */
+int
+nfc_cancel_sleep(struct nfc_cancel *cancel, const uint32_t uiMicroseconds)
+{
+  if (nfc_cancel_pending(cancel))
+    return NFC_EOPABORTED;
+#ifndef _WIN32
+  if (uiMicroseconds < 1000) {
+    // Shorter than poll() resolution, and already a bounded abort latency
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = (long) uiMicroseconds * 1000 };
+    nanosleep(&ts, NULL);
+  } else {
+    struct pollfd pfd = { .fd = cancel->fd, .events = POLLIN, .revents = 0 };
+    const uint64_t deadline = monotonic_time_ns() + (uint64_t) uiMicroseconds * 1000;
+    for (;;) {
+      const uint64_t now = monotonic_time_ns();
+      if (now >= deadline)
+        break;
+      // Rounded up: poll() returning early would end the sleep before its deadline
+      const int res = poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000));
+      if ((res == 0) || nfc_cancel_pending(cancel))
+        break;
+      if ((res > 0) && nfc_cancel_take(cancel)) {
+        // Raised while a stale wake-up was being cleared: leave it pending
+        nfc_cancel_signal(cancel);
+        break;
+      }
+      if ((res < 0) && (errno != EINTR))
+        break;
+    }
+  }
+#else
+  for (uint32_t uiSlept = 0; uiSlept < uiMicroseconds && !nfc_cancel_pending(cancel); uiSlept += CANCEL_SLEEP_SLICE * 1000)
+    Sleep(CANCEL_SLEEP_SLICE);
+#endif
+  return nfc_cancel_pending(cancel) ? NFC_EOPABORTED : NFC_SUCCESS;
+}
+
+/**
+ * @brief Sleep until \a deadline, a monotonic_time_ns() value, unless a cancellation is, or gets, pending
+ *
+ * \a cancel may be NULL for a sleep which can not be cancelled. The
+ * cancellation is not consumed.
+ *
+ * @return NFC_SUCCESS once the deadline passed, NFC_EOPABORTED if cancelled
+ */
+int
+nfc_cancel_sleep_until(struct nfc_cancel *cancel, const uint64_t deadline)
+{
+  for (;;) {
+    const uint64_t now = monotonic_time_ns();
+    if (now >= deadline)
+      return NFC_SUCCESS;
+    // Rounded up, and slept again if woken up early
+    const uint64_t left = (deadline - now + 999) / 1000;
+    const uint32_t uiMicroseconds = (left > UINT32_MAX) ? UINT32_MAX : (uint32_t) left;
+    if (cancel) {
+      if (nfc_cancel_sleep(cancel, uiMicroseconds) < 0)
+        return NFC_EOPABORTED;
+      continue;
+    }
+#ifndef _WIN32
+    struct timespec ts = { .tv_sec = uiMicroseconds / 1000000, .tv_nsec = (long)(uiMicroseconds % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+#else
+    Sleep((uiMicroseconds + 999) / 1000);
+#endif
+  }
+}
@@ -0,0 +1,66 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+
+/**
+ * @file cancel.h
+ * @brief Per-device cancellation of pending I/O waits
+ */
+
+#ifndef __NFC_CANCEL_H__
+#define __NFC_CANCEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A cancellation is a sticky "abort requested" state. It is raised by
+ * nfc_cancel_signal() from any thread, or from a signal handler, and
+ * consumed by the I/O wait it interrupts through nfc_cancel_take(), or
+ * dropped by the pn53x layer once the reply it came too late for is received.
+ * On POSIX systems it is also a file descriptor (an eventfd on Linux, a pipe
+ * elsewhere) that is readable while raised, so that bus waits can include it
+ * in their poll() set.
+ */
+struct nfc_cancel {
+#ifndef _WIN32
+  int     fd;       // Readable while a cancellation is pending
+  int     fd_write; // Written by nfc_cancel_signal(), same as fd for an eventfd
+#endif
+  bool    pending;
+};
+
+int     nfc_cancel_init(struct nfc_cancel *cancel);
+void    nfc_cancel_destroy(struct nfc_cancel *cancel);
+void    nfc_cancel_signal(struct nfc_cancel *cancel);
+bool    nfc_cancel_pending(struct nfc_cancel *cancel);
+bool    nfc_cancel_take(struct nfc_cancel *cancel);
+int     nfc_cancel_fd(const struct nfc_cancel *cancel);
+int     nfc_cancel_sleep(struct nfc_cancel *cancel, const uint32_t uiMicroseconds);
+int     nfc_cancel_sleep_until(struct nfc_cancel *cancel, const uint64_t deadline);
+
+#endif // __NFC_CANCEL_H__
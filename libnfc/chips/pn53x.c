@@ -45,6 +45,8 @@
 #include "pn53x-internal.h"
 
 #include "mirror-subr.h"
+#include "stats.h"
+#include "trace.h"
 
 #define LOG_CATEGORY "libnfc.chip.pn53x"
 #define LOG_GROUP NFC_LOG_GROUP_CHIP
@@ -62,9 +64,28 @@ const nfc_baud_rate pn532_iso14443b_supported_baud_rates[] = { NBR_106, 0 };
 const nfc_baud_rate pn533_iso14443b_supported_baud_rates[] = { NBR_847, NBR_424, NBR_212, NBR_106, 0 };
 const nfc_modulation_type pn53x_supported_modulation_as_target[] = {NMT_ISO14443A, NMT_FELICA, NMT_DEP, 0};
 
+// Configuration registers mirrored in pn53x_data.shadow_data. Volatile ones (status, IRQ, FIFO, counters,
+// Control, BitFraming, Status2...) must never be listed here: they are always read from the chip.
+static const uint16_t pn53x_shadow_registers[PN53X_SHADOW_REGISTER_COUNT] = {
+  PN53X_REG_CIU_Mode, PN53X_REG_CIU_TxMode, PN53X_REG_CIU_RxMode, PN53X_REG_CIU_TxControl,
+  PN53X_REG_CIU_TxAuto, PN53X_REG_CIU_TxSel, PN53X_REG_CIU_RxSel, PN53X_REG_CIU_RxThreshold,
+  PN53X_REG_CIU_Demod, PN53X_REG_CIU_FelNFC1, PN53X_REG_CIU_FelNFC2, PN53X_REG_CIU_MifNFC,
+  PN53X_REG_CIU_ManualRCV, PN53X_REG_CIU_TypeB, PN53X_REG_CIU_GsNOFF, PN53X_REG_CIU_ModWidth,
+  PN53X_REG_CIU_TxBitPhase, PN53X_REG_CIU_RFCfg, PN53X_REG_CIU_GsNOn, PN53X_REG_CIU_CWGsP,
+  PN53X_REG_CIU_ModGsP, PN53X_REG_CIU_TMode, PN53X_REG_CIU_TPrescaler, PN53X_REG_CIU_TReloadVal_hi,
+  PN53X_REG_CIU_TReloadVal_lo, PN53X_SFR_P3, PN53X_SFR_P3CFGA, PN53X_SFR_P3CFGB,
+};
+// Timer registers, which some firmwares (e.g. SCL3711) reset on InCommunicateThru
+#define PN53X_SHADOW_TIMER_MASK (0x0fU << 21)
+
 /* prototypes */
 int pn53x_reset_settings(struct nfc_device *pnd);
 int pn53x_writeback_register(struct nfc_device *pnd);
+static int pn53x_firmware_version_decode(struct nfc_device *pnd, const uint8_t *abtFw, const size_t szFwLen);
+static int pn53x_shadow_index(const uint16_t ui16RegisterAddress);
+static void pn53x_shadow_command_done(struct nfc_device *pnd, const uint8_t *pbtTxHead, const int res);
+static int pn53x_InListPassiveTarget_frame(struct nfc_device *pnd, const pn53x_modulation pmInitModulation, const uint8_t szMaxTargets,
+                                           const uint8_t *pbtInitiatorData, const size_t szInitiatorData, uint8_t *pbtCmd);
 
 nfc_modulation pn53x_ptt_to_nm(const pn53x_target_type ptt);
 pn53x_modulation pn53x_nm_to_pm(const nfc_modulation nm);
@@ -75,15 +96,9 @@ void pn53x_current_target_free(const struct nfc_device *pnd);
 bool pn53x_current_target_is(const struct nfc_device *pnd, const nfc_target *pnt);
 
 /* implementations */
-int
-pn53x_init(struct nfc_device *pnd)
+static int
+pn53x_init_supported_modulations(struct nfc_device *pnd)
 {
-  int res = 0;
-  // GetFirmwareVersion command is used to set PN53x chips type (PN531, PN532 or PN533)
-  if ((res = pn53x_decode_firmware_version(pnd)) < 0) {
-    return res;
-  }
-
   if (!CHIP_DATA(pnd)->supported_modulation_as_initiator) {
     CHIP_DATA(pnd)->supported_modulation_as_initiator = malloc(sizeof(nfc_modulation_type) * (NMT_DEP + 1));
     if (! CHIP_DATA(pnd)->supported_modulation_as_initiator)
@@ -119,6 +134,21 @@ pn53x_init(struct nfc_device *pnd)
   if (!CHIP_DATA(pnd)->supported_modulation_as_target) {
     CHIP_DATA(pnd)->supported_modulation_as_target = (nfc_modulation_type *) pn53x_supported_modulation_as_target;
   }
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_init(struct nfc_device *pnd)
+{
+  int res = 0;
+  // GetFirmwareVersion command is used to set PN53x chips type (PN531, PN532 or PN533)
+  if ((res = pn53x_decode_firmware_version(pnd)) < 0) {
+    return res;
+  }
+
+  if ((res = pn53x_init_supported_modulations(pnd)) < 0) {
+    return res;
+  }
 
   // CRC handling should be enabled by default as declared in nfc_device_new
   // which is the case by default for pn53x, so nothing to do here
@@ -134,6 +164,10 @@ pn53x_init(struct nfc_device *pnd)
   if ((res = pn53x_reset_settings(pnd)) < 0) {
     return res;
   }
+
+  // Load the register shadow so that the first masked writes need no ReadRegister.
+  // Not fatal: the shadow is loaded again on first use anyway.
+  pn53x_shadow_resync(pnd);
   return NFC_SUCCESS;
 }
 
@@ -161,10 +195,143 @@ pn53x_reset_settings(struct nfc_device *pnd)
   return NFC_SUCCESS;
 }
 
+static void
+pn53x_transceive_done(struct nfc_device *pnd, const uint8_t *pbtTxHead, const uint64_t start, const size_t szTx, const size_t szRx, const int res)
+{
+  const uint8_t ui8Command = pbtTxHead[0];
+  nfc_stats_status status = NFC_STATS_SUCCESS;
+
+  pn53x_shadow_command_done(pnd, pbtTxHead, res);
+  if (!pnd->stats)
+    return;
+  if (res == NFC_ETIMEOUT) {
+    status = NFC_STATS_TIMEOUT;
+  } else if (res < 0) {
+    status = NFC_STATS_IO_ERROR;
+  } else if (CHIP_DATA(pnd)->last_status_byte) {
+    status = NFC_STATS_CHIP_ERROR;
+  }
+  nfc_stats_record(pnd->stats, ui8Command, status, szTx, szRx, monotonic_time_ns() - start);
+}
+
+size_t
+pn53x_iov_len(const struct pn53x_iovec *iov, const size_t iovcnt)
+{
+  size_t szLen = 0;
+  for (size_t i = 0; i < iovcnt; i++)
+    szLen += iov[i].szData;
+  return szLen;
+}
+
+/**
+ * @brief Copy the segments described by \a iov into the contiguous buffer \a pbtDst
+ * @return number of bytes copied, at most \a szDst
+ */
+size_t
+pn53x_iov_gather(uint8_t *pbtDst, const size_t szDst, const struct pn53x_iovec *iov, const size_t iovcnt)
+{
+  size_t szPos = 0;
+  for (size_t i = 0; (i < iovcnt) && (szPos < szDst); i++) {
+    size_t szChunk = MIN(iov[i].szData, szDst - szPos);
+    memcpy(pbtDst + szPos, iov[i].pbtData, szChunk);
+    szPos += szChunk;
+  }
+  return szPos;
+}
+
+/**
+ * @brief Copy \a szSrc bytes of \a pbtSrc into the segments described by \a iov, starting \a szOffset bytes in
+ * @return number of bytes copied, less than \a szSrc if the segments are too short
+ */
+size_t
+pn53x_iov_scatter(const struct pn53x_iovec *iov, const size_t iovcnt, size_t szOffset, const uint8_t *pbtSrc, const size_t szSrc)
+{
+  size_t szPos = 0;
+  for (size_t i = 0; (i < iovcnt) && (szPos < szSrc); i++) {
+    if (szOffset >= iov[i].szData) {
+      szOffset -= iov[i].szData;
+      continue;
+    }
+    size_t szChunk = MIN(iov[i].szData - szOffset, szSrc - szPos);
+    memcpy(iov[i].pbtData + szOffset, pbtSrc + szPos, szChunk);
+    szPos += szChunk;
+    szOffset = 0;
+  }
+  return szPos;
+}
+
+static int
+pn53x_iov_send(struct nfc_device *pnd, const struct pn53x_iovec *txv, const size_t txcnt, int timeout)
+{
+  if (txcnt == 1)
+    return CHIP_DATA(pnd)->io->send(pnd, txv[0].pbtData, txv[0].szData, timeout);
+  if (CHIP_DATA(pnd)->io->sendv)
+    return CHIP_DATA(pnd)->io->sendv(pnd, txv, txcnt, timeout);
+
+  uint8_t abtTx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  if (pn53x_iov_len(txv, txcnt) > sizeof(abtTx))
+    return NFC_EINVARG;
+  return CHIP_DATA(pnd)->io->send(pnd, abtTx, pn53x_iov_gather(abtTx, sizeof(abtTx), txv, txcnt), timeout);
+}
+
+static int
+pn53x_iov_receive(struct nfc_device *pnd, const struct pn53x_iovec *rxv, const size_t rxcnt, int timeout)
+{
+  if (rxcnt == 1)
+    return CHIP_DATA(pnd)->io->receive(pnd, rxv[0].pbtData, rxv[0].szData, timeout);
+  if (CHIP_DATA(pnd)->io->receivev)
+    return CHIP_DATA(pnd)->io->receivev(pnd, rxv, rxcnt, timeout);
+
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  int res = CHIP_DATA(pnd)->io->receive(pnd, abtRx, MIN(sizeof(abtRx), pn53x_iov_len(rxv, rxcnt)), timeout);
+  if (res > 0)
+    pn53x_iov_scatter(rxv, rxcnt, 0, abtRx, res);
+  return res;
+}
+
+static void
+pn53x_iov_trace(struct nfc_device *pnd, const uint8_t ui8Direction, const uint8_t ui8Command, const struct pn53x_iovec *iov, const size_t iovcnt, size_t szOffset, const size_t szLen)
+{
+  if (iovcnt == 1) {
+    szOffset = MIN(szOffset, iov[0].szData);
+    nfc_trace_put(pnd->trace, ui8Direction, ui8Command, iov[0].pbtData + szOffset, MIN(szLen, iov[0].szData - szOffset));
+    return;
+  }
+  uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t szFrame = pn53x_iov_gather(abtFrame, sizeof(abtFrame), iov, iovcnt);
+  if (szOffset > szFrame)
+    szOffset = szFrame;
+  nfc_trace_put(pnd->trace, ui8Direction, ui8Command, abtFrame + szOffset, MIN(szLen, szFrame - szOffset));
+}
+
 int
 pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
 {
-  bool mi = false;
+  const struct pn53x_iovec txv = { (uint8_t *) pbtTx, szTx };
+  const struct pn53x_iovec rxv = { pbtRx, szRxLen };
+
+  return pn53x_transceivev(pnd, &txv, 1, &rxv, (szRxLen == 0 || !pbtRx) ? 0 : 1, timeout);
+}
+
+/*
+ * First byte of the reply (status byte or first data byte), NULL if no segment can hold it
+ */
+static uint8_t *
+pn53x_iov_head(const struct pn53x_iovec *iov, const size_t iovcnt)
+{
+  for (size_t i = 0; i < iovcnt; i++) {
+    if (iov[i].szData)
+      return iov[i].pbtData;
+  }
+  return NULL;
+}
+
+/*
+ * Send half of pn53x_transceivev(): the command is sent and \a px describes it for pn53x_transceive_receive()
+ */
+static int
+pn53x_transceive_send(struct nfc_device *pnd, const struct pn53x_iovec *txv, const size_t txcnt, int timeout, struct pn53x_exchange *px)
+{
   int res = 0;
   if (CHIP_DATA(pnd)->wb_trigged) {
     if ((res = pn53x_writeback_register(pnd)) < 0) {
@@ -172,7 +339,14 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     }
   }
 
-  PNCMD_TRACE(pbtTx[0]);
+  px->start = pnd->stats ? monotonic_time_ns() : 0;
+
+  // Command code and first parameter, which the MI loop and the status decoding need
+  px->abtTxHead[0] = px->abtTxHead[1] = 0;
+  pn53x_iov_gather(px->abtTxHead, sizeof(px->abtTxHead), txv, txcnt);
+  px->szTx = pn53x_iov_len(txv, txcnt);
+
+  PNCMD_TRACE(px->abtTxHead[0]);
   if (timeout > 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timeout value: %d", timeout);
   } else if (timeout == 0) {
@@ -182,39 +356,67 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
   } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid timeout value: %d", timeout);
   }
+  px->timeout = timeout;
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
-
-  // Check if receiving buffers are available, if not, replace them
-  if (szRxLen == 0 || !pbtRx) {
-    pbtRx = abtRx;
-  } else {
-    szRx = szRxLen;
-  }
+  if (pnd->trace)
+    pn53x_iov_trace(pnd, NFC_TRACE_HOST_TO_CHIP, px->abtTxHead[0], txv, txcnt, 1, px->szTx - 1);
 
   // Call the send/receice callback functions of the current driver
-  if ((res = CHIP_DATA(pnd)->io->send(pnd, pbtTx, szTx, timeout)) < 0) {
+  if ((res = pn53x_iov_send(pnd, txv, txcnt, timeout)) < 0) {
+    pn53x_transceive_done(pnd, px->abtTxHead, px->start, px->szTx, 0, res);
     return res;
   }
 
   // Command is sent, we store the command
-  CHIP_DATA(pnd)->last_command = pbtTx[0];
+  CHIP_DATA(pnd)->last_command = px->abtTxHead[0];
 
   // Handle power mode for PN532
-  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) {  // PN532 automatically goes into PowerDown mode when TgInitAsTarget command will be sent
+  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == px->abtTxHead[0])) {  // PN532 automatically goes into PowerDown mode when TgInitAsTarget command will be sent
     CHIP_DATA(pnd)->power_mode = POWERDOWN;
   }
+  return NFC_SUCCESS;
+}
+
+/*
+ * Receive half of pn53x_transceivev(): get the reply to the command described by \a px and decode its status
+ */
+static int
+pn53x_transceive_receive(struct nfc_device *pnd, const struct pn53x_exchange *px, const struct pn53x_iovec *rxv, size_t rxcnt)
+{
+  const uint8_t *abtTxHead = px->abtTxHead;
+  const int timeout = px->timeout;
+  bool mi = false;
+  int res = 0;
+
+  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  struct pn53x_iovec rxDefault = { abtRx, sizeof(abtRx) };
+  size_t  szRx;
+
+  // Check if receiving buffers are available, if not, replace them
+  if (rxcnt == 0) {
+    rxv = &rxDefault;
+    rxcnt = 1;
+  }
+  szRx = pn53x_iov_len(rxv, rxcnt);
+  uint8_t *pbtRxHead = pn53x_iov_head(rxv, rxcnt);
+  if (!pbtRxHead)
+    return NFC_EINVARG;
 
-  if ((res = CHIP_DATA(pnd)->io->receive(pnd, pbtRx, szRx, timeout)) < 0) {
+  if ((res = pn53x_iov_receive(pnd, rxv, rxcnt, timeout)) < 0) {
+    pn53x_transceive_done(pnd, abtTxHead, px->start, px->szTx, 0, res);
     return res;
   }
+  // The reply beat the abort: an abort coming now is too late for this command, and not meant for the next one
+  nfc_cancel_take(&pnd->cancel);
 
-  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) { // PN532 automatically wakeup on external RF field
+  if (pnd->trace)
+    pn53x_iov_trace(pnd, NFC_TRACE_CHIP_TO_HOST, abtTxHead[0] + 1, rxv, rxcnt, 0, res);
+
+  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == abtTxHead[0])) { // PN532 automatically wakeup on external RF field
     CHIP_DATA(pnd)->power_mode = NORMAL; // When TgInitAsTarget reply that means an external RF have waken up the chip
   }
 
-  switch (pbtTx[0]) {
+  switch (abtTxHead[0]) {
     case PowerDown:
     case InDataExchange:
     case InCommunicateThru:
@@ -229,14 +431,14 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     case TgResponseToInitiator:
     case TgSetGeneralBytes:
     case TgSetMetaData:
-      if (pbtRx[0] & 0x80) { abort(); } // NAD detected
-//      if (pbtRx[0] & 0x40) { abort(); } // MI detected
-      mi = pbtRx[0] & 0x40;
-      CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+      if (*pbtRxHead & 0x80) { abort(); } // NAD detected
+//      if (*pbtRxHead & 0x40) { abort(); } // MI detected
+      mi = *pbtRxHead & 0x40;
+      CHIP_DATA(pnd)->last_status_byte = *pbtRxHead & 0x3f;
       break;
     case Diagnose:
-      if (pbtTx[1] == 0x06) { // Diagnose: Card presence detection
-        CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+      if (abtTxHead[1] == 0x06) { // Diagnose: Card presence detection
+        CHIP_DATA(pnd)->last_status_byte = *pbtRxHead & 0x3f;
       } else {
         CHIP_DATA(pnd)->last_status_byte = 0;
       };
@@ -249,13 +451,13 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
         CHIP_DATA(pnd)->last_status_byte = 0;
         break;
       }
-      CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+      CHIP_DATA(pnd)->last_status_byte = *pbtRxHead & 0x3f;
       break;
     case ReadRegister:
     case WriteRegister:
       if (CHIP_DATA(pnd)->type == PN533) {
         // PN533 prepends its answer by the status byte
-        CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
+        CHIP_DATA(pnd)->last_status_byte = *pbtRxHead & 0x3f;
       } else {
         CHIP_DATA(pnd)->last_status_byte = 0;
       }
@@ -268,24 +470,31 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     int res2;
     uint8_t  abtRx2[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
     // Send empty command to card
-    if ((res2 = CHIP_DATA(pnd)->io->send(pnd, pbtTx, 2, timeout)) < 0) {
+    if (pnd->trace)
+      nfc_trace_put(pnd->trace, NFC_TRACE_HOST_TO_CHIP, abtTxHead[0], abtTxHead + 1, 1);
+    if ((res2 = CHIP_DATA(pnd)->io->send(pnd, abtTxHead, 2, timeout)) < 0) {
+      pn53x_transceive_done(pnd, abtTxHead, px->start, px->szTx, res, res2);
       return res2;
     }
     if ((res2 = CHIP_DATA(pnd)->io->receive(pnd, abtRx2, sizeof(abtRx2), timeout)) < 0) {
+      pn53x_transceive_done(pnd, abtTxHead, px->start, px->szTx, res, res2);
       return res2;
     }
+    if (pnd->trace)
+      nfc_trace_put(pnd->trace, NFC_TRACE_CHIP_TO_HOST, abtTxHead[0] + 1, abtRx2, res2);
     mi = abtRx2[0] & 0x40;
     if ((size_t)(res + res2 - 1) > szRx) {
       CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
       break;
     }
-    memcpy(pbtRx + res, abtRx2 + 1, res2 - 1);
+    pn53x_iov_scatter(rxv, rxcnt, res, abtRx2 + 1, res2 - 1);
     // Copy last status byte
-    pbtRx[0] = abtRx2[0];
+    *pbtRxHead = abtRx2[0];
     res += res2 - 1;
   }
 
   szRx = (size_t) res;
+  pn53x_transceive_done(pnd, abtTxHead, px->start, px->szTx, szRx, res);
 
   switch (CHIP_DATA(pnd)->last_status_byte) {
     case 0:
@@ -344,6 +553,68 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
   return res;
 }
 
+/**
+ * @brief Send a command gathered from \a txv and scatter the reply into \a rxv
+ *
+ * The first byte of the command is the PN53x command code and the first byte of the reply is the status byte or the first data byte, as with pn53x_transceive().
+ * Callers use separate segments to keep a header or the status byte apart from their own buffer, so the payload is neither assembled nor unpacked on the stack.
+ * When \a rxcnt is 0, the reply is received into an internal buffer and discarded.
+ */
+int
+pn53x_transceivev(struct nfc_device *pnd, const struct pn53x_iovec *txv, const size_t txcnt, const struct pn53x_iovec *rxv, size_t rxcnt, int timeout)
+{
+  struct pn53x_exchange x;
+  int res = 0;
+
+  if (CHIP_DATA(pnd)->pending.op != PN53X_PENDING_NONE) {
+    // The reply to the pending command would be taken for the reply to this one
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "A non-blocking operation is pending, complete it first");
+    return NFC_EINVARG;
+  }
+  if ((rxcnt > 0) && !pn53x_iov_head(rxv, rxcnt))
+    return NFC_EINVARG;
+
+  if ((res = pn53x_transceive_send(pnd, txv, txcnt, timeout, &x)) < 0)
+    return res;
+  return pn53x_transceive_receive(pnd, &x, rxv, rxcnt);
+}
+
+/**
+ * @brief Send a command built by another pn53x layer and return the reply as the chip sent it
+ *
+ * Unlike pn53x_transceive(), the status byte is neither decoded nor stripped and MI chaining is
+ * left to the caller, which owns the chip state: the register shadow is invalidated, so that
+ * pn53x_state_export() reads the registers back.
+ * @return reply length, otherwise returns libnfc's error code
+ */
+int
+pn53x_relay(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  const struct pn53x_iovec txv = { (uint8_t *) pbtTx, szTx };
+  struct pn53x_exchange x;
+  int res = 0;
+
+  if ((szTx == 0) || (szRx == 0))
+    return NFC_EINVARG;
+  if ((res = pn53x_transceive_send(pnd, &txv, 1, timeout, &x)) < 0)
+    return res;
+
+  res = CHIP_DATA(pnd)->io->receive(pnd, pbtRx, szRx, x.timeout);
+  if (res >= 0) {
+    if (pnd->trace)
+      nfc_trace_put(pnd->trace, NFC_TRACE_CHIP_TO_HOST, x.abtTxHead[0] + 1, pbtRx, res);
+    if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == x.abtTxHead[0])) {
+      CHIP_DATA(pnd)->power_mode = NORMAL;
+    } else if (PowerDown == x.abtTxHead[0]) {
+      CHIP_DATA(pnd)->power_mode = LOWVBAT;
+    }
+  }
+  CHIP_DATA(pnd)->last_status_byte = 0;
+  pn53x_transceive_done(pnd, x.abtTxHead, x.start, x.szTx, (res < 0) ? 0 : (size_t) res, res);
+  CHIP_DATA(pnd)->shadow_valid = 0;
+  return res;
+}
+
 int
 pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Parameter, const bool bEnable)
 {
@@ -645,8 +916,106 @@ pn53x_ReadRegister(struct nfc_device *pnd, uint16_t ui16RegisterAddress, uint8_t
   return NFC_SUCCESS;
 }
 
+static int
+pn53x_shadow_index(const uint16_t ui16RegisterAddress)
+{
+  for (int i = 0; i < PN53X_SHADOW_REGISTER_COUNT; i++) {
+    if (pn53x_shadow_registers[i] == ui16RegisterAddress)
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief Invalidate the register shadow entries a command may have changed
+ *
+ * Register access and status commands keep the shadow valid, as do the RFConfiguration items
+ * only held in firmware variables; any other command may have reconfigured the CIU
+ * (e.g. InListPassiveTarget sets speed and framing), as may any failed exchange.
+ * @param pbtTxHead command code and first parameter of the command
+ */
+static void
+pn53x_shadow_command_done(struct nfc_device *pnd, const uint8_t *pbtTxHead, const int res)
+{
+  if ((res < 0) || CHIP_DATA(pnd)->last_status_byte) {
+    CHIP_DATA(pnd)->shadow_valid = 0;
+    return;
+  }
+  switch (pbtTxHead[0]) {
+    case GetFirmwareVersion:
+    case GetGeneralStatus:
+    case ReadRegister:
+    case WriteRegister:
+    case ReadGPIO:
+      break;
+    case RFConfiguration:
+      switch (pbtTxHead[1]) {
+        case RFCI_TIMING:
+        case RFCI_RETRY_DATA:
+        case RFCI_RETRY_SELECT:
+          break;
+        case RFCI_FIELD:
+          CHIP_DATA(pnd)->shadow_valid &= ~((1U << pn53x_shadow_index(PN53X_REG_CIU_TxControl)) | (1U << pn53x_shadow_index(PN53X_REG_CIU_TxAuto)));
+          break;
+        default:
+          CHIP_DATA(pnd)->shadow_valid = 0;
+          break;
+      }
+      break;
+    case InCommunicateThru:
+      CHIP_DATA(pnd)->shadow_valid &= ~PN53X_SHADOW_TIMER_MASK;
+      break;
+    default:
+      CHIP_DATA(pnd)->shadow_valid = 0;
+      break;
+  }
+}
+
+/**
+ * @brief Read all shadowed registers from the chip in a single ReadRegister command
+ */
+int
+pn53x_shadow_resync(struct nfc_device *pnd)
+{
+  int res = 0;
+  BUFFER_INIT(abtReadRegisterCmd, 1 + 2 * PN53X_SHADOW_REGISTER_COUNT);
+  BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
+  for (size_t n = 0; n < PN53X_SHADOW_REGISTER_COUNT; n++) {
+    BUFFER_APPEND(abtReadRegisterCmd, pn53x_shadow_registers[n] >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, pn53x_shadow_registers[n] & 0xff);
+  }
+  uint8_t abtRes[1 + PN53X_SHADOW_REGISTER_COUNT];
+  if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, sizeof(abtRes), -1)) < 0) {
+    return res;
+  }
+  // PN533 prepends its answer by a status byte
+  const size_t off = (CHIP_DATA(pnd)->type == PN533) ? 1 : 0;
+  if ((size_t)res < off + PN53X_SHADOW_REGISTER_COUNT) {
+    return NFC_ECHIP;
+  }
+  memcpy(CHIP_DATA(pnd)->shadow_data, abtRes + off, PN53X_SHADOW_REGISTER_COUNT);
+  CHIP_DATA(pnd)->shadow_valid = (uint32_t)((1ULL << PN53X_SHADOW_REGISTER_COUNT) - 1);
+  return NFC_SUCCESS;
+}
+
 int pn53x_read_register(struct nfc_device *pnd, uint16_t ui16RegisterAddress, uint8_t *ui8Value)
 {
+  const int i = pn53x_shadow_index(ui16RegisterAddress);
+  if (i >= 0) {
+    int res;
+    if (!(CHIP_DATA(pnd)->shadow_valid & (1U << i)) && CHIP_DATA(pnd)->wb_trigged) {
+      // The write-back would be sent first anyway, and its ReadRegister, if any, reloads the stale entries
+      if ((res = pn53x_writeback_register(pnd)) < 0)
+        return res;
+    }
+    if (!(CHIP_DATA(pnd)->shadow_valid & (1U << i))) {
+      // Refreshing the whole shadow costs the same round trip as reading this register alone
+      if ((res = pn53x_shadow_resync(pnd)) < 0)
+        return res;
+    }
+    *ui8Value = CHIP_DATA(pnd)->shadow_data[i];
+    return NFC_SUCCESS;
+  }
   return pn53x_ReadRegister(pnd, ui16RegisterAddress, ui8Value);
 }
 
@@ -661,25 +1030,54 @@ pn53x_WriteRegister(struct nfc_device *pnd, const uint16_t ui16RegisterAddress,
 int
 pn53x_write_register(struct nfc_device *pnd, const uint16_t ui16RegisterAddress, const uint8_t ui8SymbolMask, const uint8_t ui8Value)
 {
+  uint8_t ui8FullValue = ui8Value;
+  uint8_t ui8FullMask = ui8SymbolMask;
+  const int i = pn53x_shadow_index(ui16RegisterAddress);
+
+  if (i >= 0) {
+    // Shadowed register: masked writes are composed locally, the chip only sees a full write, if any
+    const uint32_t bit = 1U << i;
+    const bool cached = (ui16RegisterAddress >= PN53X_CACHE_REGISTER_MIN_ADDRESS) && (ui16RegisterAddress <= PN53X_CACHE_REGISTER_MAX_ADDRESS);
+    if ((ui8SymbolMask != 0xff) && !(CHIP_DATA(pnd)->shadow_valid & bit) && !cached) {
+      int res;
+      if ((res = pn53x_shadow_resync(pnd)) < 0)
+        return res;
+    }
+    if (CHIP_DATA(pnd)->shadow_valid & bit) {
+      ui8FullValue = (ui8Value & ui8SymbolMask) | (CHIP_DATA(pnd)->shadow_data[i] & (~ui8SymbolMask));
+      if (ui8FullValue == CHIP_DATA(pnd)->shadow_data[i]) {
+        // The chip already holds this value
+        return NFC_SUCCESS;
+      }
+      ui8FullMask = 0xff;
+      CHIP_DATA(pnd)->shadow_data[i] = ui8FullValue;
+    } else if (ui8SymbolMask == 0xff) {
+      CHIP_DATA(pnd)->shadow_data[i] = ui8FullValue;
+      CHIP_DATA(pnd)->shadow_valid |= bit;
+    }
+    // Otherwise this is a masked write to a stale entry of the write-back cache area:
+    // pn53x_writeback_register() resolves it and reloads the shadow with the same ReadRegister.
+  }
+
   if ((ui16RegisterAddress < PN53X_CACHE_REGISTER_MIN_ADDRESS) || (ui16RegisterAddress > PN53X_CACHE_REGISTER_MAX_ADDRESS)) {
     // Direct write
-    if (ui8SymbolMask != 0xff) {
+    if (ui8FullMask != 0xff) {
       int res = 0;
       uint8_t ui8CurrentValue;
-      if ((res = pn53x_read_register(pnd, ui16RegisterAddress, &ui8CurrentValue)) < 0)
+      if ((res = pn53x_ReadRegister(pnd, ui16RegisterAddress, &ui8CurrentValue)) < 0)
         return res;
       uint8_t ui8NewValue = ((ui8Value & ui8SymbolMask) | (ui8CurrentValue & (~ui8SymbolMask)));
       if (ui8NewValue != ui8CurrentValue) {
         return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8NewValue);
       }
     } else {
-      return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8Value);
+      return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8FullValue);
     }
   } else {
     // Write-back cache area
     const int internal_address = ui16RegisterAddress - PN53X_CACHE_REGISTER_MIN_ADDRESS;
-    CHIP_DATA(pnd)->wb_data[internal_address] = (CHIP_DATA(pnd)->wb_data[internal_address] & CHIP_DATA(pnd)->wb_mask[internal_address] & (~ui8SymbolMask)) | (ui8Value & ui8SymbolMask);
-    CHIP_DATA(pnd)->wb_mask[internal_address] = CHIP_DATA(pnd)->wb_mask[internal_address] | ui8SymbolMask;
+    CHIP_DATA(pnd)->wb_data[internal_address] = (CHIP_DATA(pnd)->wb_data[internal_address] & CHIP_DATA(pnd)->wb_mask[internal_address] & (~ui8FullMask)) | (ui8FullValue & ui8FullMask);
+    CHIP_DATA(pnd)->wb_mask[internal_address] = CHIP_DATA(pnd)->wb_mask[internal_address] | ui8FullMask;
     CHIP_DATA(pnd)->wb_trigged = true;
   }
   return NFC_SUCCESS;
@@ -689,6 +1087,7 @@ int
 pn53x_writeback_register(struct nfc_device *pnd)
 {
   int res = 0;
+  uint32_t resync_bits = 0;
   // TODO Check at each step (ReadRegister, WriteRegister) if we didn't exceed max supported frame length
   BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
   BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
@@ -704,6 +1103,23 @@ pn53x_writeback_register(struct nfc_device *pnd)
     }
   }
 
+  if (BUFFER_SIZE(abtReadRegisterCmd) > 1) {
+    // Since a ReadRegister round trip is needed anyway, reload the stale shadow entries with it
+    for (int i = 0; i < PN53X_SHADOW_REGISTER_COUNT; i++) {
+      const uint16_t pn53x_register_address = pn53x_shadow_registers[i];
+      if (CHIP_DATA(pnd)->shadow_valid & (1U << i))
+        continue;
+      if ((pn53x_register_address >= PN53X_CACHE_REGISTER_MIN_ADDRESS) && (pn53x_register_address <= PN53X_CACHE_REGISTER_MAX_ADDRESS) &&
+          (CHIP_DATA(pnd)->wb_mask[pn53x_register_address - PN53X_CACHE_REGISTER_MIN_ADDRESS])) {
+        // Already read above, or about to be fully written
+        continue;
+      }
+      resync_bits |= 1U << i;
+      BUFFER_APPEND(abtReadRegisterCmd, pn53x_register_address  >> 8);
+      BUFFER_APPEND(abtReadRegisterCmd, pn53x_register_address & 0xff);
+    }
+  }
+
   if (BUFFER_SIZE(abtReadRegisterCmd) > 1) {
     // It needs to read some registers
     uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
@@ -726,9 +1142,21 @@ pn53x_writeback_register(struct nfc_device *pnd)
         } else {
           CHIP_DATA(pnd)->wb_mask[n] = 0x00;  // We already have the right value
         }
+        const int shadow = pn53x_shadow_index(PN53X_CACHE_REGISTER_MIN_ADDRESS + n);
+        if (shadow >= 0) {
+          CHIP_DATA(pnd)->shadow_data[shadow] = CHIP_DATA(pnd)->wb_data[n];
+          CHIP_DATA(pnd)->shadow_valid |= 1U << shadow;
+        }
+        i++;
+      }
+    }
+    for (int n = 0; n < PN53X_SHADOW_REGISTER_COUNT; n++) {
+      if (resync_bits & (1U << n)) {
+        CHIP_DATA(pnd)->shadow_data[n] = abtRes[i];
         i++;
       }
     }
+    CHIP_DATA(pnd)->shadow_valid |= resync_bits;
   }
   // Now, the writeback-cache only has masks with 0xff, we can start to WriteRegister
   BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
@@ -759,12 +1187,16 @@ pn53x_decode_firmware_version(struct nfc_device *pnd)
 {
   const uint8_t abtCmd[] = { GetFirmwareVersion };
   uint8_t  abtFw[4];
-  size_t  szFwLen = sizeof(abtFw);
   int res = 0;
-  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtFw, szFwLen, -1)) < 0) {
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtFw, sizeof(abtFw), -1)) < 0) {
     return res;
   }
-  szFwLen = (size_t) res;
+  return pn53x_firmware_version_decode(pnd, abtFw, (size_t) res);
+}
+
+static int
+pn53x_firmware_version_decode(struct nfc_device *pnd, const uint8_t *abtFw, const size_t szFwLen)
+{
   // Determine which version of chip it is: PN531 will return only 2 bytes, while others return 4 bytes and have the first to tell the version IC
   if (szFwLen == 2) {
     CHIP_DATA(pnd)->type = PN531;
@@ -804,6 +1236,72 @@ pn53x_decode_firmware_version(struct nfc_device *pnd)
       // Could not happend
       break;
   }
+  memcpy(CHIP_DATA(pnd)->abtFirmware, abtFw, szFwLen);
+  CHIP_DATA(pnd)->szFirmware = szFwLen;
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Bring the chip back to the state pn53x_init() leaves it in and describe that state in \a ps
+ *
+ * Commands relayed with pn53x_relay() leave the register shadow invalid: the registers are then
+ * read back in one command and pn53x_reset_settings() only writes those which differ.
+ */
+int
+pn53x_state_export(struct nfc_device *pnd, struct pn53x_state *ps)
+{
+  const uint32_t uiAllValid = (uint32_t)((1ULL << PN53X_SHADOW_REGISTER_COUNT) - 1);
+  int res = 0;
+
+  if (CHIP_DATA(pnd)->shadow_valid != uiAllValid) {
+    if ((res = pn53x_SetParameters(pnd, PARAM_AUTO_ATR_RES | PARAM_AUTO_RATS)) < 0)
+      return res;
+    if ((res = pn53x_shadow_resync(pnd)) < 0)
+      return res;
+    // The flags may not match the chip anymore: start from nfc_device_new() ones so that each setting is checked
+    pnd->bCrc = false;
+    pnd->bPar = false;
+    pnd->bEasyFraming = false;
+    if ((res = pn53x_reset_settings(pnd)) < 0)
+      return res;
+    if (CHIP_DATA(pnd)->wb_trigged && ((res = pn53x_writeback_register(pnd)) < 0))
+      return res;
+  }
+
+  memcpy(ps->abtFirmware, CHIP_DATA(pnd)->abtFirmware, sizeof(ps->abtFirmware));
+  ps->szFirmware = CHIP_DATA(pnd)->szFirmware;
+  ps->ui8Parameters = CHIP_DATA(pnd)->ui8Parameters;
+  ps->timer_correction = CHIP_DATA(pnd)->timer_correction;
+  ps->shadow_valid = CHIP_DATA(pnd)->shadow_valid;
+  memcpy(ps->shadow_data, CHIP_DATA(pnd)->shadow_data, sizeof(ps->shadow_data));
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Initialize the chip data from a state exported by pn53x_state_export()
+ *
+ * This is pn53x_init() without any command sent to the chip.
+ */
+int
+pn53x_state_import(struct nfc_device *pnd, const struct pn53x_state *ps)
+{
+  int res = 0;
+  if (ps->szFirmware > sizeof(ps->abtFirmware))
+    return NFC_EINVARG;
+  if ((res = pn53x_firmware_version_decode(pnd, ps->abtFirmware, ps->szFirmware)) < 0)
+    return res;
+  if ((res = pn53x_init_supported_modulations(pnd)) < 0)
+    return res;
+
+  CHIP_DATA(pnd)->ui8Parameters = ps->ui8Parameters;
+  CHIP_DATA(pnd)->timer_correction = ps->timer_correction;
+  CHIP_DATA(pnd)->ui8TxBits = 0;
+  CHIP_DATA(pnd)->shadow_valid = ps->shadow_valid & (uint32_t)((1ULL << PN53X_SHADOW_REGISTER_COUNT) - 1);
+  memcpy(CHIP_DATA(pnd)->shadow_data, ps->shadow_data, sizeof(CHIP_DATA(pnd)->shadow_data));
+  // As set by pn53x_reset_settings()
+  pnd->bCrc = true;
+  pnd->bPar = true;
+  pnd->bEasyFraming = true;
   return NFC_SUCCESS;
 }
 
@@ -968,10 +1466,87 @@ pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, con
   return NFC_EINVARG;
 }
 
+int
+pn53x_set_properties(struct nfc_device *pnd, const nfc_property_setting *settings, const size_t szSettings)
+{
+  int res = 0;
+  bool bTimings = false;
+  bool bRetries = false;
+  int iField = -1;
+  uint8_t ui8Parameters = CHIP_DATA(pnd)->ui8Parameters;
+
+  // Register writes pile up in the write-back cache and the register shadow; settings which need
+  // a dedicated command are only recorded here and sent once, with their final value, at the end.
+  for (size_t i = 0; i < szSettings; i++) {
+    const bool bEnable = settings[i].value != 0;
+    switch (settings[i].property) {
+      case NP_TIMEOUT_COMMAND:
+        CHIP_DATA(pnd)->timeout_command = settings[i].value;
+        break;
+      case NP_TIMEOUT_ATR:
+        CHIP_DATA(pnd)->timeout_atr = settings[i].value;
+        bTimings = true;
+        break;
+      case NP_TIMEOUT_COM:
+        CHIP_DATA(pnd)->timeout_communication = settings[i].value;
+        bTimings = true;
+        break;
+      case NP_INFINITE_SELECT:
+        pnd->bInfiniteSelect = bEnable;
+        bRetries = true;
+        break;
+      case NP_AUTO_ISO14443_4:
+        pnd->bAutoIso14443_4 = bEnable;
+        ui8Parameters = (bEnable) ? (ui8Parameters | PARAM_AUTO_RATS) : (ui8Parameters & ~PARAM_AUTO_RATS);
+        break;
+      case NP_ACTIVATE_FIELD:
+        // Its RFConfiguration would flush the register writes so far: sent last, through the driver as below
+        iField = bEnable;
+        break;
+      default:
+        // Through the driver, which may hook some properties (e.g. LEDs following NP_ACTIVATE_FIELD)
+        if ((res = pnd->driver->device_set_property_bool(pnd, settings[i].property, bEnable)) < 0)
+          return res;
+        break;
+    }
+  }
+
+  if (ui8Parameters != CHIP_DATA(pnd)->ui8Parameters) {
+    if ((res = pn53x_SetParameters(pnd, ui8Parameters)) < 0)
+      return res;
+  }
+  if (bRetries) {
+    if ((res = pn53x_RFConfiguration__MaxRetries(pnd,
+                                                 (pnd->bInfiniteSelect) ? 0xff : 0x00,
+                                                 (pnd->bInfiniteSelect) ? 0xff : 0x01,
+                                                 (pnd->bInfiniteSelect) ? 0xff : 0x02)) < 0)
+      return res;
+  }
+  if (bTimings) {
+    if ((res = pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication))) < 0)
+      return res;
+  }
+  // Apply the resulting register image now, in a single WriteRegister, so errors are reported here
+  if (CHIP_DATA(pnd)->wb_trigged) {
+    if ((res = pn53x_writeback_register(pnd)) < 0)
+      return res;
+  }
+  if (iField >= 0) {
+    if ((res = pnd->driver->device_set_property_bool(pnd, NP_ACTIVATE_FIELD, iField)) < 0)
+      return res;
+  }
+  return NFC_SUCCESS;
+}
+
 int
 pn53x_idle(struct nfc_device *pnd)
 {
   int res = 0;
+  if (CHIP_DATA(pnd)->pending.op != PN53X_PENDING_NONE) {
+    // Give up the pending non-blocking operation, as nfc_abort_command() and nfc_device_complete() would
+    nfc_device_abort(pnd);
+    pn53x_complete(pnd);
+  }
   switch (CHIP_DATA(pnd)->operating_mode) {
     case TARGET:
       // InRelease used in target mode stops the target emulation and no more
@@ -1054,6 +1629,44 @@ pn532_initiator_init_secure_element(struct nfc_device *pnd)
   return pn532_SAMConfiguration(pnd, PSM_WIRED_CARD, -1);
 }
 
+/*
+ * Decode the target found by InListPassiveTarget (\a pbtTargetsData starts with NbTg) and make it the current target
+ */
+static int
+pn53x_initiator_listed_target(struct nfc_device *pnd, const nfc_modulation nm,
+                              const uint8_t *pbtTargetsData, const size_t szTargetsData,
+                              nfc_target *pnt)
+{
+  nfc_target nttmp;
+  int res = 0;
+
+  if (szTargetsData <= 1) // For Coverity to know szTargetsData is always > 1 if res > 0
+    return 0;
+
+  memset(&nttmp, 0x00, sizeof(nfc_target));
+  nttmp.nm = nm;
+  if ((res = pn53x_decode_target_data(pbtTargetsData + 1, szTargetsData - 1, CHIP_DATA(pnd)->type, nm.nmt, &(nttmp.nti))) < 0) {
+    return res;
+  }
+  if ((nm.nmt == NMT_ISO14443A) && (nm.nbr != NBR_106)) {
+    uint8_t pncmd_inpsl[4] = { InPSL, 0x01 };
+    pncmd_inpsl[2] = nm.nbr - 1;
+    pncmd_inpsl[3] = nm.nbr - 1;
+    if ((res = pn53x_transceive(pnd, pncmd_inpsl, sizeof(pncmd_inpsl), NULL, 0, 0)) < 0) {
+      return res;
+    }
+  }
+  if (pn53x_current_target_new(pnd, &nttmp) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  // Is a tag info struct available
+  if (pnt) {
+    memcpy(pnt, &nttmp, sizeof(nfc_target));
+  }
+  return pbtTargetsData[0];
+}
+
 static int
 pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
                                           const nfc_modulation nm,
@@ -1074,16 +1687,13 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
       return pnd->last_error;
     }
     // No native support in InListPassiveTarget so we do discovery by hand
-    if ((res = nfc_device_set_property_bool(pnd, NP_FORCE_ISO14443_B, true)) < 0) {
-      return res;
-    }
-    if ((res = nfc_device_set_property_bool(pnd, NP_FORCE_SPEED_106, true)) < 0) {
-      return res;
-    }
-    if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0) {
-      return res;
-    }
-    if ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0) {
+    const nfc_property_setting settings[] = {
+      { NP_FORCE_ISO14443_B, true },
+      { NP_FORCE_SPEED_106, true },
+      { NP_HANDLE_CRC, true },
+      { NP_EASY_FRAMING, false },
+    };
+    if ((res = nfc_device_set_properties(pnd, settings, sizeof(settings) / sizeof(settings[0]))) < 0) {
       return res;
     }
     bool found = false;
@@ -1245,21 +1855,7 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
     if ((res = pn53x_InListPassiveTarget(pnd, pm, 1, pbtInitData, szInitData, abtTargetsData, &szTargetsData, timeout)) <= 0)
       return res;
 
-    if (szTargetsData <= 1) // For Coverity to know szTargetsData is always > 1 if res > 0
-      return 0;
-
-    nttmp.nm = nm;
-    if ((res = pn53x_decode_target_data(abtTargetsData + 1, szTargetsData - 1, CHIP_DATA(pnd)->type, nm.nmt, &(nttmp.nti))) < 0) {
-      return res;
-    }
-    if ((nm.nmt == NMT_ISO14443A) && (nm.nbr != NBR_106)) {
-      uint8_t pncmd_inpsl[4] = { InPSL, 0x01 };
-      pncmd_inpsl[2] = nm.nbr - 1;
-      pncmd_inpsl[3] = nm.nbr - 1;
-      if ((res = pn53x_transceive(pnd, pncmd_inpsl, sizeof(pncmd_inpsl), NULL, 0, 0)) < 0) {
-        return res;
-      }
-    }
+    return pn53x_initiator_listed_target(pnd, nm, abtTargetsData, szTargetsData, pnt);
   }
   if (pn53x_current_target_new(pnd, &nttmp) == NULL) {
     pnd->last_error = NFC_ESOFT;
@@ -1474,16 +2070,61 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
       memcpy(pbtRx, abtRx + 1, szRx - 1);
     }
   }
-  // Everything went successful
-  return szRxBits;
+  // Everything went successful
+  return szRxBits;
+}
+
+static int
+pn53x_initiator_exchange(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                         const size_t szRx, int timeout)
+{
+  uint8_t  abtCmd[2];
+  int res = 0;
+
+  // The command header goes in its own segment, the payload is sent straight from the caller's buffer
+  struct pn53x_iovec txv[2] = {
+    { abtCmd, 0 },
+    { (uint8_t *) pbtTx, szTx },
+  };
+  if (pnd->bEasyFraming) {
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 1;              /* target number */
+    txv[0].szData = 2;
+  } else {
+    abtCmd[0] = InCommunicateThru;
+    txv[0].szData = 1;
+  }
+
+  // Send the frame to the PN53X chip and get the answer
+  // The status byte is split off and the data lands in the caller's buffer; the last segment only
+  // catches an answer longer than that buffer, so it can be reported as an overflow.
+  uint8_t  btStatus;
+  uint8_t  abtOverflow[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  const size_t szUser = pbtRx ? szRx : 0;
+  const struct pn53x_iovec rxv[3] = {
+    { &btStatus, 1 },
+    { pbtRx, szUser },
+    { abtOverflow, sizeof(abtOverflow) - 1 - MIN(szUser, sizeof(abtOverflow) - 1) },
+  };
+  if ((res = pn53x_transceivev(pnd, txv, 2, rxv, 3, timeout)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  const size_t szRxLen = (size_t)res - 1;
+  if (pbtRx != NULL) {
+    if (szRxLen >  szRx) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen);
+      return NFC_EOVFLOW;
+    }
+  }
+  // Everything went successful, we return received bytes count
+  return szRxLen;
 }
 
 int
 pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
                                  const size_t szRx, int timeout)
 {
-  size_t  szExtraTxLen;
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
   int res = 0;
 
   // We can not just send bytes without parity if while the PN53X expects we handled them
@@ -1492,42 +2133,58 @@ pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, c
     return pnd->last_error;
   }
 
-  // Copy the data into the command frame
-  if (pnd->bEasyFraming) {
-    abtCmd[0] = InDataExchange;
-    abtCmd[1] = 1;              /* target number */
-    memcpy(abtCmd + 2, pbtTx, szTx);
-    szExtraTxLen = 2;
-  } else {
-    abtCmd[0] = InCommunicateThru;
-    memcpy(abtCmd + 1, pbtTx, szTx);
-    szExtraTxLen = 1;
-  }
-
   // To transfer command frames bytes we can not have any leading bits, reset this to zero
   if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
 
-  // Send the frame to the PN53X chip and get the answer
-  // We have to give the amount of bytes + (the two command bytes 0xD4, 0x42)
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  if ((res = pn53x_transceive(pnd, abtCmd, szTx + szExtraTxLen, abtRx, sizeof(abtRx), timeout)) < 0) {
+  return pn53x_initiator_exchange(pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+}
+
+int
+pn53x_initiator_transceive_batch(struct nfc_device *pnd, nfc_transceive_op ops[], const size_t szOps, const int flags, int timeout)
+{
+  int res = 0;
+  int last_error = 0;
+  size_t szDone = 0;
+
+  // Same preconditions as pn53x_initiator_transceive_bytes(), checked once for the whole batch
+  if (!pnd->bPar) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
-  const size_t szRxLen = (size_t)res - 1;
-  if (pbtRx != NULL) {
-    if (szRxLen >  szRx) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen);
-      return NFC_EOVFLOW;
+  if (CHIP_DATA(pnd)->wb_trigged) {
+    if ((res = pn53x_writeback_register(pnd)) < 0) {
+      pnd->last_error = res;
+      return pnd->last_error;
     }
-    // Copy the received bytes
-    memcpy(pbtRx, abtRx + 1, szRxLen);
   }
-  // Everything went successful, we return received bytes count
-  return szRxLen;
+  if (timeout == -1) {
+    timeout = CHIP_DATA(pnd)->timeout_command;
+  }
+
+  for (size_t i = 0; i < szOps; i++) {
+    res = pn53x_initiator_exchange(pnd, ops[i].pbtTx, ops[i].szTx, ops[i].pbtRx, ops[i].szRx, timeout);
+    if ((res >= 0) && ops[i].szRxExpected && ((size_t)res != ops[i].szRxExpected)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Exchange %" PRIuPTR ": %d byte(s) received, %" PRIuPTR " expected", i, res, ops[i].szRxExpected);
+      res = NFC_ERFTRANS;
+    }
+    ops[i].res = res;
+    if (res < 0) {
+      last_error = res;
+      if (flags & NFC_BATCH_STOP_ON_ERROR)
+        break;
+    } else {
+      szDone++;
+    }
+  }
+  pnd->last_error = last_error;
+  return szDone;
 }
 
 static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles)
@@ -1735,7 +2392,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
   }
 
   uint8_t txmode = 0;
-  if (pnd->bCrc) { // check if we're in TypeA or TypeB mode to compute right CRC later
+  if (pnd->bCrc) { // check if we're in TypeA or TypeB mode to compute right CRC later, TxMode is normally served by the register shadow
     if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &txmode)) < 0) {
       return res;
     }
@@ -2493,25 +3150,25 @@ pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t s
   return szRxBits;
 }
 
-int
-pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+/*
+ * Command used to exchange data as a target: \a btDataCommand (TgGetData/TgSetData) when the chip handles
+ * the framing, \a btRawCommand (TgGetInitiatorCommand/TgResponseToInitiator) otherwise
+ */
+static int
+pn53x_target_data_command(struct nfc_device *pnd, const uint8_t btDataCommand, const uint8_t btRawCommand)
 {
-  uint8_t  abtCmd[1];
-
   // XXX I think this is not a clean way to provide some kind of "EasyFraming"
   // but at the moment I have no more better than this
   if (pnd->bEasyFraming) {
     switch (CHIP_DATA(pnd)->current_target->nm.nmt) {
       case NMT_DEP:
-        abtCmd[0] = TgGetData;
-        break;
+        return btDataCommand;
       case NMT_ISO14443A:
         if (CHIP_DATA(pnd)->current_target->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) {
           // We are dealing with a ISO/IEC 14443-4 compliant target
           if ((CHIP_DATA(pnd)->type == PN532) && (pnd->bAutoIso14443_4)) {
             // We are using ISO/IEC 14443-4 PICC emulation capability from the PN532
-            abtCmd[0] = TgGetData;
-            break;
+            return btDataCommand;
           } else {
             // TODO Support EasyFraming for other cases by software
             pnd->last_error = NFC_ENOTIMPL;
@@ -2526,17 +3183,25 @@ pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t
       case NMT_ISO14443B2SR:
       case NMT_ISO14443B2CT:
       case NMT_FELICA:
-        abtCmd[0] = TgGetInitiatorCommand;
         break;
     }
-  } else {
-    abtCmd[0] = TgGetInitiatorCommand;
   }
+  return btRawCommand;
+}
+
+int
+pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
+  uint8_t  abtCmd[1];
+  int res = 0;
+
+  if ((res = pn53x_target_data_command(pnd, TgGetData, TgGetInitiatorCommand)) < 0)
+    return res;
+  abtCmd[0] = res;
 
   // Try to gather a received frame from the reader
   uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
   size_t szRx = sizeof(abtRx);
-  int res = 0;
   if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, szRx, timeout)) < 0)
     return pnd->last_error;
   szRx = (size_t) res;
@@ -2604,40 +3269,9 @@ pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size
   if (!pnd->bPar)
     return NFC_ECHIP;
 
-  // XXX I think this is not a clean way to provide some kind of "EasyFraming"
-  // but at the moment I have no more better than this
-  if (pnd->bEasyFraming) {
-    switch (CHIP_DATA(pnd)->current_target->nm.nmt) {
-      case NMT_DEP:
-        abtCmd[0] = TgSetData;
-        break;
-      case NMT_ISO14443A:
-        if (CHIP_DATA(pnd)->current_target->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) {
-          // We are dealing with a ISO/IEC 14443-4 compliant target
-          if ((CHIP_DATA(pnd)->type == PN532) && (pnd->bAutoIso14443_4)) {
-            // We are using ISO/IEC 14443-4 PICC emulation capability from the PN532
-            abtCmd[0] = TgSetData;
-            break;
-          } else {
-            // TODO Support EasyFraming for other cases by software
-            pnd->last_error = NFC_ENOTIMPL;
-            return pnd->last_error;
-          }
-        }
-      // NO BREAK
-      case NMT_JEWEL:
-      case NMT_BARCODE:
-      case NMT_ISO14443B:
-      case NMT_ISO14443BI:
-      case NMT_ISO14443B2SR:
-      case NMT_ISO14443B2CT:
-      case NMT_FELICA:
-        abtCmd[0] = TgResponseToInitiator;
-        break;
-    }
-  } else {
-    abtCmd[0] = TgResponseToInitiator;
-  }
+  if ((res = pn53x_target_data_command(pnd, TgSetData, TgResponseToInitiator)) < 0)
+    return res;
+  abtCmd[0] = res;
 
   // Copy the data into the command frame
   memcpy(abtCmd + 1, pbtTx, szTx);
@@ -2650,6 +3284,212 @@ pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size
   return szTx;
 }
 
+/*
+ * Non-blocking operations
+ *
+ * A submit function sends its command and returns as soon as the chip took it, the reply is then
+ * received and decoded by pn53x_complete() once the driver's receive_ready reports it is there.
+ * Meanwhile the device is busy: pn53x_transceivev() refuses any other command.
+ */
+static int
+pn53x_submit_check(struct nfc_device *pnd)
+{
+  if (!CHIP_DATA(pnd)->io->get_pollfd || !CHIP_DATA(pnd)->io->receive_ready) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  if (CHIP_DATA(pnd)->pending.op != PN53X_PENDING_NONE) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "A non-blocking operation is already pending");
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_submit(struct nfc_device *pnd, const pn53x_pending_operation op, const struct pn53x_iovec *txv, const size_t txcnt, const int timeout)
+{
+  struct pn53x_pending *pp = &CHIP_DATA(pnd)->pending;
+  int res = 0;
+
+  if ((res = pn53x_transceive_send(pnd, txv, txcnt, timeout, &pp->exchange)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  pp->op = op;
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_get_pollfd(struct nfc_device *pnd)
+{
+  if (!CHIP_DATA(pnd)->io->get_pollfd) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  return CHIP_DATA(pnd)->io->get_pollfd(pnd);
+}
+
+int
+pn53x_initiator_submit_select_passive_target(struct nfc_device *pnd,
+                                             const nfc_modulation nm,
+                                             const uint8_t *pbtInitData, const size_t szInitData,
+                                             nfc_target *pnt)
+{
+  uint8_t  abtCmd[15];
+  int res = 0;
+
+  if ((res = pn53x_submit_check(pnd)) < 0)
+    return res;
+  // These ones are discovered by a sequence of raw exchanges, see pn53x_initiator_select_passive_target_ext()
+  if ((nm.nmt == NMT_ISO14443BI) || (nm.nmt == NMT_ISO14443B2SR) || (nm.nmt == NMT_ISO14443B2CT) || (nm.nmt == NMT_BARCODE)) {
+    pnd->last_error = NFC_ENOTIMPL;
+    return pnd->last_error;
+  }
+  const pn53x_modulation pm = pn53x_nm_to_pm(nm);
+  if ((PM_UNDEFINED == pm) || (NBR_UNDEFINED == nm.nbr)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if ((res = pn53x_InListPassiveTarget_frame(pnd, pm, 1, pbtInitData, szInitData, abtCmd)) < 0)
+    return res;
+
+  const struct pn53x_iovec txv = { abtCmd, (size_t) res };
+  CHIP_DATA(pnd)->pending.nm = nm;
+  CHIP_DATA(pnd)->pending.pnt = pnt;
+  return pn53x_submit(pnd, PN53X_PENDING_SELECT_PASSIVE_TARGET, &txv, 1, 0);
+}
+
+int
+pn53x_initiator_submit_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
+                                        uint8_t *pbtRx, const size_t szRx)
+{
+  uint8_t  abtCmd[2];
+  int res = 0;
+
+  if ((res = pn53x_submit_check(pnd)) < 0)
+    return res;
+  // Same preconditions as pn53x_initiator_transceive_bytes()
+  if (!pnd->bPar) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+
+  struct pn53x_iovec txv[2] = {
+    { abtCmd, 0 },
+    { (uint8_t *) pbtTx, szTx },
+  };
+  if (pnd->bEasyFraming) {
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 1;              /* target number */
+    txv[0].szData = 2;
+  } else {
+    abtCmd[0] = InCommunicateThru;
+    txv[0].szData = 1;
+  }
+  CHIP_DATA(pnd)->pending.pbtRx = pbtRx;
+  CHIP_DATA(pnd)->pending.szRx = pbtRx ? szRx : 0;
+  return pn53x_submit(pnd, PN53X_PENDING_TRANSCEIVE_BYTES, txv, 2, -1);
+}
+
+int
+pn53x_target_submit_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen)
+{
+  uint8_t  abtCmd[1];
+  int res = 0;
+
+  if ((res = pn53x_submit_check(pnd)) < 0)
+    return res;
+  if ((res = pn53x_target_data_command(pnd, TgGetData, TgGetInitiatorCommand)) < 0)
+    return res;
+  abtCmd[0] = res;
+
+  const struct pn53x_iovec txv = { abtCmd, sizeof(abtCmd) };
+  CHIP_DATA(pnd)->pending.pbtRx = pbtRx;
+  CHIP_DATA(pnd)->pending.szRx = szRxLen;
+  return pn53x_submit(pnd, PN53X_PENDING_TARGET_RECEIVE_BYTES, &txv, 1, -1);
+}
+
+int
+pn53x_target_submit_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx)
+{
+  uint8_t  abtCmd[1];
+  int res = 0;
+
+  if ((res = pn53x_submit_check(pnd)) < 0)
+    return res;
+  // We can not just send bytes without parity if while the PN53X expects we handled them
+  if (!pnd->bPar)
+    return NFC_ECHIP;
+  if ((res = pn53x_target_data_command(pnd, TgSetData, TgResponseToInitiator)) < 0)
+    return res;
+  abtCmd[0] = res;
+
+  const struct pn53x_iovec txv[2] = {
+    { abtCmd, sizeof(abtCmd) },
+    { (uint8_t *) pbtTx, szTx },
+  };
+  CHIP_DATA(pnd)->pending.szTx = szTx;
+  return pn53x_submit(pnd, PN53X_PENDING_TARGET_SEND_BYTES, txv, 2, -1);
+}
+
+/*
+ * Finish the pending non-blocking operation, returns NFC_EAGAIN while its reply is not there yet.
+ * A cancellation raised by nfc_abort_command() is served by the driver's receive, which aborts the chip command.
+ */
+int
+pn53x_complete(struct nfc_device *pnd)
+{
+  struct pn53x_pending *pp = &CHIP_DATA(pnd)->pending;
+  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  const struct pn53x_iovec rxv = { abtRx, sizeof(abtRx) };
+  int res = 0;
+
+  if (pp->op == PN53X_PENDING_NONE) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if (!nfc_cancel_pending(&pnd->cancel) && (CHIP_DATA(pnd)->io->receive_ready(pnd) == 0)) {
+    pnd->last_error = NFC_EAGAIN;
+    return pnd->last_error;
+  }
+
+  const pn53x_pending_operation op = pp->op;
+  pp->op = PN53X_PENDING_NONE;
+  if ((res = pn53x_transceive_receive(pnd, &pp->exchange, &rxv, 1)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+
+  switch (op) {
+    case PN53X_PENDING_SELECT_PASSIVE_TARGET:
+      if ((res <= 1) || (abtRx[0] == 0))
+        return 0;
+      return pn53x_initiator_listed_target(pnd, pp->nm, abtRx, (size_t) res, pp->pnt);
+    case PN53X_PENDING_TRANSCEIVE_BYTES:
+    case PN53X_PENDING_TARGET_RECEIVE_BYTES:
+      // Skip the status byte
+      res = (res > 0) ? res - 1 : 0;
+      if ((pp->pbtRx != NULL) && ((size_t) res > pp->szRx)) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %d needed", pp->szRx, res);
+        pnd->last_error = NFC_EOVFLOW;
+        return pnd->last_error;
+      }
+      if (pp->pbtRx != NULL)
+        memcpy(pp->pbtRx, abtRx + 1, res);
+      return res;
+    case PN53X_PENDING_TARGET_SEND_BYTES:
+      return pp->szTx;
+    case PN53X_PENDING_NONE:
+      break;
+  }
+  return NFC_ESOFT;
+}
+
 static struct sErrorMessage {
   int     iErrorCode;
   const char *pcErrorMsg;
@@ -2818,16 +3658,17 @@ pn53x_PowerDown(struct nfc_device *pnd)
  * @note Selected targets count can be found in \a pbtTargetsData[0] if available (i.e. \a pszTargetsData content is more than 0)
  * @note To decode theses TargetData[n], there is @fn pn53x_decode_target_data
  */
-int
-pn53x_InListPassiveTarget(struct nfc_device *pnd,
-                          const pn53x_modulation pmInitModulation, const uint8_t szMaxTargets,
-                          const uint8_t *pbtInitiatorData, const size_t szInitiatorData,
-                          uint8_t *pbtTargetsData, size_t *pszTargetsData,
-                          int timeout)
+/*
+ * Build an InListPassiveTarget command into \a pbtCmd (15 bytes), returns its length or a libnfc error code
+ */
+static int
+pn53x_InListPassiveTarget_frame(struct nfc_device *pnd,
+                                const pn53x_modulation pmInitModulation, const uint8_t szMaxTargets,
+                                const uint8_t *pbtInitiatorData, const size_t szInitiatorData,
+                                uint8_t *pbtCmd)
 {
-  uint8_t  abtCmd[15] = { InListPassiveTarget };
-
-  abtCmd[1] = szMaxTargets;     // MaxTg
+  pbtCmd[0] = InListPassiveTarget;
+  pbtCmd[1] = szMaxTargets;     // MaxTg
 
   switch (pmInitModulation) {
     case PM_ISO14443A_106:
@@ -2863,13 +3704,27 @@ pn53x_InListPassiveTarget(struct nfc_device *pnd,
       pnd->last_error = NFC_EINVARG;
       return pnd->last_error;
   }
-  abtCmd[2] = pmInitModulation; // BrTy, the type of init modulation used for polling a passive tag
+  pbtCmd[2] = pmInitModulation; // BrTy, the type of init modulation used for polling a passive tag
 
   // Set the optional initiator data (used for Felica, ISO14443B, Topaz Polling or for ISO14443A selecting a specific UID).
   if (pbtInitiatorData)
-    memcpy(abtCmd + 3, pbtInitiatorData, szInitiatorData);
+    memcpy(pbtCmd + 3, pbtInitiatorData, szInitiatorData);
+  return 3 + szInitiatorData;
+}
+
+int
+pn53x_InListPassiveTarget(struct nfc_device *pnd,
+                          const pn53x_modulation pmInitModulation, const uint8_t szMaxTargets,
+                          const uint8_t *pbtInitiatorData, const size_t szInitiatorData,
+                          uint8_t *pbtTargetsData, size_t *pszTargetsData,
+                          int timeout)
+{
+  uint8_t  abtCmd[15];
   int res = 0;
-  if ((res = pn53x_transceive(pnd, abtCmd, 3 + szInitiatorData, pbtTargetsData, *pszTargetsData, timeout)) < 0) {
+
+  if ((res = pn53x_InListPassiveTarget_frame(pnd, pmInitModulation, szMaxTargets, pbtInitiatorData, szInitiatorData, abtCmd)) < 0)
+    return res;
+  if ((res = pn53x_transceive(pnd, abtCmd, res, pbtTargetsData, *pszTargetsData, timeout)) < 0) {
     return res;
   }
   *pszTargetsData = (size_t) res;
@@ -3192,6 +4047,22 @@ pn53x_check_error_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const
 int
 pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, const size_t szData)
 {
+  const struct pn53x_iovec iov = { (uint8_t *) pbtData, szData };
+  return pn53x_build_framev(pbtFrame, pszFrame, &iov, 1);
+}
+
+/**
+ * @brief Build a PN53x frame from a payload split over several segments
+ *
+ * Segments are copied once, straight into their final place in \a pbtFrame, and the data checksum is computed on the way.
+ * @note The first byte of the first segment is the Command Code (CC)
+ */
+int
+pn53x_build_framev(uint8_t *pbtFrame, size_t *pszFrame, const struct pn53x_iovec *iov, const size_t iovcnt)
+{
+  const size_t szData = pn53x_iov_len(iov, iovcnt);
+  size_t szHeader;
+
   if (szData <= PN53x_NORMAL_FRAME__DATA_MAX_LEN) {
     // LEN - Packet length = data length (len) + checksum (1) + end of stream marker (1)
     pbtFrame[3] = szData + 1;
@@ -3199,19 +4070,7 @@ pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, c
     pbtFrame[4] = 256 - (szData + 1);
     // TFI
     pbtFrame[5] = 0xD4;
-    // DATA - Copy the PN53X command into the packet buffer
-    memcpy(pbtFrame + 6, pbtData, szData);
-
-    // DCS - Calculate data payload checksum
-    uint8_t btDCS = (256 - 0xD4);
-    for (size_t szPos = 0; szPos < szData; szPos++) {
-      btDCS -= pbtData[szPos];
-    }
-    pbtFrame[6 + szData] = btDCS;
-
-    // 0x00 - End of stream marker
-    pbtFrame[szData + 7] = 0x00;
-
+    szHeader = 6;
     (*pszFrame) = szData + PN53x_NORMAL_FRAME__OVERHEAD;
   } else if (szData <= PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
     // Extended frame marker
@@ -3225,24 +4084,28 @@ pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, c
     pbtFrame[7] = 256 - ((pbtFrame[5] + pbtFrame[6]) & 0xff);
     // TFI
     pbtFrame[8] = 0xD4;
-    // DATA - Copy the PN53X command into the packet buffer
-    memcpy(pbtFrame + 9, pbtData, szData);
-
-    // DCS - Calculate data payload checksum
-    uint8_t btDCS = (256 - 0xD4);
-    for (size_t szPos = 0; szPos < szData; szPos++) {
-      btDCS -= pbtData[szPos];
-    }
-    pbtFrame[9 + szData] = btDCS;
-
-    // 0x00 - End of stream marker
-    pbtFrame[szData + 10] = 0x00;
-
+    szHeader = 9;
     (*pszFrame) = szData + PN53x_EXTENDED_FRAME__OVERHEAD;
   } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "We can't send more than %d bytes in a raw (requested: %" PRIdPTR ")", PN53x_EXTENDED_FRAME__DATA_MAX_LEN, szData);
     return NFC_ECHIP;
   }
+
+  // DATA - Copy the PN53X command into the packet buffer and calculate data payload checksum (DCS)
+  uint8_t *pbtPos = pbtFrame + szHeader;
+  uint8_t btDCS = (256 - 0xD4);
+  for (size_t i = 0; i < iovcnt; i++) {
+    memcpy(pbtPos, iov[i].pbtData, iov[i].szData);
+    for (size_t szPos = 0; szPos < iov[i].szData; szPos++) {
+      btDCS -= pbtPos[szPos];
+    }
+    pbtPos += iov[i].szData;
+  }
+  pbtPos[0] = btDCS;
+
+  // 0x00 - End of stream marker
+  pbtPos[1] = 0x00;
+
   return NFC_SUCCESS;
 }
 pn53x_modulation
@@ -3684,6 +4547,9 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
   CHIP_DATA(pnd)->wb_trigged = false;
   memset(CHIP_DATA(pnd)->wb_mask, 0x00, PN53X_CACHE_REGISTER_SIZE);
 
+  // Register shadow is not loaded yet
+  CHIP_DATA(pnd)->shadow_valid = 0;
+
   // Set default command timeout (350 ms)
   CHIP_DATA(pnd)->timeout_command = 350;
 
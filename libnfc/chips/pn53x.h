@@ -150,20 +150,89 @@ typedef enum {
   PSM_DUAL_CARD = 0x04
 } pn532_sam_mode;
 
+/**
+ * @internal
+ * @struct pn53x_iovec
+ * @brief Segment of a PN53x frame payload, used to gather a command or scatter a reply without intermediate copies
+ * @note Like POSIX struct iovec, the pointer is not const so the same type describes both directions; send paths never write through it.
+ */
+struct pn53x_iovec {
+  uint8_t *pbtData;
+  size_t szData;
+};
+
 /**
  * @internal
  * @struct pn53x_io
  * @brief PN53x I/O structure
+ *
+ * sendv and receivev are optional: when a driver leaves them NULL, pn53x_transceivev() flattens the segments and falls back to send and receive.
+ *
+ * get_pollfd and receive_ready are optional too, they are only needed by the non-blocking operations (see pn53x_complete()):
+ * get_pollfd returns a descriptor that becomes readable when the reply may have progressed, receive_ready returns 0 while
+ * the reply is not complete yet and any other value once receive will no more wait for the chip.
  */
 struct pn53x_io {
   int (*send)(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout);
   int (*receive)(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout);
+  int (*sendv)(struct nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, int timeout);
+  int (*receivev)(struct nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, int timeout);
+  int (*get_pollfd)(struct nfc_device *pnd);
+  int (*receive_ready)(struct nfc_device *pnd);
+};
+
+/**
+ * @internal
+ * @struct pn53x_exchange
+ * @brief Command sent to the PN53x whose reply has not been received yet
+ */
+struct pn53x_exchange {
+  /** Command code and first parameter */
+  uint8_t abtTxHead[2];
+  /** Command length */
+  size_t szTx;
+  /** Sending time, for the command statistics */
+  uint64_t start;
+  /** Timeout used to receive the reply */
+  int timeout;
+};
+
+/**
+ * @internal
+ * @enum pn53x_pending_operation
+ * @brief Non-blocking operation started by a submit function and not completed yet
+ */
+typedef enum {
+  PN53X_PENDING_NONE = 0,
+  PN53X_PENDING_SELECT_PASSIVE_TARGET,
+  PN53X_PENDING_TRANSCEIVE_BYTES,
+  PN53X_PENDING_TARGET_RECEIVE_BYTES,
+  PN53X_PENDING_TARGET_SEND_BYTES,
+} pn53x_pending_operation;
+
+/**
+ * @internal
+ * @struct pn53x_pending
+ * @brief State of a non-blocking operation, kept between its submit function and pn53x_complete()
+ */
+struct pn53x_pending {
+  pn53x_pending_operation op;
+  struct pn53x_exchange exchange;
+  /** Selected modulation and caller's target (select) */
+  nfc_modulation nm;
+  nfc_target *pnt;
+  /** Caller's reply buffer (transceive, target receive) */
+  uint8_t *pbtRx;
+  size_t szRx;
+  /** Sent bytes count (target send) */
+  size_t szTx;
 };
 
 /* defines */
 #define PN53X_CACHE_REGISTER_MIN_ADDRESS 	PN53X_REG_CIU_Mode
 #define PN53X_CACHE_REGISTER_MAX_ADDRESS 	PN53X_REG_CIU_Coll
 #define PN53X_CACHE_REGISTER_SIZE 		((PN53X_CACHE_REGISTER_MAX_ADDRESS - PN53X_CACHE_REGISTER_MIN_ADDRESS) + 1)
+#define PN53X_SHADOW_REGISTER_COUNT 		28
 
 /**
  * @internal
@@ -175,6 +244,9 @@ struct pn53x_data {
   pn53x_type type;
   /** Chip firmware text */
   char firmware_text[22];
+  /** GetFirmwareVersion answer the type and firmware text were decoded from */
+  uint8_t abtFirmware[4];
+  uint8_t szFirmware;
   /** Current power mode */
   pn53x_power_mode power_mode;
   /** Current operating mode */
@@ -201,6 +273,9 @@ struct pn53x_data {
   uint8_t wb_data[PN53X_CACHE_REGISTER_SIZE];
   uint8_t wb_mask[PN53X_CACHE_REGISTER_SIZE];
   bool wb_trigged;
+  /** Shadow of the configuration registers (see pn53x_shadow_registers), an entry is valid when its bit is set in shadow_valid */
+  uint8_t shadow_data[PN53X_SHADOW_REGISTER_COUNT];
+  uint32_t shadow_valid;
   /** Command timeout */
   int timeout_command;
   /** ATR timeout */
@@ -211,10 +286,30 @@ struct pn53x_data {
   nfc_modulation_type *supported_modulation_as_initiator;
   nfc_modulation_type *supported_modulation_as_target;
   bool progressive_field;
+  /** Non-blocking operation in progress */
+  struct pn53x_pending pending;
 };
 
 #define CHIP_DATA(pnd) ((struct pn53x_data*)(pnd->chip_data))
 
+/**
+ * @internal
+ * @struct pn53x_state
+ * @brief Chip state left by pn53x_init(), handed by a PN53x relay to the pn53x layer driving the chip through it
+ */
+struct pn53x_state {
+  /** GetFirmwareVersion answer */
+  uint8_t abtFirmware[4];
+  uint8_t szFirmware;
+  /** SetParameters cache */
+  uint8_t ui8Parameters;
+  /** Interframe timer correction */
+  int16_t timer_correction;
+  /** Register shadow */
+  uint32_t shadow_valid;
+  uint8_t shadow_data[PN53X_SHADOW_REGISTER_COUNT];
+};
+
 /**
  * @enum pn53x_modulation
  * @brief NFC modulation enumeration
@@ -303,6 +398,10 @@ extern const uint8_t pn53x_nack_frame[PN53x_ACK_FRAME__LEN];
 
 int    pn53x_init(struct nfc_device *pnd);
 int    pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout);
+int    pn53x_transceivev(struct nfc_device *pnd, const struct pn53x_iovec *txv, const size_t txcnt, const struct pn53x_iovec *rxv, const size_t rxcnt, int timeout);
+int    pn53x_relay(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+int    pn53x_state_export(struct nfc_device *pnd, struct pn53x_state *ps);
+int    pn53x_state_import(struct nfc_device *pnd, const struct pn53x_state *ps);
 
 int    pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Value, const bool bEnable);
 int    pn53x_set_tx_bits(struct nfc_device *pnd, const uint8_t ui8Bits);
@@ -312,10 +411,12 @@ int    pn53x_decode_target_data(const uint8_t *pbtRawData, size_t szRawData,
                                 pn53x_type chip_type, nfc_modulation_type nmt,
                                 nfc_target_info *pnti);
 int    pn53x_read_register(struct nfc_device *pnd, uint16_t ui16Reg, uint8_t *ui8Value);
+int    pn53x_shadow_resync(struct nfc_device *pnd);
 int    pn53x_write_register(struct nfc_device *pnd, uint16_t ui16Reg, uint8_t ui8SymbolMask, uint8_t ui8Value);
 int    pn53x_decode_firmware_version(struct nfc_device *pnd);
 int    pn53x_set_property_int(struct nfc_device *pnd, const nfc_property property, const int value);
 int    pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, const bool bEnable);
+int    pn53x_set_properties(struct nfc_device *pnd, const nfc_property_setting *settings, const size_t szSettings);
 
 int    pn53x_check_communication(struct nfc_device *pnd);
 int    pn53x_idle(struct nfc_device *pnd);
@@ -340,6 +441,7 @@ int    pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pb
                                        const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar);
 int    pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
                                         uint8_t *pbtRx, const size_t szRx, int timeout);
+int    pn53x_initiator_transceive_batch(struct nfc_device *pnd, nfc_transceive_op ops[], const size_t szOps, const int flags, int timeout);
 int    pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
                                              const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles);
 int    pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
@@ -354,6 +456,18 @@ int    pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const
 int    pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 int    pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
 
+// Non-blocking operations
+int    pn53x_get_pollfd(struct nfc_device *pnd);
+int    pn53x_initiator_submit_select_passive_target(struct nfc_device *pnd,
+                                                    const nfc_modulation nm,
+                                                    const uint8_t *pbtInitData, const size_t szInitData,
+                                                    nfc_target *pnt);
+int    pn53x_initiator_submit_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
+                                               uint8_t *pbtRx, const size_t szRx);
+int    pn53x_target_submit_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen);
+int    pn53x_target_submit_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx);
+int    pn53x_complete(struct nfc_device *pnd);
+
 // Error handling functions
 const char *pn53x_strerror(const struct nfc_device *pnd);
 
@@ -394,6 +508,10 @@ int    pn53x_RFConfiguration__MaxRetries(struct nfc_device *pnd, const uint8_t M
 int    pn53x_check_ack_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen);
 int    pn53x_check_error_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen);
 int    pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, const size_t szData);
+int    pn53x_build_framev(uint8_t *pbtFrame, size_t *pszFrame, const struct pn53x_iovec *iov, const size_t iovcnt);
+size_t pn53x_iov_len(const struct pn53x_iovec *iov, const size_t iovcnt);
+size_t pn53x_iov_gather(uint8_t *pbtDst, const size_t szDst, const struct pn53x_iovec *iov, const size_t iovcnt);
+size_t pn53x_iov_scatter(const struct pn53x_iovec *iov, const size_t iovcnt, size_t szOffset, const uint8_t *pbtSrc, const size_t szSrc);
 int    pn53x_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt);
 int    pn53x_get_supported_baud_rate(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
 int    pn53x_get_information_about(nfc_device *pnd, char **pbuf);
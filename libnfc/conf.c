@@ -33,10 +33,17 @@
 #ifdef CONFFILES
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <string.h>
+#include <time.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
@@ -56,72 +63,74 @@
 #define LIBNFC_CONFFILE        LIBNFC_SYSCONFDIR"/libnfc.conf"
 #define LIBNFC_DEVICECONFDIR   LIBNFC_SYSCONFDIR"/devices.d"
 
+struct conf_buffer {
+  uint8_t *data;
+  size_t   len;
+  size_t   alloc;
+};
+
+struct conf_loader {
+  nfc_context *context;
+  /** Should what is read be saved to the cache */
+  bool bRecord;
+  /** When the configuration started to be read */
+  time_t start;
+  uint32_t file_count;
+  uint32_t entry_count;
+  struct conf_buffer files;
+  struct conf_buffer entries;
+};
+
 static int
-escaped_value(const char line[BUFSIZ], int i, char **value)
+escaped_value(char line[BUFSIZ], int i, char **value)
 {
   if (line[i] != '"')
-    goto FAIL;
+    return -1;
   i++;
   if (line[i] == 0 || line[i] == '\n')
-    goto FAIL;
-  int c = 0;
-  while (line[i] && line[i] != '"') {
+    return -1;
+  const int start = i;
+  while (line[i] && line[i] != '"')
     i++;
-    c++;
-  }
   if (line[i] != '"')
-    goto FAIL;
-  *value = malloc(c + 1);
-  if (!*value)
-    goto FAIL;
-  memset(*value, 0, c + 1);
-  memcpy(*value, &line[i - c], c);
+    return -1;
+  const int end = i;
   i++;
   while (line[i] && isspace(line[i]))
     i++;
   if (line[i] != 0 && line[i] != '\n')
-    goto FAIL;
+    return -1;
+  line[end] = '\0';
+  *value = &line[start];
   return 0;
-
-FAIL:
-  free(*value);
-  *value = NULL;
-  return -1;
 }
 
 static int
-non_escaped_value(const char line[BUFSIZ], int i, char **value)
+non_escaped_value(char line[BUFSIZ], int i, char **value)
 {
-  int c = 0;
-  while (line[i] && !isspace(line[i])) {
+  const int start = i;
+  while (line[i] && !isspace(line[i]))
     i++;
-    c++;
-  }
-  *value = malloc(c + 1);
-  if (!*value)
-    goto FAIL;
-  memset(*value, 0, c + 1);
-  memcpy(*value, &line[i - c], c);
-  i++;
+  const int end = i;
   while (line[i] && isspace(line[i]))
     i++;
   if (line[i] != 0)
-    goto FAIL;
+    return -1;
+  line[end] = '\0';
+  *value = &line[start];
   return 0;
-
-FAIL:
-  free(*value);
-  *value = NULL;
-  return -1;
 }
 
+/*
+ * Split a configuration line in place: key and value point into line, which
+ * gets NUL terminators, so that parsing does not allocate.
+ */
 static int
-parse_line(const char line[BUFSIZ], char **key, char **value)
+parse_line(char line[BUFSIZ], char **key, char **value)
 {
   *key = NULL;
   *value = NULL;
   int i = 0;
-  int c = 0;
 
   // optional initial spaces
   while (isspace(line[i]))
@@ -130,17 +139,12 @@ parse_line(const char line[BUFSIZ], char **key, char **value)
     return -1;
 
   // key
-  while (isalnum(line[i]) || line[i] == '_' || line[i] == '.') {
+  const int key_start = i;
+  while (isalnum(line[i]) || line[i] == '_' || line[i] == '.')
     i++;
-    c++;
-  }
-  if (c == 0 || line[i] == 0 || line[i] == '\n') // key is empty
-    return -1;
-  *key = malloc(c + 1);
-  if (!*key)
+  const int key_end = i;
+  if (key_end == key_start || line[i] == 0 || line[i] == '\n') // key is empty
     return -1;
-  memset(*key, 0, c + 1);
-  memcpy(*key, &line[i - c], c);
 
   // space before '='
   while (isspace(line[i]))
@@ -155,29 +159,91 @@ parse_line(const char line[BUFSIZ], char **key, char **value)
     i++;
   if (line[i] == 0 || line[i] == '\n')
     return -1;
-  if (escaped_value(line, i, value) == 0)
-    return 0;
-  else if (non_escaped_value(line, i, value) == 0)
-    return 0;
+  if ((escaped_value(line, i, value) != 0) && (non_escaped_value(line, i, value) != 0))
+    return -1;
 
-  // Extracting key or value failed
-  free(*key);
-  *key = NULL;
-  free(*value);
-  *value = NULL;
-  return -1;
+  // The value starts after '=', terminating the key does not alter it
+  line[key_end] = '\0';
+  *key = &line[key_start];
+  return 0;
+}
+
+static bool
+conf_buffer_append(struct conf_buffer *b, const void *data, size_t len)
+{
+  if (b->len + len > b->alloc) {
+    size_t alloc = b->alloc ? b->alloc : 1024;
+    while (alloc < b->len + len)
+      alloc *= 2;
+    uint8_t *p = realloc(b->data, alloc);
+    if (!p)
+      return false;
+    b->data = p;
+    b->alloc = alloc;
+  }
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+  return true;
+}
+
+/*
+ * Remember the attributes of a file the configuration depends on, st is NULL
+ * when it does not exist.
+ */
+static void
+conf_record_file(struct conf_loader *loader, const char *path, const struct stat *st)
+{
+  if (!loader->bRecord)
+    return;
+  struct conf_cache_file file = {
+    .mtime = st ? (int64_t) st->st_mtime : -1,
+    .ctime = st ? (int64_t) st->st_ctime : -1,
+    .size = st ? (int64_t) st->st_size : -1,
+    .ino = st ? (int64_t) st->st_ino : -1,
+    .path_len = strlen(path) + 1,
+  };
+  // A file changed during the second the configuration was read could
+  // change again without its timestamps telling: do not cache it
+  if (st && ((st->st_mtime >= loader->start) || (st->st_ctime >= loader->start)))
+    loader->bRecord = false;
+  if (!conf_buffer_append(&loader->files, &file, sizeof(file)) ||
+      !conf_buffer_append(&loader->files, path, file.path_len))
+    loader->bRecord = false;
+  loader->file_count++;
 }
 
 static void
-conf_parse_file(const char *filename,
-                void (*conf_keyvalue)(void *data, const char *key, const char *value),
-                void *data)
+conf_record_entry(struct conf_loader *loader, const char *key, const char *value)
+{
+  if (!loader->bRecord)
+    return;
+  struct conf_cache_entry entry = {
+    .key_len = strlen(key) + 1,
+    .value_len = strlen(value) + 1,
+  };
+  if (!conf_buffer_append(&loader->entries, &entry, sizeof(entry)) ||
+      !conf_buffer_append(&loader->entries, key, entry.key_len) ||
+      !conf_buffer_append(&loader->entries, value, entry.value_len))
+    loader->bRecord = false;
+  loader->entry_count++;
+}
+
+static void
+conf_parse_file(struct conf_loader *loader, const char *filename,
+                void (*conf_keyvalue)(struct conf_loader *loader, const char *key, const char *value))
 {
   FILE *f = fopen(filename, "r");
   if (!f) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unable to open file: %s", filename);
+    conf_record_file(loader, filename, NULL);
     return;
   }
+  struct stat st;
+  if (fstat(fileno(f), &st) == 0) {
+    conf_record_file(loader, filename, &st);
+  } else {
+    loader->bRecord = false;
+  }
   char line[BUFSIZ];
 
   int lineno = 0;
@@ -191,9 +257,7 @@ conf_parse_file(const char *filename,
         char *key;
         char *value;
         if (parse_line(line, &key, &value) == 0) {
-          conf_keyvalue(data, key, value);
-          free(key);
-          free(value);
+          conf_keyvalue(loader, key, value);
         } else {
           log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Parse error on line #%d: %s", lineno, line);
         }
@@ -204,10 +268,26 @@ conf_parse_file(const char *filename,
   return;
 }
 
+/*
+ * Entry of the user defined device a key applies to: the last one, or a new
+ * one when bNew.
+ */
+static struct nfc_user_defined_device *
+conf_device(nfc_context *context, bool bNew)
+{
+  if (!bNew)
+    return &context->user_defined_devices[context->user_defined_device_count - 1];
+  struct nfc_user_defined_device *udd = nfc_context_add_user_defined_device(context);
+  if (!udd)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to allocate user-defined device.");
+  return udd;
+}
+
 static void
-conf_keyvalue_context(void *data, const char *key, const char *value)
+conf_keyvalue_apply(nfc_context *context, const char *key, const char *value)
 {
-  nfc_context *context = (nfc_context *)data;
+  struct nfc_user_defined_device *udd;
+
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "key: [%s], value: [%s]", key, value);
   if (strcmp(key, "allow_autoscan") == 0) {
     string_as_boolean(value, &(context->allow_autoscan));
@@ -216,51 +296,46 @@ conf_keyvalue_context(void *data, const char *key, const char *value)
   } else if (strcmp(key, "log_level") == 0) {
     context->log_level = atoi(value);
   } else if (strcmp(key, "device.name") == 0) {
-    if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].name, "") != 0) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    strncpy(context->user_defined_devices[context->user_defined_device_count - 1].name, value, DEVICE_NAME_LENGTH - 1);
-    context->user_defined_devices[context->user_defined_device_count - 1].name[DEVICE_NAME_LENGTH - 1] = '\0';
+    if (!(udd = conf_device(context, (context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].name, "") != 0)))
+      return;
+    strncpy(udd->name, value, DEVICE_NAME_LENGTH - 1);
+    udd->name[DEVICE_NAME_LENGTH - 1] = '\0';
   } else if (strcmp(key, "device.connstring") == 0) {
-    if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].connstring, "") != 0) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    strncpy(context->user_defined_devices[context->user_defined_device_count - 1].connstring, value, NFC_BUFSIZE_CONNSTRING - 1);
-    context->user_defined_devices[context->user_defined_device_count - 1].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
+    if (!(udd = conf_device(context, (context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].connstring, "") != 0)))
+      return;
+    strncpy(udd->connstring, value, NFC_BUFSIZE_CONNSTRING - 1);
+    udd->connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
   } else if (strcmp(key, "device.optional") == 0) {
-    if ((context->user_defined_device_count == 0) || context->user_defined_devices[context->user_defined_device_count - 1].optional) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
+    if (!(udd = conf_device(context, (context->user_defined_device_count == 0) || context->user_defined_devices[context->user_defined_device_count - 1].optional)))
+      return;
     if ((strcmp(value, "true") == 0) || (strcmp(value, "True") == 0) || (strcmp(value, "1") == 0)) //optional
-      context->user_defined_devices[context->user_defined_device_count - 1].optional = true;
+      udd->optional = true;
   } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unknown key in config line: %s = %s", key, value);
   }
 }
 
 static void
-conf_keyvalue_device(void *data, const char *key, const char *value)
+conf_keyvalue_context(struct conf_loader *loader, const char *key, const char *value)
+{
+  conf_record_entry(loader, key, value);
+  conf_keyvalue_apply(loader->context, key, value);
+}
+
+static void
+conf_keyvalue_device(struct conf_loader *loader, const char *key, const char *value)
 {
   char newkey[BUFSIZ];
-  sprintf(newkey, "device.%s", key);
-  conf_keyvalue_context(data, newkey, value);
+  snprintf(newkey, sizeof(newkey), "device.%s", key);
+  conf_keyvalue_context(loader, newkey, value);
 }
 
 static void
-conf_devices_load(const char *dirname, nfc_context *context)
+conf_devices_load(struct conf_loader *loader, const char *dirname)
 {
+  struct stat ds;
+  // Adding, removing or renaming a file changes the directory timestamps
+  conf_record_file(loader, dirname, (stat(dirname, &ds) == 0) ? &ds : NULL);
   DIR *d = opendir(dirname);
   if (!d) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open directory: %s", dirname);
@@ -281,7 +356,7 @@ conf_devices_load(const char *dirname, nfc_context *context)
             continue;
           }
           if (S_ISREG(s.st_mode)) {
-            conf_parse_file(filename, conf_keyvalue_device, context);
+            conf_parse_file(loader, filename, conf_keyvalue_device);
           }
         }
       }
@@ -290,12 +365,190 @@ conf_devices_load(const char *dirname, nfc_context *context)
   }
 }
 
+#ifndef _WIN32
+static bool
+conf_cache_dir(char dir[BUFSIZ], bool bCreate)
+{
+  const char *pcXdg = getenv("XDG_CACHE_HOME");
+  const char *pcHome = getenv("HOME");
+
+  // Do not let a privileged program trust the cache of its caller
+  if (getuid() != geteuid())
+    return false;
+  if (pcXdg && pcXdg[0]) {
+    snprintf(dir, BUFSIZ, "%s", pcXdg);
+  } else if (pcHome && pcHome[0]) {
+    snprintf(dir, BUFSIZ, "%s/.cache", pcHome);
+  } else {
+    return false;
+  }
+  if (bCreate)
+    mkdir(dir, 0700);
+  if (strlen(dir) + strlen("/libnfc/"CONF_CACHE_FILE".XXXXXX") >= BUFSIZ)
+    return false;
+  strcat(dir, "/libnfc");
+  if (bCreate)
+    mkdir(dir, 0700);
+  return true;
+}
+
+/*
+ * Check that the cached file attributes at p still match, or return NULL.
+ * Return the first byte after the file records otherwise.
+ */
+static const uint8_t *
+conf_cache_check_files(const uint8_t *p, const uint8_t *end, uint32_t file_count)
+{
+  for (uint32_t i = 0; i < file_count; i++) {
+    struct conf_cache_file file;
+    if ((size_t)(end - p) < sizeof(file))
+      return NULL;
+    memcpy(&file, p, sizeof(file));
+    p += sizeof(file);
+    if ((file.path_len == 0) || ((size_t)(end - p) < file.path_len) || (p[file.path_len - 1] != '\0'))
+      return NULL;
+    const char *path = (const char *) p;
+    p += file.path_len;
+    // The cache must describe this build's configuration
+    if ((i == 0) && (strcmp(path, LIBNFC_CONFFILE) != 0))
+      return NULL;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+      if (file.size != -1)
+        return NULL;
+    } else if ((file.mtime != (int64_t) st.st_mtime) || (file.ctime != (int64_t) st.st_ctime) ||
+               (file.size != (int64_t) st.st_size) || (file.ino != (int64_t) st.st_ino)) {
+      return NULL;
+    }
+  }
+  return p;
+}
+
+/*
+ * Check that the cached entries at p are well formed, so that they are only
+ * applied once all of them are known to be valid.
+ */
+static bool
+conf_cache_check_entries(const uint8_t *p, const uint8_t *end, uint32_t entry_count)
+{
+  for (uint32_t i = 0; i < entry_count; i++) {
+    struct conf_cache_entry entry;
+    if ((size_t)(end - p) < sizeof(entry))
+      return false;
+    memcpy(&entry, p, sizeof(entry));
+    p += sizeof(entry);
+    if ((entry.key_len == 0) || (entry.value_len == 0) ||
+        ((size_t)(end - p) < (size_t) entry.key_len + entry.value_len) ||
+        (p[entry.key_len - 1] != '\0') || (p[entry.key_len + entry.value_len - 1] != '\0'))
+      return false;
+    p += entry.key_len + entry.value_len;
+  }
+  return p == end;
+}
+
+static bool
+conf_cache_load(nfc_context *context)
+{
+  char path[BUFSIZ];
+  struct stat st;
+  bool bLoaded = false;
+
+  if (!conf_cache_dir(path, false))
+    return false;
+  strcat(path, "/"CONF_CACHE_FILE);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_uid != geteuid()) ||
+      (st.st_size < (off_t) sizeof(struct conf_cache_header)) || (st.st_size > UINT32_MAX)) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const uint8_t *p = map;
+  const uint8_t *end = p + st.st_size;
+  struct conf_cache_header header;
+  memcpy(&header, p, sizeof(header));
+  if ((memcmp(header.magic, CONF_CACHE_MAGIC, sizeof(header.magic)) == 0) &&
+      (header.version == CONF_CACHE_VERSION) && (header.size == (uint32_t) st.st_size)) {
+    const uint8_t *entries = conf_cache_check_files(p + sizeof(header), end, header.file_count);
+    if (entries && conf_cache_check_entries(entries, end, header.entry_count)) {
+      p = entries;
+      for (uint32_t i = 0; i < header.entry_count; i++) {
+        struct conf_cache_entry entry;
+        memcpy(&entry, p, sizeof(entry));
+        p += sizeof(entry);
+        conf_keyvalue_apply(context, (const char *) p, (const char *)(p + entry.key_len));
+        p += entry.key_len + entry.value_len;
+      }
+      bLoaded = true;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Configuration loaded from %s", path);
+    }
+  }
+  munmap(map, st.st_size);
+  return bLoaded;
+}
+
+static void
+conf_cache_save(const struct conf_loader *loader)
+{
+  char path[BUFSIZ];
+  char tmp[BUFSIZ];
+
+  if (!conf_cache_dir(path, true))
+    return;
+  strcat(path, "/"CONF_CACHE_FILE);
+  // conf_cache_dir() left room for the suffix
+  strcpy(tmp, path);
+  strcat(tmp, ".XXXXXX");
+
+  struct conf_cache_header header = {
+    .magic = CONF_CACHE_MAGIC,
+    .version = CONF_CACHE_VERSION,
+    .size = sizeof(header) + loader->files.len + loader->entries.len,
+    .file_count = loader->file_count,
+    .entry_count = loader->entry_count,
+  };
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to create %s", tmp);
+    return;
+  }
+  bool bWritten = (write(fd, &header, sizeof(header)) == (ssize_t) sizeof(header)) &&
+                  (write(fd, loader->files.data, loader->files.len) == (ssize_t) loader->files.len) &&
+                  (write(fd, loader->entries.data, loader->entries.len) == (ssize_t) loader->entries.len);
+  if ((close(fd) != 0) || !bWritten || (rename(tmp, path) != 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to write %s", path);
+    unlink(tmp);
+  }
+}
+#endif // _WIN32
+
 void
 conf_load(nfc_context *context)
 {
-  conf_parse_file(LIBNFC_CONFFILE, conf_keyvalue_context, context);
-  conf_devices_load(LIBNFC_DEVICECONFDIR, context);
+  struct conf_loader loader;
+
+  memset(&loader, 0x00, sizeof(loader));
+  loader.context = context;
+#ifndef _WIN32
+  if (conf_cache_load(context))
+    return;
+  loader.bRecord = true;
+  loader.start = time(NULL);
+#endif // _WIN32
+  conf_parse_file(&loader, LIBNFC_CONFFILE, conf_keyvalue_context);
+  conf_devices_load(&loader, LIBNFC_DEVICECONFDIR);
+#ifndef _WIN32
+  if (loader.bRecord)
+    conf_cache_save(&loader);
+#endif // _WIN32
+  free(loader.files.data);
+  free(loader.entries.data);
 }
 
 #endif // CONFFILES
-
@@ -26,8 +26,51 @@
 #ifndef __NFC_CONF_H__
 #define __NFC_CONF_H__
 
+#include <stdint.h>
+
 #include <nfc/nfc-types.h>
 
+/*
+ * Parsed configuration cache
+ *
+ * The key/value pairs read from libnfc.conf and devices.d are saved, in the
+ * order they were read, to a per-user cache file (conf.cache in
+ * $XDG_CACHE_HOME/libnfc or ~/.cache/libnfc) along with the attributes of
+ * every file and directory they come from. As long as none of these changed,
+ * conf_load() maps the cache and replays its pairs instead of parsing the
+ * configuration files again.
+ *
+ * Layout, in host byte order: a conf_cache_header, then file_count
+ * conf_cache_file records each followed by its NUL terminated path, then
+ * entry_count conf_cache_entry records each followed by its NUL terminated
+ * key and value.
+ */
+#define CONF_CACHE_MAGIC    "libnfcC"
+#define CONF_CACHE_VERSION  1
+#define CONF_CACHE_FILE     "conf.cache"
+
+struct conf_cache_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t size;
+  uint32_t file_count;
+  uint32_t entry_count;
+};
+
+struct conf_cache_file {
+  /** Attributes of the file, all -1 when it did not exist */
+  int64_t  mtime;
+  int64_t  ctime;
+  int64_t  size;
+  int64_t  ino;
+  uint32_t path_len;
+};
+
+struct conf_cache_entry {
+  uint16_t key_len;
+  uint16_t value_len;
+};
+
 void conf_load(nfc_context *context);
 
 #endif // __NFC_CONF_H__
@@ -34,6 +34,7 @@
 
 #include <nfc/nfc-types.h>
 
-extern const struct nfc_driver_list *nfc_drivers;
+// Registered drivers are reached through nfc_context.drivers, see nfc_init()
+struct nfc_driver_list;
 
 #endif // __NFC_DRIVERS_H__
@@ -103,40 +103,18 @@ const char *supported_devices[] = {
 };
 
 struct acr122_pcsc_data {
+  // Each device has its own PC/SC context, so devices can be used from different threads
+  SCARDCONTEXT hContext;
+  bool bContext;
   SCARDHANDLE hCard;
   SCARD_IO_REQUEST ioCard;
   uint8_t  abtRx[ACR122_PCSC_RESPONSE_LEN];
   size_t  szRx;
+  char    acFirmware[11];
 };
 
 #define DRIVER_DATA(pnd) ((struct acr122_pcsc_data*)(pnd->driver_data))
 
-static SCARDCONTEXT _SCardContext;
-static int _iSCardContextRefCount = 0;
-
-static SCARDCONTEXT *
-acr122_pcsc_get_scardcontext(void)
-{
-  if (_iSCardContextRefCount == 0) {
-    if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &_SCardContext) != SCARD_S_SUCCESS)
-      return NULL;
-  }
-  _iSCardContextRefCount++;
-
-  return &_SCardContext;
-}
-
-static void
-acr122_pcsc_free_scardcontext(void)
-{
-  if (_iSCardContextRefCount) {
-    _iSCardContextRefCount--;
-    if (!_iSCardContextRefCount) {
-      SCardReleaseContext(_SCardContext);
-    }
-  }
-}
-
 #define PCSC_MAX_DEVICES 16
 /**
  * @brief List opened devices
@@ -154,21 +132,23 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
   size_t  szPos = 0;
   char    acDeviceNames[256 + 64 * PCSC_MAX_DEVICES];
   size_t  szDeviceNamesLen = sizeof(acDeviceNames);
-  SCARDCONTEXT *pscc;
+  SCARDCONTEXT scc;
   int     i;
 
   // Clear the reader list
   memset(acDeviceNames, '\0', szDeviceNamesLen);
 
   // Test if context succeeded
-  if (!(pscc = acr122_pcsc_get_scardcontext())) {
+  if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &scc) != SCARD_S_SUCCESS) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: %s", "PCSC context not found (make sure PCSC daemon is running).");
     return 0;
   }
   // Retrieve the string array of all available pcsc readers
   DWORD dwDeviceNamesLen = szDeviceNamesLen;
-  if (SCardListReaders(*pscc, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS)
+  if (SCardListReaders(scc, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS) {
+    SCardReleaseContext(scc);
     return 0;
+  }
 
   size_t device_found = 0;
   while ((acDeviceNames[szPos] != '\0') && (device_found < connstrings_len)) {
@@ -189,7 +169,7 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
     // Find next device name position
     while (acDeviceNames[szPos++] != '\0');
   }
-  acr122_pcsc_free_scardcontext();
+  SCardReleaseContext(scc);
 
   return device_found;
 }
@@ -257,7 +237,7 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     perror("malloc");
     goto error;
   }
-  pnd->driver_data = malloc(sizeof(struct acr122_pcsc_data));
+  pnd->driver_data = calloc(1, sizeof(struct acr122_pcsc_data));
   if (!pnd->driver_data) {
     perror("malloc");
     goto error;
@@ -269,16 +249,15 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     goto error;
   }
 
-  SCARDCONTEXT *pscc;
-
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open %s", ndd.pcsc_device_name);
   // Test if context succeeded
-  if (!(pscc = acr122_pcsc_get_scardcontext()))
+  if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &(DRIVER_DATA(pnd)->hContext)) != SCARD_S_SUCCESS)
     goto error;
+  DRIVER_DATA(pnd)->bContext = true;
   // Test if we were able to connect to the "emulator" card
-  if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
+  if (SCardConnect(DRIVER_DATA(pnd)->hContext, ndd.pcsc_device_name, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
     // Connect to ACR122 firmware version >2.0
-    if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_DIRECT, 0, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
+    if (SCardConnect(DRIVER_DATA(pnd)->hContext, ndd.pcsc_device_name, SCARD_SHARE_DIRECT, 0, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
       // We can not connect to this device.
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PCSC connect failed");
       goto error;
@@ -308,6 +287,8 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
 
 error:
   free(ndd.pcsc_device_name);
+  if (pnd && pnd->driver_data && DRIVER_DATA(pnd)->bContext)
+    SCardReleaseContext(DRIVER_DATA(pnd)->hContext);
   nfc_device_free(pnd);
   return NULL;
 }
@@ -318,7 +299,7 @@ acr122_pcsc_close(nfc_device *pnd)
   pn53x_idle(pnd);
 
   SCardDisconnect(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
-  acr122_pcsc_free_scardcontext();
+  SCardReleaseContext(DRIVER_DATA(pnd)->hContext);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -439,9 +420,9 @@ acr122_pcsc_firmware(nfc_device *pnd)
   uint8_t  abtGetFw[5] = { 0xFF, 0x00, 0x48, 0x00, 0x00 };
   uint32_t uiResult;
 
-  static char abtFw[11];
-  DWORD dwFwLen = sizeof(abtFw);
-  memset(abtFw, 0x00, sizeof(abtFw));
+  char   *abtFw = DRIVER_DATA(pnd)->acFirmware;
+  DWORD dwFwLen = sizeof(DRIVER_DATA(pnd)->acFirmware);
+  memset(abtFw, 0x00, dwFwLen);
   if (DRIVER_DATA(pnd)->ioCard.dwProtocol == SCARD_PROTOCOL_UNDEFINED) {
     uiResult = SCardControl(DRIVER_DATA(pnd)->hCard, IOCTL_CCID_ESCAPE_SCARD_CTL_CODE, abtGetFw, sizeof(abtGetFw), (uint8_t *) abtFw, dwFwLen - 1, &dwFwLen);
   } else {
@@ -490,6 +471,7 @@ const struct nfc_driver acr122_pcsc_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -502,6 +484,7 @@ const struct nfc_driver acr122_pcsc_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
@@ -74,8 +74,6 @@ Thanks to d18c7db and Okko for example code
 #define LOG_GROUP     NFC_LOG_GROUP_DRIVER
 #define LOG_CATEGORY "libnfc.driver.acr122_usb"
 
-#define USB_INFINITE_TIMEOUT   0
-
 #define DRIVER_DATA(pnd) ((struct acr122_usb_data*)(pnd->driver_data))
 
 /*
@@ -172,11 +170,10 @@ struct acr122_usb_apdu_frame {
 
 // Internal data struct
 struct acr122_usb_data {
-  usb_dev_handle *pudh;
+  usbbus_handle *pudh;
   uint32_t uiEndPointIn;
   uint32_t uiEndPointOut;
   uint32_t uiMaxPacketSize;
-  volatile bool abort_flag;
   // Keep some buffers to reduce memcpy() usage
   struct acr122_usb_tama_frame tama_frame;
   struct acr122_usb_apdu_frame apdu_frame;
@@ -216,18 +213,11 @@ static int acr122_usb_send_apdu(nfc_device *pnd,
                                 uint8_t *out, const size_t out_size);
 
 static int
-acr122_usb_bulk_read(struct acr122_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
+acr122_usb_bulk_read(struct acr122_usb_data *data, uint8_t abtRx[], const size_t szRx, struct nfc_cancel *cancel, const int timeout)
 {
-  int res = usb_bulk_read(data->pudh, data->uiEndPointIn, (char *) abtRx, szRx, timeout);
+  int res = usbbus_bulk_read(data->pudh, data->uiEndPointIn, abtRx, szRx, cancel, timeout);
   if (res > 0) {
     LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, res);
-  } else if (res < 0) {
-    if (res != -USB_TIMEDOUT) {
-      res = NFC_EIO;
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", _usb_strerror(res));
-    } else {
-      res = NFC_ETIMEOUT;
-    }
   }
   return res;
 }
@@ -236,18 +226,11 @@ static int
 acr122_usb_bulk_write(struct acr122_usb_data *data, uint8_t abtTx[], const size_t szTx, const int timeout)
 {
   LOG_HEX(NFC_LOG_GROUP_COM, "TX", abtTx, szTx);
-  int res = usb_bulk_write(data->pudh, data->uiEndPointOut, (char *) abtTx, szTx, timeout);
+  int res = usbbus_bulk_write(data->pudh, data->uiEndPointOut, abtTx, szTx, timeout);
   if (res > 0) {
     // HACK This little hack is a well know problem of USB, see http://www.libusb.org/ticket/6 for more details
     if ((res % data->uiMaxPacketSize) == 0) {
-      usb_bulk_write(data->pudh, data->uiEndPointOut, "\0", 0, timeout);
-    }
-  } else if (res < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", _usb_strerror(res));
-    if (res == -USB_TIMEDOUT) {
-      res = NFC_ETIMEOUT;
-    } else {
-      res = NFC_EIO;
+      usbbus_bulk_write(data->pudh, data->uiEndPointOut, (const uint8_t *) "\0", 0, timeout);
     }
   }
   return res;
@@ -265,34 +248,13 @@ const struct acr122_usb_supported_device acr122_usb_supported_devices[] = {
   { 0x072F, 0x2214, "ACS ACR1222" },
 };
 
-// Find transfer endpoints for bulk transfers
+// Bulk transfer endpoints, as found by usbbus_list_devices()
 static void
-acr122_usb_get_end_points(struct usb_device *dev, struct acr122_usb_data *data)
+acr122_usb_get_end_points(const struct usbbus_device *dev, struct acr122_usb_data *data)
 {
-  uint32_t uiIndex;
-  uint32_t uiEndPoint;
-  struct usb_interface_descriptor *puid = dev->config->interface->altsetting;
-
-  // 3 Endpoints maximum: Interrupt In, Bulk In, Bulk Out
-  for (uiIndex = 0; uiIndex < puid->bNumEndpoints; uiIndex++) {
-    // Only accept bulk transfer endpoints (ignore interrupt endpoints)
-    if (puid->endpoint[uiIndex].bmAttributes != USB_ENDPOINT_TYPE_BULK)
-      continue;
-
-    // Copy the endpoint to a local var, makes it more readable code
-    uiEndPoint = puid->endpoint[uiIndex].bEndpointAddress;
-
-    // Test if we dealing with a bulk IN endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_IN) {
-      data->uiEndPointIn = uiEndPoint;
-      data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
-    }
-    // Test if we dealing with a bulk OUT endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_OUT) {
-      data->uiEndPointOut = uiEndPoint;
-      data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
-    }
-  }
+  data->uiEndPointIn = dev->uiEndPointIn;
+  data->uiEndPointOut = dev->uiEndPointOut;
+  data->uiMaxPacketSize = dev->uiMaxPacketSize;
 }
 
 static size_t
@@ -300,47 +262,38 @@ acr122_usb_scan(const nfc_context *context, nfc_connstring connstrings[], const
 {
   (void)context;
 
-  usb_prepare();
+  if (usbbus_prepare() < 0)
+    return 0;
 
   size_t device_found = 0;
-  uint32_t uiBusIndex = 0;
-  struct usb_bus *bus;
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
-    struct usb_device *dev;
-
-    for (dev = bus->devices; dev; dev = dev->next, uiBusIndex++) {
-      for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
-        if ((acr122_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-            (acr122_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
-          // Make sure there are 2 endpoints available
-          // with libusb-win32 we got some null pointers so be robust before looking at endpoints:
-          if (dev->config == NULL || dev->config->interface == NULL || dev->config->interface->altsetting == NULL) {
-            // Nope, we maybe want the next one, let's try to find another
-            continue;
-          }
-          if (dev->config->interface->altsetting->bNumEndpoints < 2) {
-            // Nope, we maybe want the next one, let's try to find another
-            continue;
-          }
-
-          usb_dev_handle *udev = usb_open(dev);
-          if (udev == NULL)
-            continue;
-
-          // Set configuration
-          // acr122_usb_get_usb_device_name (dev, udev, pnddDevices[device_found].acDevice, sizeof (pnddDevices[device_found].acDevice));
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s Name %s", bus->dirname, dev->filename, acr122_usb_supported_devices[n].name);
-          usb_close(udev);
-          snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", ACR122_USB_DRIVER_NAME, bus->dirname, dev->filename);
-          device_found++;
-          // Test if we reach the maximum "wanted" devices
-          if (device_found == connstrings_len) {
-            return device_found;
-          }
+  struct usbbus_device *devices;
+  const size_t szDevices = usbbus_list_devices(&devices);
+  for (size_t i = 0; (i < szDevices) && (device_found < connstrings_len); i++) {
+    const struct usbbus_device *dev = &devices[i];
+
+    for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
+      if ((acr122_usb_supported_devices[n].vendor_id == dev->idVendor) &&
+          (acr122_usb_supported_devices[n].product_id == dev->idProduct)) {
+        // Make sure there are 2 endpoints available
+        if (!dev->bHasConfig || (dev->bNumEndpoints < 2)) {
+          // Nope, we maybe want the next one, let's try to find another
+          continue;
         }
+
+        // Check device can be opened, usbbus remembers it while the device stays plugged
+        if (usbbus_check_device(dev, 0) < 0)
+          continue;
+
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s Name %s", dev->dirname, dev->filename, acr122_usb_supported_devices[n].name);
+        snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", ACR122_USB_DRIVER_NAME, dev->dirname, dev->filename);
+        device_found++;
+        // Test if we reach the maximum "wanted" devices
+        if (device_found == connstrings_len)
+          break;
       }
     }
   }
+  usbbus_free_devices(devices, szDevices);
 
   return device_found;
 }
@@ -351,23 +304,23 @@ struct acr122_usb_descriptor {
 };
 
 static bool
-acr122_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char *buffer, size_t len)
+acr122_usb_get_usb_device_name(const struct usbbus_device *dev, usbbus_handle *udev, char *buffer, size_t len)
 {
   *buffer = '\0';
 
-  if (dev->descriptor.iManufacturer || dev->descriptor.iProduct) {
+  if (dev->iManufacturer || dev->iProduct) {
     if (udev) {
-      usb_get_string_simple(udev, dev->descriptor.iManufacturer, buffer, len);
+      usbbus_get_string(udev, dev->iManufacturer, buffer, len);
       if (strlen(buffer) > 0)
         strcpy(buffer + strlen(buffer), " / ");
-      usb_get_string_simple(udev, dev->descriptor.iProduct, buffer + strlen(buffer), len - strlen(buffer));
+      usbbus_get_string(udev, dev->iProduct, buffer + strlen(buffer), len - strlen(buffer));
     }
   }
 
   if (!*buffer) {
     for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
-      if ((acr122_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-          (acr122_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
+      if ((acr122_usb_supported_devices[n].vendor_id == dev->idVendor) &&
+          (acr122_usb_supported_devices[n].product_id == dev->idProduct)) {
         strncpy(buffer, acr122_usb_supported_devices[n].name, len);
         buffer[len - 1] = '\0';
         return true;
@@ -382,6 +335,8 @@ static nfc_device *
 acr122_usb_open(const nfc_context *context, const nfc_connstring connstring)
 {
   nfc_device *pnd = NULL;
+  struct usbbus_device *devices = NULL;
+  size_t szDevices = 0;
   struct acr122_usb_descriptor desc = { NULL, NULL };
   int connstring_decode_level = connstring_decode(connstring, ACR122_USB_DRIVER_NAME, "usb", &desc.dirname, &desc.filename);
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d element(s) have been decoded from \"%s\"", connstring_decode_level, connstring);
@@ -394,80 +349,76 @@ acr122_usb_open(const nfc_context *context, const nfc_connstring connstring)
     .uiEndPointIn = 0,
     .uiEndPointOut = 0,
   };
-  struct usb_bus *bus;
-  struct usb_device *dev;
 
-  usb_prepare();
+  if (usbbus_prepare() < 0)
+    goto free_mem;
 
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
+  szDevices = usbbus_list_devices(&devices);
+  for (size_t i = 0; i < szDevices; i++) {
+    const struct usbbus_device *dev = &devices[i];
     if (connstring_decode_level > 1)  {
       // A specific bus have been specified
-      if (0 != strcmp(bus->dirname, desc.dirname))
+      if (0 != strcmp(dev->dirname, desc.dirname))
         continue;
     }
-    for (dev = bus->devices; dev; dev = dev->next) {
-      if (connstring_decode_level > 2)  {
-        // A specific dev have been specified
-        if (0 != strcmp(dev->filename, desc.filename))
-          continue;
-      }
-      // Open the USB device
-      if ((data.pudh = usb_open(dev)) == NULL)
+    if (connstring_decode_level > 2)  {
+      // A specific dev have been specified
+      if (0 != strcmp(dev->filename, desc.filename))
         continue;
-      // Reset device
-      usb_reset(data.pudh);
-      // Retrieve end points
-      acr122_usb_get_end_points(dev, &data);
-      // Claim interface
-      int res = usb_claim_interface(data.pudh, 0);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", _usb_strerror(res));
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
+    }
+    // Open the USB device
+    if ((data.pudh = usbbus_open(dev)) == NULL)
+      continue;
+    // Reset device
+    usbbus_reset(data.pudh);
+    // Retrieve end points
+    acr122_usb_get_end_points(dev, &data);
+    // Claim interface
+    int res = usbbus_claim_interface(data.pudh, 0);
+    if (res < 0) {
+      usbbus_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
 
-      res = usb_set_altinterface(data.pudh, 0);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set alternate setting on USB interface (%s)", _usb_strerror(res));
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
+    res = usbbus_set_altinterface(data.pudh, 0);
+    if (res < 0) {
+      usbbus_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
 
-      // Allocate memory for the device info and specification, fill it and return the info
-      pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        goto error;
-      }
-      acr122_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
+    // Allocate memory for the device info and specification, fill it and return the info
+    pnd = nfc_device_new(context, connstring);
+    if (!pnd) {
+      perror("malloc");
+      goto error;
+    }
+    acr122_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
 
-      pnd->driver_data = malloc(sizeof(struct acr122_usb_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        goto error;
-      }
-      *DRIVER_DATA(pnd) = data;
+    pnd->driver_data = malloc(sizeof(struct acr122_usb_data));
+    if (!pnd->driver_data) {
+      perror("malloc");
+      goto error;
+    }
+    *DRIVER_DATA(pnd) = data;
 
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &acr122_usb_io) == NULL) {
-        perror("malloc");
-        goto error;
-      }
+    // Alloc and init chip's data
+    if (pn53x_data_new(pnd, &acr122_usb_io) == NULL) {
+      perror("malloc");
+      goto error;
+    }
 
-      memcpy(&(DRIVER_DATA(pnd)->tama_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
-      memcpy(&(DRIVER_DATA(pnd)->apdu_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
-      CHIP_DATA(pnd)->timer_correction = 46; // empirical tuning
-      pnd->driver = &acr122_usb_driver;
+    memcpy(&(DRIVER_DATA(pnd)->tama_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
+    memcpy(&(DRIVER_DATA(pnd)->apdu_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
+    CHIP_DATA(pnd)->timer_correction = 46; // empirical tuning
+    pnd->driver = &acr122_usb_driver;
 
-      if (acr122_usb_init(pnd) < 0) {
-        usb_close(data.pudh);
-        goto error;
-      }
-      DRIVER_DATA(pnd)->abort_flag = false;
-      goto free_mem;
+    if (acr122_usb_init(pnd) < 0) {
+      usbbus_close(data.pudh);
+      goto error;
     }
+    goto free_mem;
   }
   // We ran out of devices before the index required
   goto free_mem;
@@ -477,6 +428,7 @@ error:
   nfc_device_free(pnd);
   pnd = NULL;
 free_mem:
+  usbbus_free_devices(devices, szDevices);
   free(desc.dirname);
   free(desc.filename);
   return pnd;
@@ -488,14 +440,8 @@ acr122_usb_close(nfc_device *pnd)
   acr122_usb_ack(pnd);
   pn53x_idle(pnd);
 
-  int res;
-  if ((res = usb_release_interface(DRIVER_DATA(pnd)->pudh, 0)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", _usb_strerror(res));
-  }
-
-  if ((res = usb_close(DRIVER_DATA(pnd)->pudh)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to close USB connection (%s)", _usb_strerror(res));
-  }
+  usbbus_release_interface(DRIVER_DATA(pnd)->pudh, 0);
+  usbbus_close(DRIVER_DATA(pnd)->pudh);
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -544,22 +490,30 @@ acr122_build_frame_from_apdu(nfc_device *pnd, const uint8_t ins, const uint8_t p
 }
 
 static int
-acr122_build_frame_from_tama(nfc_device *pnd, const uint8_t *tama, const size_t tama_len)
+acr122_build_frame_from_tamav(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt)
 {
+  const size_t tama_len = pn53x_iov_len(iov, iovcnt);
   if (tama_len > sizeof(DRIVER_DATA(pnd)->tama_frame.tama_payload))
     return NFC_EINVARG;
 
   DRIVER_DATA(pnd)->tama_frame.ccid_header.dwLength = htole32(tama_len + sizeof(struct apdu_header) + 1);
   DRIVER_DATA(pnd)->tama_frame.apdu_header.bLen = tama_len + 1;
-  memcpy(DRIVER_DATA(pnd)->tama_frame.tama_payload, tama, tama_len);
+  pn53x_iov_gather(DRIVER_DATA(pnd)->tama_frame.tama_payload, tama_len, iov, iovcnt);
   return (sizeof(struct ccid_header) + sizeof(struct apdu_header) + 1 + tama_len);
 }
 
 static int
-acr122_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
+acr122_build_frame_from_tama(nfc_device *pnd, const uint8_t *tama, const size_t tama_len)
+{
+  const struct pn53x_iovec iov = { (uint8_t *) tama, tama_len };
+  return acr122_build_frame_from_tamav(pnd, &iov, 1);
+}
+
+static int
+acr122_usb_sendv(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, const int timeout)
 {
   int res;
-  if ((res = acr122_build_frame_from_tama(pnd, pbtData, szData)) < 0) {
+  if ((res = acr122_build_frame_from_tamav(pnd, iov, iovcnt)) < 0) {
     pnd->last_error = NFC_EINVARG;
     return pnd->last_error;
   }
@@ -571,7 +525,13 @@ acr122_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, co
   return NFC_SUCCESS;
 }
 
-#define USB_TIMEOUT_PER_PASS 200
+static int
+acr122_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
+{
+  const struct pn53x_iovec iov = { (uint8_t *) pbtData, szData };
+  return acr122_usb_sendv(pnd, &iov, 1, timeout);
+}
+
 static int
 acr122_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
 {
@@ -580,40 +540,21 @@ acr122_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, co
   uint8_t  abtRxBuf[255 + sizeof(struct ccid_header)];
   int res;
 
-  /*
-   * If no timeout is specified but the command is blocking, force a 200ms (USB_TIMEOUT_PER_PASS)
-   * timeout to allow breaking the loop if the user wants to stop it.
-   */
-  int usb_timeout;
-  int remaining_time = timeout;
 read:
-  if (timeout == USB_INFINITE_TIMEOUT) {
-    usb_timeout = USB_TIMEOUT_PER_PASS;
-  } else {
-    // A user-provided timeout is set, we have to cut it in multiple chunk to be able to keep an nfc_abort_command() mecanism
-    remaining_time -= USB_TIMEOUT_PER_PASS;
-    if (remaining_time <= 0) {
-      pnd->last_error = NFC_ETIMEOUT;
-      return pnd->last_error;
-    } else {
-      usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
-    }
-  }
-
-  res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), usb_timeout);
+  // nfc_abort_command() makes this wait return NFC_EOPABORTED
+  res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), &pnd->cancel, timeout);
 
   uint8_t attempted_response = RDR_to_PC_DataBlock;
   size_t len;
 
   if (res == NFC_ETIMEOUT) {
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      DRIVER_DATA(pnd)->abort_flag = false;
-      acr122_usb_ack(pnd);
-      pnd->last_error = NFC_EOPABORTED;
-      return pnd->last_error;
-    } else {
-      goto read;
-    }
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  if (res == NFC_EOPABORTED) {
+    acr122_usb_ack(pnd);
+    pnd->last_error = res;
+    return pnd->last_error;
   }
   if (res < 12) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid RDR_to_PC_DataBlock frame");
@@ -649,14 +590,8 @@ read:
     }
     res = acr122_usb_send_apdu(pnd, APDU_GetAdditionnalData, 0x00, 0x00, NULL, 0, abtRxBuf[11], abtRxBuf, sizeof(abtRxBuf));
     if (res == NFC_ETIMEOUT) {
-      if (DRIVER_DATA(pnd)->abort_flag) {
-        DRIVER_DATA(pnd)->abort_flag = false;
-        acr122_usb_ack(pnd);
-        pnd->last_error = NFC_EOPABORTED;
-        return pnd->last_error;
-      } else {
-        goto read; // FIXME May cause some trouble on Touchatag, right ?
-      }
+      // A pending nfc_abort_command() is noticed by the next wait
+      goto read; // FIXME May cause some trouble on Touchatag, right ?
     }
     if (res < 12) {
       // try to interrupt current device state
@@ -732,7 +667,7 @@ acr122_usb_ack(nfc_device *pnd)
   if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), (unsigned char *) & (DRIVER_DATA(pnd)->tama_frame), res, 1000)) < 0)
     return res;
   uint8_t  abtRxBuf[255 + sizeof(struct ccid_header)];
-  res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), 1000);
+  res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), NULL, 1000);
   return res;
 }
 
@@ -745,7 +680,7 @@ acr122_usb_send_apdu(nfc_device *pnd,
   size_t frame_len = acr122_build_frame_from_apdu(pnd, ins, p1, p2, data, data_len, le);
   if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), (unsigned char *) & (DRIVER_DATA(pnd)->apdu_frame), frame_len, 1000)) < 0)
     return res;
-  if ((res = acr122_usb_bulk_read(DRIVER_DATA(pnd), out, out_size, 1000)) < 0)
+  if ((res = acr122_usb_bulk_read(DRIVER_DATA(pnd), out, out_size, NULL, 1000)) < 0)
     return res;
   return res;
 }
@@ -776,7 +711,7 @@ acr122_usb_init(nfc_device *pnd)
   if ((res = acr122_usb_bulk_write (DRIVER_DATA (pnd), (uint8_t *) acr122u_get_led_state_frame, sizeof (acr122u_get_led_state_frame), 1000)) < 0)
     return res;
 
-  if ((res = acr122_usb_bulk_read (DRIVER_DATA (pnd), abtRxBuf, sizeof (abtRxBuf), 1000)) < 0)
+  if ((res = acr122_usb_bulk_read (DRIVER_DATA (pnd), abtRxBuf, sizeof (abtRxBuf), false, 1000)) < 0)
     return res;
   */
 
@@ -790,7 +725,7 @@ acr122_usb_init(nfc_device *pnd)
 
   if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), ccid_frame, sizeof(struct ccid_header), 1000)) < 0)
     return res;
-  if ((res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), 1000)) < 0)
+  if ((res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), NULL, 1000)) < 0)
     return res;
 
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "ACR122 PICC Operating Parameters");
@@ -810,16 +745,10 @@ acr122_usb_init(nfc_device *pnd)
   return NFC_SUCCESS;
 }
 
-static int
-acr122_usb_abort_command(nfc_device *pnd)
-{
-  DRIVER_DATA(pnd)->abort_flag = true;
-  return NFC_SUCCESS;
-}
-
 const struct pn53x_io acr122_usb_io = {
   .send       = acr122_usb_send,
   .receive    = acr122_usb_receive,
+  .sendv      = acr122_usb_sendv,
 };
 
 const struct nfc_driver acr122_usb_driver = {
@@ -837,6 +766,7 @@ const struct nfc_driver acr122_usb_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -849,12 +779,13 @@ const struct nfc_driver acr122_usb_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = acr122_usb_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
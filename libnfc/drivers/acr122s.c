@@ -60,11 +60,6 @@
 struct acr122s_data {
   serial_port port;
   uint8_t seq;
-#ifndef WIN32
-  int abort_fds[2];
-#else
-  volatile bool abort_flag;
-#endif
 };
 
 const struct pn53x_io acr122s_io;
@@ -199,18 +194,11 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
   uint8_t positive_ack[4] = { STX, 0, 0, ETX };
   serial_port port = DRIVER_DATA(pnd)->port;
   int ret;
-  void *abort_p;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->abort_fds[1]);
-#else
-  abort_p = &(DRIVER_DATA(pnd)->abort_flag);
-#endif
 
   if ((ret = uart_send(port, frame, frame_size, timeout)) < 0)
     return ret;
 
-  if ((ret = uart_receive(port, ack, 4, abort_p, timeout)) < 0)
+  if ((ret = uart_receive(port, ack, 4, &pnd->cancel, timeout)) < 0)
     return ret;
 
   if (memcmp(ack, positive_ack, 4) != 0) {
@@ -230,14 +218,14 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
  * @param: pnd is target nfc device
  * @param: frame is buffer where received response frame will be stored
  * @param: frame_size is frame size
- * @param: abort_p
+ * @param: cancel cancellation to watch, NULL if none
  * @param: timeout
  * @note returned frame size can be fetched using FRAME_SIZE macro
  *
  * @return 0 if success
  */
 static int
-acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abort_p, int timeout)
+acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, struct nfc_cancel *cancel, int timeout)
 {
   if (frame_size < 13) {
     pnd->last_error = NFC_EINVARG;
@@ -246,7 +234,7 @@ acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abo
   int ret;
   serial_port port = DRIVER_DATA(pnd)->port;
 
-  if ((ret = uart_receive(port, frame, 11, abort_p, timeout)) != 0)
+  if ((ret = uart_receive(port, frame, 11, cancel, timeout)) != 0)
     return ret;
 
   // Is buffer sufficient to store response?
@@ -256,7 +244,7 @@ acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abo
   }
 
   size_t remaining = FRAME_SIZE(frame) - 11;
-  if ((ret = uart_receive(port, frame + 11, remaining, abort_p, timeout)) != 0)
+  if ((ret = uart_receive(port, frame + 11, remaining, cancel, timeout)) != 0)
     return ret;
 
   struct xfr_block_res *res = (struct xfr_block_res *) &frame[1];
@@ -351,7 +339,7 @@ acr122s_activate_sam(nfc_device *pnd)
   if ((ret = acr122s_send_frame(pnd, cmd, 0)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, NULL, 0)) != 0)
     return ret;
 
   CHIP_DATA(pnd)->power_mode = NORMAL;
@@ -373,7 +361,7 @@ acr122s_deactivate_sam(nfc_device *pnd)
   if ((ret = acr122s_send_frame(pnd, cmd, 0)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, NULL, 0)) != 0)
     return ret;
 
   CHIP_DATA(pnd)->power_mode = LOWVBAT;
@@ -394,7 +382,7 @@ acr122s_get_firmware_version(nfc_device *pnd, char *version, size_t length)
   if ((ret = acr122s_send_frame(pnd, cmd, 1000)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, cmd, sizeof(cmd), 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, cmd, sizeof(cmd), NULL, 0)) != 0)
     return ret;
 
   size_t len = APDU_SIZE(cmd);
@@ -411,111 +399,65 @@ struct acr122s_descriptor {
   uint32_t speed;
 };
 
-static size_t
-acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static int
+acr122s_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ACR122S device on serial port: %s at %d baud.", acPort, ACR122S_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp, true);
-      uart_set_speed(sp, ACR122S_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ACR122S_DRIVER_NAME, acPort, ACR122S_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-
-      pnd->driver = &acr122s_driver;
-      pnd->driver_data = malloc(sizeof(struct acr122s_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-      DRIVER_DATA(pnd)->seq = 0;
-
-#ifndef WIN32
-      if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-#else
-      DRIVER_DATA(pnd)->abort_flag = false;
-#endif
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ACR122S device on serial port: %s at %d baud.", acPort, ACR122S_DEFAULT_SPEED);
 
-      if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      CHIP_DATA(pnd)->type = PN532;
-      CHIP_DATA(pnd)->power_mode = NORMAL;
-
-      char version[32];
-      int ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
-      if (ret == 0 && strncmp("ACR122S", version, 7) != 0) {
-        ret = -1;
-      }
-
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-
-      if (ret != 0)
-        continue;
-
-      // ACR122S reader is found
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return 0;
+
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp, true);
+  uart_set_speed(sp, ACR122S_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ACR122S_DRIVER_NAME, acPort, ACR122S_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return NFC_ESOFT;
+  }
+
+  pnd->driver = &acr122s_driver;
+  pnd->driver_data = malloc(sizeof(struct acr122s_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return NFC_ESOFT;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+  DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->seq = 0;
+
+  if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return NFC_ESOFT;
   }
-  free(acPorts);
-  return device_found;
+  CHIP_DATA(pnd)->type = PN532;
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+
+  char version[32];
+  int ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
+  if (ret == 0 && strncmp("ACR122S", version, 7) != 0) {
+    ret = -1;
+  }
+
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+
+  // ACR122S reader is found if it reported its firmware version
+  return (ret != 0) ? 0 : 1;
+}
+
+static size_t
+acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return uart_scan_ports(context, acr122s_probe, connstrings, connstrings_len);
 }
 
 static void
@@ -526,12 +468,6 @@ acr122s_close(nfc_device *pnd)
 
   uart_close(DRIVER_DATA(pnd)->port);
 
-#ifndef WIN32
-  // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->abort_fds[0]);
-  close(DRIVER_DATA(pnd)->abort_fds[1]);
-#endif
-
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -603,16 +539,6 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   DRIVER_DATA(pnd)->port = sp;
   DRIVER_DATA(pnd)->seq = 0;
 
-#ifndef WIN32
-  if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-    uart_close(DRIVER_DATA(pnd)->port);
-    nfc_device_free(pnd);
-    return NULL;
-  }
-#else
-  DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
   if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
     perror("malloc");
     uart_close(DRIVER_DATA(pnd)->port);
@@ -679,18 +605,10 @@ acr122s_send(nfc_device *pnd, const uint8_t *buf, const size_t buf_len, int time
 static int
 acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
 {
-  void *abort_p;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->abort_fds[1]);
-#else
-  abort_p = &(DRIVER_DATA(pnd)->abort_flag);
-#endif
-
   uint8_t tmp[MAX_FRAME_SIZE];
-  pnd->last_error = acr122s_recv_frame(pnd, tmp, sizeof(tmp), abort_p, timeout);
+  pnd->last_error = acr122s_recv_frame(pnd, tmp, sizeof(tmp), &pnd->cancel, timeout);
 
-  if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
+  if (NFC_EOPABORTED == pnd->last_error) {
     pnd->last_error = NFC_EOPABORTED;
     return pnd->last_error;
   }
@@ -711,23 +629,6 @@ acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
   return data_len;
 }
 
-static int
-acr122s_abort_command(nfc_device *pnd)
-{
-  if (pnd) {
-#ifndef WIN32
-    close(DRIVER_DATA(pnd)->abort_fds[0]);
-    close(DRIVER_DATA(pnd)->abort_fds[1]);
-    if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-      return NFC_ESOFT;
-    }
-#else
-    DRIVER_DATA(pnd)->abort_flag = true;
-#endif
-  }
-  return NFC_SUCCESS;
-}
-
 const struct pn53x_io acr122s_io = {
   .send    = acr122s_send,
   .receive = acr122s_receive,
@@ -748,6 +649,7 @@ const struct nfc_driver acr122s_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -760,12 +662,13 @@ const struct nfc_driver acr122s_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = acr122s_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
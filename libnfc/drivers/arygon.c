@@ -82,11 +82,6 @@ const struct pn53x_io arygon_tama_io;
 
 struct arygon_data {
   serial_port port;
-#ifndef WIN32
-  int     iAbortFds[2];
-#else
-  volatile bool abort_flag;
-#endif
 };
 
 // ARYGON frames
@@ -97,106 +92,57 @@ static const uint8_t arygon_error_unknown_mode[] = "FF060000\x0d\x0a";
 int     arygon_reset_tama(nfc_device *pnd);
 void    arygon_firmware(nfc_device *pnd, char *str);
 
-static size_t
-arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static int
+arygon_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ARYGON device on serial port: %s at %d baud.", acPort, ARYGON_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp, true);
-      uart_set_speed(sp, ARYGON_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ARYGON_DRIVER_NAME, acPort, ARYGON_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-
-      pnd->driver = &arygon_driver;
-      pnd->driver_data = malloc(sizeof(struct arygon_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-
-#ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        pn53x_data_free(pnd);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-#else
-      DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
-      int res = arygon_reset_tama(pnd);
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
-
-      // ARYGON reader is found
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ARYGON device on serial port: %s at %d baud.", acPort, ARYGON_DEFAULT_SPEED);
+
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return 0;
+
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp, true);
+  uart_set_speed(sp, ARYGON_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ARYGON_DRIVER_NAME, acPort, ARYGON_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return NFC_ESOFT;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+
+  pnd->driver = &arygon_driver;
+  pnd->driver_data = malloc(sizeof(struct arygon_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return NFC_ESOFT;
   }
-  free(acPorts);
-  return device_found;
+  DRIVER_DATA(pnd)->port = sp;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return NFC_ESOFT;
+  }
+
+  int res = arygon_reset_tama(pnd);
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  // ARYGON reader is found if TAMA answered
+  return (res < 0) ? 0 : 1;
+}
+
+static size_t
+arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return uart_scan_ports(context, arygon_probe, connstrings, connstrings_len);
 }
 
 struct arygon_descriptor {
@@ -210,12 +156,6 @@ arygon_close_step2(nfc_device *pnd)
   // Release UART port
   uart_close(DRIVER_DATA(pnd)->port);
 
-#ifndef WIN32
-  // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->iAbortFds[0]);
-  close(DRIVER_DATA(pnd)->iAbortFds[1]);
-#endif
-
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -303,18 +243,6 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   CHIP_DATA(pnd)->timer_correction = 46;
   pnd->driver = &arygon_driver;
 
-#ifndef WIN32
-  // pipe-based abort mecanism
-  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-    uart_close(DRIVER_DATA(pnd)->port);
-    pn53x_data_free(pnd);
-    nfc_device_free(pnd);
-    return NULL;
-  }
-#else
-  DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
   // Check communication using "Reset TAMA" command
   if (arygon_reset_tama(pnd) < 0) {
     arygon_close_step2(pnd);
@@ -400,17 +328,10 @@ arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, i
 {
   uint8_t  abtRxBuf[5];
   size_t len;
-  void *abort_p = NULL;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[1]);
-#else
-  abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
-#endif
 
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, timeout);
+  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, &pnd->cancel, timeout);
 
-  if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
+  if (NFC_EOPABORTED == pnd->last_error) {
     arygon_abort(pnd);
 
     /* last_error got reset by arygon_abort() */
@@ -570,22 +491,6 @@ arygon_reset_tama(nfc_device *pnd)
   return NFC_SUCCESS;
 }
 
-static int
-arygon_abort_command(nfc_device *pnd)
-{
-  if (pnd) {
-#ifndef WIN32
-    close(DRIVER_DATA(pnd)->iAbortFds[0]);
-    if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-      return NFC_ESOFT;
-    }
-#else
-    DRIVER_DATA(pnd)->abort_flag = true;
-#endif
-  }
-  return NFC_SUCCESS;
-}
-
 
 const struct pn53x_io arygon_tama_io = {
   .send       = arygon_tama_send,
@@ -607,6 +512,7 @@ const struct nfc_driver arygon_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -619,12 +525,13 @@ const struct nfc_driver arygon_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = arygon_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
@@ -0,0 +1,456 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file broker.c
+ * @brief Driver for PN53x devices kept open by the nfcd broker daemon
+ *
+ * nfcd opens the devices once and relays the PN53x commands of its clients,
+ * which run the whole pn53x layer themselves. Opening a device through the
+ * broker thus costs a single round trip to nfcd: the chip state pn53x_init()
+ * would establish comes along with the reply (see pn53x_state_export()).
+ *
+ * The device is held by one client at a time, from nfc_open() to nfc_close():
+ * nfc_open() waits until it is given back by the previous one, and fails after
+ * BROKER_OPEN_TIMEOUT.
+ *
+ * Connection string: broker[:socket[:connstring]]
+ *  - socket is the path of the nfcd socket, BROKER_DEFAULT_SOCKET when empty;
+ *  - connstring is the connection string nfcd opens the device with, the
+ *    first device of nfcd when empty (e.g. broker:/run/nfcd.sock:pn532_uart:/dev/ttyS0).
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "broker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+
+#define BROKER_DRIVER_NAME "broker"
+// Time given to nfcd on top of the command timeout before its reply is given up
+#define BROKER_REPLY_MARGIN 1000
+// Time nfc_open() waits for the device while another client holds it
+#define BROKER_OPEN_TIMEOUT 5000
+
+#ifndef MSG_NOSIGNAL
+// Systems without it are left to the application SIGPIPE disposition
+#  define MSG_NOSIGNAL 0
+#endif
+
+#define LOG_CATEGORY "libnfc.driver.broker"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+// Internal data structs
+const struct pn53x_io broker_io;
+struct broker_data {
+  int fd;
+  // Tag of the last request, only its reply is waited for
+  uint32_t uiTag;
+  uint8_t abtRx[sizeof(struct broker_header) + BROKER_PAYLOAD_MAX];
+  size_t szRx;
+};
+
+#define DRIVER_DATA(pnd) ((struct broker_data*)(pnd->driver_data))
+
+static int
+broker_connstring_decode(const nfc_connstring connstring, char *pcSocket, const size_t szSocket, char *pcDevice)
+{
+  const size_t szName = strlen(BROKER_DRIVER_NAME);
+  const char *pcPath = connstring + szName;
+  const char *pcEnd;
+  size_t szPath;
+
+  if ((strncmp(connstring, BROKER_DRIVER_NAME, szName) != 0) || ((*pcPath != '\0') && (*pcPath != ':')))
+    return NFC_EINVARG;
+  if (*pcPath == ':')
+    pcPath++;
+  // The device connection string has colons of its own, so only the first one ends the path
+  pcEnd = strchr(pcPath, ':');
+  szPath = pcEnd ? (size_t)(pcEnd - pcPath) : strlen(pcPath);
+  if (szPath == 0) {
+    pcPath = BROKER_DEFAULT_SOCKET;
+    szPath = strlen(BROKER_DEFAULT_SOCKET);
+  }
+  if (szPath >= szSocket)
+    return NFC_EINVARG;
+  memcpy(pcSocket, pcPath, szPath);
+  pcSocket[szPath] = '\0';
+  snprintf(pcDevice, NFC_BUFSIZE_CONNSTRING, "%s", pcEnd ? pcEnd + 1 : "");
+  return NFC_SUCCESS;
+}
+
+static int
+broker_write(struct broker_data *data, const uint8_t op, const uint32_t tag, const int32_t arg, const uint8_t *pbtData, const size_t szData)
+{
+  uint8_t abtMsg[sizeof(struct broker_header) + BROKER_PAYLOAD_MAX];
+  struct broker_header hdr = { .op = op, .version = BROKER_PROTOCOL_VERSION, .len = szData, .tag = tag, .arg = arg };
+  size_t szMsg = sizeof(hdr) + szData;
+  size_t szDone = 0;
+
+  if (szData > BROKER_PAYLOAD_MAX)
+    return NFC_EINVARG;
+  // A single write, so that nfcd rarely sees a partial message
+  memcpy(abtMsg, &hdr, sizeof(hdr));
+  if (szData)
+    memcpy(abtMsg + sizeof(hdr), pbtData, szData);
+  while (szDone < szMsg) {
+    ssize_t res = send(data->fd, abtMsg + szDone, szMsg - szDone, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to nfcd: %s", strerror(errno));
+      return NFC_EIO;
+    }
+    szDone += res;
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * Read from nfcd until a whole message is buffered. timeout is in ms, 0 does
+ * not wait and -1 waits forever. While \a bAbortable, raising pnd->cancel
+ * aborts the last request, whose reply is still waited for.
+ * @return 1 when a message is buffered, 0 on timeout, otherwise libnfc's error code
+ */
+static int
+broker_read(nfc_device *pnd, const int timeout, bool bAbortable)
+{
+  struct broker_data *data = DRIVER_DATA(pnd);
+  const uint64_t deadline = monotonic_time_ns() + ((timeout > 0) ? (uint64_t)timeout * 1000000 : 0);
+  struct broker_header hdr;
+
+  for (;;) {
+    if (data->szRx >= sizeof(hdr)) {
+      memcpy(&hdr, data->abtRx, sizeof(hdr));
+      if ((hdr.version != BROKER_PROTOCOL_VERSION) || (hdr.len > BROKER_PAYLOAD_MAX)) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid message from nfcd");
+        return NFC_EIO;
+      }
+      if (data->szRx >= sizeof(hdr) + hdr.len)
+        return 1;
+    }
+
+    int iWait = -1;
+    if (timeout >= 0) {
+      const uint64_t now = monotonic_time_ns();
+      iWait = (now < deadline) ? (int)((deadline - now + 999999) / 1000000) : 0;
+    }
+    const int iAbortFd = bAbortable ? nfc_cancel_fd(&pnd->cancel) : -1;
+    struct pollfd pfds[2] = {
+      { .fd = data->fd, .events = POLLIN },
+      { .fd = iAbortFd, .events = POLLIN },
+    };
+    int res = poll(pfds, (iAbortFd >= 0) ? 2 : 1, iWait);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error: %s", strerror(errno));
+      return NFC_EIO;
+    }
+    if (res == 0)
+      return 0;
+    if ((iAbortFd >= 0) && pfds[1].revents && nfc_cancel_take(&pnd->cancel)) {
+      // nfcd aborts the command on the device, its reply then tells so
+      if ((res = broker_write(data, BROKER_ABORT, data->uiTag, 0, NULL, 0)) < 0)
+        return res;
+      bAbortable = false;
+    }
+    if (pfds[0].revents) {
+      ssize_t szRead = recv(data->fd, data->abtRx + data->szRx, sizeof(data->abtRx) - data->szRx, 0);
+      if (szRead == 0) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "nfcd closed the connection");
+        return NFC_EIO;
+      }
+      if (szRead < 0) {
+        if ((errno == EINTR) || (errno == EAGAIN))
+          continue;
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from nfcd: %s", strerror(errno));
+        return NFC_EIO;
+      }
+      data->szRx += szRead;
+    }
+  }
+}
+
+// Drop the message at the start of the receive buffer
+static void
+broker_consume(struct broker_data *data)
+{
+  struct broker_header hdr;
+  memcpy(&hdr, data->abtRx, sizeof(hdr));
+  const size_t szMsg = sizeof(hdr) + hdr.len;
+  memmove(data->abtRx, data->abtRx + szMsg, data->szRx - szMsg);
+  data->szRx -= szMsg;
+}
+
+/*
+ * Wait for the reply to the last request, as broker_read() does. Replies to
+ * requests given up earlier are dropped. The reply is left at the start of
+ * the receive buffer, for broker_consume().
+ * @return 1 when the reply is buffered, 0 on timeout, otherwise libnfc's error code
+ */
+static int
+broker_reply(nfc_device *pnd, const int timeout, const bool bAbortable, struct broker_header *phdr)
+{
+  struct broker_data *data = DRIVER_DATA(pnd);
+  int res;
+
+  while ((res = broker_read(pnd, timeout, bAbortable)) > 0) {
+    memcpy(phdr, data->abtRx, sizeof(*phdr));
+    if (phdr->tag == data->uiTag)
+      break;
+    broker_consume(data);
+  }
+  return res;
+}
+
+static size_t
+broker_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  // nfcd is only reachable through an explicit connection string
+  return 0;
+}
+
+static void
+broker_close(nfc_device *pnd)
+{
+  pn53x_idle(pnd);
+  // nfcd gives the device back once the commands above are served, there is no need to wait for it
+  broker_write(DRIVER_DATA(pnd), BROKER_CLOSE, ++DRIVER_DATA(pnd)->uiTag, 0, NULL, 0);
+  close(DRIVER_DATA(pnd)->fd);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+broker_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  struct sockaddr_un sun;
+  char acDevice[NFC_BUFSIZE_CONNSTRING];
+  struct broker_header hdr;
+  struct broker_session session;
+
+  memset(&sun, 0x00, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  if (broker_connstring_decode(connstring, sun.sun_path, sizeof(sun.sun_path), acDevice) < 0) {
+    return NULL;
+  }
+
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    return NULL;
+  }
+  pnd->driver_data = calloc(1, sizeof(struct broker_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  struct broker_data *data = DRIVER_DATA(pnd);
+
+  if ((data->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to create socket: %s", strerror(errno));
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  if (connect(data->fd, (struct sockaddr *) &sun, sizeof(sun)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to connect to nfcd (%s): %s", sun.sun_path, strerror(errno));
+    goto error;
+  }
+
+  // nfcd replies once the device is free, as well as in the state pn53x_init() leaves it in
+  if (broker_write(data, BROKER_OPEN, ++data->uiTag, 0, (const uint8_t *) acDevice, strlen(acDevice)) < 0)
+    goto error;
+  int res;
+  if ((res = broker_reply(pnd, BROKER_OPEN_TIMEOUT, false, &hdr)) < 0)
+    goto error;
+  if (res == 0) {
+    // Closing the connection withdraws the request
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "nfcd did not give the device within %d ms, another client holds it", BROKER_OPEN_TIMEOUT);
+    goto error;
+  }
+  if ((hdr.arg < 0) || (hdr.len != sizeof(session))) {
+    pnd->last_error = (hdr.arg < 0) ? hdr.arg : NFC_EIO;
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "nfcd could not open \"%s\": %s", acDevice, nfc_strerror(pnd));
+    goto error;
+  }
+  memcpy(&session, data->abtRx + sizeof(hdr), sizeof(session));
+  broker_consume(data);
+  session.name[sizeof(session.name) - 1] = '\0';
+  snprintf(pnd->name, sizeof(pnd->name), "%s", session.name);
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &broker_io) == NULL) {
+    perror("malloc");
+    goto error;
+  }
+  pnd->driver = &broker_driver;
+  if (pn53x_state_import(pnd, &session.state) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unsupported chip state from nfcd");
+    pn53x_data_free(pnd);
+    goto error;
+  }
+  return pnd;
+
+error:
+  close(data->fd);
+  nfc_device_free(pnd);
+  return NULL;
+}
+
+static int
+broker_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  struct broker_data *data = DRIVER_DATA(pnd);
+
+  // The reply to a request given up earlier may still come, the new tag tells them apart
+  if ((pnd->last_error = broker_write(data, BROKER_TRANSCEIVE, ++data->uiTag, timeout, pbtData, szData)) < 0) {
+    return pnd->last_error;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+broker_receivev(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, int timeout)
+{
+  struct broker_data *data = DRIVER_DATA(pnd);
+  struct broker_header hdr;
+  int res;
+
+  // nfcd applies the timeout itself, this one only guards against a stuck daemon
+  if ((res = broker_reply(pnd, (timeout > 0) ? timeout + BROKER_REPLY_MARGIN : -1, true, &hdr)) <= 0) {
+    pnd->last_error = (res == 0) ? NFC_ETIMEOUT : res;
+    return pnd->last_error;
+  }
+  res = hdr.arg;
+  if (res >= 0) {
+    const size_t szDataLen = pn53x_iov_len(iov, iovcnt);
+    if (hdr.len > szDataLen) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, (size_t) hdr.len);
+      res = NFC_EIO;
+    } else {
+      pn53x_iov_scatter(iov, iovcnt, 0, data->abtRx + sizeof(hdr), hdr.len);
+      res = hdr.len;
+    }
+  }
+  broker_consume(data);
+  pnd->last_error = (res < 0) ? res : 0;
+  return res;
+}
+
+static int
+broker_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  const struct pn53x_iovec iov = { pbtData, szDataLen };
+  return broker_receivev(pnd, &iov, 1, timeout);
+}
+
+static int
+broker_get_pollfd(nfc_device *pnd)
+{
+  return DRIVER_DATA(pnd)->fd;
+}
+
+static int
+broker_receive_ready(nfc_device *pnd)
+{
+  struct broker_header hdr;
+  return broker_reply(pnd, 0, false, &hdr);
+}
+
+const struct pn53x_io broker_io = {
+  .send       = broker_send,
+  .receive    = broker_receive,
+  .receivev   = broker_receivev,
+  .get_pollfd    = broker_get_pollfd,
+  .receive_ready = broker_receive_ready,
+};
+
+const struct nfc_driver broker_driver = {
+  .name                             = BROKER_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = broker_scan,
+  .open                             = broker_open,
+  .close                            = broker_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = pn532_initiator_init_secure_element,
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
+  .device_set_property_int      = pn53x_set_property_int,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = nfc_device_abort,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+
+  .device_get_pollfd                      = pn53x_get_pollfd,
+  .initiator_submit_select_passive_target = pn53x_initiator_submit_select_passive_target,
+  .initiator_submit_transceive_bytes      = pn53x_initiator_submit_transceive_bytes,
+  .target_submit_receive_bytes            = pn53x_target_submit_receive_bytes,
+  .target_submit_send_bytes               = pn53x_target_submit_send_bytes,
+  .device_complete                        = pn53x_complete,
+};
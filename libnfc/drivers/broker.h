@@ -0,0 +1,80 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file broker.h
+ * @brief Driver for PN53x devices kept open by the nfcd broker daemon
+ */
+
+#ifndef __NFC_DRIVER_BROKER_H__
+#define __NFC_DRIVER_BROKER_H__
+
+#include <stdint.h>
+
+#include <nfc/nfc-types.h>
+
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+
+extern const struct nfc_driver broker_driver;
+
+/*
+ * Protocol spoken between the broker driver and nfcd over a local stream
+ * socket. Each message is a broker_header followed by len bytes of payload,
+ * in host byte order. The requests of a connection are served in order and
+ * each reply carries the tag of its request, so that a client can send
+ * requests without waiting for the previous replies.
+ */
+#define BROKER_PROTOCOL_VERSION 1
+#define BROKER_DEFAULT_SOCKET   "/run/nfcd.sock"
+#define BROKER_PAYLOAD_MAX      NFC_BUFSIZE_CONNSTRING
+
+enum broker_op {
+  /** Payload: connection string of the device, empty for the default one. Reply payload: struct broker_session */
+  BROKER_OPEN = 1,
+  /** Payload: PN53x command, arg: timeout. Reply payload: PN53x reply, as returned by pn53x_relay() */
+  BROKER_TRANSCEIVE,
+  /** Abort the request whose tag is given, which replies NFC_EOPABORTED. No reply of its own */
+  BROKER_ABORT,
+  /** Give the device back. Empty reply */
+  BROKER_CLOSE,
+};
+
+struct broker_header {
+  uint8_t  op;
+  uint8_t  version;
+  uint16_t len;
+  uint32_t tag;
+  /** Request: timeout in milliseconds. Reply: payload length or libnfc's error code */
+  int32_t  arg;
+};
+
+struct broker_session {
+  char name[DEVICE_NAME_LENGTH];
+  struct pn53x_state state;
+};
+
+#endif // ! __NFC_DRIVER_BROKER_H__
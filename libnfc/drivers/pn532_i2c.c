@@ -71,7 +71,7 @@ const struct pn53x_io pn532_i2c_io;
 
 struct pn532_i2c_data {
   i2c_device dev;
-  volatile bool abort_flag;
+  uint64_t transaction_stop;  // Monotonic time (ns) of the last STOP condition
 };
 
 /* preamble and start bytes, see pn532-internal.h for details */
@@ -88,8 +88,6 @@ static int pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t
 
 static int pn532_i2c_ack(nfc_device *pnd);
 
-static int pn532_i2c_abort_command(nfc_device *pnd);
-
 static int pn532_i2c_wakeup(nfc_device *pnd);
 
 static int pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout);
@@ -105,61 +103,61 @@ static size_t pn532_i2c_scan(const nfc_context *context, nfc_connstring connstri
  * table 320. I2C timing specification, page 211, rev. 3.2 - 2007-12-07.
  */
 #define PN532_BUS_FREE_TIME 5
-static struct timespec __transaction_stop;
 
 /**
- * @brief Wrapper around i2c_read to ensure proper timing by respecting the
- * 	  minimal free bus time between a STOP condition and a START condition.
+ * @brief Sleep until the minimal free bus time since the last STOP condition
+ * 	  of this device has elapsed, if it has not already.
  *
- * @note This is not thread safe, but since libnfc is single threaded
- * 	 this should be okay.
+ * @param pnd pointer on the NFC device.
+ * @param cancel cancellation that ends the sleep early, NULL if none
+ * @return NFC_SUCCESS once the bus is free, NFC_EOPABORTED if cancelled
+ */
+static int pn532_i2c_wait_bus_free(nfc_device *pnd, struct nfc_cancel *cancel)
+{
+  return nfc_cancel_sleep_until(cancel, DRIVER_DATA(pnd)->transaction_stop + (uint64_t) PN532_BUS_FREE_TIME * 1000 * 1000);
+}
+
+/**
+ * @brief Read the status byte and the frame that follows it in a single I2C
+ * 	  transaction, respecting the minimal free bus time between a STOP
+ * 	  condition and a START condition.
  *
- * @param id I2C device
+ * @param pnd pointer on the NFC device.
  * @param buf pointer on buffer used to store data
  * @param len length of the buffer
- * @return length (in bytes) of read data, or driver error code (negative value)
+ * @return length (in bytes) of read data, or driver error code (negative value),
+ *         NFC_EOPABORTED if pnd->cancel was raised while waiting for the bus
  */
-static ssize_t pn532_i2c_read(const i2c_device id,
+static ssize_t pn532_i2c_read(nfc_device *pnd,
                               uint8_t *buf, const size_t len)
 {
-  struct timespec transaction_start, bus_free_time = { 0, 0 };
-  ssize_t ret;
-
-  clock_gettime(CLOCK_MONOTONIC, &transaction_start);
-  bus_free_time.tv_nsec = (PN532_BUS_FREE_TIME * 1000 * 1000) -
-                          (transaction_start.tv_nsec - __transaction_stop.tv_nsec);
-  nanosleep(&bus_free_time, NULL);
-
-  ret = i2c_read(id, buf, len);
-  clock_gettime(CLOCK_MONOTONIC, &__transaction_stop);
-  return ret;
+  struct i2c_segment segment = { .pbtData = buf, .szLen = len, .bRead = true };
+  int ret;
+
+  if ((ret = pn532_i2c_wait_bus_free(pnd, &pnd->cancel)) < 0)
+    return ret;
+  ret = i2c_transfer(DRIVER_DATA(pnd)->dev, &segment, 1);
+  DRIVER_DATA(pnd)->transaction_stop = monotonic_time_ns();
+  return (ret < 0) ? ret : (ssize_t) len;
 }
 
 /**
  * @brief Wrapper around i2c_write to ensure proper timing by respecting the
  * 	  minimal free bus time between a STOP condition and a START condition.
  *
- * @note This is not thread safe, but since libnfc is single threaded
- * 	 this should be okay.
- *
- * @param id I2C device
+ * @param pnd pointer on the NFC device.
  * @param buf pointer on buffer containing data
  * @param len length of the buffer
  * @return NFC_SUCCESS on success, otherwise driver error code
  */
-static ssize_t pn532_i2c_write(const i2c_device id,
+static ssize_t pn532_i2c_write(nfc_device *pnd,
                                const uint8_t *buf, const size_t len)
 {
-  struct timespec transaction_start, bus_free_time = { 0, 0 };
   ssize_t ret;
 
-  clock_gettime(CLOCK_MONOTONIC, &transaction_start);
-  bus_free_time.tv_nsec = (PN532_BUS_FREE_TIME * 1000 * 1000) -
-                          (transaction_start.tv_nsec - __transaction_stop.tv_nsec);
-  nanosleep(&bus_free_time, NULL);
-
-  ret = i2c_write(id, buf, len);
-  clock_gettime(CLOCK_MONOTONIC, &__transaction_stop);
+  pn532_i2c_wait_bus_free(pnd, NULL);
+  ret = i2c_write(DRIVER_DATA(pnd)->dev, buf, len);
+  DRIVER_DATA(pnd)->transaction_stop = monotonic_time_ns();
   return ret;
 }
 
@@ -213,6 +211,7 @@ pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const s
         return 0;
       }
       DRIVER_DATA(pnd)->dev = id;
+      DRIVER_DATA(pnd)->transaction_stop = 0;
 
       // Alloc and init chip's data
       if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
@@ -232,8 +231,6 @@ pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const s
       // This device starts in LowVBat power mode
       CHIP_DATA(pnd)->power_mode = LOWVBAT;
 
-      DRIVER_DATA(pnd)->abort_flag = false;
-
       // Check communication using "Diagnose" command, with "Communication test" (0x00)
       int res = pn53x_check_communication(pnd);
       i2c_close(DRIVER_DATA(pnd)->dev);
@@ -321,6 +318,7 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
   DRIVER_DATA(pnd)->dev = i2c_dev;
+  DRIVER_DATA(pnd)->transaction_stop = 0;
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
@@ -339,8 +337,6 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_i2c_driver;
 
-  DRIVER_DATA(pnd)->abort_flag = false;
-
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
     nfc_perror(pnd, "pn53x_check_communication");
@@ -412,7 +408,7 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
   }
 
   for (retries = PN532_SEND_RETRIES; retries > 0; retries--) {
-    res = pn532_i2c_write(DRIVER_DATA(pnd)->dev, abtFrame, szFrame);
+    res = pn532_i2c_write(pnd, abtFrame, szFrame);
     if (res >= 0)
       break;
 
@@ -462,25 +458,21 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
   bool done = false;
   int res;
 
-  struct timeval start_tv, cur_tv;
-  long long duration;
+  uint64_t deadline = 0;
 
   // Actual I2C response frame includes an additional status byte,
   // so we use a temporary buffer to read the I2C frame
   uint8_t i2cRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + 1];
 
   if (timeout > 0) {
-    // If a timeout is specified, get current timestamp
-    gettimeofday(&start_tv, NULL);
+    // If a timeout is specified, compute the deadline
+    deadline = monotonic_time_ns() + (uint64_t) timeout * 1000 * 1000;
   }
 
   do {
-    int recCount = pn532_i2c_read(DRIVER_DATA(pnd)->dev, i2cRx, szDataLen + 1);
-
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      // Reset abort flag
-      DRIVER_DATA(pnd)->abort_flag = false;
+    int recCount = pn532_i2c_read(pnd, i2cRx, szDataLen + 1);
 
+    if (nfc_cancel_take(&pnd->cancel)) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
               "Wait for a READY frame has been aborted.");
       return NFC_EOPABORTED;
@@ -502,11 +494,7 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
         /* Not ready yet. Check for elapsed timeout. */
 
         if (timeout > 0) {
-          gettimeofday(&cur_tv, NULL);
-          duration = (cur_tv.tv_sec - start_tv.tv_sec) * 1000000L
-                     + (cur_tv.tv_usec - start_tv.tv_usec);
-
-          if (duration / 1000 > timeout) {
+          if (monotonic_time_ns() > deadline) {
             res = NFC_ETIMEOUT;
             done = true;
 
@@ -642,22 +630,7 @@ error:
 int
 pn532_i2c_ack(nfc_device *pnd)
 {
-  return pn532_i2c_write(DRIVER_DATA(pnd)->dev, pn53x_ack_frame, sizeof(pn53x_ack_frame));
-}
-
-/**
- * @brief Abort any pending operation
- *
- * @param pnd pointer on the NFC device.
- * @return NFC_SUCCESS
- */
-static int
-pn532_i2c_abort_command(nfc_device *pnd)
-{
-  if (pnd) {
-    DRIVER_DATA(pnd)->abort_flag = true;
-  }
-  return NFC_SUCCESS;
+  return pn532_i2c_write(pnd, pn53x_ack_frame, sizeof(pn53x_ack_frame));
 }
 
 const struct pn53x_io pn532_i2c_io = {
@@ -680,6 +653,7 @@ const struct nfc_driver pn532_i2c_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -692,12 +666,13 @@ const struct nfc_driver pn532_i2c_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = pn532_i2c_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
 };
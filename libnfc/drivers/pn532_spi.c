@@ -51,6 +51,12 @@
 #define PN532_SPI_DRIVER_NAME "pn532_spi"
 #define PN532_SPI_MODE SPI_MODE_0
 
+// Ready wait schedule: a few back-to-back status reads, then sleeps doubling
+// from PN532_SPI_BACKOFF_MIN_US up to PN532_SPI_BACKOFF_MAX_US
+#define PN532_SPI_SPIN_READS 4
+#define PN532_SPI_BACKOFF_MIN_US 100
+#define PN532_SPI_BACKOFF_MAX_US 2000
+
 #define LOG_CATEGORY "libnfc.driver.pn532_spi"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
@@ -74,7 +80,6 @@
 const struct pn53x_io pn532_spi_io;
 struct pn532_spi_data {
   spi_port port;
-  volatile bool abort_flag;
 };
 
 static const uint8_t pn532_spi_cmd_dataread = 0x03;
@@ -150,8 +155,6 @@ pn532_spi_scan(const nfc_context *context, nfc_connstring connstrings[], const s
       // This device starts in LowVBat power mode
       CHIP_DATA(pnd)->power_mode = LOWVBAT;
 
-      DRIVER_DATA(pnd)->abort_flag = false;
-
       // Check communication using "Diagnose" command, with "Communication test" (0x00)
       int res = pn53x_check_communication(pnd);
       spi_close(DRIVER_DATA(pnd)->port);
@@ -180,8 +183,40 @@ pn532_spi_scan(const nfc_context *context, nfc_connstring connstrings[], const s
 struct pn532_spi_descriptor {
   char *port;
   uint32_t speed;
+  char *irq_chip;
+  uint32_t irq_line;
 };
 
+/*
+ * The optional fourth connstring field selects the GPIO line wired to the
+ * PN532 P70_IRQ pin, as <gpiochip>@<line>, e.g.
+ * pn532_spi:/dev/spidev0.0:500000:/dev/gpiochip0@25
+ * connstring_decode() only splits three fields, so it is looked up here.
+ */
+static int
+pn532_spi_decode_irq(const nfc_connstring connstring, struct pn532_spi_descriptor *ndd)
+{
+  ndd->irq_chip = NULL;
+  const char *irq_s = connstring;
+  for (int i = 0; i < 3; i++) {
+    if ((irq_s = strchr(irq_s, ':')) == NULL)
+      return 0;
+    irq_s++;
+  }
+  const char *at = strrchr(irq_s, '@');
+  if ((at == NULL) || (at == irq_s) || (sscanf(at + 1, "%10"SCNu32, &ndd->irq_line) != 1)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid IRQ line specification: %s", irq_s);
+    return -1;
+  }
+  if ((ndd->irq_chip = malloc(at - irq_s + 1)) == NULL) {
+    perror("malloc");
+    return -1;
+  }
+  memcpy(ndd->irq_chip, irq_s, at - irq_s);
+  ndd->irq_chip[at - irq_s] = '\0';
+  return 0;
+}
+
 static void
 pn532_spi_close(nfc_device *pnd)
 {
@@ -216,6 +251,10 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
   if (connstring_decode_level < 3) {
     ndd.speed = PN532_SPI_DEFAULT_SPEED;
   }
+  if (pn532_spi_decode_irq(connstring, &ndd) < 0) {
+    free(ndd.port);
+    return NULL;
+  }
   spi_port sp;
   nfc_device *pnd = NULL;
 
@@ -228,11 +267,23 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "SPI port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SPI_PORT) || (sp == INVALID_SPI_PORT)) {
     free(ndd.port);
+    free(ndd.irq_chip);
     return NULL;
   }
   spi_set_speed(sp, ndd.speed);
   spi_set_mode(sp, PN532_SPI_MODE);
 
+  if (ndd.irq_chip) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Using IRQ line %s@%"PRIu32, ndd.irq_chip, ndd.irq_line);
+    int res = spi_irq_open(sp, ndd.irq_chip, ndd.irq_line);
+    free(ndd.irq_chip);
+    if (res < 0) {
+      free(ndd.port);
+      spi_close(sp);
+      return NULL;
+    }
+  }
+
   // We have a connection
   pnd = nfc_device_new(context, connstring);
   if (!pnd) {
@@ -269,8 +320,6 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_spi_driver;
 
-  DRIVER_DATA(pnd)->abort_flag = false;
-
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
     nfc_perror(pnd, "pn53x_check_communication");
@@ -339,14 +388,22 @@ pn532_spi_wakeup(nfc_device *pnd)
 #define PN532_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
 
 
+/*
+ * Wait for the PN532 to report a frame ready.
+ * The status is first read back to back, since short commands are often
+ * answered within a few transfers. After that, either the IRQ line is waited
+ * on (when configured) or the status is polled with an exponential backoff,
+ * so that fast answers are not rounded up to a fixed sleep. Both waits end
+ * as soon as pnd->cancel is raised.
+ */
 static int
 pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
 {
   static const uint8_t pn532_spi_ready = 0x01;
-  static const int pn532_spi_poll_interval = 10; //ms
-
 
-  int timer = 0;
+  const uint64_t deadline = (timeout > 0) ? monotonic_time_ns() + (uint64_t) timeout * 1000000 : 0;
+  uint32_t backoff = PN532_SPI_BACKOFF_MIN_US;
+  int reads = 0;
 
   int ret;
   while ((ret = pn532_spi_read_spi_status(pnd)) != pn532_spi_ready) {
@@ -354,18 +411,36 @@ pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
       return ret;
     }
 
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      DRIVER_DATA(pnd)->abort_flag = false;
+    if (nfc_cancel_take(&pnd->cancel)) {
       return NFC_EOPABORTED;
     }
 
-    if (timeout > 0) {
-      timer += pn532_spi_poll_interval;
-      if (timer > timeout) {
+    uint64_t remaining_us = UINT64_MAX;
+    if (deadline) {
+      const uint64_t now = monotonic_time_ns();
+      if (now >= deadline) {
         return NFC_ETIMEOUT;
       }
+      remaining_us = (deadline - now) / 1000;
+    }
 
-      msleep(pn532_spi_poll_interval);
+    if (++reads < PN532_SPI_SPIN_READS) {
+      continue;
+    }
+
+    if (spi_has_irq(DRIVER_DATA(pnd)->port)) {
+      const int irq_timeout = deadline ? (int)(remaining_us / 1000) + 1 : -1;
+      ret = spi_irq_wait(DRIVER_DATA(pnd)->port, nfc_cancel_fd(&pnd->cancel), irq_timeout);
+      if ((ret < 0) && (ret != NFC_ETIMEOUT) && (ret != NFC_EOPABORTED)) {
+        return ret;
+      }
+    } else {
+      nfc_cancel_sleep(&pnd->cancel, (remaining_us < backoff) ? (uint32_t) remaining_us : backoff);
+      if (backoff < PN532_SPI_BACKOFF_MAX_US) {
+        backoff *= 2;
+        if (backoff > PN532_SPI_BACKOFF_MAX_US)
+          backoff = PN532_SPI_BACKOFF_MAX_US;
+      }
     }
   }
 
@@ -416,10 +491,32 @@ pn532_spi_receive_next_chunk(nfc_device *pnd, uint8_t *pbtData, const size_t szD
   return res;
 }
 
+/*
+ * Copy the next szLen bytes of the frame being received: first the bytes
+ * already clocked in abtFrame, then further chunks read from the chip.
+ */
+static int
+pn532_spi_frame_take(nfc_device *pnd, const uint8_t *abtFrame, const size_t szFrame, size_t *pos, uint8_t *pbtData, const size_t szLen)
+{
+  const size_t szBuffered = (*pos < szFrame) ? MIN(szFrame - *pos, szLen) : 0;
+
+  memcpy(pbtData, abtFrame + *pos, szBuffered);
+  *pos += szBuffered;
+  if (szBuffered < szLen) {
+    return pn532_spi_receive_next_chunk(pnd, pbtData + szBuffered, szLen - szBuffered);
+  }
+  return NFC_SUCCESS;
+}
+
 static int
 pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t  abtRxBuf[5];
+  // A normal frame that fits in pbtData is read along with DATAREAD in a
+  // single message; the PN532 just pads past the end of the frame.
+  uint8_t abtFrame[PN53x_NORMAL_FRAME__OVERHEAD + PN53x_NORMAL_FRAME__DATA_MAX_LEN];
+  const size_t szFrame = PN53x_NORMAL_FRAME__OVERHEAD + MIN(szDataLen + 1, PN53x_NORMAL_FRAME__DATA_MAX_LEN);
+  uint8_t abtRxBuf[2];
+  size_t pos = 0;
   size_t len;
 
   pnd->last_error = pn532_spi_wait_for_data(pnd, timeout);
@@ -433,70 +530,58 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     goto error;
   }
 
-  pnd->last_error = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, abtRxBuf, 4, true);
+  const struct spi_segment segments[2] = {
+    { .pbtTx = &pn532_spi_cmd_dataread, .pbtRx = NULL, .szLen = 1, .bCsChange = false },
+    { .pbtTx = NULL, .pbtRx = abtFrame, .szLen = szFrame, .bCsChange = false },
+  };
+  pnd->last_error = spi_transfer(DRIVER_DATA(pnd)->port, segments, 2, true);
 
   if (pnd->last_error < 0) {
     goto error;
   }
 
   const uint8_t pn53x_long_preamble[3] = { 0x00, 0x00, 0xff };
-  if (0 == (memcmp(abtRxBuf, pn53x_long_preamble, 3))) {
-    // long preamble
-
-    // omit first byte
-    for (size_t i = 0; i < 3; ++i) {
-      abtRxBuf[i] = abtRxBuf[i + 1];
-    }
-
-    // need one more byte
-    pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf + 3, 1);
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive one more byte for long preamble frame. (RX)");
-      goto error;
-    }
+  if (0 == (memcmp(abtFrame, pn53x_long_preamble, 3))) {
+    // long preamble, omit first byte
+    pos = 1;
   }
 
-
   const uint8_t pn53x_preamble[2] = { 0x00, 0xff };
-  if (0 != (memcmp(abtRxBuf, pn53x_preamble, 2))) {
+  if (0 != (memcmp(abtFrame + pos, pn53x_preamble, 2))) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", " preamble+start code mismatch");
     pnd->last_error = NFC_EIO;
     goto error;
   }
+  pos += 2;
 
-  if ((0x01 == abtRxBuf[2]) && (0xff == abtRxBuf[3])) {
-    // Error frame
-    pn532_spi_receive_next_chunk(pnd, abtRxBuf, 3);
-
+  if ((0x01 == abtFrame[pos]) && (0xff == abtFrame[pos + 1])) {
+    // Error frame, already read in full
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
     pnd->last_error = NFC_EIO;
     goto error;
-  } else if ((0xff == abtRxBuf[2]) && (0xff == abtRxBuf[3])) {
+  } else if ((0xff == abtFrame[pos]) && (0xff == abtFrame[pos + 1])) {
     // Extended frame
-    pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf, 3);
-
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
-    }
-    // (abtRxBuf[0] << 8) + abtRxBuf[1] (LEN) include TFI + (CC+1)
-    len = (abtRxBuf[0] << 8) + abtRxBuf[1] - 2;
-    if (((abtRxBuf[0] + abtRxBuf[1] + abtRxBuf[2]) % 256) != 0) {
+    pos += 2;
+    // (abtFrame[pos] << 8) + abtFrame[pos + 1] (LEN) include TFI + (CC+1)
+    len = (abtFrame[pos] << 8) + abtFrame[pos + 1] - 2;
+    if (((abtFrame[pos] + abtFrame[pos + 1] + abtFrame[pos + 2]) % 256) != 0) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
       pnd->last_error = NFC_EIO;
       goto error;
     }
+    pos += 3;
   } else {
     // Normal frame
-    if (256 != (abtRxBuf[2] + abtRxBuf[3])) {
+    if (256 != (abtFrame[pos] + abtFrame[pos + 1])) {
       // TODO: Retry
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
       pnd->last_error = NFC_EIO;
       goto error;
     }
 
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[2] - 2;
+    // abtFrame[pos] (LEN) include TFI + (CC+1)
+    len = abtFrame[pos] - 2;
+    pos += 2;
   }
 
   if (len > szDataLen) {
@@ -506,8 +591,7 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
   }
 
   // TFI + PD0 (CC+1)
-
-  pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf, 2);
+  pnd->last_error = pn532_spi_frame_take(pnd, abtFrame, szFrame, &pos, abtRxBuf, 2);
 
   if (pnd->last_error != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
@@ -527,7 +611,7 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
   }
 
   if (len) {
-    pnd->last_error = pn532_spi_receive_next_chunk(pnd, pbtData, len);
+    pnd->last_error = pn532_spi_frame_take(pnd, abtFrame, szFrame, &pos, pbtData, len);
 
     if (pnd->last_error != 0) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
@@ -535,7 +619,7 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     }
   }
 
-  pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf, 2);
+  pnd->last_error = pn532_spi_frame_take(pnd, abtFrame, szFrame, &pos, abtRxBuf, 2);
 
   if (pnd->last_error != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
@@ -649,16 +733,6 @@ pn532_spi_ack(nfc_device *pnd)
   return res;
 }
 
-static int
-pn532_spi_abort_command(nfc_device *pnd)
-{
-  if (pnd) {
-    DRIVER_DATA(pnd)->abort_flag = true;
-  }
-
-  return NFC_SUCCESS;
-}
-
 const struct pn53x_io pn532_spi_io = {
   .send       = pn532_spi_send,
   .receive    = pn532_spi_receive,
@@ -679,6 +753,7 @@ const struct nfc_driver pn532_spi_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -691,12 +766,13 @@ const struct nfc_driver pn532_spi_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = pn532_spi_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
 };
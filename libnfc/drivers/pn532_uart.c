@@ -58,11 +58,6 @@
 const struct pn53x_io pn532_uart_io;
 struct pn532_uart_data {
   serial_port port;
-#ifndef WIN32
-  int     iAbortFds[2];
-#else
-  volatile bool abort_flag;
-#endif
 };
 
 // Prototypes
@@ -71,117 +66,120 @@ int     pn532_uart_wakeup(nfc_device *pnd);
 
 #define DRIVER_DATA(pnd) ((struct pn532_uart_data*)(pnd->driver_data))
 
-static size_t
-pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static int
+pn532_uart_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
-
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on serial port: %s at %d baud.", acPort, PN532_UART_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp, true);
-      // Serial port claimed but we need to check if a PN532_UART is opened.
-      uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_UART_DRIVER_NAME, acPort, PN532_UART_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      pnd->driver = &pn532_uart_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_uart_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
-
-#ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        pn53x_data_free(pnd);
-        nfc_device_free(pnd);
-        iDevice = 0;
-        while ((acPort = acPorts[iDevice++])) {
-          free((void *)acPort);
-        }
-        free(acPorts);
-        return 0;
-      }
-#else
-      DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on serial port: %s at %d baud.", acPort, PN532_UART_DEFAULT_SPEED);
 
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return 0;
 
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp, true);
+  // Serial port claimed but we need to check if a PN532_UART is opened.
+  uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_UART_DRIVER_NAME, acPort, PN532_UART_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return NFC_ESOFT;
   }
-  iDevice = 0;
-  while ((acPort = acPorts[iDevice++])) {
-    free((void *)acPort);
+  pnd->driver = &pn532_uart_driver;
+  pnd->driver_data = malloc(sizeof(struct pn532_uart_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return NFC_ESOFT;
+  }
+  DRIVER_DATA(pnd)->port = sp;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return NFC_ESOFT;
   }
-  free(acPorts);
-  return device_found;
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return (res < 0) ? 0 : 1;
+}
+
+static size_t
+pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  return uart_scan_ports(context, pn532_uart_probe, connstrings, connstrings_len);
 }
 
 struct pn532_uart_descriptor {
   char *port;
   uint32_t speed;
+  uint32_t high_speed;  // Speed negotiated once the PN532 answers at speed, 0 if none
 };
 
+// Speeds supported by SetSerialBaudRate, indexed by its BR parameter
+static const uint32_t pn532_uart_serial_baud_rates[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000 };
+
+/*
+ * Switch the PN532 and the host to uiSpeed using SetSerialBaudRate.
+ * On failure, the host side is brought back to its previous speed.
+ */
+static int
+pn532_uart_set_serial_baud_rate(nfc_device *pnd, const uint32_t uiSpeed)
+{
+  const serial_port sp = DRIVER_DATA(pnd)->port;
+  const uint32_t uiInitialSpeed = uart_get_speed(sp);
+  size_t szBR;
+  int res;
+
+  for (szBR = 0; szBR < sizeof(pn532_uart_serial_baud_rates) / sizeof(pn532_uart_serial_baud_rates[0]); szBR++) {
+    if (pn532_uart_serial_baud_rates[szBR] == uiSpeed)
+      break;
+  }
+  if (szBR == sizeof(pn532_uart_serial_baud_rates) / sizeof(pn532_uart_serial_baud_rates[0])) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "PN532 does not support %" PRIu32 " baud", uiSpeed);
+    return NFC_EINVARG;
+  }
+  // Make sure the host side can follow before asking the PN532 to switch
+  if ((res = uart_set_speed(sp, uiSpeed)) < 0) {
+    return res;
+  }
+  uart_set_speed(sp, uiInitialSpeed);
+
+  const uint8_t abtCmd[] = { SetSerialBaudRate, (uint8_t) szBR };
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0) {
+    return res;
+  }
+  // The PN532 switches once the host acknowledged its answer
+  if ((res = pn532_uart_ack(pnd)) < 0) {
+    return res;
+  }
+  // Pending output is drained at the previous speed, then give the PN532 time to switch
+  uart_set_speed(sp, uiSpeed);
+  uart_flush_input(sp, true);
+
+  if ((res = pn53x_check_communication(pnd)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "No answer at %" PRIu32 " baud, falling back to %" PRIu32 " baud", uiSpeed, uiInitialSpeed);
+    uart_set_speed(sp, uiInitialSpeed);
+    uart_flush_input(sp, true);
+    return res;
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Serial link switched to %" PRIu32 " baud", uiSpeed);
+  return NFC_SUCCESS;
+}
+
 static void
 pn532_uart_close(nfc_device *pnd)
 {
@@ -190,12 +188,6 @@ pn532_uart_close(nfc_device *pnd)
   // Release UART port
   uart_close(DRIVER_DATA(pnd)->port);
 
-#ifndef WIN32
-  // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->iAbortFds[0]);
-  close(DRIVER_DATA(pnd)->iAbortFds[1]);
-#endif
-
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -222,6 +214,18 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   if (connstring_decode_level < 3) {
     ndd.speed = PN532_UART_DEFAULT_SPEED;
   }
+  // Optional fourth field (pn532_uart:port:speed:high_speed): speed to negotiate with SetSerialBaudRate
+  ndd.high_speed = 0;
+  const char *pcHighSpeed = connstring;
+  for (int i = 0; (i < 3) && pcHighSpeed; i++) {
+    if ((pcHighSpeed = strchr(pcHighSpeed, ':')))
+      pcHighSpeed++;
+  }
+  if (pcHighSpeed && (sscanf(pcHighSpeed, "%10"PRIu32, &ndd.high_speed) != 1)) {
+    // high_speed is not a number
+    free(ndd.port);
+    return NULL;
+  }
   serial_port sp;
   nfc_device *pnd = NULL;
 
@@ -276,18 +280,6 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_uart_driver;
 
-#ifndef WIN32
-  // pipe-based abort mecanism
-  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-    uart_close(DRIVER_DATA(pnd)->port);
-    pn53x_data_free(pnd);
-    nfc_device_free(pnd);
-    return NULL;
-  }
-#else
-  DRIVER_DATA(pnd)->abort_flag = false;
-#endif
-
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "pn53x_check_communication error");
@@ -295,6 +287,15 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
 
+  if (ndd.high_speed && (ndd.high_speed != ndd.speed)) {
+    // Not fatal as long as the PN532 still answers at the initial speed
+    if ((pn532_uart_set_serial_baud_rate(pnd, ndd.high_speed) < 0) && (pn53x_check_communication(pnd) < 0)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "pn53x_check_communication error");
+      pn532_uart_close(pnd);
+      return NULL;
+    }
+  }
+
   pn53x_init(pnd);
   return pnd;
 }
@@ -311,7 +312,7 @@ pn532_uart_wakeup(nfc_device *pnd)
 
 #define PN532_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
 static int
-pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+pn532_uart_sendv(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, int timeout)
 {
   int res = 0;
   // Before sending anything, we need to discard from any junk bytes
@@ -343,7 +344,7 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
   uint8_t  abtFrame[PN532_BUFFER_LEN] = { 0x00, 0x00, 0xff };       // Every packet must start with "00 00 ff"
   size_t szFrame = 0;
 
-  if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
+  if ((res = pn53x_build_framev(abtFrame, &szFrame, iov, iovcnt)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
@@ -372,125 +373,150 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
 }
 
 static int
-pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
-  uint8_t  abtRxBuf[5];
-  size_t len;
-  void *abort_p = NULL;
-
-#ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[1]);
-#else
-  abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
-#endif
-
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, timeout);
+  const struct pn53x_iovec iov = { (uint8_t *) pbtData, szData };
+  return pn532_uart_sendv(pnd, &iov, 1, timeout);
+}
 
-  if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
-    pn532_uart_ack(pnd);
-    return NFC_EOPABORTED;
-  }
+/*
+ * Incremental parser of a PN532 frame held in place in the UART receive buffer.
+ *
+ * Returns 0 while \a szAvailable bytes are not enough, *pszFrame being then the
+ * frame length to wait for, 1 once the whole frame is there and valid, or a
+ * libnfc error code. On success, the payload (TFI and command code excluded)
+ * starts at \a pbtFrame + *pszHeader and is *pszData bytes long.
+ */
+static int
+pn532_uart_parse_frame(nfc_device *pnd, const uint8_t *pbtFrame, const size_t szAvailable, const size_t szDataLen,
+                       size_t *pszFrame, size_t *pszHeader, size_t *pszData)
+{
+  size_t szHeader;
+  size_t len;
 
-  if (pnd->last_error < 0) {
-    goto error;
+  if (szAvailable < 5) {
+    *pszFrame = 5;
+    return 0;
   }
 
   const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
-  if (0 != (memcmp(abtRxBuf, pn53x_preamble, 3))) {
+  if (0 != (memcmp(pbtFrame, pn53x_preamble, 3))) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame preamble+start code mismatch");
-    pnd->last_error = NFC_EIO;
-    goto error;
+    return NFC_EIO;
   }
 
-  if ((0x01 == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
+  if ((0x01 == pbtFrame[3]) && (0xff == pbtFrame[4])) {
     // Error frame
-    uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
+    *pszFrame = 8;
+    if (szAvailable < *pszFrame)
+      return 0;
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  } else if ((0xff == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
+    return NFC_EIO;
+  } else if ((0xff == pbtFrame[3]) && (0xff == pbtFrame[4])) {
     // Extended frame
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
+    if (szAvailable < 8) {
+      *pszFrame = 8;
+      return 0;
     }
-    // (abtRxBuf[0] << 8) + abtRxBuf[1] (LEN) include TFI + (CC+1)
-    len = (abtRxBuf[0] << 8) + abtRxBuf[1] - 2;
-    if (((abtRxBuf[0] + abtRxBuf[1] + abtRxBuf[2]) % 256) != 0) {
+    if (((pbtFrame[5] + pbtFrame[6] + pbtFrame[7]) % 256) != 0) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      goto error;
+      return NFC_EIO;
     }
+    // (pbtFrame[5] << 8) + pbtFrame[6] (LEN) include TFI + (CC+1)
+    len = (pbtFrame[5] << 8) + pbtFrame[6];
+    szHeader = 8;
   } else {
     // Normal frame
-    if (256 != (abtRxBuf[3] + abtRxBuf[4])) {
+    if (256 != (pbtFrame[3] + pbtFrame[4])) {
       // TODO: Retry
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      goto error;
+      return NFC_EIO;
     }
-
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[3] - 2;
+    // pbtFrame[3] (LEN) include TFI + (CC+1)
+    len = pbtFrame[3];
+    szHeader = 5;
   }
 
+  if (len < 2) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame too short");
+    return NFC_EIO;
+  }
+  len -= 2;
   if (len > szDataLen) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EIO;
-    goto error;
+    return NFC_EIO;
   }
 
-  // TFI + PD0 (CC+1)
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    goto error;
-  }
+  // Header, TFI + PD0 (CC+1), payload, DCS + postamble
+  *pszFrame = szHeader + 2 + len + 2;
+  if (szAvailable < *pszFrame)
+    return 0;
 
-  if (abtRxBuf[0] != 0xD5) {
+  if (pbtFrame[szHeader] != 0xD5) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
-    pnd->last_error = NFC_EIO;
-    goto error;
+    return NFC_EIO;
   }
 
-  if (abtRxBuf[1] != CHIP_DATA(pnd)->last_command + 1) {
+  if (pbtFrame[szHeader + 1] != CHIP_DATA(pnd)->last_command + 1) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
-    pnd->last_error = NFC_EIO;
-    goto error;
+    return NFC_EIO;
   }
 
-  if (len) {
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, pbtData, len, 0, timeout);
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
-    }
+  // TFI, PD0 to PDn and DCS sum up to zero
+  uint8_t btDCS = 0;
+  for (size_t szPos = szHeader; szPos < szHeader + 2 + len + 1; szPos++) {
+    btDCS += pbtFrame[szPos];
   }
-
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    goto error;
+  if (btDCS != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
+    return NFC_EIO;
   }
 
-  uint8_t btDCS = (256 - 0xD5);
-  btDCS -= CHIP_DATA(pnd)->last_command + 1;
-  for (size_t szPos = 0; szPos < len; szPos++) {
-    btDCS -= pbtData[szPos];
+  if (0x00 != pbtFrame[*pszFrame - 1]) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
+    return NFC_EIO;
   }
 
-  if (btDCS != abtRxBuf[0]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
-    pnd->last_error = NFC_EIO;
-    goto error;
-  }
+  *pszHeader = szHeader + 2;
+  *pszData = len;
+  return 1;
+}
 
-  if (0x00 != abtRxBuf[1]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
-    pnd->last_error = NFC_EIO;
+static int
+pn532_uart_receivev(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, int timeout)
+{
+  const size_t szDataLen = pn53x_iov_len(iov, iovcnt);
+  const uint8_t *pbtFrame = NULL;
+  size_t szHeader = 0;
+  size_t len = 0;
+  int res;
+
+  // Parse the frame in place in the UART buffer as it comes: a whole frame usually needs a single read
+  size_t szFrame = 5;
+  do {
+    res = uart_peek(DRIVER_DATA(pnd)->port, &pbtFrame, szFrame, &pnd->cancel, timeout);
+
+    if (NFC_EOPABORTED == res) {
+      pn532_uart_ack(pnd);
+      return NFC_EOPABORTED;
+    }
+
+    if (res < 0) {
+      if (szFrame > 5) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
+      }
+      pnd->last_error = res;
+      goto error;
+    }
+  } while (0 == (res = pn532_uart_parse_frame(pnd, pbtFrame, (size_t) res, szDataLen, &szFrame, &szHeader, &len)));
+
+  if (res < 0) {
+    pnd->last_error = res;
     goto error;
   }
+
+  pn53x_iov_scatter(iov, iovcnt, 0, pbtFrame + szHeader, len);
+  uart_consume(DRIVER_DATA(pnd)->port, szFrame);
   // The PN53x command is done and we successfully received the reply
   return len;
 error:
@@ -498,6 +524,39 @@ error:
   return pnd->last_error;
 }
 
+static int
+pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  const struct pn53x_iovec iov = { pbtData, szDataLen };
+  return pn532_uart_receivev(pnd, &iov, 1, timeout);
+}
+
+static int
+pn532_uart_get_pollfd(nfc_device *pnd)
+{
+  const int fd = uart_get_fd(DRIVER_DATA(pnd)->port);
+  if (fd < 0) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  return fd;
+}
+
+static int
+pn532_uart_receive_ready(nfc_device *pnd)
+{
+  const uint8_t *pbtFrame = NULL;
+  size_t szFrame = 0;
+  size_t szHeader = 0;
+  size_t len = 0;
+  int res;
+
+  // Parse whatever is already there: an invalid frame or an I/O error is ready too, receive will report it
+  if ((res = uart_peek_nowait(DRIVER_DATA(pnd)->port, &pbtFrame)) < 0)
+    return res;
+  return pn532_uart_parse_frame(pnd, pbtFrame, (size_t) res, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, &szFrame, &szHeader, &len);
+}
+
 int
 pn532_uart_ack(nfc_device *pnd)
 {
@@ -510,25 +569,13 @@ pn532_uart_ack(nfc_device *pnd)
   return (uart_send(DRIVER_DATA(pnd)->port, pn53x_ack_frame, sizeof(pn53x_ack_frame),  0));
 }
 
-static int
-pn532_uart_abort_command(nfc_device *pnd)
-{
-  if (pnd) {
-#ifndef WIN32
-    close(DRIVER_DATA(pnd)->iAbortFds[0]);
-    if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-      return NFC_ESOFT;
-    }
-#else
-    DRIVER_DATA(pnd)->abort_flag = true;
-#endif
-  }
-  return NFC_SUCCESS;
-}
-
 const struct pn53x_io pn532_uart_io = {
   .send       = pn532_uart_send,
   .receive    = pn532_uart_receive,
+  .sendv      = pn532_uart_sendv,
+  .receivev   = pn532_uart_receivev,
+  .get_pollfd    = pn532_uart_get_pollfd,
+  .receive_ready = pn532_uart_receive_ready,
 };
 
 const struct nfc_driver pn532_uart_driver = {
@@ -546,6 +593,7 @@ const struct nfc_driver pn532_uart_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -558,13 +606,21 @@ const struct nfc_driver pn532_uart_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = pn532_uart_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+
+  .device_get_pollfd                      = pn53x_get_pollfd,
+  .initiator_submit_select_passive_target = pn53x_initiator_submit_select_passive_target,
+  .initiator_submit_transceive_bytes      = pn53x_initiator_submit_transceive_bytes,
+  .target_submit_receive_bytes            = pn53x_target_submit_receive_bytes,
+  .target_submit_send_bytes               = pn53x_target_submit_send_bytes,
+  .device_complete                        = pn53x_complete,
 };
 
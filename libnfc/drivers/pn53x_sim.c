@@ -0,0 +1,798 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file pn53x_sim.c
+ * @brief In-process PN53x simulator driver
+ *
+ * This driver does not talk to any hardware: its pn53x_io answers TAMA
+ * commands itself, from a virtual RF field described by a script. It is meant
+ * to exercise the whole nfc_* -> pn53x_* -> io stack in a deterministic way
+ * (benchmarks, CI), not to emulate every chip corner case.
+ *
+ * Non-blocking operations are supported: the descriptor is readable as soon
+ * as an answer is known, the command latency being then spent by
+ * nfc_device_complete().
+ *
+ * Connection string: pn53x_sim[:script[:latency]]
+ *  - script is a path to a script file, or "default" for the built-in field
+ *    (one MIFARE Ultralight-like ISO14443A target);
+ *  - latency is the default per-command latency in microseconds.
+ *
+ * Script syntax, one directive per line, '#' starts a comment, hex strings
+ * are written without separators:
+ *   firmware <hex>              GetFirmwareVersion answer (default: 32010607)
+ *   latency <cmd|*> <usec>      latency of a command code (hex), or of all
+ *   target <atqa> <sak> <uid> [<ats>]
+ *                               ISO14443A 106 kbps target put in the field
+ *                               (with infinite select retries, as a real chip,
+ *                               InListPassiveTarget waits for one)
+ *   reply <request> <response>  answer sent by the selected target to request
+ *                               (unmatched requests are echoed back)
+ *   activation <mode>           TgInitAsTarget mode byte (default: 00)
+ *   initiator <frame>           frame sent by the virtual external initiator
+ *                               once in target mode (TgInitAsTarget first,
+ *                               then each TgGetData/TgGetInitiatorCommand)
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "pn53x_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define PN53X_SIM_DRIVER_NAME "pn53x_sim"
+
+#define PN53X_SIM_MAX_TARGETS 8
+#define PN53X_SIM_MAX_REPLIES 32
+#define PN53X_SIM_MAX_INITIATOR_FRAMES 32
+#define PN53X_SIM_FRAME_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN - 2)
+// No answer will ever come (eg. no external initiator in the field)
+#define PN53X_SIM_NO_ANSWER UINT32_MAX
+
+#define LOG_CATEGORY "libnfc.driver.pn53x_sim"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+struct pn53x_sim_frame {
+  uint8_t abtData[PN53X_SIM_FRAME_LEN];
+  size_t szData;
+};
+
+struct pn53x_sim_target {
+  uint8_t abtAtqa[2];
+  uint8_t btSak;
+  uint8_t abtUid[10];
+  size_t szUidLen;
+  uint8_t abtAts[254];
+  size_t szAtsLen;
+  bool halted;
+};
+
+struct pn53x_sim_reply {
+  struct pn53x_sim_frame request;
+  struct pn53x_sim_frame response;
+};
+
+// Internal data structs
+const struct pn53x_io pn53x_sim_io;
+struct pn53x_sim_data {
+  // Virtual chip
+  uint8_t abtFirmware[4];
+  size_t szFirmware;
+  uint8_t abtCiuRegisters[256];
+  uint8_t abtSfrRegisters[256];
+  uint32_t auiLatency[256];
+  bool bField;
+  uint8_t btMxRtyPassiveActivation;
+  // Virtual RF field
+  struct pn53x_sim_target targets[PN53X_SIM_MAX_TARGETS];
+  size_t szTargets;
+  int iSelectedTarget;
+  struct pn53x_sim_reply replies[PN53X_SIM_MAX_REPLIES];
+  size_t szReplies;
+  uint8_t btActivationMode;
+  struct pn53x_sim_frame initiator_frames[PN53X_SIM_MAX_INITIATOR_FRAMES];
+  size_t szInitiatorFrames;
+  size_t szInitiatorFramePos;
+  // Answer to the command being processed
+  uint8_t btCommand;
+  uint8_t abtAnswer[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t szAnswer;
+  uint32_t uiAnswerDelay;
+  // Raised while an answer is waiting to be received, its descriptor is the pollable one
+  struct nfc_cancel answered;
+};
+
+#define DRIVER_DATA(pnd) ((struct pn53x_sim_data*)(pnd->driver_data))
+
+/*
+ * Wait for the virtual chip to produce its answer, honouring the command
+ * timeout (in ms, 0 means infinite) and pnd->cancel.
+ */
+static int
+pn53x_sim_wait(nfc_device *pnd, uint32_t uiDelay, const int timeout)
+{
+  const uint32_t uiSlice = 1000000;
+  int res = NFC_SUCCESS;
+
+  if ((timeout > 0) && ((uint64_t)uiDelay > (uint64_t)timeout * 1000)) {
+    uiDelay = (uint32_t)timeout * 1000;
+    res = NFC_ETIMEOUT;
+  }
+  while (uiDelay > 0) {
+    const uint32_t uiStep = (uiDelay > uiSlice) ? uiSlice : uiDelay;
+    if (nfc_cancel_sleep(&pnd->cancel, uiStep) < 0) {
+      nfc_cancel_take(&pnd->cancel);
+      return NFC_EOPABORTED;
+    }
+    if (uiDelay != PN53X_SIM_NO_ANSWER)
+      uiDelay -= uiStep;
+  }
+  if (nfc_cancel_take(&pnd->cancel))
+    return NFC_EOPABORTED;
+  return res;
+}
+
+static int
+pn53x_sim_parse_hex(const char *pcHex, uint8_t *pbtData, const size_t szDataMax)
+{
+  size_t szData = 0;
+  while (isxdigit((unsigned char)pcHex[0]) && isxdigit((unsigned char)pcHex[1])) {
+    unsigned int uiByte;
+    if ((szData >= szDataMax) || (sscanf(pcHex, "%2x", &uiByte) != 1))
+      return -1;
+    pbtData[szData++] = uiByte;
+    pcHex += 2;
+  }
+  return (*pcHex == '\0') ? (int)szData : -1;
+}
+
+static void
+pn53x_sim_default_field(struct pn53x_sim_data *data)
+{
+  const uint8_t abtUid[] = { 0x04, 0xa1, 0xb2, 0xc3, 0xd4, 0xe5, 0xf6 };
+  struct pn53x_sim_target *target = &(data->targets[0]);
+
+  memset(target, 0x00, sizeof(*target));
+  target->abtAtqa[0] = 0x00;
+  target->abtAtqa[1] = 0x44;
+  target->btSak = 0x00;
+  memcpy(target->abtUid, abtUid, sizeof(abtUid));
+  target->szUidLen = sizeof(abtUid);
+  data->szTargets = 1;
+}
+
+static int
+pn53x_sim_parse_line(struct pn53x_sim_data *data, char *line)
+{
+  char *apcTokens[5];
+  size_t szTokens = 0;
+  char *pc = line;
+  int res;
+
+  while (szTokens < sizeof(apcTokens) / sizeof(apcTokens[0])) {
+    while (isspace((unsigned char) * pc))
+      pc++;
+    if ((*pc == '\0') || (*pc == '#'))
+      break;
+    apcTokens[szTokens++] = pc;
+    while ((*pc != '\0') && (!isspace((unsigned char) * pc)))
+      pc++;
+    if (*pc != '\0')
+      *(pc++) = '\0';
+  }
+  if (szTokens == 0)
+    return NFC_SUCCESS;
+
+  if ((strcmp(apcTokens[0], "firmware") == 0) && (szTokens == 2)) {
+    res = pn53x_sim_parse_hex(apcTokens[1], data->abtFirmware, sizeof(data->abtFirmware));
+    if ((res != 2) && (res != 4))
+      return NFC_EINVARG;
+    data->szFirmware = res;
+  } else if ((strcmp(apcTokens[0], "latency") == 0) && (szTokens == 3)) {
+    unsigned long ulLatency;
+    unsigned int uiCommand;
+    if (sscanf(apcTokens[2], "%lu", &ulLatency) != 1)
+      return NFC_EINVARG;
+    if (strcmp(apcTokens[1], "*") == 0) {
+      for (size_t n = 0; n < 256; n++)
+        data->auiLatency[n] = ulLatency;
+    } else if ((sscanf(apcTokens[1], "%x", &uiCommand) == 1) && (uiCommand < 256)) {
+      data->auiLatency[uiCommand] = ulLatency;
+    } else {
+      return NFC_EINVARG;
+    }
+  } else if ((strcmp(apcTokens[0], "target") == 0) && ((szTokens == 4) || (szTokens == 5))) {
+    if (data->szTargets >= PN53X_SIM_MAX_TARGETS)
+      return NFC_EINVARG;
+    struct pn53x_sim_target *target = &(data->targets[data->szTargets]);
+    memset(target, 0x00, sizeof(*target));
+    if (pn53x_sim_parse_hex(apcTokens[1], target->abtAtqa, sizeof(target->abtAtqa)) != 2)
+      return NFC_EINVARG;
+    if (pn53x_sim_parse_hex(apcTokens[2], &(target->btSak), 1) != 1)
+      return NFC_EINVARG;
+    if ((res = pn53x_sim_parse_hex(apcTokens[3], target->abtUid, sizeof(target->abtUid))) <= 0)
+      return NFC_EINVARG;
+    target->szUidLen = res;
+    if (szTokens == 5) {
+      if ((res = pn53x_sim_parse_hex(apcTokens[4], target->abtAts, sizeof(target->abtAts))) <= 0)
+        return NFC_EINVARG;
+      target->szAtsLen = res;
+    }
+    data->szTargets++;
+  } else if ((strcmp(apcTokens[0], "reply") == 0) && (szTokens == 3)) {
+    if (data->szReplies >= PN53X_SIM_MAX_REPLIES)
+      return NFC_EINVARG;
+    struct pn53x_sim_reply *reply = &(data->replies[data->szReplies]);
+    if ((res = pn53x_sim_parse_hex(apcTokens[1], reply->request.abtData, sizeof(reply->request.abtData))) < 0)
+      return NFC_EINVARG;
+    reply->request.szData = res;
+    if ((res = pn53x_sim_parse_hex(apcTokens[2], reply->response.abtData, sizeof(reply->response.abtData))) < 0)
+      return NFC_EINVARG;
+    reply->response.szData = res;
+    data->szReplies++;
+  } else if ((strcmp(apcTokens[0], "activation") == 0) && (szTokens == 2)) {
+    if (pn53x_sim_parse_hex(apcTokens[1], &(data->btActivationMode), 1) != 1)
+      return NFC_EINVARG;
+  } else if ((strcmp(apcTokens[0], "initiator") == 0) && (szTokens == 2)) {
+    if (data->szInitiatorFrames >= PN53X_SIM_MAX_INITIATOR_FRAMES)
+      return NFC_EINVARG;
+    struct pn53x_sim_frame *frame = &(data->initiator_frames[data->szInitiatorFrames]);
+    if ((res = pn53x_sim_parse_hex(apcTokens[1], frame->abtData, sizeof(frame->abtData))) < 0)
+      return NFC_EINVARG;
+    frame->szData = res;
+    data->szInitiatorFrames++;
+  } else {
+    return NFC_EINVARG;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_sim_load_script(struct pn53x_sim_data *data, const char *filename)
+{
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open script: %s", filename);
+    return NFC_EINVARG;
+  }
+  char line[BUFSIZ];
+  int lineno = 0;
+  int res = NFC_SUCCESS;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    if ((res = pn53x_sim_parse_line(data, line)) < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Parse error in %s at line %d", filename, lineno);
+      break;
+    }
+  }
+  fclose(f);
+  return res;
+}
+
+static void
+pn53x_sim_field_reset(struct pn53x_sim_data *data)
+{
+  for (size_t n = 0; n < data->szTargets; n++)
+    data->targets[n].halted = false;
+  data->iSelectedTarget = -1;
+}
+
+static void
+pn53x_sim_answer_append(struct pn53x_sim_data *data, const uint8_t *pbtData, const size_t szData)
+{
+  const size_t szAvailable = sizeof(data->abtAnswer) - data->szAnswer;
+  const size_t szCopy = (szData > szAvailable) ? szAvailable : szData;
+  memcpy(data->abtAnswer + data->szAnswer, pbtData, szCopy);
+  data->szAnswer += szCopy;
+}
+
+static void
+pn53x_sim_answer_byte(struct pn53x_sim_data *data, const uint8_t btByte)
+{
+  pn53x_sim_answer_append(data, &btByte, 1);
+}
+
+// Target data as returned by InListPassiveTarget/InAutoPoll (Tg excluded)
+static void
+pn53x_sim_answer_target(struct pn53x_sim_data *data, const struct pn53x_sim_target *target)
+{
+  pn53x_sim_answer_append(data, target->abtAtqa, 2);
+  pn53x_sim_answer_byte(data, target->btSak);
+  pn53x_sim_answer_byte(data, target->szUidLen);
+  pn53x_sim_answer_append(data, target->abtUid, target->szUidLen);
+  if (target->szAtsLen) {
+    // ATS length byte is counted in ATS frame
+    pn53x_sim_answer_byte(data, target->szAtsLen + 1);
+    pn53x_sim_answer_append(data, target->abtAts, target->szAtsLen);
+  }
+}
+
+static int
+pn53x_sim_find_target(struct pn53x_sim_data *data, const uint8_t *pbtUid, const size_t szUid)
+{
+  for (size_t n = 0; n < data->szTargets; n++) {
+    const struct pn53x_sim_target *target = &(data->targets[n]);
+    if (target->halted)
+      continue;
+    if (szUid && ((szUid != target->szUidLen) || (memcmp(pbtUid, target->abtUid, szUid) != 0)))
+      continue;
+    return n;
+  }
+  return -1;
+}
+
+static void
+pn53x_sim_exchange(struct pn53x_sim_data *data, const uint8_t *pbtTx, const size_t szTx)
+{
+  if ((!data->bField) || (data->iSelectedTarget < 0)) {
+    // Nobody answers
+    pn53x_sim_answer_byte(data, ETIMEOUT);
+    return;
+  }
+  pn53x_sim_answer_byte(data, 0x00);
+  for (size_t n = 0; n < data->szReplies; n++) {
+    const struct pn53x_sim_reply *reply = &(data->replies[n]);
+    if ((reply->request.szData == szTx) && (memcmp(reply->request.abtData, pbtTx, szTx) == 0)) {
+      pn53x_sim_answer_append(data, reply->response.abtData, reply->response.szData);
+      return;
+    }
+  }
+  pn53x_sim_answer_append(data, pbtTx, szTx);
+}
+
+static void
+pn53x_sim_halt_selected(struct pn53x_sim_data *data)
+{
+  if (data->iSelectedTarget >= 0) {
+    data->targets[data->iSelectedTarget].halted = true;
+    data->iSelectedTarget = -1;
+  }
+}
+
+static int
+pn53x_sim_process(struct pn53x_sim_data *data, const uint8_t *pbtTx, const size_t szTx)
+{
+  data->szAnswer = 0;
+  data->btCommand = pbtTx[0];
+  data->uiAnswerDelay = data->auiLatency[pbtTx[0]];
+
+  switch (pbtTx[0]) {
+    case Diagnose:
+      if ((szTx > 1) && (pbtTx[1] == 0x00)) {
+        // Communication test: echo back
+        pn53x_sim_answer_append(data, pbtTx + 1, szTx - 1);
+      } else if ((szTx > 1) && (pbtTx[1] == 0x06)) {
+        // Card presence detection
+        pn53x_sim_answer_byte(data, (data->iSelectedTarget >= 0) ? 0x00 : ETIMEOUT);
+      } else {
+        pn53x_sim_answer_byte(data, 0x00);
+      }
+      break;
+    case GetFirmwareVersion:
+      pn53x_sim_answer_append(data, data->abtFirmware, data->szFirmware);
+      break;
+    case GetGeneralStatus:
+      pn53x_sim_answer_byte(data, 0x00); // Err
+      pn53x_sim_answer_byte(data, data->bField ? 0x01 : 0x00);
+      if (data->iSelectedTarget >= 0) {
+        const uint8_t abtTg[] = { 0x01, 0x00, 0x00, 0x00 }; // Tg, BrRx, BrTx, Type
+        pn53x_sim_answer_byte(data, 0x01);
+        pn53x_sim_answer_append(data, abtTg, sizeof(abtTg));
+      } else {
+        pn53x_sim_answer_byte(data, 0x00);
+      }
+      pn53x_sim_answer_byte(data, 0x00); // SAM status
+      break;
+    case ReadRegister:
+      for (size_t n = 1; n + 1 < szTx; n += 2) {
+        const uint16_t ui16Address = (pbtTx[n] << 8) | pbtTx[n + 1];
+        if ((ui16Address & 0xff00) == 0x6300) {
+          pn53x_sim_answer_byte(data, data->abtCiuRegisters[ui16Address & 0xff]);
+        } else if ((ui16Address & 0xff00) == 0xff00) {
+          pn53x_sim_answer_byte(data, data->abtSfrRegisters[ui16Address & 0xff]);
+        } else {
+          pn53x_sim_answer_byte(data, 0x00);
+        }
+      }
+      break;
+    case WriteRegister:
+      for (size_t n = 1; n + 2 < szTx; n += 3) {
+        const uint16_t ui16Address = (pbtTx[n] << 8) | pbtTx[n + 1];
+        if ((ui16Address & 0xff00) == 0x6300) {
+          data->abtCiuRegisters[ui16Address & 0xff] = pbtTx[n + 2];
+        } else if ((ui16Address & 0xff00) == 0xff00) {
+          data->abtSfrRegisters[ui16Address & 0xff] = pbtTx[n + 2];
+        }
+      }
+      break;
+    case SetParameters:
+    case SetSerialBaudRate:
+    case SAMConfiguration:
+      break;
+    case RFConfiguration:
+      if ((szTx > 2) && (pbtTx[1] == RFCI_FIELD)) {
+        data->bField = pbtTx[2] & 0x01;
+        if (!data->bField)
+          pn53x_sim_field_reset(data);
+      } else if ((szTx > 4) && (pbtTx[1] == RFCI_RETRY_SELECT)) {
+        data->btMxRtyPassiveActivation = pbtTx[4];
+      }
+      break;
+    case PowerDown:
+      pn53x_sim_answer_byte(data, 0x00);
+      break;
+    case InListPassiveTarget: {
+      // Only ISO14443A at 106 kbps is populated in the virtual field
+      int iTarget = -1;
+      data->bField = true;
+      if ((szTx > 2) && (pbtTx[2] == PM_ISO14443A_106))
+        iTarget = pn53x_sim_find_target(data, pbtTx + 3, szTx - 3);
+      if ((iTarget < 0) && (data->btMxRtyPassiveActivation == 0xff)) {
+        // Infinite retries: the chip waits for a target which never comes
+        data->uiAnswerDelay = PN53X_SIM_NO_ANSWER;
+        break;
+      }
+      if (iTarget < 0) {
+        pn53x_sim_answer_byte(data, 0x00);
+        break;
+      }
+      data->iSelectedTarget = iTarget;
+      pn53x_sim_answer_byte(data, 0x01); // NbTg
+      pn53x_sim_answer_byte(data, 0x01); // Tg
+      pn53x_sim_answer_target(data, &(data->targets[iTarget]));
+    }
+    break;
+    case InAutoPoll: {
+      int iTarget = -1;
+      data->bField = true;
+      for (size_t n = 3; n < szTx; n++) {
+        if ((pbtTx[n] == PTT_GENERIC_PASSIVE_106) || (pbtTx[n] == PTT_MIFARE) || (pbtTx[n] == PTT_ISO14443_4A_106)) {
+          iTarget = pn53x_sim_find_target(data, NULL, 0);
+          break;
+        }
+      }
+      if (iTarget < 0) {
+        pn53x_sim_answer_byte(data, 0x00);
+        break;
+      }
+      const struct pn53x_sim_target *target = &(data->targets[iTarget]);
+      data->iSelectedTarget = iTarget;
+      pn53x_sim_answer_byte(data, 0x01); // NbTg
+      pn53x_sim_answer_byte(data, (target->btSak & 0x20) ? PTT_ISO14443_4A_106 : PTT_MIFARE);
+      const size_t szLenPos = data->szAnswer;
+      pn53x_sim_answer_byte(data, 0x00); // AutoPollTargetData length, updated below
+      pn53x_sim_answer_byte(data, 0x01); // Tg
+      pn53x_sim_answer_target(data, target);
+      data->abtAnswer[szLenPos] = data->szAnswer - szLenPos - 1;
+    }
+    break;
+    case InDataExchange:
+      if ((szTx < 2) || ((pbtTx[1] & 0x0f) != 0x01)) {
+        pn53x_sim_answer_byte(data, EINVPARAM);
+        break;
+      }
+      pn53x_sim_exchange(data, pbtTx + 2, szTx - 2);
+      break;
+    case InCommunicateThru:
+      pn53x_sim_exchange(data, pbtTx + 1, szTx - 1);
+      break;
+    case InDeselect:
+    case InRelease:
+      pn53x_sim_halt_selected(data);
+      pn53x_sim_answer_byte(data, 0x00);
+      break;
+    case InSelect:
+    case InPSL:
+      pn53x_sim_answer_byte(data, (data->iSelectedTarget >= 0) ? 0x00 : ETIMEOUT);
+      break;
+    case TgInitAsTarget:
+      data->szInitiatorFramePos = 0;
+      if (data->szInitiatorFrames == 0) {
+        // No external initiator will ever show up
+        data->uiAnswerDelay = PN53X_SIM_NO_ANSWER;
+        break;
+      }
+      pn53x_sim_answer_byte(data, data->btActivationMode);
+      pn53x_sim_answer_append(data, data->initiator_frames[0].abtData, data->initiator_frames[0].szData);
+      data->szInitiatorFramePos = 1;
+      break;
+    case TgGetData:
+    case TgGetInitiatorCommand:
+      if (data->szInitiatorFramePos >= data->szInitiatorFrames) {
+        pn53x_sim_answer_byte(data, ETGREL);
+        break;
+      }
+      pn53x_sim_answer_byte(data, 0x00);
+      pn53x_sim_answer_append(data, data->initiator_frames[data->szInitiatorFramePos].abtData, data->initiator_frames[data->szInitiatorFramePos].szData);
+      data->szInitiatorFramePos++;
+      break;
+    case TgSetData:
+    case TgResponseToInitiator:
+    case TgSetGeneralBytes:
+    case TgSetMetaData:
+      pn53x_sim_answer_byte(data, 0x00);
+      break;
+    default:
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unsupported command: 0x%02x", pbtTx[0]);
+      return NFC_ENOTIMPL;
+  }
+  return NFC_SUCCESS;
+}
+
+static size_t
+pn53x_sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  // The simulator is only reachable through an explicit connection string
+  return 0;
+}
+
+static void
+pn53x_sim_close(nfc_device *pnd)
+{
+  pn53x_idle(pnd);
+  pn53x_data_free(pnd);
+  nfc_cancel_destroy(&DRIVER_DATA(pnd)->answered);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+pn53x_sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  char *script = NULL;
+  char *latency_s = NULL;
+  unsigned long ulLatency = 0;
+  int connstring_decode_level = connstring_decode(connstring, PN53X_SIM_DRIVER_NAME, NULL, &script, &latency_s);
+  if (connstring_decode_level < 1) {
+    return NULL;
+  }
+  if (connstring_decode_level == 3) {
+    if (sscanf(latency_s, "%lu", &ulLatency) != 1) {
+      // latency_s is not a number
+      free(script);
+      free(latency_s);
+      return NULL;
+    }
+    free(latency_s);
+  }
+
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    free(script);
+    return NULL;
+  }
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN53X_SIM_DRIVER_NAME, script ? script : "default");
+
+  pnd->driver_data = calloc(1, sizeof(struct pn53x_sim_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    free(script);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  struct pn53x_sim_data *data = DRIVER_DATA(pnd);
+  const uint8_t abtFirmware[] = { 0x32, 0x01, 0x06, 0x07 };
+  memcpy(data->abtFirmware, abtFirmware, sizeof(abtFirmware));
+  data->szFirmware = sizeof(abtFirmware);
+  for (size_t n = 0; n < 256; n++)
+    data->auiLatency[n] = ulLatency;
+  data->btMxRtyPassiveActivation = 0xff;
+  data->iSelectedTarget = -1;
+
+  if (script && (strcmp(script, "default") != 0)) {
+    int res = pn53x_sim_load_script(data, script);
+    free(script);
+    if (res < 0) {
+      nfc_device_free(pnd);
+      return NULL;
+    }
+  } else {
+    free(script);
+    pn53x_sim_default_field(data);
+  }
+
+  if (nfc_cancel_init(&data->answered) < 0) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn53x_sim_io) == NULL) {
+    perror("malloc");
+    nfc_cancel_destroy(&data->answered);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pnd->driver = &pn53x_sim_driver;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  if (pn53x_check_communication(pnd) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "pn53x_check_communication error");
+    pn53x_sim_close(pnd);
+    return NULL;
+  }
+
+  pn53x_init(pnd);
+  return pnd;
+}
+
+static int
+pn53x_sim_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  if (szData == 0) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  LOG_HEX(NFC_LOG_GROUP_COM, "TX", pbtData, szData);
+  // The answer to a previous command may have been left unreceived
+  nfc_cancel_take(&DRIVER_DATA(pnd)->answered);
+  if ((pnd->last_error = pn53x_sim_process(DRIVER_DATA(pnd), pbtData, szData)) < 0) {
+    return pnd->last_error;
+  }
+  if (DRIVER_DATA(pnd)->uiAnswerDelay != PN53X_SIM_NO_ANSWER)
+    nfc_cancel_signal(&DRIVER_DATA(pnd)->answered);
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_sim_receive_check(nfc_device *pnd, const size_t szDataLen, int timeout)
+{
+  struct pn53x_sim_data *data = DRIVER_DATA(pnd);
+
+  if ((pnd->last_error = pn53x_sim_wait(pnd, data->uiAnswerDelay, timeout)) < 0) {
+    return pnd->last_error;
+  }
+  nfc_cancel_take(&data->answered);
+  if (data->btCommand != CHIP_DATA(pnd)->last_command) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  if (data->szAnswer > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, data->szAnswer);
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  LOG_HEX(NFC_LOG_GROUP_COM, "RX", data->abtAnswer, data->szAnswer);
+  return NFC_SUCCESS;
+}
+
+static int
+pn53x_sim_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  struct pn53x_sim_data *data = DRIVER_DATA(pnd);
+  int res;
+
+  if ((res = pn53x_sim_receive_check(pnd, szDataLen, timeout)) < 0) {
+    return res;
+  }
+  memcpy(pbtData, data->abtAnswer, data->szAnswer);
+  return data->szAnswer;
+}
+
+static int
+pn53x_sim_receivev(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, int timeout)
+{
+  struct pn53x_sim_data *data = DRIVER_DATA(pnd);
+  int res;
+
+  if ((res = pn53x_sim_receive_check(pnd, pn53x_iov_len(iov, iovcnt), timeout)) < 0) {
+    return res;
+  }
+  pn53x_iov_scatter(iov, iovcnt, 0, data->abtAnswer, data->szAnswer);
+  return data->szAnswer;
+}
+
+static int
+pn53x_sim_get_pollfd(nfc_device *pnd)
+{
+  const int fd = nfc_cancel_fd(&DRIVER_DATA(pnd)->answered);
+  if (fd < 0) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  return fd;
+}
+
+static int
+pn53x_sim_receive_ready(nfc_device *pnd)
+{
+  return nfc_cancel_pending(&DRIVER_DATA(pnd)->answered);
+}
+
+const struct pn53x_io pn53x_sim_io = {
+  .send       = pn53x_sim_send,
+  .receive    = pn53x_sim_receive,
+  .receivev   = pn53x_sim_receivev,
+  .get_pollfd    = pn53x_sim_get_pollfd,
+  .receive_ready = pn53x_sim_receive_ready,
+};
+
+const struct nfc_driver pn53x_sim_driver = {
+  .name                             = PN53X_SIM_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = pn53x_sim_scan,
+  .open                             = pn53x_sim_open,
+  .close                            = pn53x_sim_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = pn532_initiator_init_secure_element,
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
+  .device_set_property_int      = pn53x_set_property_int,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = nfc_device_abort,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+
+  .device_get_pollfd                      = pn53x_get_pollfd,
+  .initiator_submit_select_passive_target = pn53x_initiator_submit_select_passive_target,
+  .initiator_submit_transceive_bytes      = pn53x_initiator_submit_transceive_bytes,
+  .target_submit_receive_bytes            = pn53x_target_submit_receive_bytes,
+  .target_submit_send_bytes               = pn53x_target_submit_send_bytes,
+  .device_complete                        = pn53x_complete,
+};
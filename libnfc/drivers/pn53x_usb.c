@@ -56,8 +56,6 @@ Thanks to d18c7db and Okko for example code
 #define LOG_CATEGORY "libnfc.driver.pn53x_usb"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
-#define USB_INFINITE_TIMEOUT   0
-
 #define DRIVER_DATA(pnd) ((struct pn53x_usb_data*)(pnd->driver_data))
 
 const nfc_modulation_type no_target_support[] = {0};
@@ -75,12 +73,11 @@ typedef enum {
 
 // Internal data struct
 struct pn53x_usb_data {
-  usb_dev_handle *pudh;
+  usbbus_handle *pudh;
   pn53x_usb_model model;
   uint32_t uiEndPointIn;
   uint32_t uiEndPointOut;
   uint32_t uiMaxPacketSize;
-  volatile bool abort_flag;
   bool possibly_corrupted_usbdesc;
 };
 
@@ -88,18 +85,15 @@ struct pn53x_usb_data {
 const struct pn53x_io pn53x_usb_io;
 
 // Prototypes
-bool pn53x_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char *buffer, size_t len);
+bool pn53x_usb_get_usb_device_name(const struct usbbus_device *dev, usbbus_handle *udev, char *buffer, size_t len);
 int pn53x_usb_init(nfc_device *pnd);
 
 static int
-pn53x_usb_bulk_read(struct pn53x_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
+pn53x_usb_bulk_read(struct pn53x_usb_data *data, uint8_t abtRx[], const size_t szRx, struct nfc_cancel *cancel, const int timeout)
 {
-  int res = usb_bulk_read(data->pudh, data->uiEndPointIn, (char *) abtRx, szRx, timeout);
+  int res = usbbus_bulk_read(data->pudh, data->uiEndPointIn, abtRx, szRx, cancel, timeout);
   if (res > 0) {
     LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, res);
-  } else if (res < 0) {
-    if (res != -USB_TIMEDOUT)
-      log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", _usb_strerror(res));
   }
   return res;
 }
@@ -108,14 +102,12 @@ static int
 pn53x_usb_bulk_write(struct pn53x_usb_data *data, uint8_t abtTx[], const size_t szTx, const int timeout)
 {
   LOG_HEX(NFC_LOG_GROUP_COM, "TX", abtTx, szTx);
-  int res = usb_bulk_write(data->pudh, data->uiEndPointOut, (char *) abtTx, szTx, timeout);
+  int res = usbbus_bulk_write(data->pudh, data->uiEndPointOut, abtTx, szTx, timeout);
   if (res > 0) {
     // HACK This little hack is a well know problem of USB, see http://www.libusb.org/ticket/6 for more details
     if ((res % data->uiMaxPacketSize) == 0) {
-      usb_bulk_write(data->pudh, data->uiEndPointOut, "\0", 0, timeout);
+      usbbus_bulk_write(data->pudh, data->uiEndPointOut, (const uint8_t *) "\0", 0, timeout);
     }
-  } else {
-    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", _usb_strerror(res));
   }
   return res;
 }
@@ -237,11 +229,11 @@ pn53x_usb_get_device_model(uint16_t vendor_id, uint16_t product_id)
 }
 
 static void
-pn53x_usb_get_end_points_default(struct usb_device *dev, struct pn53x_usb_data *data)
+pn53x_usb_get_end_points_default(const struct usbbus_device *dev, struct pn53x_usb_data *data)
 {
   for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
-    if ((dev->descriptor.idVendor == pn53x_usb_supported_devices[n].vendor_id) &&
-        (dev->descriptor.idProduct == pn53x_usb_supported_devices[n].product_id)) {
+    if ((dev->idVendor == pn53x_usb_supported_devices[n].vendor_id) &&
+        (dev->idProduct == pn53x_usb_supported_devices[n].product_id)) {
       if (pn53x_usb_supported_devices[n].uiMaxPacketSize != 0) {
         data->uiEndPointIn = pn53x_usb_supported_devices[n].uiEndPointIn;
         data->uiEndPointOut = pn53x_usb_supported_devices[n].uiEndPointOut;
@@ -257,34 +249,13 @@ pn53x_usb_get_end_points_default(struct usb_device *dev, struct pn53x_usb_data *
 
 int  pn53x_usb_ack(nfc_device *pnd);
 
-// Find transfer endpoints for bulk transfers
+// Bulk transfer endpoints, as found by usbbus_list_devices()
 static void
-pn53x_usb_get_end_points(struct usb_device *dev, struct pn53x_usb_data *data)
+pn53x_usb_get_end_points(const struct usbbus_device *dev, struct pn53x_usb_data *data)
 {
-  uint32_t uiIndex;
-  uint32_t uiEndPoint;
-  struct usb_interface_descriptor *puid = dev->config->interface->altsetting;
-
-  // 3 Endpoints maximum: Interrupt In, Bulk In, Bulk Out
-  for (uiIndex = 0; uiIndex < puid->bNumEndpoints; uiIndex++) {
-    // Only accept bulk transfer endpoints (ignore interrupt endpoints)
-    if (puid->endpoint[uiIndex].bmAttributes != USB_ENDPOINT_TYPE_BULK)
-      continue;
-
-    // Copy the endpoint to a local var, makes it more readable code
-    uiEndPoint = puid->endpoint[uiIndex].bEndpointAddress;
-
-    // Test if we dealing with a bulk IN endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_IN) {
-      data->uiEndPointIn = uiEndPoint;
-      data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
-    }
-    // Test if we dealing with a bulk OUT endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_OUT) {
-      data->uiEndPointOut = uiEndPoint;
-      data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
-    }
-  }
+  data->uiEndPointIn = dev->uiEndPointIn;
+  data->uiEndPointOut = dev->uiEndPointOut;
+  data->uiMaxPacketSize = dev->uiMaxPacketSize;
 }
 
 static size_t
@@ -292,62 +263,45 @@ pn53x_usb_scan(const nfc_context *context, nfc_connstring connstrings[], const s
 {
   (void)context;
 
-  usb_prepare();
+  if (usbbus_prepare() < 0)
+    return 0;
 
   size_t device_found = 0;
-  uint32_t uiBusIndex = 0;
-  struct usb_bus *bus;
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
-    struct usb_device *dev;
-
-    for (dev = bus->devices; dev; dev = dev->next, uiBusIndex++) {
-      for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
-        if ((pn53x_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-            (pn53x_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
-          // Make sure there are 2 endpoints available
-          // with libusb-win32 we got some null pointers so be robust before looking at endpoints:
-          if (dev->config == NULL) {
-            // We tolerate null config if we have defaults
-            if (pn53x_usb_supported_devices[n].uiMaxPacketSize == 0)
-              // Nope, we maybe want the next one, let's try to find another
-              continue;
-          } else {
-            if (dev->config->interface == NULL || dev->config->interface->altsetting == NULL) {
-              // Nope, we maybe want the next one, let's try to find another
-              continue;
-            }
-            if (dev->config->interface->altsetting->bNumEndpoints < 2) {
-              // Nope, we maybe want the next one, let's try to find another
-              continue;
-            }
-          }
-
-          usb_dev_handle *udev = usb_open(dev);
-          if (udev == NULL)
-            continue;
+  struct usbbus_device *devices;
+  const size_t szDevices = usbbus_list_devices(&devices);
+  for (size_t i = 0; (i < szDevices) && (device_found < connstrings_len); i++) {
+    const struct usbbus_device *dev = &devices[i];
 
-          // Set configuration
-          int res = usb_set_configuration(udev, 1);
-          if (res < 0) {
-            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
-            usb_close(udev);
-            // we failed to use the device
+    for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
+      if ((pn53x_usb_supported_devices[n].vendor_id == dev->idVendor) &&
+          (pn53x_usb_supported_devices[n].product_id == dev->idProduct)) {
+        // Make sure there are 2 endpoints available
+        if (!dev->bHasConfig) {
+          // We tolerate null config if we have defaults
+          if (pn53x_usb_supported_devices[n].uiMaxPacketSize == 0)
+            // Nope, we maybe want the next one, let's try to find another
             continue;
-          }
-
-          // pn53x_usb_get_usb_device_name (dev, udev, pnddDevices[device_found].acDevice, sizeof (pnddDevices[device_found].acDevice));
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s", bus->dirname, dev->filename);
-          usb_close(udev);
-          snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", PN53X_USB_DRIVER_NAME, bus->dirname, dev->filename);
-          device_found++;
-          // Test if we reach the maximum "wanted" devices
-          if (device_found == connstrings_len) {
-            return device_found;
-          }
+        } else if (dev->bNumEndpoints < 2) {
+          // Nope, we maybe want the next one, let's try to find another
+          continue;
         }
+
+        // Check configuration can be set, usbbus remembers it while the device stays plugged
+        if (usbbus_check_device(dev, 1) < 0) {
+          // we failed to use the device
+          continue;
+        }
+
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s", dev->dirname, dev->filename);
+        snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", PN53X_USB_DRIVER_NAME, dev->dirname, dev->filename);
+        device_found++;
+        // Test if we reach the maximum "wanted" devices
+        if (device_found == connstrings_len)
+          break;
       }
     }
   }
+  usbbus_free_devices(devices, szDevices);
 
   return device_found;
 }
@@ -358,23 +312,23 @@ struct pn53x_usb_descriptor {
 };
 
 bool
-pn53x_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char *buffer, size_t len)
+pn53x_usb_get_usb_device_name(const struct usbbus_device *dev, usbbus_handle *udev, char *buffer, size_t len)
 {
   *buffer = '\0';
 
-  if (dev->descriptor.iManufacturer || dev->descriptor.iProduct) {
+  if (dev->iManufacturer || dev->iProduct) {
     if (udev) {
-      usb_get_string_simple(udev, dev->descriptor.iManufacturer, buffer, len);
+      usbbus_get_string(udev, dev->iManufacturer, buffer, len);
       if (strlen(buffer) > 0)
         strcpy(buffer + strlen(buffer), " / ");
-      usb_get_string_simple(udev, dev->descriptor.iProduct, buffer + strlen(buffer), len - strlen(buffer));
+      usbbus_get_string(udev, dev->iProduct, buffer + strlen(buffer), len - strlen(buffer));
     }
   }
 
   if (!*buffer) {
     for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
-      if ((pn53x_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-          (pn53x_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
+      if ((pn53x_usb_supported_devices[n].vendor_id == dev->idVendor) &&
+          (pn53x_usb_supported_devices[n].product_id == dev->idProduct)) {
         strncpy(buffer, pn53x_usb_supported_devices[n].name, len);
         buffer[len - 1] = '\0';
         return true;
@@ -389,6 +343,8 @@ static nfc_device *
 pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
 {
   nfc_device *pnd = NULL;
+  struct usbbus_device *devices = NULL;
+  size_t szDevices = 0;
   struct pn53x_usb_descriptor desc = { NULL, NULL };
   int connstring_decode_level = connstring_decode(connstring, PN53X_USB_DRIVER_NAME, "usb", &desc.dirname, &desc.filename);
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d element(s) have been decoded from \"%s\"", connstring_decode_level, connstring);
@@ -402,110 +358,103 @@ pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
     .uiEndPointOut = 0,
     .possibly_corrupted_usbdesc = false,
   };
-  struct usb_bus *bus;
-  struct usb_device *dev;
 
-  usb_prepare();
+  if (usbbus_prepare() < 0)
+    goto free_mem;
 
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
+  szDevices = usbbus_list_devices(&devices);
+  for (size_t i = 0; i < szDevices; i++) {
+    const struct usbbus_device *dev = &devices[i];
     if (connstring_decode_level > 1)  {
       // A specific bus have been specified
-      if (0 != strcmp(bus->dirname, desc.dirname))
+      if (0 != strcmp(dev->dirname, desc.dirname))
         continue;
     }
-    for (dev = bus->devices; dev; dev = dev->next) {
-      if (connstring_decode_level > 2)  {
-        // A specific dev have been specified
-        if (0 != strcmp(dev->filename, desc.filename))
-          continue;
-      }
-      // Open the USB device
-      if ((data.pudh = usb_open(dev)) == NULL)
+    if (connstring_decode_level > 2)  {
+      // A specific dev have been specified
+      if (0 != strcmp(dev->filename, desc.filename))
         continue;
-      // Retrieve end points, using default if dev->config is broken
-      if (dev->config == NULL) {
-        pn53x_usb_get_end_points_default(dev, &data);
-        data.possibly_corrupted_usbdesc = true;
-      } else {
-        pn53x_usb_get_end_points(dev, &data);
-      }
-      // Set configuration
-      int res = usb_set_configuration(data.pudh, 1);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
-        if (EPERM == -res) {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: Please double check USB permissions for device %04x:%04x", dev->descriptor.idVendor, dev->descriptor.idProduct);
-        }
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
+    }
+    // Open the USB device
+    if ((data.pudh = usbbus_open(dev)) == NULL)
+      continue;
+    // Retrieve end points, using default if dev->config is broken
+    if (!dev->bHasConfig) {
+      pn53x_usb_get_end_points_default(dev, &data);
+      data.possibly_corrupted_usbdesc = true;
+    } else {
+      pn53x_usb_get_end_points(dev, &data);
+    }
+    // Set configuration
+    int res = usbbus_set_configuration(data.pudh, 1);
+    if (res < 0) {
+      usbbus_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
 
-      res = usb_claim_interface(data.pudh, 0);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", _usb_strerror(res));
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
-      data.model = pn53x_usb_get_device_model(dev->descriptor.idVendor, dev->descriptor.idProduct);
-      // Allocate memory for the device info and specification, fill it and return the info
-      pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        goto error;
-      }
-      pn53x_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
+    res = usbbus_claim_interface(data.pudh, 0);
+    if (res < 0) {
+      usbbus_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
+    data.model = pn53x_usb_get_device_model(dev->idVendor, dev->idProduct);
+    // Allocate memory for the device info and specification, fill it and return the info
+    pnd = nfc_device_new(context, connstring);
+    if (!pnd) {
+      perror("malloc");
+      goto error;
+    }
+    pn53x_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
 
-      pnd->driver_data = malloc(sizeof(struct pn53x_usb_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        goto error;
-      }
-      *DRIVER_DATA(pnd) = data;
+    pnd->driver_data = malloc(sizeof(struct pn53x_usb_data));
+    if (!pnd->driver_data) {
+      perror("malloc");
+      goto error;
+    }
+    *DRIVER_DATA(pnd) = data;
 
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn53x_usb_io) == NULL) {
-        perror("malloc");
-        goto error;
-      }
+    // Alloc and init chip's data
+    if (pn53x_data_new(pnd, &pn53x_usb_io) == NULL) {
+      perror("malloc");
+      goto error;
+    }
 
-      switch (DRIVER_DATA(pnd)->model) {
-        // empirical tuning
-        case ASK_LOGO:
-          CHIP_DATA(pnd)->timer_correction = 50;
-          CHIP_DATA(pnd)->progressive_field = true;
-          break;
-        case SCM_SCL3711:
-        case SCM_SCL3712:
-        case NXP_PN533:
-          CHIP_DATA(pnd)->timer_correction = 46;
-          break;
-        case NXP_PN531:
-          CHIP_DATA(pnd)->timer_correction = 50;
-          break;
-        case SONY_PN531:
-          CHIP_DATA(pnd)->timer_correction = 54;
-          break;
-        case SONY_RCS360:
-        case UNKNOWN:
-          CHIP_DATA(pnd)->timer_correction = 0;   // TODO: allow user to know if timed functions are available
-          break;
-      }
-      pnd->driver = &pn53x_usb_driver;
+    switch (DRIVER_DATA(pnd)->model) {
+      // empirical tuning
+      case ASK_LOGO:
+        CHIP_DATA(pnd)->timer_correction = 50;
+        CHIP_DATA(pnd)->progressive_field = true;
+        break;
+      case SCM_SCL3711:
+      case SCM_SCL3712:
+      case NXP_PN533:
+        CHIP_DATA(pnd)->timer_correction = 46;
+        break;
+      case NXP_PN531:
+        CHIP_DATA(pnd)->timer_correction = 50;
+        break;
+      case SONY_PN531:
+        CHIP_DATA(pnd)->timer_correction = 54;
+        break;
+      case SONY_RCS360:
+      case UNKNOWN:
+        CHIP_DATA(pnd)->timer_correction = 0;   // TODO: allow user to know if timed functions are available
+        break;
+    }
+    pnd->driver = &pn53x_usb_driver;
 
-      // HACK1: Send first an ACK as Abort command, to reset chip before talking to it:
-      pn53x_usb_ack(pnd);
+    // HACK1: Send first an ACK as Abort command, to reset chip before talking to it:
+    pn53x_usb_ack(pnd);
 
-      // HACK2: Then send a GetFirmware command to resync USB toggle bit between host & device
-      // in case host used set_configuration and expects the device to have reset its toggle bit, which PN53x doesn't do
-      if (pn53x_usb_init(pnd) < 0) {
-        usb_close(data.pudh);
-        goto error;
-      }
-      DRIVER_DATA(pnd)->abort_flag = false;
-      goto free_mem;
+    // HACK2: Then send a GetFirmware command to resync USB toggle bit between host & device
+    // in case host used set_configuration and expects the device to have reset its toggle bit, which PN53x doesn't do
+    if (pn53x_usb_init(pnd) < 0) {
+      usbbus_close(data.pudh);
+      goto error;
     }
+    goto free_mem;
   }
   // We ran out of devices before the index required
   goto free_mem;
@@ -515,6 +464,7 @@ error:
   nfc_device_free(pnd);
   pnd = NULL;
 free_mem:
+  usbbus_free_devices(devices, szDevices);
   free(desc.dirname);
   free(desc.filename);
   return pnd;
@@ -536,14 +486,8 @@ pn53x_usb_close(nfc_device *pnd)
 
   pn53x_idle(pnd);
 
-  int res;
-  if ((res = usb_release_interface(DRIVER_DATA(pnd)->pudh, 0)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", _usb_strerror(res));
-  }
-
-  if ((res = usb_close(DRIVER_DATA(pnd)->pudh)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to close USB connection (%s)", _usb_strerror(res));
-  }
+  usbbus_release_interface(DRIVER_DATA(pnd)->pudh, 0);
+  usbbus_close(DRIVER_DATA(pnd)->pudh);
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -551,13 +495,14 @@ pn53x_usb_close(nfc_device *pnd)
 #define PN53X_USB_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
 
 static int
-pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
+pn53x_usb_sendv(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, const int timeout)
 {
   uint8_t  abtFrame[PN53X_USB_BUFFER_LEN] = { 0x00, 0x00, 0xff };  // Every packet must start with "00 00 ff"
   size_t szFrame = 0;
   int res = 0;
+  const size_t szData = pn53x_iov_len(iov, iovcnt);
 
-  if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
+  if ((res = pn53x_build_framev(abtFrame, &szFrame, iov, iovcnt)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
@@ -569,7 +514,7 @@ pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, con
   }
 
   uint8_t abtRxBuf[PN53X_USB_BUFFER_LEN];
-  if ((res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), timeout)) < 0) {
+  if ((res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), NULL, timeout)) < 0) {
     // try to interrupt current device state
     pn53x_usb_ack(pnd);
     pnd->last_error = res;
@@ -596,47 +541,29 @@ pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, con
   return NFC_SUCCESS;
 }
 
-#define USB_TIMEOUT_PER_PASS 200
 static int
-pn53x_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
+{
+  const struct pn53x_iovec iov = { (uint8_t *) pbtData, szData };
+  return pn53x_usb_sendv(pnd, &iov, 1, timeout);
+}
+
+static int
+pn53x_usb_receivev(nfc_device *pnd, const struct pn53x_iovec *iov, const size_t iovcnt, const int timeout)
 {
+  const size_t szDataLen = pn53x_iov_len(iov, iovcnt);
   size_t len;
   off_t offset = 0;
 
   uint8_t  abtRxBuf[PN53X_USB_BUFFER_LEN];
   int res;
 
-  /*
-   * If no timeout is specified but the command is blocking, force a 200ms (USB_TIMEOUT_PER_PASS)
-   * timeout to allow breaking the loop if the user wants to stop it.
-   */
-  int usb_timeout;
-  int remaining_time = timeout;
-read:
-  if (timeout == USB_INFINITE_TIMEOUT) {
-    usb_timeout = USB_TIMEOUT_PER_PASS;
-  } else {
-    // A user-provided timeout is set, we have to cut it in multiple chunk to be able to keep an nfc_abort_command() mecanism
-    remaining_time -= USB_TIMEOUT_PER_PASS;
-    if (remaining_time <= 0) {
-      pnd->last_error = NFC_ETIMEOUT;
-      return pnd->last_error;
-    } else {
-      usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
-    }
-  }
-
-  res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), usb_timeout);
+  // nfc_abort_command() makes this wait return NFC_EOPABORTED
+  res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), &pnd->cancel, timeout);
 
-  if (res == -USB_TIMEDOUT) {
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      DRIVER_DATA(pnd)->abort_flag = false;
-      pn53x_usb_ack(pnd);
-      pnd->last_error = NFC_EOPABORTED;
-      return pnd->last_error;
-    } else {
-      goto read;
-    }
+  if (res == NFC_ETIMEOUT) {
+    pnd->last_error = res;
+    return pnd->last_error;
   }
 
   if (res < 0) {
@@ -707,14 +634,13 @@ read:
   }
   offset += 1;
 
-  memcpy(pbtData, abtRxBuf + offset, len);
-  offset += len;
-
   uint8_t btDCS = (256 - 0xD5);
   btDCS -= CHIP_DATA(pnd)->last_command + 1;
   for (size_t szPos = 0; szPos < len; szPos++) {
-    btDCS -= pbtData[szPos];
+    btDCS -= abtRxBuf[offset + szPos];
   }
+  pn53x_iov_scatter(iov, iovcnt, 0, abtRxBuf + offset, len);
+  offset += len;
 
   if (btDCS != abtRxBuf[offset]) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
@@ -740,6 +666,13 @@ pn53x_usb_ack(nfc_device *pnd)
   return pn53x_usb_bulk_write(DRIVER_DATA(pnd), (uint8_t *) pn53x_ack_frame, sizeof(pn53x_ack_frame), 1000);
 }
 
+static int
+pn53x_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+{
+  const struct pn53x_iovec iov = { pbtData, szDataLen };
+  return pn53x_usb_receivev(pnd, &iov, 1, timeout);
+}
+
 int
 pn53x_usb_init(nfc_device *pnd)
 {
@@ -841,13 +774,6 @@ pn53x_usb_set_property_bool(nfc_device *pnd, const nfc_property property, const
   return NFC_SUCCESS;
 }
 
-static int
-pn53x_usb_abort_command(nfc_device *pnd)
-{
-  DRIVER_DATA(pnd)->abort_flag = true;
-  return NFC_SUCCESS;
-}
-
 static int
 pn53x_usb_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt)
 {
@@ -861,6 +787,8 @@ pn53x_usb_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const n
 const struct pn53x_io pn53x_usb_io = {
   .send       = pn53x_usb_send,
   .receive    = pn53x_usb_receive,
+  .sendv      = pn53x_usb_sendv,
+  .receivev   = pn53x_usb_receivev,
 };
 
 const struct nfc_driver pn53x_usb_driver = {
@@ -878,6 +806,7 @@ const struct nfc_driver pn53x_usb_driver = {
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_batch       = pn53x_initiator_transceive_batch,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
@@ -890,12 +819,13 @@ const struct nfc_driver pn53x_usb_driver = {
   .target_receive_bits   = pn53x_target_receive_bits,
 
   .device_set_property_bool     = pn53x_usb_set_property_bool,
+  .device_set_properties        = pn53x_set_properties,
   .device_set_property_int      = pn53x_set_property_int,
   .get_supported_modulation     = pn53x_usb_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
 
-  .abort_command  = pn53x_usb_abort_command,
+  .abort_command  = nfc_device_abort,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
 };
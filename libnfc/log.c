@@ -32,6 +32,17 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#ifndef _WIN32
+#  include <sched.h>
+#  include <syslog.h>
+#  include <time.h>
+#  include <unistd.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#endif
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
 
 const char *
 log_priority_to_str(const int priority)
@@ -54,55 +65,649 @@ log_priority_to_str(const int priority)
 
 #include "log-internal.h"
 
-void
-log_init(const nfc_context *context)
-{
-#ifdef ENVVARS
-  char str[32];
-  sprintf(str, "%"PRIu32, context->log_level);
-  setenv("LIBNFC_LOG_LEVEL", str, 1);
+#ifdef DEBUG
+#  define LOG_MASK_DEFAULT 0x0fffffff // log_level = 3
+#else
+#  define LOG_MASK_DEFAULT 0x03333333 // log_level = 1
+#endif
+
+#if defined(__GNUC__)
+#  define log_load(p)           __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#  define log_store(p, v)       __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#  define log_load_acquire(p)   __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#  define log_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#  define log_fetch_add(p, v)   __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#  define log_fetch_sub(p, v)   __atomic_fetch_sub((p), (v), __ATOMIC_SEQ_CST)
+#  define log_cas(p, e, v)      __atomic_compare_exchange_n((p), (e), (v), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#elif defined(HAVE_PTHREAD)
+#  error "The background log writer needs GCC compatible atomic builtins"
+#else
+#  define log_load(p)           (*(p))
+#endif
+
+uint32_t log_mask = LOG_MASK_DEFAULT;
+
+// Set by log_set_quiet() to silence the calling thread only
+#if defined(__GNUC__)
+static __thread bool log_quiet = false;
 #else
-  (void)context;
+static bool log_quiet = false;
 #endif
+
+struct log_writer;
+
+/*
+ * Log sinks, process-wide like the log mask since log_put() has no context.
+ * log_put() reads them through a single pointer, so that a callback is never
+ * called with the user data of another one. Updates are serialized, build a
+ * new configuration, publish it and free the previous one once no log_put()
+ * can still be using it. NULL stands for the default: stderr, no writer.
+ */
+struct log_config {
+  /** Synchronous log callback, NULL to print on stderr */
+  nfc_log_callback callback;
+  void *user_data;
+  /** Context which set the callback, which unsets it when it exits */
+  const nfc_context *callback_owner;
+  /** Background log writer, NULL when messages are output synchronously */
+  struct log_writer *writer;
+};
+
+static struct log_config *log_config = NULL;
+
+static uint32_t
+log_level_to_mask(const uint32_t log_level)
+{
+  uint32_t mask = 0;
+
+  if (log_level) { // If log is not disabled by log_level=none
+    for (uint8_t group = 0; group <= NFC_LOG_GROUP_LIBUSB; group++) {
+      uint32_t threshold = log_level & 0x00000003; // Global log level
+      if (((log_level >> (group * 2)) & 0x00000003) > threshold)
+        threshold = (log_level >> (group * 2)) & 0x00000003; // Group log level
+      mask |= ((1u << (threshold + 1)) - 1) << (group * 4);
+    }
+  }
+  return mask;
+}
+
+#ifdef HAVE_PTHREAD
+
+#define LOG_MESSAGE_MAX_LEN 1024
+
+struct log_record {
+  /** Vyukov's bounded queue cell sequence number */
+  uint64_t seq;
+  int priority;
+  /** Categories are string literals (LOG_CATEGORY) so they need no copy */
+  const char *category;
+  char message[LOG_MESSAGE_MAX_LEN];
+};
+
+/*
+ * Background log writer: producers (any thread calling log_put()) claim a
+ * record of a bounded MPSC queue with a CAS, format the message into it and
+ * publish it. The writer thread formats the line and does the I/O. When the
+ * queue is full the message is dropped and counted, producers never block.
+ */
+struct log_writer {
+  nfc_log_sink sink;
+  FILE *file;
+  int fd;
+  nfc_log_callback callback;
+  void *user_data;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int sleeping;
+  int stop;
+
+  uint64_t enqueue_pos;
+  uint64_t dequeue_pos;
+  unsigned long dropped;
+  unsigned long reported;
+
+  size_t mask;
+  struct log_record records[];
+};
+
+// Contexts which started the writer, which runs until the last one stops it
+static unsigned int log_writer_refs = 0;
+
+// Serializes the updates of log_config
+static pthread_mutex_t log_config_mutex = PTHREAD_MUTEX_INITIALIZER;
+#  define log_config_mutex_lock()   pthread_mutex_lock(&log_config_mutex)
+#  define log_config_mutex_unlock() pthread_mutex_unlock(&log_config_mutex)
+
+/*
+ * log_put() calls in progress, counted in the slot of the epoch they started
+ * in: an update waits for both slots to drain in turn, which does not starve
+ * when other threads keep logging since new calls go to the other slot.
+ */
+static unsigned int log_config_epoch = 0;
+static unsigned int log_config_readers[2] = { 0, 0 };
+
+static const struct log_config *
+log_config_get(unsigned int *slot)
+{
+  *slot = log_load(&log_config_epoch) & 1;
+  log_fetch_add(&log_config_readers[*slot], 1);
+  return log_load(&log_config);
+}
+
+static void
+log_config_put(const unsigned int slot)
+{
+  log_fetch_sub(&log_config_readers[slot], 1);
+}
+
+/*
+ * Publish config, with log_config_mutex held, and return the previous one
+ * once no log_put() can be using it anymore.
+ */
+static struct log_config *
+log_config_publish(struct log_config *config)
+{
+  struct log_config *old = log_load(&log_config);
+
+  if (config && !config->callback && !config->writer) {
+    free(config);
+    config = NULL;
+  }
+  log_store(&log_config, config);
+  for (int i = 0; i < 2; i++) {
+    const unsigned int slot = log_fetch_add(&log_config_epoch, 1) & 1;
+    while (log_load(&log_config_readers[slot]))
+      sched_yield();
+  }
+  return old;
+}
+
+#else // HAVE_PTHREAD
+
+// Without threads log_put() cannot run during an update
+#  define log_config_mutex_lock()   ((void) 0)
+#  define log_config_mutex_unlock() ((void) 0)
+
+static const struct log_config *
+log_config_get(unsigned int *slot)
+{
+  *slot = 0;
+  return log_config;
+}
+
+#  define log_config_put(slot) ((void) (slot))
+
+static struct log_config *
+log_config_publish(struct log_config *config)
+{
+  struct log_config *old = log_config;
+
+  if (config && !config->callback && !config->writer) {
+    free(config);
+    config = NULL;
+  }
+  log_config = config;
+  return old;
+}
+
+#endif // HAVE_PTHREAD
+
+/*
+ * Copy of the current configuration, to be modified then published, with
+ * the update lock held.
+ */
+static struct log_config *
+log_config_copy(void)
+{
+  struct log_config *config = malloc(sizeof(*config));
+
+  if (!config)
+    return NULL;
+  if (log_config) {
+    *config = *log_config;
+  } else {
+    memset(config, 0x00, sizeof(*config));
+  }
+  return config;
+}
+
+#ifdef HAVE_PTHREAD
+
+static bool
+log_writer_push(struct log_writer *writer, const int priority, const char *category, const char *format, va_list va)
+{
+  struct log_record *record;
+  uint64_t pos = log_load(&writer->enqueue_pos);
+
+  for (;;) {
+    record = &writer->records[pos & writer->mask];
+    const int64_t diff = (int64_t) log_load_acquire(&record->seq) - (int64_t) pos;
+    if (diff == 0) {
+      if (log_cas(&writer->enqueue_pos, &pos, pos + 1))
+        break;
+    } else if (diff < 0) {
+      log_fetch_add(&writer->dropped, 1);
+      return false;
+    } else {
+      pos = log_load(&writer->enqueue_pos);
+    }
+  }
+
+  record->priority = priority;
+  record->category = category;
+  vsnprintf(record->message, sizeof(record->message), format, va);
+  log_store(&record->seq, pos + 1);
+
+  if (log_load(&writer->sleeping)) {
+    pthread_mutex_lock(&writer->mutex);
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+  }
+  return true;
+}
+
+static int
+log_syslog_priority(const int priority)
+{
+  switch (priority) {
+    case NFC_LOG_PRIORITY_ERROR:
+      return LOG_ERR;
+    case NFC_LOG_PRIORITY_INFO:
+      return LOG_INFO;
+    case NFC_LOG_PRIORITY_DEBUG:
+      return LOG_DEBUG;
+    default:
+      break;
+  }
+  return LOG_NOTICE;
+}
+
+static void
+log_writer_output(struct log_writer *writer, const int priority, const char *category, char *message)
+{
+  switch (writer->sink) {
+    case NFC_LOG_SINK_STDERR:
+    case NFC_LOG_SINK_FILE:
+      fprintf(writer->file, "%s\t%s\t%s\n", log_priority_to_str(priority), category, message);
+      break;
+    case NFC_LOG_SINK_CALLBACK:
+      writer->callback(priority, category, message, writer->user_data);
+      break;
+    case NFC_LOG_SINK_SYSLOG:
+      syslog(log_syslog_priority(priority), "%s\t%s", category, message);
+      break;
+    case NFC_LOG_SINK_JOURNALD: {
+      // Native journal protocol: one datagram of KEY=value lines
+      char datagram[LOG_MESSAGE_MAX_LEN + 128];
+      for (char *p = message; *p; p++) {
+        if (*p == '\n')
+          *p = ' ';
+      }
+      const int len = snprintf(datagram, sizeof(datagram), "PRIORITY=%d\nSYSLOG_IDENTIFIER=libnfc\nNFC_LOG_CATEGORY=%s\nMESSAGE=%s\n",
+                               log_syslog_priority(priority), category, message);
+      if (len > 0)
+        (void) send(writer->fd, datagram, ((size_t) len < sizeof(datagram)) ? (size_t) len : sizeof(datagram) - 1, 0);
+      break;
+    }
+  }
+}
+
+static bool
+log_writer_pop(struct log_writer *writer)
+{
+  struct log_record *record = &writer->records[writer->dequeue_pos & writer->mask];
+
+  if (log_load_acquire(&record->seq) != writer->dequeue_pos + 1)
+    return false;
+  log_writer_output(writer, record->priority, record->category, record->message);
+  log_store_release(&record->seq, writer->dequeue_pos + writer->mask + 1);
+  writer->dequeue_pos++;
+  return true;
+}
+
+static void *
+log_writer_thread(void *arg)
+{
+  struct log_writer *writer = arg;
+
+  for (;;) {
+    while (log_writer_pop(writer))
+      ;
+
+    const unsigned long dropped = log_load(&writer->dropped);
+    if (dropped != writer->reported) {
+      char message[64];
+      snprintf(message, sizeof(message), "%lu log message(s) dropped", dropped - writer->reported);
+      log_writer_output(writer, NFC_LOG_PRIORITY_ERROR, "libnfc.log", message);
+      writer->reported = dropped;
+    }
+    if (writer->file)
+      fflush(writer->file);
+
+    pthread_mutex_lock(&writer->mutex);
+    log_store(&writer->sleeping, 1);
+    const struct log_record *next = &writer->records[writer->dequeue_pos & writer->mask];
+    if (log_load(&next->seq) != writer->dequeue_pos + 1) {
+      if (log_load(&writer->stop)) {
+        pthread_mutex_unlock(&writer->mutex);
+        break;
+      }
+      // Records still being formatted are picked up at next wakeup at worst
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += 100000000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&writer->cond, &writer->mutex, &deadline);
+    }
+    log_store(&writer->sleeping, 0);
+    pthread_mutex_unlock(&writer->mutex);
+  }
+  return NULL;
+}
+
+static void
+log_writer_free(struct log_writer *writer)
+{
+  if (writer->file && (writer->file != stderr))
+    fclose(writer->file);
+  if (writer->fd >= 0)
+    close(writer->fd);
+  if (writer->sink == NFC_LOG_SINK_SYSLOG)
+    closelog();
+  pthread_cond_destroy(&writer->cond);
+  pthread_mutex_destroy(&writer->mutex);
+  free(writer);
+}
+
+static int
+log_writer_open(struct log_writer *writer, const char *path)
+{
+  switch (writer->sink) {
+    case NFC_LOG_SINK_STDERR:
+      writer->file = stderr;
+      break;
+    case NFC_LOG_SINK_CALLBACK:
+      if (!writer->callback)
+        return NFC_EINVARG;
+      break;
+    case NFC_LOG_SINK_FILE:
+      if (!path)
+        return NFC_EINVARG;
+      if (!(writer->file = fopen(path, "a")))
+        return NFC_EIO;
+      break;
+    case NFC_LOG_SINK_SYSLOG:
+      openlog("libnfc", LOG_PID, LOG_USER);
+      break;
+    case NFC_LOG_SINK_JOURNALD: {
+      struct sockaddr_un sa;
+      memset(&sa, 0, sizeof(sa));
+      sa.sun_family = AF_UNIX;
+      strncpy(sa.sun_path, path ? path : "/run/systemd/journal/socket", sizeof(sa.sun_path) - 1);
+      if ((writer->fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+        return NFC_EIO;
+      if (connect(writer->fd, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+        return NFC_EIO;
+      break;
+    }
+    default:
+      return NFC_EINVARG;
+  }
+  return NFC_SUCCESS;
+}
+
+static void
+log_writer_stop(struct log_writer *writer)
+{
+  pthread_mutex_lock(&writer->mutex);
+  log_store(&writer->stop, 1);
+  pthread_cond_signal(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+  pthread_join(writer->thread, NULL);
+  log_writer_free(writer);
+}
+
+int
+log_start_writer(nfc_context *context, const nfc_log_sink sink, const char *path, const size_t queue_len)
+{
+  struct log_writer *writer;
+  struct log_config *config;
+  size_t size = 2;
+
+  if ((queue_len == 0) || (queue_len > (SIZE_MAX - sizeof(*writer)) / sizeof(writer->records[0]) / 2))
+    return NFC_EINVARG;
+  while (size < queue_len)
+    size <<= 1;
+
+  if (!(writer = malloc(sizeof(*writer) + size * sizeof(writer->records[0]))))
+    return NFC_ESOFT;
+  writer->sink = sink;
+  writer->file = NULL;
+  writer->fd = -1;
+  writer->callback = NULL;
+  writer->user_data = NULL;
+  writer->sleeping = 0;
+  writer->stop = 0;
+  writer->enqueue_pos = 0;
+  writer->dequeue_pos = 0;
+  writer->dropped = 0;
+  writer->reported = 0;
+  writer->mask = size - 1;
+  for (size_t i = 0; i < size; i++)
+    writer->records[i].seq = i;
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+
+  log_config_mutex_lock();
+  if (log_config) {
+    writer->callback = log_config->callback;
+    writer->user_data = log_config->user_data;
+  }
+  int res;
+  if ((res = log_writer_open(writer, path)) < 0) {
+    log_config_mutex_unlock();
+    log_writer_free(writer);
+    return res;
+  }
+  if (!(config = log_config_copy())) {
+    log_config_mutex_unlock();
+    log_writer_free(writer);
+    return NFC_ESOFT;
+  }
+  if (pthread_create(&writer->thread, NULL, log_writer_thread, writer) != 0) {
+    log_config_mutex_unlock();
+    free(config);
+    log_writer_free(writer);
+    return NFC_ESOFT;
+  }
+  config->writer = writer;
+  struct log_config *old = log_config_publish(config);
+  if (!context->log_writer_ref) {
+    context->log_writer_ref = true;
+    log_writer_refs++;
+  }
+  log_config_mutex_unlock();
+
+  // The previous writer, unpublished, is stopped once the new one is ready
+  if (old) {
+    if (old->writer)
+      log_writer_stop(old->writer);
+    free(old);
+  }
+  return NFC_SUCCESS;
 }
 
 void
-log_exit(void)
+log_stop_writer(nfc_context *context)
 {
+  struct log_config *config;
+  struct log_config *old = NULL;
+
+  log_config_mutex_lock();
+  if (!context->log_writer_ref) {
+    log_config_mutex_unlock();
+    return;
+  }
+  context->log_writer_ref = false;
+  if (--log_writer_refs == 0) {
+    if (!(config = log_config_copy())) {
+      // Keep the writer running rather than freeing it under producers
+      log_writer_refs++;
+      log_config_mutex_unlock();
+      return;
+    }
+    config->writer = NULL;
+    old = log_config_publish(config);
+  }
+  log_config_mutex_unlock();
+
+  if (old) {
+    if (old->writer)
+      log_writer_stop(old->writer);
+    free(old);
+  }
+}
+
+unsigned long
+log_get_dropped(const nfc_context *context)
+{
+  unsigned long dropped = 0;
+  unsigned int slot;
+
+  (void) context;
+  const struct log_config *config = log_config_get(&slot);
+  if (config && config->writer)
+    dropped = log_load(&config->writer->dropped);
+  log_config_put(slot);
+  return dropped;
+}
+
+#else // HAVE_PTHREAD
+
+int
+log_start_writer(nfc_context *context, const nfc_log_sink sink, const char *path, const size_t queue_len)
+{
+  (void) context;
+  (void) sink;
+  (void) path;
+  (void) queue_len;
+  return NFC_ENOTIMPL;
 }
 
 void
-log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+log_stop_writer(nfc_context *context)
 {
-  char *env_log_level = NULL;
-#ifdef ENVVARS
-  env_log_level = getenv("LIBNFC_LOG_LEVEL");
-#endif
-  uint32_t log_level;
-  if (NULL == env_log_level) {
-    // LIBNFC_LOG_LEVEL is not set
-#ifdef DEBUG
-    log_level = 3;
+  (void) context;
+}
+
+unsigned long
+log_get_dropped(const nfc_context *context)
+{
+  (void) context;
+  return 0;
+}
+
+#endif // HAVE_PTHREAD
+
+void
+log_init(nfc_context *context)
+{
+  log_set_level(context, context->log_level);
+}
+
+void
+log_set_quiet(const bool quiet)
+{
+  log_quiet = quiet;
+}
+
+void
+log_set_level(nfc_context *context, const uint32_t log_level)
+{
+  const uint32_t mask = log_level_to_mask(log_level);
+
+  context->log_level = log_level;
+#if defined(__GNUC__)
+  __atomic_store_n(&log_mask, mask, __ATOMIC_RELAXED);
 #else
-    log_level = 1;
+  *(volatile uint32_t *)&log_mask = mask;
 #endif
-  } else {
-    log_level = atoi(env_log_level);
+}
+
+void
+log_set_callback(nfc_context *context, nfc_log_callback callback, void *user_data)
+{
+  struct log_config *config;
+
+  log_config_mutex_lock();
+  if (!(config = log_config_copy())) {
+    log_config_mutex_unlock();
+    return;
   }
+  config->callback = callback;
+  config->user_data = user_data;
+  config->callback_owner = callback ? context : NULL;
+  free(log_config_publish(config));
+  log_config_mutex_unlock();
+}
 
-  //  printf("log_level = %"PRIu32" group = %"PRIu8" priority = %"PRIu8"\n", log_level, group, priority);
-  if (log_level) { // If log is not disabled by log_level=none
-    if (((log_level & 0x00000003) >= priority) ||   // Global log level
-        (((log_level >> (group * 2)) & 0x00000003) >= priority)) { // Group log level
-
-      va_list va;
-      va_start(va, format);
-      log_put_internal("%s\t%s\t", log_priority_to_str(priority), category);
-      log_vput_internal(format, va);
-      log_put_internal("\n");
-      va_end(va);
+void
+log_exit(nfc_context *context)
+{
+  log_stop_writer(context);
+  log_config_mutex_lock();
+  if (log_config && (log_config->callback_owner == context)) {
+    struct log_config *config = log_config_copy();
+    if (config) {
+      config->callback = NULL;
+      config->user_data = NULL;
+      config->callback_owner = NULL;
+      free(log_config_publish(config));
+    }
+  }
+  log_config_mutex_unlock();
+}
+
+void
+log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+{
+  if (!log_enabled(group, priority) || log_quiet)
+    return;
+
+  va_list va;
+  va_start(va, format);
+  if (log_load(&log_config)) {
+    unsigned int slot;
+    const struct log_config *config = log_config_get(&slot);
+    if (config) {
+#ifdef HAVE_PTHREAD
+      if (config->writer) {
+        log_writer_push(config->writer, priority, category, format, va);
+        log_config_put(slot);
+        va_end(va);
+        return;
+      }
+#endif
+      if (config->callback) {
+        char message[1024];
+        vsnprintf(message, sizeof(message), format, va);
+        config->callback(priority, category, message, config->user_data);
+        log_config_put(slot);
+        va_end(va);
+        return;
+      }
     }
+    log_config_put(slot);
   }
+  log_put_internal("%s\t%s\t", log_priority_to_str(priority), category);
+  log_vput_internal(format, va);
+  log_put_internal("\n");
+  va_end(va);
 }
 
 #endif // LOG
@@ -33,11 +33,6 @@
 
 #include "nfc-internal.h"
 
-#define NFC_LOG_PRIORITY_NONE   0
-#define NFC_LOG_PRIORITY_ERROR  1
-#define NFC_LOG_PRIORITY_INFO   2
-#define NFC_LOG_PRIORITY_DEBUG  3
-
 #define NFC_LOG_GROUP_GENERAL   1
 #define NFC_LOG_GROUP_CONFIG    2
 #define NFC_LOG_GROUP_CHIP      3
@@ -71,8 +66,33 @@ const char *log_priority_to_str(const int priority);
 #    define __has_attribute_format 1
 #  endif
 
-void log_init(const nfc_context *context);
-void log_exit(void);
+/*
+  Enabled (group, priority) pairs are cached in a bitmask so that disabled
+  log calls cost a single load and test: bit (group * 4 + priority) is set
+  when a message of that priority in that group would be printed.
+
+  Like the LIBNFC_LOG_LEVEL environment variable it replaces, the mask is
+  process-wide: log_put() has no context, so the last log level set, by
+  nfc_init() or nfc_set_log_level(), applies to every context.
+*/
+extern uint32_t log_mask;
+
+#  if defined(__GNUC__)
+#    define log_mask_load() __atomic_load_n(&log_mask, __ATOMIC_RELAXED)
+#  else
+#    define log_mask_load() (*(volatile uint32_t *)&log_mask)
+#  endif
+
+#  define log_enabled(group, priority) ((log_mask_load() >> (((group) * 4) + (priority))) & 0x00000001)
+
+void log_init(nfc_context *context);
+void log_set_level(nfc_context *context, const uint32_t log_level);
+void log_set_quiet(const bool quiet);
+void log_set_callback(nfc_context *context, nfc_log_callback callback, void *user_data);
+int log_start_writer(nfc_context *context, const nfc_log_sink sink, const char *path, const size_t queue_len);
+void log_stop_writer(nfc_context *context);
+unsigned long log_get_dropped(const nfc_context *context);
+void log_exit(nfc_context *context);
 void log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
 #  if __has_attribute_format
 __attribute__((format(printf, 4, 5)))
@@ -80,8 +100,15 @@ __attribute__((format(printf, 4, 5)))
 ;
 #else
 // No logging
+#define log_enabled(group, priority) (0)
 #define log_init(nfc_context) ((void) 0)
-#define log_exit() ((void) 0)
+#define log_set_level(nfc_context, log_level) ((void) (nfc_context), (void) (log_level))
+#define log_set_quiet(quiet) ((void) (quiet))
+#define log_set_callback(nfc_context, callback, user_data) ((void) (nfc_context), (void) (callback), (void) (user_data))
+#define log_start_writer(nfc_context, sink, path, queue_len) ((void) (nfc_context), (void) (sink), (void) (path), (void) (queue_len), NFC_ENOTIMPL)
+#define log_stop_writer(nfc_context) ((void) (nfc_context))
+#define log_get_dropped(nfc_context) ((void) (nfc_context), 0UL)
+#define log_exit(nfc_context) ((void) 0)
 #define log_put(group, category, priority, format, ...) do {} while (0)
 
 #endif // LOG
@@ -96,6 +123,8 @@ __attribute__((format(printf, 4, 5)))
     size_t	 __szPos; \
     char	 __acBuf[1024]; \
     size_t	 __szBuf = 0; \
+    if (!log_enabled(group, NFC_LOG_PRIORITY_DEBUG)) \
+      break; \
     if ((int)szBytes < 0) { \
       fprintf (stderr, "%s:%d: Attempt to print %d bytes!\n", __FILE__, __LINE__, (int)szBytes); \
       log_put (group, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s:%d: Attempt to print %d bytes!\n", __FILE__, __LINE__, (int)szBytes); \
@@ -29,14 +29,16 @@
  * @brief Provide internal function to manipulate nfc_device type
  */
 
-#include <stdlib.h>
-#include <string.h>
-
 #ifdef HAVE_CONFIG_H
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "nfc-internal.h"
+#include "stats.h"
+#include "trace.h"
 
 nfc_device *
 nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
@@ -63,6 +65,28 @@ nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
   memcpy(res->connstring, connstring, sizeof(res->connstring));
   res->driver_data = NULL;
   res->chip_data   = NULL;
+  res->trace       = NULL;
+  res->stats       = nfc_stats_new();
+
+  if (nfc_cancel_init(&res->cancel) < 0) {
+    nfc_stats_free(res->stats);
+    free(res);
+    return NULL;
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  const int lock_res = pthread_mutex_init(&res->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (lock_res != 0) {
+    nfc_cancel_destroy(&res->cancel);
+    nfc_stats_free(res->stats);
+    free(res);
+    return NULL;
+  }
+#endif
 
   return res;
 }
@@ -72,6 +96,24 @@ nfc_device_free(nfc_device *dev)
 {
   if (dev) {
     free(dev->driver_data);
+    nfc_trace_free(dev->trace);
+    nfc_stats_free(dev->stats);
+    nfc_cancel_destroy(&dev->cancel);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&dev->lock);
+#endif
     free(dev);
   }
 }
+
+/**
+ * @brief Cancel the pending (or next) I/O wait of \a pnd
+ *
+ * Shared abort_command of the drivers whose bus waits watch pnd->cancel.
+ */
+int
+nfc_device_abort(nfc_device *pnd)
+{
+  nfc_cancel_signal(&pnd->cancel);
+  return NFC_SUCCESS;
+}
@@ -29,13 +29,13 @@
 * @brief Provide some useful internal functions
 */
 
-#include <nfc/nfc.h>
-#include "nfc-internal.h"
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
 #ifdef CONFFILES
 #include "conf.h"
 #endif
@@ -43,10 +43,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
 #define LOG_CATEGORY "libnfc.general"
 
+uint64_t
+monotonic_time_ns(void)
+{
+#ifdef _WIN32
+  return (uint64_t) GetTickCount64() * 1000000;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
+
+uint64_t
+realtime_time_ns(void)
+{
+#ifdef _WIN32
+  FILETIME ft;
+  GetSystemTimeAsFileTime(&ft);
+  // 100 ns intervals since 1601-01-01
+  return ((((uint64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime) - 116444736000000000ULL) * 100;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
+
 void
 string_as_boolean(const char *s, bool *value)
 {
@@ -86,23 +118,29 @@ nfc_context_new(void)
 #else
   res->log_level = 1;
 #endif
+  res->log_writer_ref = false;
 
-  // Clear user defined devices array
-  for (int i = 0; i < MAX_USER_DEFINED_DEVICES; i++) {
-    strcpy(res->user_defined_devices[i].name, "");
-    strcpy(res->user_defined_devices[i].connstring, "");
-    res->user_defined_devices[i].optional = false;
-  }
+  // Empty user defined devices table
+  res->user_defined_devices = NULL;
   res->user_defined_device_count = 0;
+  res->user_defined_device_capacity = 0;
 
 #ifdef ENVVARS
+  // Honor log level from environment while loading configuration
+  char *envvar = getenv("LIBNFC_LOG_LEVEL");
+  if (envvar) {
+    log_set_level(res, atoi(envvar));
+  }
+
   // Load user defined device from environment variable at first
-  char *envvar = getenv("LIBNFC_DEFAULT_DEVICE");
+  envvar = getenv("LIBNFC_DEFAULT_DEVICE");
   if (envvar) {
-    strcpy(res->user_defined_devices[0].name, "user defined default device");
-    strncpy(res->user_defined_devices[0].connstring, envvar, NFC_BUFSIZE_CONNSTRING);
-    res->user_defined_devices[0].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-    res->user_defined_device_count++;
+    struct nfc_user_defined_device *udd = nfc_context_add_user_defined_device(res);
+    if (udd) {
+      strcpy(udd->name, "user defined default device");
+      strncpy(udd->connstring, envvar, NFC_BUFSIZE_CONNSTRING);
+      udd->connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
+    }
   }
 
 #endif // ENVVARS
@@ -118,10 +156,13 @@ nfc_context_new(void)
   // Load user defined device from environment variable as the only reader
   envvar = getenv("LIBNFC_DEVICE");
   if (envvar) {
-    strcpy(res->user_defined_devices[0].name, "user defined device");
-    strncpy(res->user_defined_devices[0].connstring, envvar, NFC_BUFSIZE_CONNSTRING);
-    res->user_defined_devices[0].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-    res->user_defined_device_count = 1;
+    res->user_defined_device_count = 0;
+    struct nfc_user_defined_device *udd = nfc_context_add_user_defined_device(res);
+    if (udd) {
+      strcpy(udd->name, "user defined device");
+      strncpy(udd->connstring, envvar, NFC_BUFSIZE_CONNSTRING);
+      udd->connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
+    }
   }
 
   // Load "auto scan" option
@@ -161,10 +202,34 @@ nfc_context_new(void)
 void
 nfc_context_free(nfc_context *context)
 {
-  log_exit();
+  log_exit(context);
+  free(context->user_defined_devices);
   free(context);
 }
 
+/**
+ * @brief Append an empty entry to the user defined devices of a context
+ * @return the new entry, or NULL if the table could not be grown
+ *
+ * The table doubles when full, so that configurations with hundreds of
+ * devices only cost a few reallocations.
+ */
+struct nfc_user_defined_device *
+nfc_context_add_user_defined_device(nfc_context *context)
+{
+  if (context->user_defined_device_count == context->user_defined_device_capacity) {
+    unsigned int capacity = context->user_defined_device_capacity ? 2 * context->user_defined_device_capacity : 4;
+    struct nfc_user_defined_device *udds = realloc(context->user_defined_devices, capacity * sizeof(*udds));
+    if (!udds)
+      return NULL;
+    context->user_defined_devices = udds;
+    context->user_defined_device_capacity = capacity;
+  }
+  struct nfc_user_defined_device *udd = &context->user_defined_devices[context->user_defined_device_count++];
+  memset(udd, 0x00, sizeof(*udd));
+  return udd;
+}
+
 void
 prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData, size_t *pszInitiatorData)
 {
@@ -35,22 +35,34 @@
 #include <stdbool.h>
 #include <err.h>
 #  include <sys/time.h>
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
 
 #include "nfc/nfc.h"
 
+#include "cancel.h"
 #include "log.h"
 
 /**
  * @macro HAL
  * @brief Execute corresponding driver function if exists.
+ *
+ * The call holds the device lock, so concurrent calls on one device are serialized.
  */
-#define HAL( FUNCTION, ... ) pnd->last_error = 0; \
-  if (pnd->driver->FUNCTION) { \
-    return pnd->driver->FUNCTION( __VA_ARGS__ ); \
-  } else { \
-    pnd->last_error = NFC_EDEVNOTSUPP; \
-    return false; \
-  }
+#define HAL( FUNCTION, ... ) do { \
+    int hal_res; \
+    nfc_device_lock(pnd); \
+    pnd->last_error = 0; \
+    if (pnd->driver->FUNCTION) { \
+      hal_res = pnd->driver->FUNCTION( __VA_ARGS__ ); \
+    } else { \
+      pnd->last_error = NFC_EDEVNOTSUPP; \
+      hal_res = false; \
+    } \
+    nfc_device_unlock(pnd); \
+    return hal_res; \
+  } while (0)
 
 #ifndef MIN
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
@@ -134,6 +146,7 @@ struct nfc_driver {
   int (*initiator_select_dep_target)(struct nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
   int (*initiator_deselect_target)(struct nfc_device *pnd);
   int (*initiator_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+  int (*initiator_transceive_batch)(struct nfc_device *pnd, nfc_transceive_op ops[], const size_t szOps, const int flags, int timeout);
   int (*initiator_transceive_bits)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar);
   int (*initiator_transceive_bytes_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
   int (*initiator_transceive_bits_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles);
@@ -146,6 +159,7 @@ struct nfc_driver {
   int (*target_receive_bits)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar);
 
   int (*device_set_property_bool)(struct nfc_device *pnd, const nfc_property property, const bool bEnable);
+  int (*device_set_properties)(struct nfc_device *pnd, const nfc_property_setting *settings, const size_t szSettings);
   int (*device_set_property_int)(struct nfc_device *pnd, const nfc_property property, const int value);
   int (*get_supported_modulation)(struct nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt);
   int (*get_supported_baud_rate)(struct nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
@@ -154,13 +168,18 @@ struct nfc_driver {
   int (*abort_command)(struct nfc_device *pnd);
   int (*idle)(struct nfc_device *pnd);
   int (*powerdown)(struct nfc_device *pnd);
+
+  int (*device_get_pollfd)(struct nfc_device *pnd);
+  int (*initiator_submit_select_passive_target)(struct nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
+  int (*initiator_submit_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx);
+  int (*target_submit_receive_bytes)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen);
+  int (*target_submit_send_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx);
+  int (*device_complete)(struct nfc_device *pnd);
 };
 
 #  define DEVICE_NAME_LENGTH  256
 #  define DEVICE_PORT_LENGTH  64
 
-#define MAX_USER_DEFINED_DEVICES 4
-
 struct nfc_user_defined_device {
   char name[DEVICE_NAME_LENGTH];
   nfc_connstring connstring;
@@ -175,13 +194,21 @@ struct nfc_user_defined_device {
 struct nfc_context {
   bool allow_autoscan;
   bool allow_intrusive_scan;
+  /** Log level this context last set, logging itself is configured process-wide */
   uint32_t  log_level;
-  struct nfc_user_defined_device user_defined_devices[MAX_USER_DEFINED_DEVICES];
+  /** Does this context hold a reference on the process-wide log writer */
+  bool log_writer_ref;
+  /** Registered drivers when the context was created, never modified afterwards */
+  const struct nfc_driver_list *drivers;
+  /** User defined devices, grown on demand */
+  struct nfc_user_defined_device *user_defined_devices;
   unsigned int user_defined_device_count;
+  unsigned int user_defined_device_capacity;
 };
 
 nfc_context *nfc_context_new(void);
 void nfc_context_free(nfc_context *context);
+struct nfc_user_defined_device *nfc_context_add_user_defined_device(nfc_context *context);
 
 /**
  * @struct nfc_device
@@ -212,11 +239,32 @@ struct nfc_device {
   uint8_t  btSupportByte;
   /** Last reported error */
   int     last_error;
+  /** Frame trace ring, NULL when tracing is disabled */
+  struct nfc_trace *trace;
+  /** Per-command exchange statistics, NULL if they could not be allocated */
+  struct nfc_stats *stats;
+  /** Cancellation of the pending I/O wait, raised by nfc_abort_command() */
+  struct nfc_cancel cancel;
+#ifdef HAVE_PTHREAD
+  /** Serializes API calls on this device; recursive as composite calls nest */
+  pthread_mutex_t lock;
+#endif
 };
 
+#ifdef HAVE_PTHREAD
+#  define nfc_device_lock(pnd)   pthread_mutex_lock(&(pnd)->lock)
+#  define nfc_device_unlock(pnd) pthread_mutex_unlock(&(pnd)->lock)
+#else
+#  define nfc_device_lock(pnd)   ((void) 0)
+#  define nfc_device_unlock(pnd) ((void) 0)
+#endif
+
 nfc_device *nfc_device_new(const nfc_context *context, const nfc_connstring connstring);
 void        nfc_device_free(nfc_device *dev);
+int         nfc_device_abort(nfc_device *pnd);
 
+uint64_t monotonic_time_ns(void);
+uint64_t realtime_time_ns(void);
 void string_as_boolean(const char *s, bool *value);
 
 void iso14443_cascade_uid(const uint8_t abtUID[], const size_t szUID, uint8_t *pbtCascadedUID, size_t *pszCascadedUID);
@@ -61,6 +61,24 @@
  * @defgroup properties  Properties accessors
  * The functionnality documented below allow to configure parameters and registers.
  */
+/**
+ * @defgroup log  Log sinks
+ * The functionnality documented below allow to route libnfc log messages to a callback, a file, syslog or the systemd journal, optionally from a background thread.
+ * Log messages are not tied to a context: the log level and sinks are process-wide.
+ */
+/**
+ * @defgroup trace  Frame trace
+ * The functionnality documented below allow to record the frames exchanged with the chip and to save them for offline analysis.
+ */
+/**
+ * @defgroup pool  Reader pool
+ * The functionnality documented below allow to drive several readers from worker threads, feeding them jobs to run on the next presented tag.
+ */
+/**
+ * @defgroup nonblocking  Non-blocking operations
+ * The functionnality documented below allow to drive a device from an event loop: an operation is submitted, then
+ * completed once the device descriptor becomes readable, so that no thread has to block while waiting for a tag.
+ */
 /**
  * @defgroup misc Miscellaneous
  *
@@ -86,6 +104,8 @@
 #include "nfc-internal.h"
 #include "target-subr.h"
 #include "drivers.h"
+#include "stats.h"
+#include "trace.h"
 
 #if defined (DRIVER_ACR122_PCSC_ENABLED)
 #  include "drivers/acr122_pcsc.h"
@@ -119,6 +139,14 @@
 #  include "drivers/pn532_i2c.h"
 #endif /* DRIVER_PN532_I2C_ENABLED */
 
+#if defined (DRIVER_PN53X_SIM_ENABLED)
+#  include "drivers/pn53x_sim.h"
+#endif /* DRIVER_PN53X_SIM_ENABLED */
+
+#if defined (DRIVER_BROKER_ENABLED)
+#  include "drivers/broker.h"
+#endif /* DRIVER_BROKER_ENABLED */
+
 
 #define LOG_CATEGORY "libnfc.general"
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
@@ -128,35 +156,70 @@ struct nfc_driver_list {
   const struct nfc_driver *driver;
 };
 
-const struct nfc_driver_list *nfc_drivers = NULL;
+/*
+ * Registered drivers. The list is only ever prepended to, under
+ * nfc_drivers_mutex, so the head a context copies at nfc_init() designates an
+ * immutable list it can walk without locking. Nodes are freed when the last
+ * context is released.
+ */
+static const struct nfc_driver_list *nfc_drivers = NULL;
+static unsigned int nfc_drivers_users = 0;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t nfc_drivers_mutex = PTHREAD_MUTEX_INITIALIZER;
+#  define nfc_drivers_lock()   pthread_mutex_lock(&nfc_drivers_mutex)
+#  define nfc_drivers_unlock() pthread_mutex_unlock(&nfc_drivers_mutex)
+#else
+#  define nfc_drivers_lock()   ((void) 0)
+#  define nfc_drivers_unlock() ((void) 0)
+#endif
+
+static int
+nfc_drivers_add(const struct nfc_driver *ndr)
+{
+  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
+  if (!pndl)
+    return NFC_ESOFT;
+
+  pndl->driver = ndr;
+  pndl->next = nfc_drivers;
+  nfc_drivers = pndl;
+
+  return NFC_SUCCESS;
+}
 
 static void
 nfc_drivers_init(void)
 {
 #if defined (DRIVER_PN53X_USB_ENABLED)
-  nfc_register_driver(&pn53x_usb_driver);
+  nfc_drivers_add(&pn53x_usb_driver);
 #endif /* DRIVER_PN53X_USB_ENABLED */
 #if defined (DRIVER_ACR122_PCSC_ENABLED)
-  nfc_register_driver(&acr122_pcsc_driver);
+  nfc_drivers_add(&acr122_pcsc_driver);
 #endif /* DRIVER_ACR122_PCSC_ENABLED */
 #if defined (DRIVER_ACR122_USB_ENABLED)
-  nfc_register_driver(&acr122_usb_driver);
+  nfc_drivers_add(&acr122_usb_driver);
 #endif /* DRIVER_ACR122_USB_ENABLED */
 #if defined (DRIVER_ACR122S_ENABLED)
-  nfc_register_driver(&acr122s_driver);
+  nfc_drivers_add(&acr122s_driver);
 #endif /* DRIVER_ACR122S_ENABLED */
 #if defined (DRIVER_PN532_UART_ENABLED)
-  nfc_register_driver(&pn532_uart_driver);
+  nfc_drivers_add(&pn532_uart_driver);
 #endif /* DRIVER_PN532_UART_ENABLED */
 #if defined (DRIVER_PN532_SPI_ENABLED)
-  nfc_register_driver(&pn532_spi_driver);
+  nfc_drivers_add(&pn532_spi_driver);
 #endif /* DRIVER_PN532_SPI_ENABLED */
 #if defined (DRIVER_PN532_I2C_ENABLED)
-  nfc_register_driver(&pn532_i2c_driver);
+  nfc_drivers_add(&pn532_i2c_driver);
 #endif /* DRIVER_PN532_I2C_ENABLED */
 #if defined (DRIVER_ARYGON_ENABLED)
-  nfc_register_driver(&arygon_driver);
+  nfc_drivers_add(&arygon_driver);
 #endif /* DRIVER_ARYGON_ENABLED */
+#if defined (DRIVER_PN53X_SIM_ENABLED)
+  nfc_drivers_add(&pn53x_sim_driver);
+#endif /* DRIVER_PN53X_SIM_ENABLED */
+#if defined (DRIVER_BROKER_ENABLED)
+  nfc_drivers_add(&broker_driver);
+#endif /* DRIVER_BROKER_ENABLED */
 }
 
 static int
@@ -166,6 +229,7 @@ nfc_device_validate_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_m
  * @brief Register an NFC device driver with libnfc.
  * This function registers a driver with libnfc, the caller is responsible of managing the lifetime of the
  * driver and make sure that any resources associated with the driver are available after registration.
+ * Contexts only see the drivers registered before their nfc_init() call.
  * @param pnd Pointer to an NFC device driver to be registered.
  * @retval NFC_SUCCESS If the driver registration succeeds.
  */
@@ -175,20 +239,16 @@ nfc_register_driver(const struct nfc_driver *ndr)
   if (!ndr)
     return NFC_EINVARG;
 
-  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
-  if (!pndl)
-    return NFC_ESOFT;
-
-  pndl->driver = ndr;
-  pndl->next = nfc_drivers;
-  nfc_drivers = pndl;
-
-  return NFC_SUCCESS;
+  nfc_drivers_lock();
+  const int res = nfc_drivers_add(ndr);
+  nfc_drivers_unlock();
+  return res;
 }
 
 /** @ingroup lib
  * @brief Initialize libnfc.
  * This function must be called before calling any other libnfc function
+ * Several contexts may be used at once, from different threads; a context is not modified once initialized.
  * @param context Output location for nfc_context
  */
 void
@@ -199,8 +259,12 @@ nfc_init(nfc_context **context)
     perror("malloc");
     return;
   }
+  nfc_drivers_lock();
   if (!nfc_drivers)
     nfc_drivers_init();
+  nfc_drivers_users++;
+  (*context)->drivers = nfc_drivers;
+  nfc_drivers_unlock();
 }
 
 /** @ingroup lib
@@ -211,11 +275,15 @@ nfc_init(nfc_context **context)
 void
 nfc_exit(nfc_context *context)
 {
-  while (nfc_drivers) {
+  nfc_drivers_lock();
+  if (nfc_drivers_users)
+    nfc_drivers_users--;
+  while ((nfc_drivers_users == 0) && nfc_drivers) {
     struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
     nfc_drivers = pndl->next;
     free(pndl);
   }
+  nfc_drivers_unlock();
 
   nfc_context_free(context);
 }
@@ -253,7 +321,7 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
   }
 
   // Search through the device list for an available device
-  const struct nfc_driver_list *pndl = nfc_drivers;
+  const struct nfc_driver_list *pndl = context->drivers;
   while (pndl) {
     const struct nfc_driver *ndr = pndl->driver;
 
@@ -329,30 +397,12 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
       // let's make sure the device exists
       nfc_device *pnd = NULL;
 
-#ifdef ENVVARS
-      char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
-      char *old_env_log_level = NULL;
-      // do it silently
-      if (env_log_level) {
-        if ((old_env_log_level = malloc(strlen(env_log_level) + 1)) == NULL) {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to malloc()");
-          return 0;
-        }
-        strcpy(old_env_log_level, env_log_level);
-      }
-      setenv("LIBNFC_LOG_LEVEL", "0", 1);
-#endif // ENVVARS
+      // do it silently, without touching the log level other threads see
+      log_set_quiet(true);
 
       pnd = nfc_open(context, context->user_defined_devices[i].connstring);
 
-#ifdef ENVVARS
-      if (old_env_log_level) {
-        setenv("LIBNFC_LOG_LEVEL", old_env_log_level, 1);
-        free(old_env_log_level);
-      } else {
-        unsetenv("LIBNFC_LOG_LEVEL");
-      }
-#endif // ENVVARS
+      log_set_quiet(false);
 
       if (pnd) {
         nfc_close(pnd);
@@ -374,7 +424,7 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
 
   // Device auto-detection
   if (context->allow_autoscan) {
-    const struct nfc_driver_list *pndl = nfc_drivers;
+    const struct nfc_driver_list *pndl = context->drivers;
     while (pndl) {
       const struct nfc_driver *ndr = pndl->driver;
       if ((ndr->scan_type == NOT_INTRUSIVE) || ((context->allow_intrusive_scan) && (ndr->scan_type == INTRUSIVE))) {
@@ -431,28 +481,215 @@ nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const
   HAL(device_set_property_bool, pnd, property, bEnable);
 }
 
-/** @ingroup initiator
- * @brief Initialize NFC device as initiator (reader)
+/** @ingroup properties
+ * @brief Set several device properties at once
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
  * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param settings array of \a nfc_property_setting, applied in order
+ * @param szSettings number of entries in \a settings
  *
- * The NFC device is configured to function as RFID reader.
- * After initialization it can be used to communicate to passive RFID tags and active NFC devices.
- * The reader will act as initiator to communicate peer 2 peer (NFCIP) to other active NFC devices.
- * - Crc is handled by the device (NP_HANDLE_CRC = true)
- * - Parity is handled the device (NP_HANDLE_PARITY = true)
- * - Cryto1 cipher is disabled (NP_ACTIVATE_CRYPTO1 = false)
- * - Easy framing is enabled (NP_EASY_FRAMING = true)
- * - Auto-switching in ISO14443-4 mode is enabled (NP_AUTO_ISO14443_4 = true)
- * - Invalid frames are not accepted (NP_ACCEPT_INVALID_FRAMES = false)
- * - Multiple frames are not accepted (NP_ACCEPT_MULTIPLE_FRAMES = false)
- * - 14443-A mode is activated (NP_FORCE_ISO14443_A = true)
- * - speed is set to 106 kbps (NP_FORCE_SPEED_106 = true)
- * - Let the device try forever to find a target (NP_INFINITE_SELECT = true)
- * - RF field is shortly dropped (if it was enabled) then activated again
+ * The result is the same as calling nfc_device_set_property_int() or nfc_device_set_property_bool()
+ * for each setting, but drivers can merge the underlying chip commands: e.g. on PN53x, switching
+ * framing, CRC and speed settings together costs a single register write.
+ * On error, the settings before the failing one may have been applied.
  */
 int
-nfc_initiator_init(nfc_device *pnd)
+nfc_device_set_properties(nfc_device *pnd, const nfc_property_setting *settings, const size_t szSettings)
+{
+  if (pnd->driver->device_set_properties) {
+    HAL(device_set_properties, pnd, settings, szSettings);
+  }
+
+  int res = NFC_SUCCESS;
+  nfc_device_lock(pnd);
+  for (size_t i = 0; (i < szSettings) && (res >= 0); i++) {
+    switch (settings[i].property) {
+      case NP_TIMEOUT_COMMAND:
+      case NP_TIMEOUT_ATR:
+      case NP_TIMEOUT_COM:
+        res = nfc_device_set_property_int(pnd, settings[i].property, settings[i].value);
+        break;
+      default:
+        res = nfc_device_set_property_bool(pnd, settings[i].property, settings[i].value != 0);
+        break;
+    }
+  }
+  nfc_device_unlock(pnd);
+  return (res < 0) ? res : NFC_SUCCESS;
+}
+
+/** @ingroup data
+ * @brief Get per-command exchange statistics
+ * @return Returns the number of \a nfc_command_stats filled (>= 0) on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param stats array of \a nfc_command_stats, NFC_STATS_MAX_COMMANDS entries are always enough
+ * @param szStats size of the \a stats array
+ *
+ * Every exchange with the chip is accounted to its command code: number of
+ * exchanges, errors, bytes sent and received, and a latency histogram.
+ * Entries are sorted by command code. Statistics are updated without lock,
+ * values read while the device is in use by another thread may be slightly
+ * inconsistent.
+ */
+int
+nfc_device_get_stats(nfc_device *pnd, nfc_command_stats stats[], const size_t szStats)
+{
+  if (!pnd->stats) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  return (int) nfc_stats_get(pnd->stats, stats, szStats);
+}
+
+/** @ingroup data
+ * @brief Reset per-command exchange statistics
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ */
+int
+nfc_device_reset_stats(nfc_device *pnd)
+{
+  if (!pnd->stats) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  nfc_stats_reset(pnd->stats);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup log
+ * @brief Set the log level at runtime
+ * @param context The context to operate on.
+ * @param log_level log level, encoded as the LIBNFC_LOG_LEVEL environment variable (see libnfc.conf.sample)
+ *
+ * The log level is process-wide, as LIBNFC_LOG_LEVEL was: it applies to
+ * every context, until another call or another nfc_init() changes it.
+ */
+void
+nfc_set_log_level(nfc_context *context, const uint32_t log_level)
+{
+  log_set_level(context, log_level);
+}
+
+/** @ingroup log
+ * @brief Route log messages to a callback
+ * @param context The context to operate on.
+ * @param callback function called with each log message, NULL to restore the default output on stderr
+ * @param user_data pointer passed to \a callback
+ *
+ * Unless a background log writer is started with the NFC_LOG_SINK_CALLBACK
+ * sink, \a callback is called synchronously by the thread which logs.
+ *
+ * The callback is process-wide: it receives the messages of every context,
+ * until it is replaced or \a context, which set it, is freed by nfc_exit().
+ * It can be changed while other threads log: each message goes either to
+ * the previous callback with its \a user_data, or to the new one.
+ */
+void
+nfc_set_log_callback(nfc_context *context, nfc_log_callback callback, void *user_data)
+{
+  log_set_callback(context, callback, user_data);
+}
+
+/** @ingroup log
+ * @brief Start a background log writer
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on.
+ * @param sink destination of the log messages
+ * @param path file path for NFC_LOG_SINK_FILE, journal socket path for NFC_LOG_SINK_JOURNALD (NULL for the default one), ignored otherwise
+ * @param queue_len number of messages that can wait for the writer (rounded up to a power of 2)
+ *
+ * Log calls only format the message into a bounded queue, the writer thread
+ * does the I/O. When the queue is full, messages are dropped rather than
+ * blocking the caller: see nfc_get_log_dropped(). A previously started writer
+ * is stopped after the new one is ready.
+ *
+ * The writer is process-wide and shared by the contexts which started it: it
+ * runs until each of them has stopped it or has been freed by nfc_exit().
+ *
+ * This function returns NFC_ENOTIMPL when libnfc is built without log or
+ * thread support.
+ */
+int
+nfc_start_log_writer(nfc_context *context, const nfc_log_sink sink, const char *path, const size_t queue_len)
+{
+  return log_start_writer(context, sink, path, queue_len);
+}
+
+/** @ingroup log
+ * @brief Stop the background log writer
+ * @param context The context to operate on.
+ *
+ * Drops the reference \a context holds on the writer. When no context holds
+ * one anymore, pending messages are written before this function returns and
+ * following messages are delivered synchronously again.
+ */
+void
+nfc_stop_log_writer(nfc_context *context)
+{
+  log_stop_writer(context);
+}
+
+/** @ingroup log
+ * @brief Returns the number of log messages dropped by the background log writer
+ * @return Returns the number of messages the running writer dropped because its queue was full, 0 when no writer runs
+ * @param context The context to operate on.
+ */
+unsigned long
+nfc_get_log_dropped(const nfc_context *context)
+{
+  return log_get_dropped(context);
+}
+
+/** @ingroup trace
+ * @brief Enable, resize or disable the frame trace of a device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param frames number of frames kept in the trace ring, 0 to disable tracing
+ *
+ * When enabled, every frame sent to or received from the chip is recorded
+ * with a monotonic timestamp in a ring holding the last \a frames frames.
+ * Recording does not format nor allocate anything, so it can be left on in
+ * production. Any previously recorded frame is discarded.
+ *
+ * @warning This function must not be called while another thread uses the device.
+ */
+int
+nfc_device_set_trace(nfc_device *pnd, const size_t frames)
+{
+  struct nfc_trace *trace = NULL;
+
+  if (frames && !(trace = nfc_trace_new(frames))) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  nfc_trace_free(pnd->trace);
+  pnd->trace = trace;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup trace
+ * @brief Save the frame trace of a device to a pcapng file
+ * @return Returns the number of saved frames (>= 0) on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param filename path of the pcapng file to write
+ *
+ * Packets use link type LINKTYPE_USER0 and hold the TFI byte (0xD4 from host,
+ * 0xD5 from chip) followed by the command or response code and its data.
+ * Their timestamps count from the Unix epoch.
+ * This function can be called from another thread while the device is in use,
+ * e.g. when an error is reported.
+ */
+int
+nfc_device_save_trace(nfc_device *pnd, const char *filename)
+{
+  if (!pnd->trace)
+    return NFC_EINVARG;
+  return nfc_trace_save(pnd->trace, filename, pnd->connstring);
+}
+
+static int
+nfc_initiator_init_locked(nfc_device *pnd)
 {
   int res = 0;
   // Drop the field for a while
@@ -482,6 +719,36 @@ nfc_initiator_init(nfc_device *pnd)
   HAL(initiator_init, pnd);
 }
 
+/** @ingroup initiator
+ * @brief Initialize NFC device as initiator (reader)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * The NFC device is configured to function as RFID reader.
+ * After initialization it can be used to communicate to passive RFID tags and active NFC devices.
+ * The reader will act as initiator to communicate peer 2 peer (NFCIP) to other active NFC devices.
+ * - Crc is handled by the device (NP_HANDLE_CRC = true)
+ * - Parity is handled the device (NP_HANDLE_PARITY = true)
+ * - Cryto1 cipher is disabled (NP_ACTIVATE_CRYPTO1 = false)
+ * - Easy framing is enabled (NP_EASY_FRAMING = true)
+ * - Auto-switching in ISO14443-4 mode is enabled (NP_AUTO_ISO14443_4 = true)
+ * - Invalid frames are not accepted (NP_ACCEPT_INVALID_FRAMES = false)
+ * - Multiple frames are not accepted (NP_ACCEPT_MULTIPLE_FRAMES = false)
+ * - 14443-A mode is activated (NP_FORCE_ISO14443_A = true)
+ * - speed is set to 106 kbps (NP_FORCE_SPEED_106 = true)
+ * - Let the device try forever to find a target (NP_INFINITE_SELECT = true)
+ * - RF field is shortly dropped (if it was enabled) then activated again
+ */
+int
+nfc_initiator_init(nfc_device *pnd)
+{
+  // Hold the device so no other call interleaves with the setup sequence
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_init_locked(pnd);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Initialize NFC device as initiator with its secure element as target (reader)
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -497,6 +764,44 @@ nfc_initiator_init_secure_element(nfc_device *pnd)
   HAL(initiator_init_secure_element, pnd);
 }
 
+/*
+ * Initiator data sent to select a passive target: \a pbtInitData as given (ISO14443A UIDs being cascaded
+ * into \a pbtTmpInit, at least MAX(12, szInitData) bytes long) or the modulation defaults when empty
+ */
+static void
+initiator_init_data(const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData,
+                    uint8_t *pbtTmpInit, uint8_t **ppbtInit, size_t *pszInit)
+{
+  if (szInitData == 0) {
+    // Provide default values, if any
+    prepare_initiator_data(nm, ppbtInit, pszInit);
+  } else if (nm.nmt == NMT_ISO14443A) {
+    *ppbtInit = pbtTmpInit;
+    iso14443_cascade_uid(pbtInitData, szInitData, pbtTmpInit, pszInit);
+  } else {
+    *ppbtInit = pbtTmpInit;
+    memcpy(pbtTmpInit, pbtInitData, szInitData);
+    *pszInit = szInitData;
+  }
+}
+
+static int
+nfc_initiator_select_passive_target_locked(nfc_device *pnd,
+                                           const nfc_modulation nm,
+                                           const uint8_t *pbtInitData, const size_t szInitData,
+                                           nfc_target *pnt)
+{
+  uint8_t *abtInit = NULL;
+  uint8_t abtTmpInit[MAX(12, szInitData)];
+  size_t  szInit = 0;
+  int res;
+  if ((res = nfc_device_validate_modulation(pnd, N_INITIATOR, &nm)) != NFC_SUCCESS)
+    return res;
+  initiator_init_data(nm, pbtInitData, szInitData, abtTmpInit, &abtInit, &szInit);
+
+  HAL(initiator_select_passive_target, pnd, nm, abtInit, szInit, pnt);
+}
+
 /** @ingroup initiator
  * @brief Select a passive or emulated tag
  * @return Returns selected passive target count on success, otherwise returns libnfc's error code (negative value)
@@ -526,47 +831,17 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
                                     const uint8_t *pbtInitData, const size_t szInitData,
                                     nfc_target *pnt)
 {
-  uint8_t *abtInit = NULL;
-  uint8_t abtTmpInit[MAX(12, szInitData)];
-  size_t  szInit = 0;
-  int res;
-  if ((res = nfc_device_validate_modulation(pnd, N_INITIATOR, &nm)) != NFC_SUCCESS)
-    return res;
-  if (szInitData == 0) {
-    // Provide default values, if any
-    prepare_initiator_data(nm, &abtInit, &szInit);
-  } else if (nm.nmt == NMT_ISO14443A) {
-    abtInit = abtTmpInit;
-    iso14443_cascade_uid(pbtInitData, szInitData, abtInit, &szInit);
-  } else {
-    abtInit = abtTmpInit;
-    memcpy(abtInit, pbtInitData, szInitData);
-    szInit = szInitData;
-  }
-
-  HAL(initiator_select_passive_target, pnd, nm, abtInit, szInit, pnt);
+  // Hold the device so the modulation checked is the one selected with
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_select_passive_target_locked(pnd, nm, pbtInitData, szInitData, pnt);
+  nfc_device_unlock(pnd);
+  return res;
 }
 
-/** @ingroup initiator
- * @brief List passive or emulated tags
- * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
- *
- * @param pnd \a nfc_device struct pointer that represent currently used device
- * @param nm desired modulation
- * @param[out] ant array of \a nfc_target that will be filled with targets info
- * @param szTargets size of \a ant (will be the max targets listed)
- *
- * The NFC device will try to find the available passive tags. Some NFC devices
- * are capable to emulate passive tags. The standards (ISO18092 and ECMA-340)
- * describe the modulation that can be used for reader to passive
- * communications. The chip needs to know with what kind of tag it is dealing
- * with, therefore the initial modulation and speed (106, 212 or 424 kbps)
- * should be supplied.
- */
-int
-nfc_initiator_list_passive_targets(nfc_device *pnd,
-                                   const nfc_modulation nm,
-                                   nfc_target ant[], const size_t szTargets)
+static int
+nfc_initiator_list_passive_targets_locked(nfc_device *pnd,
+                                          const nfc_modulation nm,
+                                          nfc_target ant[], const size_t szTargets)
 {
   nfc_target nt;
   size_t  szTargetFound = 0;
@@ -617,6 +892,34 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
   return szTargetFound;
 }
 
+/** @ingroup initiator
+ * @brief List passive or emulated tags
+ * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nm desired modulation
+ * @param[out] ant array of \a nfc_target that will be filled with targets info
+ * @param szTargets size of \a ant (will be the max targets listed)
+ *
+ * The NFC device will try to find the available passive tags. Some NFC devices
+ * are capable to emulate passive tags. The standards (ISO18092 and ECMA-340)
+ * describe the modulation that can be used for reader to passive
+ * communications. The chip needs to know with what kind of tag it is dealing
+ * with, therefore the initial modulation and speed (106, 212 or 424 kbps)
+ * should be supplied.
+ */
+int
+nfc_initiator_list_passive_targets(nfc_device *pnd,
+                                   const nfc_modulation nm,
+                                   nfc_target ant[], const size_t szTargets)
+{
+  // Hold the device for the whole select/deselect sequence
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_list_passive_targets_locked(pnd, nm, ant, szTargets);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Polling for NFC targets
  * @return Returns polled targets count, otherwise returns libnfc's error code (negative value).
@@ -668,29 +971,12 @@ nfc_initiator_select_dep_target(nfc_device *pnd,
   HAL(initiator_select_dep_target, pnd, ndm, nbr, pndiInitiator, pnt, timeout);
 }
 
-/** @ingroup initiator
- * @brief Poll a target and request active or passive mode for D.E.P. (Data Exchange Protocol)
- * @return Returns selected D.E.P targets count on success, otherwise returns libnfc's error code (negative value).
- *
- * @param pnd \a nfc_device struct pointer that represent currently used device
- * @param ndm desired D.E.P. mode (\a NDM_ACTIVE or \a NDM_PASSIVE for active, respectively passive mode)
- * @param nbr desired baud rate
- * @param pndiInitiator pointer \a nfc_dep_info struct that contains \e NFCID3 and \e General \e Bytes to set to the initiator device (optionnal, can be \e NULL)
- * @param[out] pnt is a \a nfc_target struct pointer where target information will be put.
- * @param timeout in milliseconds
- *
- * The NFC device will try to find an available D.E.P. target. The standards
- * (ISO18092 and ECMA-340) describe the modulation that can be used for reader
- * to passive communications.
- *
- * @note \a nfc_dep_info will be returned when the target was acquired successfully.
- */
-int
-nfc_initiator_poll_dep_target(struct nfc_device *pnd,
-                              const nfc_dep_mode ndm, const nfc_baud_rate nbr,
-                              const nfc_dep_info *pndiInitiator,
-                              nfc_target *pnt,
-                              const int timeout)
+static int
+nfc_initiator_poll_dep_target_locked(struct nfc_device *pnd,
+                                     const nfc_dep_mode ndm, const nfc_baud_rate nbr,
+                                     const nfc_dep_info *pndiInitiator,
+                                     nfc_target *pnt,
+                                     const int timeout)
 {
   const int period = 300;
   int remaining_time = timeout;
@@ -721,6 +1007,37 @@ end:
   return result;
 }
 
+/** @ingroup initiator
+ * @brief Poll a target and request active or passive mode for D.E.P. (Data Exchange Protocol)
+ * @return Returns selected D.E.P targets count on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param ndm desired D.E.P. mode (\a NDM_ACTIVE or \a NDM_PASSIVE for active, respectively passive mode)
+ * @param nbr desired baud rate
+ * @param pndiInitiator pointer \a nfc_dep_info struct that contains \e NFCID3 and \e General \e Bytes to set to the initiator device (optionnal, can be \e NULL)
+ * @param[out] pnt is a \a nfc_target struct pointer where target information will be put.
+ * @param timeout in milliseconds
+ *
+ * The NFC device will try to find an available D.E.P. target. The standards
+ * (ISO18092 and ECMA-340) describe the modulation that can be used for reader
+ * to passive communications.
+ *
+ * @note \a nfc_dep_info will be returned when the target was acquired successfully.
+ */
+int
+nfc_initiator_poll_dep_target(struct nfc_device *pnd,
+                              const nfc_dep_mode ndm, const nfc_baud_rate nbr,
+                              const nfc_dep_info *pndiInitiator,
+                              nfc_target *pnt,
+                              const int timeout)
+{
+  // Hold the device until NP_INFINITE_SELECT is restored
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_poll_dep_target_locked(pnd, ndm, nbr, pndiInitiator, pnt, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Deselect a selected passive or emulated tag
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
@@ -771,7 +1088,60 @@ int
 nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
                                const size_t szRx, int timeout)
 {
-  HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout)
+  HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+}
+
+/** @ingroup initiator
+ * @brief Send a sequence of byte frames to a target and collect the answers
+ * @return Returns the number of successful exchanges, otherwise returns libnfc's error code if the batch could not be started
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param ops array of exchanges, run in order; the result of each one is stored in its \a res field
+ * @param szOps number of exchanges in \a ops
+ * @param flags \a NFC_BATCH_STOP_ON_ERROR to stop at the first failing exchange, 0 to run them all
+ * @param timeout in milliseconds, applied to each exchange
+ *
+ * Each exchange behaves like nfc_initiator_transceive_bytes() on the selected target.
+ * An exchange whose \a szRxExpected is not 0 and which receives another number of bytes fails with \a NFC_ERFTRANS.
+ * Exchanges after a failing one are left untouched when \a NFC_BATCH_STOP_ON_ERROR is set.
+ *
+ * Device settings are checked once for the whole batch, which makes long sequences of short commands
+ * (e.g. card personalisation) cheaper than as many nfc_initiator_transceive_bytes() calls.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_initiator_transceive_batch(nfc_device *pnd, nfc_transceive_op ops[], const size_t szOps, const int flags, int timeout)
+{
+  if (pnd->driver->initiator_transceive_batch) {
+    HAL(initiator_transceive_batch, pnd, ops, szOps, flags, timeout);
+  }
+
+  // Drivers without a native batch support run the exchanges one by one
+  int last_error = 0;
+  size_t szDone = 0;
+  nfc_device_lock(pnd);
+  for (size_t i = 0; i < szOps; i++) {
+    int res = nfc_initiator_transceive_bytes(pnd, ops[i].pbtTx, ops[i].szTx, ops[i].pbtRx, ops[i].szRx, timeout);
+    if ((res >= 0) && ops[i].szRxExpected && ((size_t)res != ops[i].szRxExpected))
+      res = NFC_ERFTRANS;
+    ops[i].res = res;
+    if (res < 0) {
+      if (res == NFC_EDEVNOTSUPP) {
+        nfc_device_unlock(pnd);
+        return res;
+      }
+      last_error = res;
+      if (flags & NFC_BATCH_STOP_ON_ERROR)
+        break;
+    } else {
+      szDone++;
+    }
+  }
+  pnd->last_error = last_error;
+  nfc_device_unlock(pnd);
+  return szDone;
 }
 
 /** @ingroup initiator
@@ -903,6 +1273,37 @@ nfc_initiator_transceive_bits_timed(nfc_device *pnd,
   HAL(initiator_transceive_bits_timed, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar, cycles);
 }
 
+static int
+nfc_target_init_locked(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  int res = 0;
+  // Disallow invalid frame
+  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_INVALID_FRAMES, false)) < 0)
+    return res;
+  // Disallow multiple frames
+  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_MULTIPLE_FRAMES, false)) < 0)
+    return res;
+  // Make sure we reset the CRC and parity to chip handling.
+  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0)
+    return res;
+  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0)
+    return res;
+  // Activate auto ISO14443-4 switching by default
+  if ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, true)) < 0)
+    return res;
+  // Activate "easy framing" feature by default
+  if ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0)
+    return res;
+  // Deactivate the CRYPTO1 cipher, it may could cause problems when still active
+  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_CRYPTO1, false)) < 0)
+    return res;
+  // Drop explicitely the field
+  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0)
+    return res;
+
+  HAL(target_init, pnd, pnt, pbtRx, szRx, timeout);
+}
+
 /** @ingroup target
  * @brief Initialize NFC device as an emulated tag
  * @return Returns received bytes count on success, otherwise returns libnfc's error code
@@ -939,32 +1340,11 @@ nfc_initiator_transceive_bits_timed(nfc_device *pnd,
 int
 nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
 {
-  int res = 0;
-  // Disallow invalid frame
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_INVALID_FRAMES, false)) < 0)
-    return res;
-  // Disallow multiple frames
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACCEPT_MULTIPLE_FRAMES, false)) < 0)
-    return res;
-  // Make sure we reset the CRC and parity to chip handling.
-  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0)
-    return res;
-  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0)
-    return res;
-  // Activate auto ISO14443-4 switching by default
-  if ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, true)) < 0)
-    return res;
-  // Activate "easy framing" feature by default
-  if ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0)
-    return res;
-  // Deactivate the CRYPTO1 cipher, it may could cause problems when still active
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_CRYPTO1, false)) < 0)
-    return res;
-  // Drop explicitely the field
-  if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0)
-    return res;
-
-  HAL(target_init, pnd, pnt, pbtRx, szRx, timeout);
+  // Hold the device so no other call interleaves with the setup sequence
+  nfc_device_lock(pnd);
+  const int res = nfc_target_init_locked(pnd, pnt, pbtRx, szRx, timeout);
+  nfc_device_unlock(pnd);
+  return res;
 }
 
 /** @ingroup dev
@@ -991,13 +1371,19 @@ nfc_idle(nfc_device *pnd)
  *
  * Some commands (ie. nfc_target_init()) are blocking functions and will return only in particular conditions (ie. external initiator request).
  * This function attempt to abort the current running command.
+ * It may be called from another thread or from a signal handler: it only raises the device cancellation,
+ * which wakes the pending I/O wait. When no command is running, the next wait is aborted. An abort which
+ * comes once the device replied to the running command is too late for it, and is dropped.
  *
  * @note The blocking function (ie. nfc_target_init()) will failed with DEABORT error.
  */
 int
 nfc_abort_command(nfc_device *pnd)
 {
-  HAL(abort_command, pnd);
+  // No device lock here: it is held by the very command to abort
+  if (!pnd->driver->abort_command)
+    return NFC_EDEVNOTSUPP;
+  return pnd->driver->abort_command(pnd);
 }
 
 /** @ingroup target
@@ -1080,6 +1466,153 @@ nfc_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint
   HAL(target_receive_bits, pnd, pbtRx, szRx, pbtRxPar);
 }
 
+/** @ingroup nonblocking
+ * @brief Get the descriptor to watch for the completion of non-blocking operations
+ * @return Returns a file descriptor on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * The descriptor stays the same while the device is open and is owned by libnfc: watch it for reading
+ * (\c POLLIN, \c EPOLLIN, \c UV_READABLE...) but never read, write or close it.
+ * Only some drivers provide one, the others return \a NFC_EDEVNOTSUPP here and from the submit functions.
+ */
+int
+nfc_device_get_pollfd(nfc_device *pnd)
+{
+  if (!pnd->driver->device_get_pollfd) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(device_get_pollfd, pnd);
+}
+
+/** @ingroup nonblocking
+ * @brief Start selecting a passive or emulated tag without waiting for it
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nm desired modulation
+ * @param pbtInitData optional initiator data, see nfc_initiator_select_passive_target()
+ * @param szInitData length of initiator data \a pbtInitData.
+ * @param[out] pnt \a nfc_target struct pointer which will filled if available, it must remain valid until nfc_device_complete() returns
+ *
+ * The command is sent to the device (InListPassiveTarget) and this function returns as soon as the device took it.
+ * nfc_device_complete() then returns what nfc_initiator_select_passive_target() would have returned.
+ * With \a NP_INFINITE_SELECT set (see nfc_initiator_init()), the operation only completes once a tag is there:
+ * stop waiting with nfc_abort_command().
+ * Modulations which have to be discovered by raw exchanges (ISO14443B', ASK CTx, ST SRx, NFC Barcode) are not supported.
+ */
+int
+nfc_device_submit_select_passive_target(nfc_device *pnd,
+                                        const nfc_modulation nm,
+                                        const uint8_t *pbtInitData, const size_t szInitData,
+                                        nfc_target *pnt)
+{
+  uint8_t *abtInit = NULL;
+  uint8_t abtTmpInit[MAX(12, szInitData)];
+  size_t  szInit = 0;
+  int res;
+  if (!pnd->driver->initiator_submit_select_passive_target) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  if ((res = nfc_device_validate_modulation(pnd, N_INITIATOR, &nm)) != NFC_SUCCESS)
+    return res;
+  initiator_init_data(nm, pbtInitData, szInitData, abtTmpInit, &abtInit, &szInit);
+
+  HAL(initiator_submit_select_passive_target, pnd, nm, abtInit, szInit, pnt);
+}
+
+/** @ingroup nonblocking
+ * @brief Start sending bytes to the selected target without waiting for its answer
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted.
+ * @param szTx contains the length in bytes.
+ * @param[out] pbtRx response from the target, it must remain valid until nfc_device_complete() returns
+ * @param szRx size of \a pbtRx
+ *
+ * The frame is sent (InDataExchange, or InCommunicateThru without \a NP_EASY_FRAMING) and nfc_device_complete()
+ * then returns what nfc_initiator_transceive_bytes() would have returned. The target answer timeout is the one
+ * of the device (see \a NP_TIMEOUT_COM).
+ */
+int
+nfc_device_submit_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  if (!pnd->driver->initiator_submit_transceive_bytes) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(initiator_submit_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx);
+}
+
+/** @ingroup nonblocking
+ * @brief Start waiting for bytes from the initiator without blocking
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pbtRx received bytes, it must remain valid until nfc_device_complete() returns
+ * @param szRx size of \a pbtRx
+ *
+ * The device must have been initialized as target with nfc_target_init().
+ * nfc_device_complete() then returns what nfc_target_receive_bytes() would have returned.
+ */
+int
+nfc_device_submit_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx)
+{
+  if (!pnd->driver->target_submit_receive_bytes) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(target_submit_receive_bytes, pnd, pbtRx, szRx);
+}
+
+/** @ingroup nonblocking
+ * @brief Start sending bytes to the initiator without blocking
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted.
+ * @param szTx contains the length in bytes.
+ *
+ * The device must have been initialized as target with nfc_target_init().
+ * nfc_device_complete() then returns what nfc_target_send_bytes() would have returned.
+ */
+int
+nfc_device_submit_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx)
+{
+  if (!pnd->driver->target_submit_send_bytes) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(target_submit_send_bytes, pnd, pbtTx, szTx);
+}
+
+/** @ingroup nonblocking
+ * @brief Complete the submitted operation, if its result is there
+ * @return Returns the result of the submitted operation, \a NFC_EAGAIN if it is not completed yet, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Like a read(2) on a non-blocking descriptor, this function never waits for the tag or the initiator:
+ * call it right after the submit function, then each time the descriptor from nfc_device_get_pollfd() is
+ * readable, until it returns something else than \a NFC_EAGAIN.
+ * Only one operation can be pending on a device: until it is completed, submit functions fail with
+ * \a NFC_EINVARG and so do blocking functions that talk to the device.
+ *
+ * To give up a pending operation, call nfc_abort_command() then this function, which returns \a NFC_EOPABORTED.
+ */
+int
+nfc_device_complete(nfc_device *pnd)
+{
+  if (!pnd->driver->device_complete) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  HAL(device_complete, pnd);
+}
+
 static struct sErrorMessage {
   int     iErrorCode;
   const char *pcErrorMsg;
@@ -1094,6 +1627,7 @@ static struct sErrorMessage {
   { NFC_ETIMEOUT, "Timeout" },
   { NFC_EOPABORTED, "Operation Aborted" },
   { NFC_ENOTIMPL, "Not (yet) Implemented" },
+  { NFC_EAGAIN, "Operation Would Block" },
   { NFC_ETGRELEASED, "Target Released" },
   { NFC_EMFCAUTHFAIL, "Mifare Authentication Failed" },
   { NFC_ERFTRANS, "RF Transmission Error" },
@@ -0,0 +1,463 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file reader-pool.c
+ * @brief Pool of readers driven by worker threads
+ *
+ * Each reader has a worker thread. Jobs wait in a bounded queue; while the
+ * queue is not empty every idle worker polls its reader for a target, and the
+ * first one that selects a target takes the oldest job. Jobs therefore go to
+ * the readers tags are presented to, and submitters block when the queue is
+ * full.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+#define LOG_CATEGORY "libnfc.pool"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+#ifdef HAVE_PTHREAD
+
+// Pause after a select error, so a failing reader does not spin (us)
+#define POOL_ERROR_PAUSE 100000
+// Period of the removal check of a processed target (us)
+#define POOL_PRESENCE_PERIOD 20000
+
+struct pool_job {
+  nfc_reader_job job;
+  void *user_data;
+};
+
+struct pool_reader {
+  struct nfc_reader_pool *pool;
+  nfc_device *pnd;
+  pthread_t thread;
+  bool started;
+  /** Worker is in a select attempt (or its error pause), which stop aborts */
+  bool selecting;
+  nfc_reader_stats stats;
+};
+
+struct nfc_reader_pool {
+  nfc_modulation nm;
+
+  pthread_mutex_t mutex;
+  /** Signaled when a job is queued, or when the pool stops */
+  pthread_cond_t jobs_cond;
+  /** Signaled when a job leaves the queue, or when the pool stops */
+  pthread_cond_t space_cond;
+  bool stop;
+
+  /** Ring of queued jobs */
+  struct pool_job *queue;
+  size_t szQueue;
+  size_t szHead;
+  size_t szPending;
+
+  size_t szReaders;
+  struct pool_reader readers[];
+};
+
+static bool
+pool_stopping(struct nfc_reader_pool *pool)
+{
+  pthread_mutex_lock(&pool->mutex);
+  const bool stop = pool->stop;
+  pthread_mutex_unlock(&pool->mutex);
+  return stop;
+}
+
+static void
+pool_select_error(struct pool_reader *reader, const int res)
+{
+  pthread_mutex_lock(&reader->pool->mutex);
+  reader->stats.select_errors++;
+  reader->stats.last_error = res;
+  pthread_mutex_unlock(&reader->pool->mutex);
+}
+
+// Run job on pnt, then wait for pnt to leave so that the next job gets another target
+static void
+pool_run(struct pool_reader *reader, const struct pool_job *job, const nfc_target *pnt)
+{
+  struct nfc_reader_pool *pool = reader->pool;
+  nfc_device *pnd = reader->pnd;
+
+  const uint64_t start = monotonic_time_ns();
+  const int res = job->job(pnd, pnt, job->user_data);
+  const uint64_t elapsed = monotonic_time_ns() - start;
+
+  pthread_mutex_lock(&pool->mutex);
+  reader->stats.jobs++;
+  reader->stats.busy_us += elapsed / 1000;
+  if (res < 0) {
+    reader->stats.jobs_failed++;
+    reader->stats.last_error = res;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  while (!pool_stopping(pool) && (nfc_initiator_target_is_present(pnd, pnt) == NFC_SUCCESS)) {
+    if (nfc_cancel_sleep(&pnd->cancel, POOL_PRESENCE_PERIOD) < 0)
+      break;
+  }
+  nfc_initiator_deselect_target(pnd);
+}
+
+static void *
+pool_worker(void *arg)
+{
+  struct pool_reader *reader = arg;
+  struct nfc_reader_pool *pool = reader->pool;
+  nfc_target nt;
+
+  pthread_mutex_lock(&pool->mutex);
+  for (;;) {
+    // Only touch the reader when a job waits for a target
+    while (!pool->stop && (pool->szPending == 0))
+      pthread_cond_wait(&pool->jobs_cond, &pool->mutex);
+    if (pool->stop)
+      break;
+    reader->selecting = true;
+    pthread_mutex_unlock(&pool->mutex);
+
+    const int res = nfc_initiator_select_passive_target(reader->pnd, pool->nm, NULL, 0, &nt);
+    if (res < 0) {
+      pool_select_error(reader, res);
+      nfc_cancel_sleep(&reader->pnd->cancel, POOL_ERROR_PAUSE);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    reader->selecting = false;
+    if (res <= 0)
+      continue;
+    reader->stats.targets++;
+    if (pool->stop)
+      break;
+    if (pool->szPending == 0) {
+      // Another reader took the last job: leave this target for the next one
+      pthread_mutex_unlock(&pool->mutex);
+      nfc_initiator_deselect_target(reader->pnd);
+      pthread_mutex_lock(&pool->mutex);
+      continue;
+    }
+    const struct pool_job job = pool->queue[pool->szHead];
+    pool->szHead = (pool->szHead + 1) % pool->szQueue;
+    pool->szPending--;
+    pthread_cond_signal(&pool->space_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_run(reader, &job, &nt);
+
+    pthread_mutex_lock(&pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+/** @ingroup pool
+ * @brief Open readers and start their worker threads
+ * @return Returns a pointer to a \a nfc_reader_pool on success, otherwise returns \c NULL
+ * @param context The context to operate on
+ * @param connstrings connection strings of the readers, or \c NULL to use the devices found by nfc_list_devices()
+ * @param szReaders number of readers: size of \a connstrings, or maximum number of listed devices
+ * @param nm modulation of the targets to select
+ * @param szQueue maximum number of queued jobs, 0 for one per reader
+ *
+ * Every reader is opened and set up as initiator; the pool fails if one of them
+ * can not be. Readers belong to the pool until nfc_reader_pool_free(): only
+ * jobs should use them.
+ */
+nfc_reader_pool *
+nfc_reader_pool_new(nfc_context *context, const nfc_connstring connstrings[], const size_t szReaders, const nfc_modulation nm, const size_t szQueue)
+{
+  nfc_connstring *listed = NULL;
+  size_t szOpen = szReaders;
+
+  if (szReaders == 0)
+    return NULL;
+  if (!connstrings) {
+    if (!(listed = malloc(szReaders * sizeof(nfc_connstring)))) {
+      perror("malloc");
+      return NULL;
+    }
+    if ((szOpen = nfc_list_devices(context, listed, szReaders)) == 0) {
+      free(listed);
+      return NULL;
+    }
+    connstrings = (const nfc_connstring *) listed;
+  }
+
+  struct nfc_reader_pool *pool = calloc(1, sizeof(struct nfc_reader_pool) + szOpen * sizeof(struct pool_reader));
+  if (!pool) {
+    perror("calloc");
+    free(listed);
+    return NULL;
+  }
+  pool->nm = nm;
+  pool->szQueue = szQueue ? szQueue : szOpen;
+  if (!(pool->queue = malloc(pool->szQueue * sizeof(struct pool_job)))) {
+    perror("malloc");
+    free(pool);
+    free(listed);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->jobs_cond, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pool->space_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  for (size_t i = 0; i < szOpen; i++) {
+    struct pool_reader *reader = &pool->readers[i];
+    reader->pool = pool;
+    pool->szReaders++;
+    if (!(reader->pnd = nfc_open(context, connstrings[i]))) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open \"%s\"", connstrings[i]);
+      goto error;
+    }
+    // Single select attempts, so that workers notice new jobs and stop requests
+    if ((nfc_initiator_init(reader->pnd) < 0) ||
+        (nfc_device_set_property_bool(reader->pnd, NP_INFINITE_SELECT, false) < 0)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set up \"%s\" as initiator", connstrings[i]);
+      goto error;
+    }
+  }
+  free(listed);
+  listed = NULL;
+
+  for (size_t i = 0; i < pool->szReaders; i++) {
+    struct pool_reader *reader = &pool->readers[i];
+    if (pthread_create(&reader->thread, NULL, pool_worker, reader) != 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to start a reader worker");
+      goto error;
+    }
+    reader->started = true;
+  }
+  return pool;
+
+error:
+  free(listed);
+  nfc_reader_pool_free(pool);
+  return NULL;
+}
+
+/** @ingroup pool
+ * @brief Queue a job to run on the next selected target
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pool \a nfc_reader_pool to feed
+ * @param job function called from the worker of the reader that selected the target
+ * @param user_data pointer passed to \a job
+ * @param timeout maximum time to wait for room in the queue, in milliseconds
+ *
+ * If timeout equals to 0, the function blocks until the job is queued.
+ * If timeout is negative, the function fails at once when the queue is full.
+ * NFC_ETIMEOUT is returned when the queue stayed full.
+ */
+int
+nfc_reader_pool_submit(nfc_reader_pool *pool, nfc_reader_job job, void *user_data, const int timeout)
+{
+  struct timespec deadline;
+
+  if (!job)
+    return NFC_EINVARG;
+  if (timeout > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  while (!pool->stop && (pool->szPending == pool->szQueue)) {
+    int res = 0;
+    if (timeout < 0)
+      res = ETIMEDOUT;
+    else if (timeout == 0)
+      pthread_cond_wait(&pool->space_cond, &pool->mutex);
+    else
+      res = pthread_cond_timedwait(&pool->space_cond, &pool->mutex, &deadline);
+    if (res == ETIMEDOUT) {
+      pthread_mutex_unlock(&pool->mutex);
+      return NFC_ETIMEOUT;
+    }
+  }
+  if (pool->stop) {
+    pthread_mutex_unlock(&pool->mutex);
+    return NFC_EOPABORTED;
+  }
+  pool->queue[(pool->szHead + pool->szPending) % pool->szQueue] = (struct pool_job) { job, user_data };
+  pool->szPending++;
+  // Every idle reader may be the one a tag is presented to
+  pthread_cond_broadcast(&pool->jobs_cond);
+  pthread_mutex_unlock(&pool->mutex);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup pool
+ * @brief Number of queued jobs, waiting for a target
+ * @return Returns the number of jobs not yet taken by a reader
+ * @param pool \a nfc_reader_pool to look at
+ */
+size_t
+nfc_reader_pool_pending(nfc_reader_pool *pool)
+{
+  pthread_mutex_lock(&pool->mutex);
+  const size_t szPending = pool->szPending;
+  pthread_mutex_unlock(&pool->mutex);
+  return szPending;
+}
+
+/** @ingroup pool
+ * @brief Get per-reader statistics
+ * @return Returns the number of \a nfc_reader_stats filled (>= 0)
+ * @param pool \a nfc_reader_pool to look at
+ * @param stats array of \a nfc_reader_stats, in the order readers were given to nfc_reader_pool_new()
+ * @param szStats size of the \a stats array
+ */
+int
+nfc_reader_pool_get_stats(nfc_reader_pool *pool, nfc_reader_stats stats[], const size_t szStats)
+{
+  pthread_mutex_lock(&pool->mutex);
+  const size_t szFilled = MIN(szStats, pool->szReaders);
+  for (size_t i = 0; i < szFilled; i++)
+    stats[i] = pool->readers[i].stats;
+  pthread_mutex_unlock(&pool->mutex);
+  return (int) szFilled;
+}
+
+/** @ingroup pool
+ * @brief Stop the workers and close the readers
+ * @param pool \a nfc_reader_pool to free
+ *
+ * Running jobs are waited for, select attempts are aborted. Jobs still queued
+ * are not run: they are called with \c NULL device and target, so that their
+ * \a user_data can be released.
+ */
+void
+nfc_reader_pool_free(nfc_reader_pool *pool)
+{
+  if (!pool)
+    return;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->jobs_cond);
+  pthread_cond_broadcast(&pool->space_cond);
+  // Only abort select attempts: a job owns its reader, and an abort would hit its commands
+  for (size_t i = 0; i < pool->szReaders; i++) {
+    if (pool->readers[i].selecting)
+      nfc_abort_command(pool->readers[i].pnd);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (size_t i = 0; i < pool->szReaders; i++) {
+    struct pool_reader *reader = &pool->readers[i];
+    if (reader->started)
+      pthread_join(reader->thread, NULL);
+    // The abort may have come between two commands (error pause, select just
+    // done): drop it, nfc_close() has to release the target and the field
+    nfc_cancel_take(&reader->pnd->cancel);
+    nfc_close(reader->pnd);
+  }
+
+  for (; pool->szPending; pool->szPending--) {
+    const struct pool_job *job = &pool->queue[pool->szHead];
+    job->job(NULL, NULL, job->user_data);
+    pool->szHead = (pool->szHead + 1) % pool->szQueue;
+  }
+
+  pthread_cond_destroy(&pool->space_cond);
+  pthread_cond_destroy(&pool->jobs_cond);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->queue);
+  free(pool);
+}
+
+#else // HAVE_PTHREAD
+
+nfc_reader_pool *
+nfc_reader_pool_new(nfc_context *context, const nfc_connstring connstrings[], const size_t szReaders, const nfc_modulation nm, const size_t szQueue)
+{
+  (void) context;
+  (void) connstrings;
+  (void) szReaders;
+  (void) nm;
+  (void) szQueue;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Reader pools need thread support");
+  return NULL;
+}
+
+int
+nfc_reader_pool_submit(nfc_reader_pool *pool, nfc_reader_job job, void *user_data, const int timeout)
+{
+  (void) pool;
+  (void) job;
+  (void) user_data;
+  (void) timeout;
+  return NFC_ENOTIMPL;
+}
+
+size_t
+nfc_reader_pool_pending(nfc_reader_pool *pool)
+{
+  (void) pool;
+  return 0;
+}
+
+int
+nfc_reader_pool_get_stats(nfc_reader_pool *pool, nfc_reader_stats stats[], const size_t szStats)
+{
+  (void) pool;
+  (void) stats;
+  (void) szStats;
+  return NFC_ENOTIMPL;
+}
+
+void
+nfc_reader_pool_free(nfc_reader_pool *pool)
+{
+  (void) pool;
+}
+
+#endif // HAVE_PTHREAD
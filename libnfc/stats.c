@@ -0,0 +1,128 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file stats.c
+ * @brief Per-command exchange statistics
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+struct nfc_stats *
+nfc_stats_new(void)
+{
+  return calloc(1, sizeof(struct nfc_stats));
+}
+
+void
+nfc_stats_free(struct nfc_stats *stats)
+{
+  free(stats);
+}
+
+void
+nfc_stats_reset(struct nfc_stats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+static size_t
+nfc_stats_bucket(const uint64_t us)
+{
+  if (us < 2)
+    return (size_t) us;
+  if (us >= ((uint64_t) 1 << 32))
+    return NFC_STATS_BUCKETS - 1;
+
+  // Two buckets per power of two: the exponent and the bit below the leading one
+  size_t log2 = 1;
+  while ((us >> (log2 + 1)) != 0)
+    log2++;
+  return 2 * log2 + ((us >> (log2 - 1)) & 1);
+}
+
+/*
+ * Called once per exchange by the thread driving the device: only updates
+ * counters of a preallocated slot.
+ */
+void
+nfc_stats_record(struct nfc_stats *stats, const uint8_t command, const nfc_stats_status status, const size_t szTx, const size_t szRx, const uint64_t elapsed_ns)
+{
+  nfc_command_stats *cs;
+
+  if (stats->index[command]) {
+    cs = &stats->commands[stats->index[command] - 1];
+  } else {
+    if (stats->used == NFC_STATS_MAX_COMMANDS)
+      return;
+    cs = &stats->commands[stats->used++];
+    cs->command = command;
+    stats->index[command] = (uint8_t) stats->used;
+  }
+
+  const uint64_t us = elapsed_ns / 1000;
+  cs->count++;
+  switch (status) {
+    case NFC_STATS_SUCCESS:
+      break;
+    case NFC_STATS_TIMEOUT:
+      cs->timeouts++;
+      break;
+    case NFC_STATS_IO_ERROR:
+      cs->io_errors++;
+      break;
+    case NFC_STATS_CHIP_ERROR:
+      cs->chip_errors++;
+      break;
+  }
+  cs->bytes_sent += szTx;
+  cs->bytes_received += szRx;
+  cs->total_us += us;
+  if (us > cs->max_us)
+    cs->max_us = us;
+  cs->histogram[nfc_stats_bucket(us)]++;
+}
+
+size_t
+nfc_stats_get(const struct nfc_stats *stats, nfc_command_stats *commands, const size_t szCommands)
+{
+  size_t n = 0;
+
+  // Sorted by command code
+  for (size_t command = 0; (command < sizeof(stats->index)) && (n < szCommands); command++) {
+    if (stats->index[command])
+      commands[n++] = stats->commands[stats->index[command] - 1];
+  }
+  return n;
+}
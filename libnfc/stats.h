@@ -0,0 +1,58 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file stats.h
+ * @brief Per-command exchange statistics
+ */
+
+#ifndef __NFC_STATS_H__
+#define __NFC_STATS_H__
+
+#include <nfc/nfc-types.h>
+
+typedef enum {
+  NFC_STATS_SUCCESS,
+  NFC_STATS_TIMEOUT,
+  NFC_STATS_IO_ERROR,
+  NFC_STATS_CHIP_ERROR,
+} nfc_stats_status;
+
+struct nfc_stats {
+  /** Slot of each command code, plus one; 0 when the command was never seen */
+  uint8_t index[256];
+  size_t used;
+  nfc_command_stats commands[NFC_STATS_MAX_COMMANDS];
+};
+
+struct nfc_stats *nfc_stats_new(void);
+void nfc_stats_free(struct nfc_stats *stats);
+void nfc_stats_reset(struct nfc_stats *stats);
+void nfc_stats_record(struct nfc_stats *stats, const uint8_t command, const nfc_stats_status status, const size_t szTx, const size_t szRx, const uint64_t elapsed_ns);
+size_t nfc_stats_get(const struct nfc_stats *stats, nfc_command_stats *commands, const size_t szCommands);
+
+#endif // __NFC_STATS_H__
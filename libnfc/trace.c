@@ -0,0 +1,244 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file trace.c
+ * @brief Binary frame trace ring
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "trace.h"
+
+#define LOG_CATEGORY "libnfc.trace"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+#if defined(__GNUC__)
+#  define trace_load_acquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#  define trace_load_relaxed(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+#  define trace_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#  define trace_store_relaxed(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#  define trace_fence_acquire()     __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#  define trace_fence_release()     __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#  define trace_load_acquire(p)     (*(volatile const uint64_t *)(p))
+#  define trace_load_relaxed(p)     (*(volatile const uint64_t *)(p))
+#  define trace_store_release(p, v) (*(volatile uint64_t *)(p) = (v))
+#  define trace_store_relaxed(p, v) (*(volatile uint64_t *)(p) = (v))
+#  define trace_fence_acquire()     ((void) 0)
+#  define trace_fence_release()     ((void) 0)
+#endif
+
+// pcapng block types, options and link type
+#define PCAPNG_SHB              0x0A0D0D0A
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_OPT_EPB_FLAGS    2
+#define PCAPNG_EPB_INBOUND      1
+#define PCAPNG_EPB_OUTBOUND     2
+#define LINKTYPE_USER0          147
+
+struct nfc_trace *
+nfc_trace_new(const size_t size)
+{
+  struct nfc_trace *trace;
+
+  if ((size == 0) || (size > (SIZE_MAX - sizeof(*trace)) / sizeof(trace->frames[0])))
+    return NULL;
+  if (!(trace = calloc(1, sizeof(*trace) + size * sizeof(trace->frames[0]))))
+    return NULL;
+  trace->size = size;
+  // Frames are stamped from the monotonic clock, which a wall clock step cannot reorder
+  trace->epoch_offset = realtime_time_ns() - monotonic_time_ns();
+  return trace;
+}
+
+void
+nfc_trace_free(struct nfc_trace *trace)
+{
+  free(trace);
+}
+
+/*
+ * Only one thread (the one driving the device) may write to a trace.
+ */
+void
+nfc_trace_put(struct nfc_trace *trace, const nfc_trace_direction direction, const uint8_t command, const uint8_t *data, const size_t len)
+{
+  const uint64_t pos = trace->head;
+  struct nfc_trace_frame *frame = &trace->frames[pos % trace->size];
+  const size_t caplen = (len > NFC_TRACE_DATA_MAX_LEN) ? NFC_TRACE_DATA_MAX_LEN : len;
+
+  trace_store_relaxed(&frame->seq, 0);
+  trace_fence_release();
+  frame->timestamp = monotonic_time_ns();
+  frame->len = (uint16_t) len;
+  frame->caplen = (uint16_t) caplen;
+  frame->direction = direction;
+  frame->command = command;
+  if (caplen)
+    memcpy(frame->data, data, caplen);
+  trace_store_release(&frame->seq, pos + 1);
+  trace_store_release(&trace->head, pos + 1);
+}
+
+static bool
+trace_write(FILE *f, const void *data, const size_t len)
+{
+  static const uint8_t padding[3] = { 0, 0, 0 };
+
+  if (fwrite(data, 1, len, f) != len)
+    return false;
+  if ((len % 4) && (fwrite(padding, 1, 4 - (len % 4), f) != 4 - (len % 4)))
+    return false;
+  return true;
+}
+
+static bool
+trace_write_u32(FILE *f, const uint32_t value)
+{
+  return trace_write(f, &value, sizeof(value));
+}
+
+static bool
+trace_write_option(FILE *f, const uint16_t code, const void *value, const uint16_t len)
+{
+  const uint16_t header[2] = { code, len };
+
+  return trace_write(f, header, sizeof(header)) && ((len == 0) || trace_write(f, value, len));
+}
+
+#define PCAPNG_PADDED(len) (((len) + 3) & ~((size_t) 3))
+
+static bool
+trace_write_header(FILE *f, const char *name)
+{
+  // Section Header Block
+  const uint32_t shb[3] = { PCAPNG_SHB, 28, PCAPNG_BYTE_ORDER_MAGIC };
+  const uint16_t version[2] = { 1, 0 };
+  const uint32_t shb_trailer[3] = { 0xffffffff, 0xffffffff, 28 }; // Unknown section length
+  if (!trace_write(f, shb, sizeof(shb)) ||
+      !trace_write(f, version, sizeof(version)) ||
+      !trace_write(f, shb_trailer, sizeof(shb_trailer)))
+    return false;
+
+  // Interface Description Block: name, nanosecond resolution
+  const size_t name_len = strlen(name);
+  const uint8_t tsresol = 9;
+  const uint32_t idb_len = 20 + (uint32_t)(4 + PCAPNG_PADDED(name_len)) + 8 + 4;
+  const uint32_t idb[2] = { PCAPNG_IDB, idb_len };
+  const uint16_t linktype[2] = { LINKTYPE_USER0, 0 };
+  const uint32_t snaplen = 0;
+  return trace_write(f, idb, sizeof(idb)) &&
+         trace_write(f, linktype, sizeof(linktype)) &&
+         trace_write_u32(f, snaplen) &&
+         trace_write_option(f, PCAPNG_OPT_IF_NAME, name, (uint16_t) name_len) &&
+         trace_write_option(f, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol)) &&
+         trace_write_option(f, PCAPNG_OPT_ENDOFOPT, NULL, 0) &&
+         trace_write_u32(f, idb_len);
+}
+
+static bool
+trace_write_frame(FILE *f, const struct nfc_trace *trace, const struct nfc_trace_frame *frame)
+{
+  uint8_t abtPacket[2 + NFC_TRACE_DATA_MAX_LEN];
+  const uint32_t caplen = 2 + frame->caplen;
+  const uint32_t flags = (frame->direction == NFC_TRACE_CHIP_TO_HOST) ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+  const uint32_t epb_len = 28 + (uint32_t) PCAPNG_PADDED(caplen) + 8 + 4 + 4;
+  // pcapng timestamps count from the Unix epoch
+  const uint64_t timestamp = frame->timestamp + trace->epoch_offset;
+  const uint32_t epb[7] = {
+    PCAPNG_EPB, epb_len, 0,
+    (uint32_t)(timestamp >> 32), (uint32_t) timestamp,
+    caplen, 2 + (uint32_t) frame->len
+  };
+
+  abtPacket[0] = frame->direction;
+  abtPacket[1] = frame->command;
+  memcpy(abtPacket + 2, frame->data, frame->caplen);
+
+  return trace_write(f, epb, sizeof(epb)) &&
+         trace_write(f, abtPacket, caplen) &&
+         trace_write_option(f, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof(flags)) &&
+         trace_write_option(f, PCAPNG_OPT_ENDOFOPT, NULL, 0) &&
+         trace_write_u32(f, epb_len);
+}
+
+/*
+ * Take a snapshot of the frames currently held by the ring and write it as
+ * pcapng. It is safe to call this while another thread records frames.
+ */
+int
+nfc_trace_save(const struct nfc_trace *trace, const char *filename, const char *name)
+{
+  FILE *f;
+
+  if (!(f = fopen(filename, "wb"))) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open file: %s", filename);
+    return NFC_EIO;
+  }
+
+  bool success = trace_write_header(f, name);
+  const uint64_t head = trace_load_acquire(&trace->head);
+  size_t count = 0;
+  for (uint64_t pos = (head > trace->size) ? head - trace->size : 0; success && (pos < head); pos++) {
+    const struct nfc_trace_frame *slot = &trace->frames[pos % trace->size];
+    struct nfc_trace_frame frame;
+
+    if (trace_load_acquire(&slot->seq) != pos + 1)
+      continue; // Overwritten or being written
+    memcpy(&frame, slot, sizeof(frame));
+    trace_fence_acquire();
+    if (trace_load_relaxed(&slot->seq) != pos + 1)
+      continue;
+    if (frame.caplen > NFC_TRACE_DATA_MAX_LEN)
+      continue;
+
+    success = trace_write_frame(f, trace, &frame);
+    count++;
+  }
+
+  if ((fclose(f) != 0) || !success) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write file: %s", filename);
+    return NFC_EIO;
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d frame(s) saved to %s", (int) count, filename);
+  return (int) count;
+}
@@ -0,0 +1,98 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file trace.h
+ * @brief Binary frame trace ring
+ *
+ * Every frame exchanged with the chip through pn53x_transceive() can be
+ * recorded in a per-device ring. Recording only copies the frame: no
+ * formatting, no allocation, no lock. The ring is a fixed array of slots,
+ * each guarded by a sequence number, so a reader can take a consistent
+ * snapshot while the device keeps running; frames overwritten during the
+ * snapshot are skipped.
+ *
+ * nfc_device_save_trace() writes the snapshot as a pcapng file with a single
+ * interface of link type LINKTYPE_USER0 (147) and nanosecond timestamps
+ * counted from the Unix epoch. Frames are stamped from a monotonic clock;
+ * the offset to the real-time clock, taken when the trace is created, is
+ * added when saving. Each packet holds the frame as it appears
+ * inside a PN53x information frame:
+ *
+ *   TFI (1 byte)   0xD4 host to chip, 0xD5 chip to host
+ *   PD0 (1 byte)   command code (response code for chip to host frames)
+ *   PD1..PDn       command parameters or response data
+ *
+ * The direction is also stored in the epb_flags option of each Enhanced
+ * Packet Block (1: inbound, chip to host; 2: outbound, host to chip).
+ * Frames longer than NFC_TRACE_DATA_MAX_LEN are truncated; the original
+ * length is kept in the packet's original length field.
+ */
+
+#ifndef __NFC_TRACE_H__
+#define __NFC_TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NFC_TRACE_DATA_MAX_LEN  264
+
+typedef enum {
+  NFC_TRACE_HOST_TO_CHIP = 0xD4,
+  NFC_TRACE_CHIP_TO_HOST = 0xD5,
+} nfc_trace_direction;
+
+struct nfc_trace_frame {
+  /** Ring position + 1 once the slot is stable, 0 while it is being written */
+  uint64_t seq;
+  /** Monotonic timestamp in nanoseconds */
+  uint64_t timestamp;
+  /** Original data length */
+  uint16_t len;
+  /** Recorded data length */
+  uint16_t caplen;
+  uint8_t  direction;
+  uint8_t  command;
+  uint8_t  data[NFC_TRACE_DATA_MAX_LEN];
+};
+
+struct nfc_trace {
+  /** Number of slots */
+  size_t size;
+  /** Number of frames ever written */
+  uint64_t head;
+  /** Real-time minus monotonic clock when the trace was created, in nanoseconds */
+  uint64_t epoch_offset;
+  struct nfc_trace_frame frames[];
+};
+
+struct nfc_trace *nfc_trace_new(const size_t size);
+void nfc_trace_free(struct nfc_trace *trace);
+void nfc_trace_put(struct nfc_trace *trace, const nfc_trace_direction direction, const uint8_t command, const uint8_t *data, const size_t len);
+int nfc_trace_save(const struct nfc_trace *trace, const char *filename, const char *name);
+
+#endif // __NFC_TRACE_H__
@@ -12,6 +12,21 @@ AC_DEFUN([LIBNFC_CHECK_LIBUSB],
         [LIBUSB_WIN32_DIR=$withval],
         [LIBUSB_WIN32_DIR=""])
 
+    AC_ARG_WITH([libusb-1.0],
+        [AS_HELP_STRING([--with-libusb-1.0], [use libusb-1.0 asynchronous transfers instead of libusb 0.1])],
+        [with_libusb1=$withval],
+        [with_libusb1="no"])
+
+    # --with-libusb-1.0 have been set
+    if test x"$with_libusb1" = "xyes"; then
+      PKG_CHECK_MODULES([libusb], [libusb-1.0], [HAVE_LIBUSB=1], [AC_MSG_ERROR([libusb-1.0 is mandatory with --with-libusb-1.0])])
+      libusb_CFLAGS="$libusb_CFLAGS -DHAVE_LIBUSB1"
+      if test x"$PKG_CONFIG_REQUIRES" != x""; then
+        PKG_CONFIG_REQUIRES="$PKG_CONFIG_REQUIRES,"
+      fi
+      PKG_CONFIG_REQUIRES="$PKG_CONFIG_REQUIRES libusb-1.0"
+    fi
+
     # --with-libusb-win32 directory have been set
     if test "x$LIBUSB_WIN32_DIR" != "x"; then
       AC_MSG_NOTICE(["use libusb-win32 from $LIBUSB_WIN32_DIR"])
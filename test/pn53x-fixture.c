@@ -0,0 +1,24 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include "chips/pn53x.h"
+
+#include "pn53x-fixture.h"
+
+void
+pn53x_fixture_echo(nfc_device *pnd, const size_t szData)
+{
+  uint8_t abtCmd[2 + PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+
+  abtCmd[0] = 0x00;
+  abtCmd[1] = 0x00;
+  for (size_t i = 0; i < szData; i++)
+    abtCmd[2 + i] = (uint8_t) i;
+  int res = pn53x_transceive(pnd, abtCmd, 2 + szData, abtRx, sizeof(abtRx), 1000);
+  cut_assert_equal_int(1 + szData, res, cut_message("echo of %u bytes", (unsigned int) szData));
+  cut_assert_equal_memory(abtCmd + 1, 1 + szData, abtRx, (size_t) res, cut_message("echoed data"));
+}
@@ -0,0 +1,13 @@
+#ifndef __TEST_PN53X_FIXTURE_H__
+#define __TEST_PN53X_FIXTURE_H__
+
+#include <nfc/nfc.h>
+
+/*
+ * Checks run on any PN53x device, real or emulated.
+ */
+
+// Diagnose communication test: the chip echoes szData bytes, in a normal or an extended frame
+void pn53x_fixture_echo(nfc_device *pnd, const size_t szData);
+
+#endif // __TEST_PN53X_FIXTURE_H__
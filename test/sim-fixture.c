@@ -0,0 +1,102 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nfc-internal.h"
+
+#include "sim-fixture.h"
+
+#define MAX_SCRIPT_COUNT 8
+// Frames kept by sim_fixture_trace(), commands and replies
+#define TRACE_FRAME_COUNT 256
+
+static char acScripts[MAX_SCRIPT_COUNT][64];
+static size_t szScripts;
+
+void
+sim_fixture_setup(nfc_context *context)
+{
+  const nfc_connstring connstring = "pn53x_sim:default";
+  nfc_device *pnd = nfc_open(context, connstring);
+  if (!pnd)
+    cut_omit("pn53x_sim driver is needed");
+  nfc_close(pnd);
+}
+
+void
+sim_fixture_teardown(void)
+{
+  for (; szScripts > 0; szScripts--)
+    unlink(acScripts[szScripts - 1]);
+}
+
+void
+sim_fixture_script(nfc_connstring connstring, const char *pcScript, const unsigned int uiLatency)
+{
+  cut_assert_operator_int(szScripts, <, MAX_SCRIPT_COUNT, cut_message("too many scripts"));
+  char *pcPath = acScripts[szScripts];
+  strcpy(pcPath, "/tmp/test_sim.XXXXXX");
+  const int fd = mkstemp(pcPath);
+  cut_assert_operator_int(fd, >=, 0, cut_message("mkstemp"));
+  szScripts++;
+  const ssize_t res = write(fd, pcScript, strlen(pcScript));
+  close(fd);
+  cut_assert_equal_int(strlen(pcScript), res, cut_message("write %s", pcPath));
+
+  if (uiLatency)
+    snprintf(connstring, sizeof(nfc_connstring), "pn53x_sim:%s:%u", pcPath, uiLatency);
+  else
+    snprintf(connstring, sizeof(nfc_connstring), "pn53x_sim:%s", pcPath);
+}
+
+void
+sim_fixture_trace(nfc_device *pnd)
+{
+  cut_assert_equal_int(0, nfc_device_set_trace(pnd, TRACE_FRAME_COUNT), cut_message("nfc_device_set_trace"));
+}
+
+const struct nfc_trace_frame *
+sim_fixture_command(nfc_device *pnd, const size_t n)
+{
+  const struct nfc_trace *trace = pnd->trace;
+  cut_assert_not_null(trace, cut_message("sim_fixture_trace() first"));
+  cut_assert_true(trace->head <= trace->size, cut_message("trace ring overrun"));
+  size_t szCommands = 0;
+  for (uint64_t pos = 0; pos < trace->head; pos++) {
+    const struct nfc_trace_frame *frame = &trace->frames[pos];
+    if ((frame->direction == NFC_TRACE_HOST_TO_CHIP) && (szCommands++ == n))
+      return frame;
+  }
+  return NULL;
+}
+
+size_t
+sim_fixture_commands(nfc_device *pnd, uint8_t *pbtCommands, const size_t szCommands)
+{
+  const struct nfc_trace_frame *frame;
+  size_t n;
+  for (n = 0; (frame = sim_fixture_command(pnd, n)); n++) {
+    if (n < szCommands)
+      pbtCommands[n] = frame->command;
+  }
+  return n;
+}
+
+size_t
+sim_fixture_command_count(nfc_device *pnd, const uint8_t btCommand)
+{
+  const struct nfc_trace_frame *frame;
+  size_t szCount = 0;
+  for (size_t n = 0; (frame = sim_fixture_command(pnd, n)); n++) {
+    if (frame->command == btCommand)
+      szCount++;
+  }
+  return szCount;
+}
@@ -0,0 +1,28 @@
+#ifndef __TEST_SIM_FIXTURE_H__
+#define __TEST_SIM_FIXTURE_H__
+
+#include <nfc/nfc.h>
+
+#include "trace.h"
+
+/*
+ * Devices simulated by the pn53x_sim driver, which is not in the default
+ * driver set: tests using them are omitted when it is not built.
+ */
+
+// Omit the test when the pn53x_sim driver is not available
+void sim_fixture_setup(nfc_context *context);
+// Remove the scripts written since sim_fixture_setup()
+void sim_fixture_teardown(void);
+// Write pcScript to a file and return the connection string of a device running it, with uiLatency (us) if not 0
+void sim_fixture_script(nfc_connstring connstring, const char *pcScript, const unsigned int uiLatency);
+// Record the frames pnd exchanges from now on, forgetting the previous ones
+void sim_fixture_trace(nfc_device *pnd);
+// Number of commands sent since sim_fixture_trace(), whose codes go to pbtCommands (up to szCommands)
+size_t sim_fixture_commands(nfc_device *pnd, uint8_t *pbtCommands, const size_t szCommands);
+// Number of btCommand commands sent since sim_fixture_trace()
+size_t sim_fixture_command_count(nfc_device *pnd, const uint8_t btCommand);
+// n-th command sent since sim_fixture_trace(), NULL if there is none
+const struct nfc_trace_frame *sim_fixture_command(nfc_device *pnd, const size_t n);
+
+#endif // __TEST_SIM_FIXTURE_H__
@@ -0,0 +1,353 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers/broker.h"
+#include "chips/pn53x-internal.h"
+
+#include "sim-fixture.h"
+
+/*
+ * nfcd is run from the build tree (utils/nfcd) and serves a device simulated
+ * by the pn53x_sim driver: its "default" field holds a single ISO14443A
+ * target and no external initiator, so TgInitAsTarget never completes.
+ */
+void test_broker_round_trips(void);
+void test_broker_abort(void);
+void test_broker_driver(void);
+void test_broker_driver_held(void);
+void test_broker_second_instance(void);
+
+static nfc_context *context;
+static pid_t nfcd = -1;
+// Path of the nfcd socket, empty if not created
+static char acSocket[64];
+static char acNfcd[256];
+static int fd = -1;
+
+static int
+nfcd_connect(void)
+{
+  struct sockaddr_un sun;
+
+  memset(&sun, 0x00, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  strcpy(sun.sun_path, acSocket);
+  const int s = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((s >= 0) && (connect(s, (struct sockaddr *) &sun, sizeof(sun)) < 0)) {
+    close(s);
+    return -1;
+  }
+  return s;
+}
+
+static void
+broker_connect(void)
+{
+  fd = nfcd_connect();
+  cut_assert_operator_int(fd, >=, 0, cut_message("connect: %s", strerror(errno)));
+}
+
+void
+cut_setup(void)
+{
+  nfc_init(&context);
+  sim_fixture_setup(context);
+
+  const char *pcBaseDir = getenv("BASE_DIR");
+  snprintf(acNfcd, sizeof(acNfcd), "%s/../utils/nfcd", pcBaseDir ? pcBaseDir : ".");
+  if (access(acNfcd, X_OK) < 0)
+    cut_omit("nfcd is needed: %s", acNfcd);
+
+  // nfcd replaces this file with its socket
+  strcpy(acSocket, "/tmp/test_broker.XXXXXX");
+  const int tmp = mkstemp(acSocket);
+  if (tmp < 0)
+    acSocket[0] = '\0';
+  cut_assert_operator_int(tmp, >=, 0, cut_message("mkstemp"));
+  close(tmp);
+
+  nfcd = fork();
+  if (nfcd == 0) {
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    execl(acNfcd, acNfcd, "-s", acSocket, "pn53x_sim:default", (char *) NULL);
+    _exit(EXIT_FAILURE);
+  }
+  cut_assert_operator_int(nfcd, >, 0, cut_message("fork"));
+  // nfcd listens once its device is open
+  int s = -1;
+  for (int n = 0; (n < 500) && ((s = nfcd_connect()) < 0); n++)
+    usleep(10000);
+  cut_assert_operator_int(s, >=, 0, cut_message("connect: %s", strerror(errno)));
+  close(s);
+}
+
+void
+cut_teardown(void)
+{
+  if (fd >= 0)
+    close(fd);
+  fd = -1;
+  if (nfcd > 0) {
+    kill(nfcd, SIGTERM);
+    waitpid(nfcd, NULL, 0);
+  }
+  nfcd = -1;
+  if (acSocket[0])
+    unlink(acSocket);
+  acSocket[0] = '\0';
+  nfc_exit(context);
+}
+
+static void
+broker_send(const uint8_t op, const uint32_t tag, const int32_t arg, const void *pData, const size_t szData)
+{
+  uint8_t abtTx[sizeof(struct broker_header) + BROKER_PAYLOAD_MAX];
+  const struct broker_header hdr = { .op = op, .version = BROKER_PROTOCOL_VERSION, .len = szData, .tag = tag, .arg = arg };
+
+  memcpy(abtTx, &hdr, sizeof(hdr));
+  memcpy(abtTx + sizeof(hdr), pData, szData);
+  const ssize_t res = send(fd, abtTx, sizeof(hdr) + szData, 0);
+  cut_assert_equal_int(sizeof(hdr) + szData, res, cut_message("send"));
+}
+
+static void
+broker_recv_all(void *pData, const size_t szData)
+{
+  size_t szDone = 0;
+  while (szDone < szData) {
+    const ssize_t res = recv(fd, (uint8_t *) pData + szDone, szData - szDone, 0);
+    cut_assert_operator_int(res, >, 0, cut_message("recv"));
+    szDone += res;
+  }
+}
+
+// Receive the reply to request tag, whose payload goes to pData
+static int32_t
+broker_recv(const uint8_t op, const uint32_t tag, void *pData, const size_t szData)
+{
+  struct broker_header hdr;
+
+  broker_recv_all(&hdr, sizeof(hdr));
+  cut_assert_equal_uint(op, hdr.op, cut_message("reply op"));
+  cut_assert_equal_uint(tag, hdr.tag, cut_message("reply tag"));
+  cut_assert_equal_uint((hdr.arg > 0) ? (uint16_t) hdr.arg : 0, hdr.len, cut_message("reply length"));
+  cut_assert_operator_int(hdr.len, <=, szData, cut_message("reply payload"));
+  broker_recv_all(pData, hdr.len);
+  return hdr.arg;
+}
+
+static void
+broker_open(void)
+{
+  struct broker_session session;
+
+  broker_connect();
+  broker_send(BROKER_OPEN, 1, 0, NULL, 0);
+  const int32_t res = broker_recv(BROKER_OPEN, 1, &session, sizeof(session));
+  cut_assert_equal_int(sizeof(session), res, cut_message("BROKER_OPEN"));
+  cut_assert_true(session.name[0] != '\0', cut_message("device name"));
+}
+
+void
+test_broker_round_trips(void)
+{
+  const uint8_t abtGetFirmwareVersion[] = { GetFirmwareVersion };
+  const uint8_t abtDiagnose[] = { Diagnose, 0x00, 0xca, 0xfe };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  int32_t res;
+
+  broker_open();
+
+  // Requests are sent without waiting, their replies come in order
+  broker_send(BROKER_TRANSCEIVE, 2, 1000, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion));
+  broker_send(BROKER_TRANSCEIVE, 3, 1000, abtDiagnose, sizeof(abtDiagnose));
+  res = broker_recv(BROKER_TRANSCEIVE, 2, abtRx, sizeof(abtRx));
+  cut_assert_equal_memory("\x32\x01\x06\x07", 4, abtRx, (size_t) res, cut_message("GetFirmwareVersion"));
+  res = broker_recv(BROKER_TRANSCEIVE, 3, abtRx, sizeof(abtRx));
+  cut_assert_equal_memory(abtDiagnose + 1, sizeof(abtDiagnose) - 1, abtRx, (size_t) res, cut_message("Diagnose"));
+
+  broker_send(BROKER_CLOSE, 4, 0, NULL, 0);
+  cut_assert_equal_int(0, broker_recv(BROKER_CLOSE, 4, abtRx, sizeof(abtRx)), cut_message("BROKER_CLOSE"));
+
+  // Not held anymore
+  broker_send(BROKER_TRANSCEIVE, 5, 1000, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion));
+  res = broker_recv(BROKER_TRANSCEIVE, 5, abtRx, sizeof(abtRx));
+  cut_assert_equal_int(NFC_EINVARG, res, cut_message("BROKER_TRANSCEIVE after BROKER_CLOSE"));
+}
+
+void
+test_broker_abort(void)
+{
+  const uint8_t abtTgInitAsTarget[] = { TgInitAsTarget, 0x00 };
+  const uint8_t abtGetFirmwareVersion[] = { GetFirmwareVersion };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  int32_t res;
+
+  broker_open();
+
+  // Running command: no initiator comes along, only the abort ends it
+  broker_send(BROKER_TRANSCEIVE, 2, 0, abtTgInitAsTarget, sizeof(abtTgInitAsTarget));
+  usleep(100000);
+  broker_send(BROKER_ABORT, 2, 0, NULL, 0);
+  res = broker_recv(BROKER_TRANSCEIVE, 2, abtRx, sizeof(abtRx));
+  cut_assert_equal_int(NFC_EOPABORTED, res, cut_message("aborted TgInitAsTarget"));
+
+  // Queued command, aborted before it started
+  broker_send(BROKER_TRANSCEIVE, 3, 1000, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion));
+  broker_send(BROKER_TRANSCEIVE, 4, 0, abtTgInitAsTarget, sizeof(abtTgInitAsTarget));
+  broker_send(BROKER_ABORT, 4, 0, NULL, 0);
+  res = broker_recv(BROKER_TRANSCEIVE, 3, abtRx, sizeof(abtRx));
+  cut_assert_equal_int(4, res, cut_message("GetFirmwareVersion"));
+  res = broker_recv(BROKER_TRANSCEIVE, 4, abtRx, sizeof(abtRx));
+  cut_assert_equal_int(NFC_EOPABORTED, res, cut_message("aborted TgInitAsTarget"));
+
+  // The device serves the next command
+  broker_send(BROKER_TRANSCEIVE, 5, 1000, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion));
+  res = broker_recv(BROKER_TRANSCEIVE, 5, abtRx, sizeof(abtRx));
+  cut_assert_equal_memory("\x32\x01\x06\x07", 4, abtRx, (size_t) res, cut_message("GetFirmwareVersion after abort"));
+}
+
+struct abort_data {
+  void *cut_test_context;
+  nfc_device *pnd;
+  int res;
+};
+
+static void *
+target_thread(void *arg)
+{
+  struct abort_data *data = arg;
+  cut_set_current_test_context(data->cut_test_context);
+
+  nfc_target nt = {
+    .nm = {
+      .nmt = NMT_ISO14443A,
+      .nbr = NBR_106,
+    },
+    .nti = {
+      .nai = {
+        .abtAtqa = { 0x00, 0x04 },
+        .abtUid = { 0x08, 0xab, 0xcd, 0xef },
+        .btSak = 0x20,
+        .szUidLen = 4,
+      },
+    },
+  };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  data->res = nfc_target_init(data->pnd, &nt, abtRx, sizeof(abtRx), 0);
+  return NULL;
+}
+
+void
+test_broker_driver(void)
+{
+  const nfc_modulation nmIso14443A = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_106,
+  };
+  nfc_connstring connstring;
+  nfc_target nt;
+  pthread_t thread;
+  int res;
+
+  snprintf(connstring, sizeof(connstring), "broker:%s:", acSocket);
+  struct abort_data data = {
+    .cut_test_context = cut_get_current_test_context(),
+    .pnd = nfc_open(context, connstring),
+  };
+  if (!data.pnd)
+    cut_omit("broker driver is needed");
+
+  cut_assert_equal_int(0, nfc_initiator_init(data.pnd), cut_message("nfc_initiator_init"));
+  res = nfc_initiator_select_passive_target(data.pnd, nmIso14443A, NULL, 0, &nt);
+  cut_assert_equal_int(1, res, cut_message("nfc_initiator_select_passive_target"));
+  cut_assert_equal_memory("\x04\xa1\xb2\xc3\xd4\xe5\xf6", 7, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, cut_message("UID"));
+
+  // nfc_abort_command() goes to nfcd
+  pthread_create(&thread, NULL, target_thread, &data);
+  usleep(200000);
+  nfc_abort_command(data.pnd);
+  pthread_join(thread, NULL);
+  cut_assert_equal_int(NFC_EOPABORTED, data.res, cut_message("nfc_target_init"));
+
+  cut_assert_equal_int(0, nfc_initiator_init(data.pnd), cut_message("nfc_initiator_init after abort"));
+  nfc_close(data.pnd);
+}
+
+void
+test_broker_driver_held(void)
+{
+  nfc_connstring connstring;
+  struct timespec start, end;
+
+  snprintf(connstring, sizeof(connstring), "broker:%s:", acSocket);
+  nfc_device *pnd = nfc_open(context, connstring);
+  if (!pnd)
+    cut_omit("broker driver is needed");
+
+  // The device is held until nfc_close(): the second open gives up
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  nfc_device *pndHeld = nfc_open(context, connstring);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (pndHeld)
+    nfc_close(pndHeld);
+  cut_assert_null(pndHeld, cut_message("nfc_open of a held device"));
+  const long lElapsed = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+  cut_assert_operator_int(lElapsed, <, 10000, cut_message("nfc_open wait"));
+
+  // The withdrawn request does not take the device once it is given back
+  nfc_close(pnd);
+  pnd = nfc_open(context, connstring);
+  cut_assert_not_null(pnd, cut_message("nfc_open after nfc_close"));
+  cut_assert_equal_int(0, nfc_initiator_init(pnd), cut_message("nfc_initiator_init"));
+  nfc_close(pnd);
+}
+
+void
+test_broker_second_instance(void)
+{
+  int status;
+
+  // The socket of the running instance is left alone
+  const pid_t second = fork();
+  if (second == 0) {
+    const int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    execl(acNfcd, acNfcd, "-s", acSocket, "pn53x_sim:default", (char *) NULL);
+    _exit(EXIT_SUCCESS);
+  }
+  cut_assert_operator_int(second, >, 0, cut_message("fork"));
+  pid_t res = 0;
+  for (int n = 0; (n < 500) && ((res = waitpid(second, &status, WNOHANG)) == 0); n++)
+    usleep(10000);
+  if (res == 0) {
+    // Serving as well
+    kill(second, SIGTERM);
+    waitpid(second, &status, 0);
+  }
+  cut_assert_equal_int(second, res, cut_message("second nfcd exit"));
+  cut_assert_true(WIFEXITED(status), cut_message("second nfcd exit"));
+  cut_assert_equal_int(EXIT_FAILURE, WEXITSTATUS(status), cut_message("second nfcd exit status"));
+
+  broker_open();
+}
@@ -0,0 +1,210 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "cancel.h"
+#include "nfc-internal.h"
+
+#include "sim-fixture.h"
+
+/*
+ * nfc_abort_command() raised at each stage of a command run by a device
+ * simulated by the pn53x_sim driver, on the READ command of its "default"
+ * target, which echoes it back. The stages are told from the debug log: the
+ * pn53x layer logs the command name before sending it, the pn53x_sim driver
+ * its reply once received. The deadline sleeps of the drivers need no device.
+ */
+void test_cancel_before_wait(void);
+void test_cancel_during_wait(void);
+void test_cancel_after_reply(void);
+void test_cancel_sleep_until(void);
+
+#define READ_LATENCY 500000
+
+static const uint8_t abtRead[] = { 0x30, 0x00 };
+
+static nfc_context *context;
+static nfc_device *pnd;
+// Log message on which abort_on_log() aborts the running command, once
+static const char *pcAbortOn;
+
+static void
+abort_on_log(int priority, const char *category, const char *message, void *user_data)
+{
+  (void) priority;
+  (void) category;
+  (void) user_data;
+  if (pcAbortOn && (strncmp(message, pcAbortOn, strlen(pcAbortOn)) == 0)) {
+    pcAbortOn = NULL;
+    nfc_abort_command(pnd);
+  }
+}
+
+// Open a device whose READ command has uiLatency, with its target selected
+static void
+open_selected(const unsigned int uiLatency)
+{
+  const nfc_modulation nmIso14443A = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_106,
+  };
+  nfc_connstring connstring;
+  char acScript[64];
+  nfc_target nt;
+
+  sim_fixture_setup(context);
+  snprintf(acScript, sizeof(acScript), "target 0044 00 04a1b2c3d4e5f6\nlatency 40 %u\n", uiLatency);
+  sim_fixture_script(connstring, acScript, 0);
+  pnd = nfc_open(context, connstring);
+  cut_assert_not_null(pnd, cut_message("nfc_open"));
+  cut_assert_equal_int(0, nfc_initiator_init(pnd), cut_message("nfc_initiator_init"));
+  cut_assert_equal_int(1, nfc_initiator_select_passive_target(pnd, nmIso14443A, NULL, 0, &nt), cut_message("nfc_initiator_select_passive_target"));
+}
+
+static int
+transceive_read(void)
+{
+  uint8_t abtRx[16];
+  return nfc_initiator_transceive_bytes(pnd, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), 0);
+}
+
+void
+cut_setup(void)
+{
+  pcAbortOn = NULL;
+  nfc_init(&context);
+  nfc_set_log_callback(context, abort_on_log, NULL);
+  nfc_set_log_level(context, 3);
+}
+
+void
+cut_teardown(void)
+{
+  if (pnd)
+    nfc_close(pnd);
+  pnd = NULL;
+  nfc_set_log_callback(context, NULL, NULL);
+  nfc_exit(context);
+  sim_fixture_teardown();
+}
+
+void
+test_cancel_before_wait(void)
+{
+  open_selected(0);
+
+  // Sticky: raised while no command runs, it aborts the next wait
+  cut_assert_equal_int(0, nfc_abort_command(pnd), cut_message("nfc_abort_command"));
+  cut_assert_equal_int(NFC_EOPABORTED, transceive_read(), cut_message("READ after an abort"));
+  cut_assert_equal_int(sizeof(abtRead), transceive_read(), cut_message("READ"));
+
+  // Raised while the command is being sent, before its wait starts
+  pcAbortOn = "InDataExchange";
+  cut_assert_equal_int(NFC_EOPABORTED, transceive_read(), cut_message("READ aborted while sent"));
+  cut_assert_null(pcAbortOn, cut_message("abort raised"));
+  cut_assert_equal_int(sizeof(abtRead), transceive_read(), cut_message("READ"));
+}
+
+struct abort_data {
+  void *cut_test_context;
+  useconds_t delay;
+};
+
+static void *
+abort_thread(void *arg)
+{
+  struct abort_data *data = arg;
+  cut_set_current_test_context(data->cut_test_context);
+  usleep(data->delay);
+  nfc_abort_command(pnd);
+  return NULL;
+}
+
+void
+test_cancel_during_wait(void)
+{
+  struct timespec start, end;
+  pthread_t thread;
+
+  open_selected(READ_LATENCY);
+
+  struct abort_data data = {
+    .cut_test_context = cut_get_current_test_context(),
+    .delay = READ_LATENCY / 10,
+  };
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_create(&thread, NULL, abort_thread, &data);
+  const int res = transceive_read();
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pthread_join(thread, NULL);
+  cut_assert_equal_int(NFC_EOPABORTED, res, cut_message("READ aborted while waited for"));
+  const long lElapsed = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+  cut_assert_operator_int(lElapsed, <, READ_LATENCY / 2, cut_message("abort latency"));
+
+  // Consumed by the aborted wait
+  cut_assert_equal_int(sizeof(abtRead), transceive_read(), cut_message("READ"));
+}
+
+void
+test_cancel_after_reply(void)
+{
+  open_selected(0);
+
+  // The reply is received: too late for this command, and not meant for the next one
+  pcAbortOn = "RX";
+  cut_assert_equal_int(sizeof(abtRead), transceive_read(), cut_message("READ"));
+  cut_assert_null(pcAbortOn, cut_message("abort raised"));
+  cut_assert_equal_int(sizeof(abtRead), transceive_read(), cut_message("READ after a late abort"));
+}
+
+// Sleep until a deadline 2 ms past the next second of the monotonic clock, from 3 ms before that second
+static uint64_t
+sleep_across_second(struct nfc_cancel *cancel, int *res)
+{
+  const uint64_t second = (monotonic_time_ns() / 1000000000 + 1) * 1000000000;
+  nfc_cancel_sleep_until(NULL, second - 3000000);
+  const uint64_t deadline = second + 2000000;
+  *res = nfc_cancel_sleep_until(cancel, deadline);
+  const uint64_t end = monotonic_time_ns();
+  cut_assert_true(end >= deadline, cut_message("woken up %d ns early", (int)(deadline - end)));
+  return end - deadline;
+}
+
+void
+test_cancel_sleep_until(void)
+{
+  struct nfc_cancel cancel;
+  int res;
+
+  // As the PN532 I2C driver waits for its bus free time, without and with a cancellation
+  cut_assert_operator_int(sleep_across_second(NULL, &res), <, 20000000, cut_message("late wake-up"));
+  cut_assert_equal_int(NFC_SUCCESS, res, cut_message("sleep without cancellation"));
+  cut_assert_equal_int(0, nfc_cancel_init(&cancel), cut_message("nfc_cancel_init"));
+  cut_assert_operator_int(sleep_across_second(&cancel, &res), <, 20000000, cut_message("late wake-up"));
+  cut_assert_equal_int(NFC_SUCCESS, res, cut_message("sleep with a cancellation"));
+
+  // Not a whole number of milliseconds
+  for (int n = 0; n < 10; n++) {
+    const uint64_t start = monotonic_time_ns();
+    cut_assert_equal_int(NFC_SUCCESS, nfc_cancel_sleep(&cancel, 2500), cut_message("nfc_cancel_sleep"));
+    cut_assert_true(monotonic_time_ns() - start >= 2500000, cut_message("nfc_cancel_sleep woken up early"));
+  }
+
+  // Passed deadline, or raised cancellation: no sleep
+  cut_assert_equal_int(NFC_SUCCESS, nfc_cancel_sleep_until(&cancel, 0), cut_message("passed deadline"));
+  nfc_cancel_signal(&cancel);
+  const uint64_t start = monotonic_time_ns();
+  cut_assert_equal_int(NFC_EOPABORTED, nfc_cancel_sleep_until(&cancel, start + 1000000000), cut_message("raised cancellation"));
+  cut_assert_operator_int(monotonic_time_ns() - start, <, 20000000, cut_message("sleep with a raised cancellation"));
+  cut_assert_true(nfc_cancel_take(&cancel), cut_message("cancellation left pending"));
+  nfc_cancel_destroy(&cancel);
+}
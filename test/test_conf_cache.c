@@ -0,0 +1,249 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include <nfc/nfc.h>
+
+#include "conf.h"
+
+#define MAX_DEVICE_COUNT 512
+#define TEST_CONNSTRING "pn53x_sim:test"
+
+/*
+ * The cache lives in a temporary $XDG_CACHE_HOME. It is first written by
+ * nfc_init() from the configuration of this build, then forged to add user
+ * defined devices and a file of the test they depend on: these devices are
+ * only listed while the cache is replayed.
+ */
+void test_conf_cache_many_devices(void);
+void test_conf_cache_mtime(void);
+void test_conf_cache_ino(void);
+
+// $XDG_CACHE_HOME, empty if not created
+static char acCacheHome[64];
+static char acCache[128];
+// File the forged cache depends on, empty if not created
+static char acWatched[64];
+// Cache written by libnfc
+static uint8_t *pbtCache;
+static size_t szCache;
+static nfc_connstring connstrings[MAX_DEVICE_COUNT];
+
+static size_t
+file_read(const char *path, uint8_t **ppbtData)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  fseek(f, 0, SEEK_END);
+  const long lSize = ftell(f);
+  rewind(f);
+  *ppbtData = malloc(lSize);
+  const size_t szData = fread(*ppbtData, 1, lSize, f);
+  fclose(f);
+  return szData;
+}
+
+static void
+file_write(const char *path, const void *pData, const size_t szData)
+{
+  FILE *f = fopen(path, "wb");
+  cut_assert_not_null(f, cut_message("fopen %s", path));
+  cut_assert_equal_uint(szData, fwrite(pData, 1, szData, f), cut_message("fwrite %s", path));
+  fclose(f);
+}
+
+void
+cut_setup(void)
+{
+  nfc_context *context;
+
+  // Only the configuration files may define devices
+  unsetenv("LIBNFC_DEVICE");
+  unsetenv("LIBNFC_DEFAULT_DEVICE");
+
+  strcpy(acCacheHome, "/tmp/test_conf_cache.XXXXXX");
+  const int fd = mkstemp(acCacheHome);
+  if (fd >= 0) {
+    close(fd);
+    unlink(acCacheHome);
+  }
+  if ((fd < 0) || (mkdir(acCacheHome, 0700) < 0))
+    acCacheHome[0] = '\0';
+  cut_assert_true(acCacheHome[0] != '\0', cut_message("cache home"));
+  setenv("XDG_CACHE_HOME", acCacheHome, 1);
+  snprintf(acCache, sizeof(acCache), "%s/libnfc/"CONF_CACHE_FILE, acCacheHome);
+
+  strcpy(acWatched, "/tmp/test_conf_cache.XXXXXX");
+  const int fdWatched = mkstemp(acWatched);
+  if (fdWatched < 0)
+    acWatched[0] = '\0';
+  cut_assert_operator_int(fdWatched, >=, 0, cut_message("mkstemp"));
+  close(fdWatched);
+  file_write(acWatched, "watched\n", 8);
+
+  nfc_init(&context);
+  nfc_exit(context);
+  szCache = file_read(acCache, &pbtCache);
+  if (szCache < sizeof(struct conf_cache_header))
+    cut_omit("No configuration cache written (configuration files disabled, or modified a second ago)");
+}
+
+void
+cut_teardown(void)
+{
+  free(pbtCache);
+  pbtCache = NULL;
+  szCache = 0;
+  if (acWatched[0])
+    unlink(acWatched);
+  acWatched[0] = '\0';
+  if (acCacheHome[0]) {
+    unlink(acCache);
+    snprintf(acCache, sizeof(acCache), "%s/libnfc", acCacheHome);
+    rmdir(acCache);
+    rmdir(acCacheHome);
+  }
+  acCacheHome[0] = '\0';
+  unsetenv("XDG_CACHE_HOME");
+}
+
+static void
+append(uint8_t **ppbt, const void *pData, const size_t szData)
+{
+  memcpy(*ppbt, pData, szData);
+  *ppbt += szData;
+}
+
+static void
+append_entry(uint8_t **ppbt, const char *key, const char *value)
+{
+  const struct conf_cache_entry entry = { .key_len = strlen(key) + 1, .value_len = strlen(value) + 1 };
+  append(ppbt, &entry, sizeof(entry));
+  append(ppbt, key, entry.key_len);
+  append(ppbt, value, entry.value_len);
+}
+
+// Replace the cache by the one libnfc wrote, plus acWatched and szDevices user defined devices
+static void
+cache_forge(const size_t szDevices)
+{
+  struct conf_cache_header header;
+  struct stat st;
+  char acValue[32];
+
+  memcpy(&header, pbtCache, sizeof(header));
+  cut_assert_equal_memory(CONF_CACHE_MAGIC, sizeof(header.magic), header.magic, sizeof(header.magic), cut_message("cache magic"));
+
+  // Entries follow the file records
+  const uint8_t *pbtEntries = pbtCache + sizeof(header);
+  for (uint32_t i = 0; i < header.file_count; i++) {
+    struct conf_cache_file file;
+    memcpy(&file, pbtEntries, sizeof(file));
+    pbtEntries += sizeof(file) + file.path_len;
+  }
+
+  uint8_t *pbtForged = malloc(szCache + sizeof(struct conf_cache_file) + sizeof(acWatched) + szDevices * 64);
+  uint8_t *p = pbtForged + sizeof(header);
+  append(&p, pbtCache + sizeof(header), pbtEntries - (pbtCache + sizeof(header)));
+  cut_assert_equal_int(0, stat(acWatched, &st), cut_message("stat %s", acWatched));
+  const struct conf_cache_file file = {
+    .mtime = st.st_mtime,
+    .ctime = st.st_ctime,
+    .size = st.st_size,
+    .ino = st.st_ino,
+    .path_len = strlen(acWatched) + 1,
+  };
+  append(&p, &file, sizeof(file));
+  append(&p, acWatched, file.path_len);
+  append(&p, pbtEntries, szCache - (pbtEntries - pbtCache));
+  for (size_t n = 0; n < szDevices; n++) {
+    snprintf(acValue, sizeof(acValue), "test%u", (unsigned int) n);
+    append_entry(&p, "device.name", acValue);
+    snprintf(acValue, sizeof(acValue), TEST_CONNSTRING"%u", (unsigned int) n);
+    append_entry(&p, "device.connstring", acValue);
+  }
+
+  header.size = p - pbtForged;
+  header.file_count++;
+  header.entry_count += 2 * szDevices;
+  memcpy(pbtForged, &header, sizeof(header));
+  file_write(acCache, pbtForged, header.size);
+  free(pbtForged);
+}
+
+// Count the user defined devices of the forged cache listed by a new context
+static size_t
+devices_listed(void)
+{
+  nfc_context *context;
+  char acConnstring[32];
+  size_t szDevices = 0;
+
+  nfc_init(&context);
+  cut_assert_not_null(context, cut_message("nfc_init"));
+  const size_t device_count = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  nfc_exit(context);
+  for (size_t i = 0; i < device_count; i++) {
+    if (strncmp(connstrings[i], TEST_CONNSTRING, strlen(TEST_CONNSTRING)) != 0)
+      continue;
+    // In the order they were defined
+    snprintf(acConnstring, sizeof(acConnstring), TEST_CONNSTRING"%u", (unsigned int) szDevices);
+    cut_assert_equal_string(acConnstring, connstrings[i], cut_message("device #%u", (unsigned int) szDevices));
+    szDevices++;
+  }
+  return szDevices;
+}
+
+void
+test_conf_cache_many_devices(void)
+{
+  // Far more than the former fixed table of 4 user defined devices
+  cache_forge(300);
+  cut_assert_equal_uint(300, devices_listed(), cut_message("user defined devices"));
+  // The cache is still valid
+  cut_assert_equal_uint(300, devices_listed(), cut_message("user defined devices"));
+}
+
+void
+test_conf_cache_mtime(void)
+{
+  struct stat st;
+
+  cache_forge(8);
+  cut_assert_equal_uint(8, devices_listed(), cut_message("user defined devices"));
+
+  // Same content, other modification time
+  cut_assert_equal_int(0, stat(acWatched, &st), cut_message("stat %s", acWatched));
+  const struct utimbuf times = { .actime = st.st_atime, .modtime = st.st_mtime - 100 };
+  cut_assert_equal_int(0, utime(acWatched, &times), cut_message("utime %s", acWatched));
+  cut_assert_equal_uint(0, devices_listed(), cut_message("user defined devices after a modification"));
+}
+
+void
+test_conf_cache_ino(void)
+{
+  struct stat st;
+  char acReplacement[80];
+
+  cache_forge(8);
+  cut_assert_equal_uint(8, devices_listed(), cut_message("user defined devices"));
+
+  // Same content and modification time, but another file
+  cut_assert_equal_int(0, stat(acWatched, &st), cut_message("stat %s", acWatched));
+  snprintf(acReplacement, sizeof(acReplacement), "%s.new", acWatched);
+  file_write(acReplacement, "watched\n", 8);
+  const struct utimbuf times = { .actime = st.st_atime, .modtime = st.st_mtime };
+  cut_assert_equal_int(0, utime(acReplacement, &times), cut_message("utime %s", acReplacement));
+  cut_assert_equal_int(0, rename(acReplacement, acWatched), cut_message("rename %s", acReplacement));
+  cut_assert_equal_uint(0, devices_listed(), cut_message("user defined devices after a replacement"));
+}
@@ -0,0 +1,176 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <poll.h>
+
+#include <nfc/nfc.h>
+
+#include "sim-fixture.h"
+
+/*
+ * The device is simulated by the pn53x_sim driver, with a script written by
+ * each test: operations the simulated field never answers stay pending.
+ */
+void test_nonblocking_initiator(void);
+void test_nonblocking_eagain(void);
+void test_nonblocking_target(void);
+
+static const nfc_modulation nmIso14443A = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+static nfc_context *context;
+static nfc_device *device;
+
+void
+cut_setup(void)
+{
+  nfc_init(&context);
+  sim_fixture_setup(context);
+}
+
+void
+cut_teardown(void)
+{
+  if (device)
+    nfc_close(device);
+  device = NULL;
+  sim_fixture_teardown();
+  nfc_exit(context);
+}
+
+// Open a simulated device running pcScript
+static void
+open_device(const char *pcScript)
+{
+  nfc_connstring connstring;
+
+  sim_fixture_script(connstring, pcScript, 0);
+  device = nfc_open(context, connstring);
+  cut_assert_not_null(device, cut_message("nfc_open"));
+}
+
+// Whether the descriptor of the device gets readable within timeout ms
+static bool
+device_readable(const int timeout)
+{
+  struct pollfd pfd = { .fd = nfc_device_get_pollfd(device), .events = POLLIN };
+  return poll(&pfd, 1, timeout) == 1;
+}
+
+// Complete the pending operation the way an event loop does
+static int
+complete(void)
+{
+  int res;
+  while ((res = nfc_device_complete(device)) == NFC_EAGAIN) {
+    if (!device_readable(5000))
+      break;
+  }
+  return res;
+}
+
+void
+test_nonblocking_initiator(void)
+{
+  nfc_target nt;
+  uint8_t abtRx[16];
+  const uint8_t abtRead[] = { 0x30, 0x00 };
+  int res;
+
+  open_device("target 0044 00 04a1b2c3d4e5f6\n");
+  cut_assert_equal_int(0, nfc_initiator_init(device), cut_message("nfc_initiator_init"));
+  cut_assert_operator_int(nfc_device_get_pollfd(device), >=, 0, cut_message("nfc_device_get_pollfd"));
+
+  res = nfc_device_submit_select_passive_target(device, nmIso14443A, NULL, 0, &nt);
+  cut_assert_equal_int(0, res, cut_message("submit select"));
+  // Only one operation at a time
+  res = nfc_device_submit_transceive_bytes(device, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx));
+  cut_assert_equal_int(NFC_EINVARG, res, cut_message("second submit"));
+  res = nfc_initiator_transceive_bytes(device, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), -1);
+  cut_assert_equal_int(NFC_EINVARG, res, cut_message("blocking call while pending"));
+  res = complete();
+  cut_assert_equal_int(1, res, cut_message("select"));
+  cut_assert_equal_memory("\x04\xa1\xb2\xc3\xd4\xe5\xf6", 7, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, cut_message("UID"));
+
+  res = nfc_device_submit_transceive_bytes(device, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx));
+  cut_assert_equal_int(0, res, cut_message("submit transceive"));
+  res = complete();
+  // Unknown requests are echoed by the simulated target
+  cut_assert_equal_memory(abtRead, sizeof(abtRead), abtRx, (size_t) res, cut_message("transceive"));
+
+  // Blocking calls work again once completed
+  res = nfc_initiator_transceive_bytes(device, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), -1);
+  cut_assert_equal_int(sizeof(abtRead), res, cut_message("blocking call"));
+}
+
+void
+test_nonblocking_eagain(void)
+{
+  nfc_target nt;
+  int res;
+
+  // No target in the field, and the select waits for one (NP_INFINITE_SELECT)
+  open_device("# Empty field\n");
+  cut_assert_equal_int(0, nfc_initiator_init(device), cut_message("nfc_initiator_init"));
+
+  res = nfc_device_submit_select_passive_target(device, nmIso14443A, NULL, 0, &nt);
+  cut_assert_equal_int(0, res, cut_message("submit select"));
+  cut_assert_equal_int(NFC_EAGAIN, nfc_device_complete(device), cut_message("complete"));
+  cut_assert_false(device_readable(100), cut_message("descriptor readable without any result"));
+  cut_assert_equal_int(NFC_EAGAIN, nfc_device_complete(device), cut_message("complete again"));
+
+  // Giving up the operation
+  nfc_abort_command(device);
+  cut_assert_equal_int(NFC_EOPABORTED, nfc_device_complete(device), cut_message("complete after abort"));
+
+  // The device takes a new operation
+  res = nfc_device_submit_select_passive_target(device, nmIso14443A, NULL, 0, &nt);
+  cut_assert_equal_int(0, res, cut_message("submit select after abort"));
+  cut_assert_equal_int(NFC_EAGAIN, nfc_device_complete(device), cut_message("complete"));
+  nfc_abort_command(device);
+  cut_assert_equal_int(NFC_EOPABORTED, nfc_device_complete(device), cut_message("complete after abort"));
+
+  // Nothing is pending anymore
+  cut_assert_equal_int(NFC_EINVARG, nfc_device_complete(device), cut_message("complete without operation"));
+}
+
+void
+test_nonblocking_target(void)
+{
+  nfc_target nt = {
+    .nm = nmIso14443A,
+    .nti = {
+      .nai = {
+        .abtAtqa = { 0x00, 0x04 },
+        .abtUid = { 0x08, 0xab, 0xcd, 0xef },
+        .btSak = 0x20,
+        .szUidLen = 4,
+      },
+    },
+  };
+  uint8_t abtRx[64];
+  int res;
+
+  // The initiator sends one frame after the activation, then leaves
+  open_device("activation 00\ninitiator e0\ninitiator 3000\n");
+  res = nfc_target_init(device, &nt, abtRx, sizeof(abtRx), 0);
+  cut_assert_operator_int(res, >=, 0, cut_message("nfc_target_init"));
+
+  res = nfc_device_submit_target_receive_bytes(device, abtRx, sizeof(abtRx));
+  cut_assert_equal_int(0, res, cut_message("submit receive"));
+  res = complete();
+  cut_assert_equal_memory("\x30\x00", 2, abtRx, (size_t) res, cut_message("received frame"));
+
+  res = nfc_device_submit_target_send_bytes(device, (const uint8_t *) "\x01\x02\x03", 3);
+  cut_assert_equal_int(0, res, cut_message("submit send"));
+  cut_assert_equal_int(3, complete(), cut_message("send"));
+
+  res = nfc_device_submit_target_receive_bytes(device, abtRx, sizeof(abtRx));
+  cut_assert_equal_int(0, res, cut_message("submit receive"));
+  cut_assert_equal_int(NFC_ETGRELEASED, complete(), cut_message("receive once the initiator left"));
+}
@@ -0,0 +1,76 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "pn53x-fixture.h"
+
+#define MAX_DEVICE_COUNT 8
+#define NROUNDS 50
+
+/*
+ * These tests need a PN532 on I2C, e.g. given by LIBNFC_DEVICE=pn532_i2c:/dev/i2c-1,
+ * and a second one for test_pn532_i2c_two_devices.
+ */
+void test_pn532_i2c_back_to_back(void);
+void test_pn532_i2c_two_devices(void);
+
+static nfc_context *context;
+static nfc_device *devices[2];
+static size_t szDevices;
+
+void
+cut_setup(void)
+{
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+
+  nfc_init(&context);
+  szDevices = 0;
+  size_t device_count = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  for (size_t i = 0; (i < device_count) && (szDevices < 2); i++) {
+    if (strncmp(connstrings[i], "pn532_i2c:", strlen("pn532_i2c:")) != 0)
+      continue;
+    devices[szDevices] = nfc_open(context, connstrings[i]);
+    cut_assert_not_null(devices[szDevices], cut_message("nfc_open %s", connstrings[i]));
+    szDevices++;
+  }
+  if (!szDevices)
+    cut_omit("No PN532 I2C device found");
+}
+
+void
+cut_teardown(void)
+{
+  for (size_t i = 0; i < szDevices; i++)
+    nfc_close(devices[i]);
+  szDevices = 0;
+  nfc_exit(context);
+}
+
+void
+test_pn532_i2c_back_to_back(void)
+{
+  // Commands follow each other as fast as the bus free time allows, status and frame coming in a single read
+  for (int n = 0; n < NROUNDS; n++) {
+    pn53x_fixture_echo(devices[0], 16);
+    pn53x_fixture_echo(devices[0], 260);
+  }
+}
+
+void
+test_pn532_i2c_two_devices(void)
+{
+  if (szDevices < 2)
+    cut_omit("Two PN532 I2C devices are needed");
+
+  // Each device keeps its own bus free time
+  for (int n = 0; n < NROUNDS; n++) {
+    pn53x_fixture_echo(devices[n % 2], 16);
+    pn53x_fixture_echo(devices[(n + 1) % 2], 260);
+  }
+}
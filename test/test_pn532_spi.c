@@ -0,0 +1,127 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "chips/pn53x.h"
+
+#define MAX_DEVICE_COUNT 8
+#define NROUNDS 100
+
+/*
+ * These tests need a PN532 on SPI, e.g. given by LIBNFC_DEVICE=pn532_spi:/dev/spidev0.0
+ * or pn532_spi:/dev/spidev0.0:500000:gpiochip0@25 to wait on its P70_IRQ line.
+ */
+void test_pn532_spi_round_trip(void);
+void test_pn532_spi_abort(void);
+
+static nfc_context *context;
+static nfc_device *device;
+
+static double
+now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void
+cut_setup(void)
+{
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+
+  nfc_init(&context);
+  size_t device_count = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  for (size_t i = 0; (i < device_count) && !device; i++) {
+    if (strncmp(connstrings[i], "pn532_spi:", strlen("pn532_spi:")) == 0)
+      device = nfc_open(context, connstrings[i]);
+  }
+  if (!device)
+    cut_omit("No PN532 SPI device found");
+}
+
+void
+cut_teardown(void)
+{
+  if (device)
+    nfc_close(device);
+  device = NULL;
+  nfc_exit(context);
+}
+
+void
+test_pn532_spi_round_trip(void)
+{
+  const uint8_t abtGetFirmwareVersion[] = { 0x02 };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+
+  const double start = now_ms();
+  for (int n = 0; n < NROUNDS; n++) {
+    int res = pn53x_transceive(device, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion), abtRx, sizeof(abtRx), 1000);
+    cut_assert_equal_int(4, res, cut_message("GetFirmwareVersion"));
+  }
+  const double elapsed = (now_ms() - start) / NROUNDS;
+  // The PN532 answers GetFirmwareVersion at once: no round trip may take the former 10 ms ready poll period
+  cut_assert_operator_int((int) elapsed, <, 10, cut_message("%.2f ms per GetFirmwareVersion", elapsed));
+}
+
+struct abort_data {
+  void *cut_test_context;
+  int res;
+  double end;
+};
+
+static void *
+target_thread(void *arg)
+{
+  struct abort_data *data = arg;
+  cut_set_current_test_context(data->cut_test_context);
+
+  nfc_target nt = {
+    .nm = {
+      .nmt = NMT_ISO14443A,
+      .nbr = NBR_106,
+    },
+    .nti = {
+      .nai = {
+        .abtAtqa = { 0x00, 0x04 },
+        .abtUid = { 0x08, 0xab, 0xcd, 0xef },
+        .btSak = 0x20,
+        .szUidLen = 4,
+      },
+    },
+  };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  // No initiator comes along: only the abort ends this wait
+  data->res = nfc_target_init(device, &nt, abtRx, sizeof(abtRx), 0);
+  data->end = now_ms();
+  return NULL;
+}
+
+void
+test_pn532_spi_abort(void)
+{
+  struct abort_data data = {
+    .cut_test_context = cut_get_current_test_context(),
+  };
+  pthread_t thread;
+
+  pthread_create(&thread, NULL, target_thread, &data);
+  sleep(1);
+  const double start = now_ms();
+  nfc_abort_command(device);
+  pthread_join(thread, NULL);
+
+  cut_assert_equal_int(NFC_EOPABORTED, data.res, cut_message("nfc_target_init"));
+  // The ready wait is cut into 10 ms slices
+  cut_assert_operator_int((int)(data.end - start), <, 100, cut_message("abort took %.2f ms", data.end - start));
+}
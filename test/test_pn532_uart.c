@@ -0,0 +1,442 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <nfc/nfc.h>
+
+#include "chips/pn53x.h"
+
+#include "pn53x-fixture.h"
+
+void test_pn532_uart_coalesced_frames(void);
+void test_pn532_uart_split_frames(void);
+void test_pn532_uart_corrupted_frames(void);
+void test_pn532_uart_high_speed(void);
+void test_pn532_uart_high_speed_fallback(void);
+void test_pn532_uart_unsupported_speed(void);
+
+// Same termios2 layout as the UART bus, to read speeds termios(3) has no constant for
+#if defined(__linux__) && !defined(__alpha__) && !defined(__mips__) && !defined(__powerpc__) && !defined(__sparc__)
+#  define EMU_HAVE_TERMIOS2
+struct emu_termios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+#  define EMU_TCGETS2 _IOR('T', 0x2A, struct emu_termios2)
+#endif
+
+/*
+ * A PN532 is emulated on the master side of a pseudo-terminal, so that the
+ * pn532_uart driver parses real frames, as the emulator chooses to deliver
+ * them, from its UART receive buffer.
+ */
+enum emu_fault {
+  EMU_NO_FAULT,
+  EMU_BAD_CHECKSUM,
+  EMU_ERROR_FRAME,
+  // Answer SetSerialBaudRate but keep the current speed
+  EMU_IGNORE_SPEED,
+};
+
+// Speeds of SetSerialBaudRate, indexed by its BR parameter
+static const uint32_t emu_speeds[] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000 };
+
+static struct {
+  int fd;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  // Fields below are protected by mutex
+  bool stop;
+  // Write answers one byte at a time instead of ACK and answer at once
+  bool split;
+  // Spoil the next answer
+  enum emu_fault fault;
+  // Speed of the emulated PN532, which does not answer a host at another one
+  uint32_t speed;
+  // Speed taken once the host acknowledged the SetSerialBaudRate answer, 0 if none
+  uint32_t next_speed;
+  unsigned int set_serial_baud_rate_count;
+} emu;
+
+static nfc_context *context;
+static nfc_device *device;
+
+// Speed the host set its side of the pseudo-terminal to, 0 if unknown
+static uint32_t
+emu_host_speed(void)
+{
+#ifdef EMU_HAVE_TERMIOS2
+  struct emu_termios2 tio2;
+  if (ioctl(emu.fd, EMU_TCGETS2, &tio2) == 0)
+    return tio2.c_ospeed;
+#endif
+  const speed_t speeds[] = { B9600, B19200, B38400, B57600, B115200, B230400, B460800, B921600 };
+  struct termios tio;
+  if (tcgetattr(emu.fd, &tio) < 0)
+    return 0;
+  for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+    if (cfgetospeed(&tio) == speeds[i])
+      return emu_speeds[i];
+  }
+  return 0;
+}
+
+static void
+emu_write(const uint8_t *pbtData, const size_t szData, const bool split)
+{
+  size_t szDone = 0;
+  while (szDone < szData) {
+    ssize_t res = write(emu.fd, pbtData + szDone, split ? 1 : szData - szDone);
+    if (res < 0)
+      return;
+    szDone += res;
+    if (split)
+      usleep(100);
+  }
+}
+
+// Frame the answer pbtData (command code + 1 and parameters) the way a PN532 does
+static size_t
+emu_frame(uint8_t *pbtFrame, const uint8_t *pbtData, const size_t szData)
+{
+  const size_t szLen = 1 + szData;
+  size_t szFrame = 0;
+
+  pbtFrame[szFrame++] = 0x00;
+  pbtFrame[szFrame++] = 0x00;
+  pbtFrame[szFrame++] = 0xff;
+  if (szLen > 0xff) {
+    pbtFrame[szFrame++] = 0xff;
+    pbtFrame[szFrame++] = 0xff;
+    pbtFrame[szFrame++] = szLen >> 8;
+    pbtFrame[szFrame++] = szLen & 0xff;
+    pbtFrame[szFrame++] = 256 - ((pbtFrame[5] + pbtFrame[6]) & 0xff);
+  } else {
+    pbtFrame[szFrame++] = szLen;
+    pbtFrame[szFrame++] = 256 - szLen;
+  }
+  uint8_t btDCS = 0xd5;
+  pbtFrame[szFrame++] = 0xd5;
+  for (size_t i = 0; i < szData; i++) {
+    btDCS += pbtData[i];
+    pbtFrame[szFrame++] = pbtData[i];
+  }
+  pbtFrame[szFrame++] = 256 - btDCS;
+  pbtFrame[szFrame++] = 0x00;
+  return szFrame;
+}
+
+static void
+emu_answer(const uint8_t *pbtCmd, const size_t szCmd)
+{
+  const uint8_t abtAck[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+  const uint8_t abtErrorFrame[] = { 0x00, 0x00, 0xff, 0x01, 0xff, 0x7f, 0x81, 0x00 };
+  uint8_t abtData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtOut[sizeof(abtAck) + PN53x_EXTENDED_FRAME__DATA_MAX_LEN + 10];
+  size_t szData = 0;
+
+  abtData[szData++] = pbtCmd[0] + 1;
+  switch (pbtCmd[0]) {
+    case 0x00: // Diagnose: echo the test number and data
+      memcpy(abtData + szData, pbtCmd + 1, szCmd - 1);
+      szData += szCmd - 1;
+      break;
+    case 0x02: // GetFirmwareVersion: PN532 v1.6
+      memcpy(abtData + szData, "\x32\x01\x06\x07", 4);
+      szData += 4;
+      break;
+    case 0x06: // ReadRegister: one zero byte per address
+      memset(abtData + szData, 0x00, (szCmd - 1) / 2);
+      szData += (szCmd - 1) / 2;
+      break;
+    case 0x10: // SetSerialBaudRate: switch once the host acknowledged the answer
+      pthread_mutex_lock(&emu.mutex);
+      emu.set_serial_baud_rate_count++;
+      if ((szCmd == 2) && (pbtCmd[1] < sizeof(emu_speeds) / sizeof(emu_speeds[0])) && (emu.fault != EMU_IGNORE_SPEED))
+        emu.next_speed = emu_speeds[pbtCmd[1]];
+      pthread_mutex_unlock(&emu.mutex);
+      break;
+    case 0x16: // PowerDown
+    case 0x44: // InDeselect
+    case 0x52: // InRelease
+      abtData[szData++] = 0x00;
+      break;
+  }
+
+  pthread_mutex_lock(&emu.mutex);
+  const bool split = emu.split;
+  const enum emu_fault fault = emu.fault;
+  const uint32_t speed = emu.speed;
+  if (fault != EMU_IGNORE_SPEED)
+    emu.fault = EMU_NO_FAULT;
+  pthread_mutex_unlock(&emu.mutex);
+
+  // At different speeds, the host would only get garbage
+  if (emu_host_speed() != speed)
+    return;
+
+  memcpy(abtOut, abtAck, sizeof(abtAck));
+  size_t szOut = sizeof(abtAck);
+  if (fault == EMU_ERROR_FRAME) {
+    memcpy(abtOut + szOut, abtErrorFrame, sizeof(abtErrorFrame));
+    szOut += sizeof(abtErrorFrame);
+  } else {
+    szOut += emu_frame(abtOut + szOut, abtData, szData);
+    if (fault == EMU_BAD_CHECKSUM)
+      abtOut[szOut - 2] ^= 0xff;
+  }
+  emu_write(abtOut, szOut, split);
+}
+
+// Parse the host frames out of pbtIn, answer them, and return the number of bytes consumed
+static size_t
+emu_parse(const uint8_t *pbtIn, const size_t szIn)
+{
+  size_t szPos = 0;
+  for (;;) {
+    // Skip the wake-up bytes and preambles up to the start code
+    while ((szPos + 1 < szIn) && !((pbtIn[szPos] == 0x00) && (pbtIn[szPos + 1] == 0xff)))
+      szPos++;
+    const uint8_t *p = pbtIn + szPos + 2;
+    const size_t szLeft = (szPos + 2 <= szIn) ? szIn - szPos - 2 : 0;
+    if (szLeft < 2)
+      return szPos;
+    if ((p[0] == 0x00) && (p[1] == 0xff)) {
+      // ACK of the host
+      pthread_mutex_lock(&emu.mutex);
+      if (emu.next_speed)
+        emu.speed = emu.next_speed;
+      emu.next_speed = 0;
+      pthread_mutex_unlock(&emu.mutex);
+      szPos += 2 + 2;
+      continue;
+    }
+    size_t szHeader = 2;
+    size_t szLen = p[0];
+    if ((p[0] == 0xff) && (p[1] == 0xff)) {
+      if (szLeft < 5)
+        return szPos;
+      szHeader = 5;
+      szLen = (p[2] << 8) + p[3];
+    }
+    if (szLeft < szHeader + szLen + 2)
+      return szPos;
+    // TFI, command code and parameters
+    if (szLen >= 2)
+      emu_answer(p + szHeader + 1, szLen - 1);
+    szPos += 2 + szHeader + szLen + 2;
+  }
+}
+
+static void *
+emu_thread(void *arg)
+{
+  uint8_t abtIn[1024];
+  size_t szIn = 0;
+
+  (void) arg;
+  for (;;) {
+    pthread_mutex_lock(&emu.mutex);
+    const bool stop = emu.stop;
+    pthread_mutex_unlock(&emu.mutex);
+    if (stop)
+      break;
+
+    struct pollfd pfd = { .fd = emu.fd, .events = POLLIN };
+    if (poll(&pfd, 1, 20) <= 0)
+      continue;
+    ssize_t res = read(emu.fd, abtIn + szIn, sizeof(abtIn) - szIn);
+    if (res <= 0)
+      continue;
+    szIn += res;
+    const size_t szDone = emu_parse(abtIn, szIn);
+    memmove(abtIn, abtIn + szDone, szIn - szDone);
+    szIn -= szDone;
+    if (szIn == sizeof(abtIn))
+      szIn = 0;
+  }
+  return NULL;
+}
+
+static void
+emu_set(const bool split, const enum emu_fault fault)
+{
+  pthread_mutex_lock(&emu.mutex);
+  emu.split = split;
+  emu.fault = fault;
+  pthread_mutex_unlock(&emu.mutex);
+}
+
+static void
+emu_get_speed(uint32_t *speed, unsigned int *set_serial_baud_rate_count)
+{
+  pthread_mutex_lock(&emu.mutex);
+  *speed = emu.speed;
+  *set_serial_baud_rate_count = emu.set_serial_baud_rate_count;
+  pthread_mutex_unlock(&emu.mutex);
+}
+
+void
+cut_setup(void)
+{
+  nfc_connstring connstring;
+
+  memset(&emu, 0x00, sizeof(emu));
+  emu.speed = 115200;
+  if (((emu.fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0) || (grantpt(emu.fd) < 0) || (unlockpt(emu.fd) < 0)) {
+    if (emu.fd >= 0)
+      close(emu.fd);
+    emu.fd = -1;
+    cut_omit("No pseudo-terminal available");
+  }
+  pthread_mutex_init(&emu.mutex, NULL);
+  pthread_create(&emu.thread, NULL, emu_thread, NULL);
+
+  nfc_init(&context);
+  snprintf(connstring, sizeof(connstring), "pn532_uart:%s", ptsname(emu.fd));
+  device = nfc_open(context, connstring);
+  cut_assert_not_null(device, cut_message("nfc_open"));
+}
+
+void
+cut_teardown(void)
+{
+  if (emu.fd < 0)
+    return;
+  if (device)
+    nfc_close(device);
+  device = NULL;
+  nfc_exit(context);
+
+  pthread_mutex_lock(&emu.mutex);
+  emu.stop = true;
+  pthread_mutex_unlock(&emu.mutex);
+  pthread_join(emu.thread, NULL);
+  pthread_mutex_destroy(&emu.mutex);
+  close(emu.fd);
+}
+
+void
+test_pn532_uart_coalesced_frames(void)
+{
+  // ACK and answer come in the same read
+  emu_set(false, EMU_NO_FAULT);
+  pn53x_fixture_echo(device, 16);
+  pn53x_fixture_echo(device, 250);
+  pn53x_fixture_echo(device, 260);
+}
+
+void
+test_pn532_uart_split_frames(void)
+{
+  // Frames come a byte at a time, the parser has to wait for the rest
+  emu_set(true, EMU_NO_FAULT);
+  pn53x_fixture_echo(device, 16);
+  pn53x_fixture_echo(device, 250);
+  pn53x_fixture_echo(device, 260);
+}
+
+void
+test_pn532_uart_corrupted_frames(void)
+{
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  const uint8_t abtGetFirmwareVersion[] = { 0x02 };
+  int res;
+
+  emu_set(false, EMU_BAD_CHECKSUM);
+  res = pn53x_transceive(device, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion), abtRx, sizeof(abtRx), 1000);
+  cut_assert_equal_int(NFC_EIO, res, cut_message("data checksum mismatch"));
+  pn53x_fixture_echo(device, 16);
+
+  emu_set(true, EMU_ERROR_FRAME);
+  res = pn53x_transceive(device, abtGetFirmwareVersion, sizeof(abtGetFirmwareVersion), abtRx, sizeof(abtRx), 1000);
+  cut_assert_equal_int(NFC_EIO, res, cut_message("application level error"));
+  pn53x_fixture_echo(device, 260);
+}
+
+// Reopen the device with a fourth connstring field, which negotiates high_speed once the PN532 answers
+static void
+reopen_at(const uint32_t high_speed)
+{
+  nfc_connstring connstring;
+
+  nfc_close(device);
+  snprintf(connstring, sizeof(connstring), "pn532_uart:%s:115200:%u", ptsname(emu.fd), (unsigned int) high_speed);
+  device = nfc_open(context, connstring);
+}
+
+void
+test_pn532_uart_high_speed(void)
+{
+  uint32_t speeds[] = { 921600, 1288000 };
+  size_t szSpeeds = sizeof(speeds) / sizeof(speeds[0]);
+#ifndef EMU_HAVE_TERMIOS2
+  // Only termios2 sets rates termios(3) has no constant for
+  szSpeeds--;
+#endif
+
+  for (size_t i = 0; i < szSpeeds; i++) {
+    uint32_t speed;
+    unsigned int count;
+    // Closing the device brought the PN532 back to its power-on speed
+    pthread_mutex_lock(&emu.mutex);
+    emu.speed = 115200;
+    pthread_mutex_unlock(&emu.mutex);
+    reopen_at(speeds[i]);
+    cut_assert_not_null(device, cut_message("nfc_open at %u baud", (unsigned int) speeds[i]));
+    emu_get_speed(&speed, &count);
+    cut_assert_equal_uint(speeds[i], speed, cut_message("PN532 speed"));
+    cut_assert_equal_uint(speeds[i], emu_host_speed(), cut_message("host speed"));
+    pn53x_fixture_echo(device, 260);
+  }
+}
+
+void
+test_pn532_uart_high_speed_fallback(void)
+{
+  uint32_t speed;
+  unsigned int count;
+
+  // The PN532 does not switch: the driver has to go back to the initial speed
+  emu_set(false, EMU_IGNORE_SPEED);
+  reopen_at(921600);
+  cut_assert_not_null(device, cut_message("nfc_open"));
+  emu_get_speed(&speed, &count);
+  cut_assert_equal_uint(1, count, cut_message("SetSerialBaudRate count"));
+  cut_assert_equal_uint(115200, speed, cut_message("PN532 speed"));
+  cut_assert_equal_uint(115200, emu_host_speed(), cut_message("host speed"));
+  pn53x_fixture_echo(device, 16);
+}
+
+void
+test_pn532_uart_unsupported_speed(void)
+{
+  uint32_t speed;
+  unsigned int count;
+
+  // Not a SetSerialBaudRate speed: the link stays as it is
+  reopen_at(1000000);
+  cut_assert_not_null(device, cut_message("nfc_open"));
+  emu_get_speed(&speed, &count);
+  cut_assert_equal_uint(0, count, cut_message("SetSerialBaudRate count"));
+  cut_assert_equal_uint(115200, speed, cut_message("PN532 speed"));
+  cut_assert_equal_uint(115200, emu_host_speed(), cut_message("host speed"));
+  pn53x_fixture_echo(device, 16);
+}
@@ -0,0 +1,266 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "sim-fixture.h"
+
+/*
+ * Readers are simulated by the pn53x_sim driver: its "default" field holds
+ * a single ISO14443A target, and an empty script gives a field without any.
+ */
+void test_reader_pool_queue_bounds(void);
+void test_reader_pool_jobs(void);
+void test_reader_pool_free_waits_for_jobs(void);
+void test_reader_pool_free_in_error_pause(void);
+
+static const nfc_modulation nmIso14443A = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+static nfc_context *context;
+
+// What the jobs of a test went through
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int started;
+  int ran;
+  int discarded;
+  int last_res;
+  uint8_t last_uid;
+  // Time a running job waits before using its device (us)
+  useconds_t delay;
+} jobs;
+
+static double
+now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int
+job(nfc_device *pnd, const nfc_target *pnt, void *user_data)
+{
+  (void) user_data;
+  pthread_mutex_lock(&jobs.mutex);
+  if (!pnd) {
+    jobs.discarded++;
+    pthread_mutex_unlock(&jobs.mutex);
+    return 0;
+  }
+  jobs.started++;
+  pthread_cond_broadcast(&jobs.cond);
+  const useconds_t delay = jobs.delay;
+  pthread_mutex_unlock(&jobs.mutex);
+
+  usleep(delay);
+  // READ of page 0
+  const uint8_t abtRead[] = { 0x30, 0x00 };
+  uint8_t abtRx[16];
+  const int res = nfc_initiator_transceive_bytes(pnd, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), 0);
+
+  pthread_mutex_lock(&jobs.mutex);
+  jobs.ran++;
+  jobs.last_res = res;
+  jobs.last_uid = pnt->nti.nai.abtUid[0];
+  pthread_cond_broadcast(&jobs.cond);
+  pthread_mutex_unlock(&jobs.mutex);
+  return (res < 0) ? res : 0;
+}
+
+// What the chip went through while the pool was freed, from the log
+static struct {
+  pthread_mutex_t mutex;
+  bool bFreeing;
+  bool bReleased;
+  bool bFieldOff;
+} closing = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static void
+log_closing(int priority, const char *category, const char *message, void *user_data)
+{
+  (void) priority;
+  (void) user_data;
+  if (strcmp(category, "libnfc.chip.pn53x") != 0)
+    return;
+  pthread_mutex_lock(&closing.mutex);
+  if (closing.bFreeing) {
+    // nfc_close() releases the target, then switches the field off
+    if (strcmp(message, "InRelease") == 0)
+      closing.bReleased = true;
+    else if (closing.bReleased && (strcmp(message, "RFConfiguration") == 0))
+      closing.bFieldOff = true;
+  }
+  pthread_mutex_unlock(&closing.mutex);
+}
+
+// Wait for jobs.*counter to reach count, for at most 5 s
+static bool
+jobs_wait(const int *counter, const int count)
+{
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 5;
+
+  pthread_mutex_lock(&jobs.mutex);
+  int res = 0;
+  while ((*counter < count) && (res == 0))
+    res = pthread_cond_timedwait(&jobs.cond, &jobs.mutex, &deadline);
+  const bool reached = (*counter >= count);
+  pthread_mutex_unlock(&jobs.mutex);
+  return reached;
+}
+
+void
+cut_setup(void)
+{
+  memset(&jobs, 0x00, sizeof(jobs));
+  pthread_mutex_init(&jobs.mutex, NULL);
+  pthread_cond_init(&jobs.cond, NULL);
+  closing.bFreeing = false;
+  closing.bReleased = false;
+  closing.bFieldOff = false;
+
+  nfc_init(&context);
+  sim_fixture_setup(context);
+}
+
+void
+cut_teardown(void)
+{
+  sim_fixture_teardown();
+  nfc_exit(context);
+  pthread_cond_destroy(&jobs.cond);
+  pthread_mutex_destroy(&jobs.mutex);
+}
+
+void
+test_reader_pool_queue_bounds(void)
+{
+  nfc_connstring connstrings[1];
+  int res;
+
+  // No target ever comes: jobs stay queued
+  sim_fixture_script(connstrings[0], "# No target in the field\n", 1000);
+  nfc_reader_pool *pool = nfc_reader_pool_new(context, connstrings, 1, nmIso14443A, 2);
+  cut_assert_not_null(pool, cut_message("nfc_reader_pool_new"));
+
+  res = nfc_reader_pool_submit(pool, job, NULL, 0);
+  cut_assert_equal_int(NFC_SUCCESS, res, cut_message("first job"));
+  res = nfc_reader_pool_submit(pool, job, NULL, -1);
+  cut_assert_equal_int(NFC_SUCCESS, res, cut_message("second job"));
+  cut_assert_equal_uint(2, nfc_reader_pool_pending(pool), cut_message("pending jobs"));
+
+  // The queue is full
+  res = nfc_reader_pool_submit(pool, job, NULL, -1);
+  cut_assert_equal_int(NFC_ETIMEOUT, res, cut_message("job without waiting"));
+  const double start = now_ms();
+  res = nfc_reader_pool_submit(pool, job, NULL, 100);
+  const double elapsed = now_ms() - start;
+  cut_assert_equal_int(NFC_ETIMEOUT, res, cut_message("job waiting 100 ms"));
+  cut_assert_operator_int((int) elapsed, >=, 99, cut_message("waited %.2f ms", elapsed));
+  cut_assert_equal_uint(2, nfc_reader_pool_pending(pool), cut_message("pending jobs"));
+
+  // Queued jobs are handed back, not run
+  nfc_reader_pool_free(pool);
+  cut_assert_equal_int(0, jobs.ran, cut_message("jobs run"));
+  cut_assert_equal_int(2, jobs.discarded, cut_message("jobs discarded"));
+}
+
+void
+test_reader_pool_jobs(void)
+{
+  const nfc_connstring connstrings[2] = { "pn53x_sim:default", "pn53x_sim:default:50" };
+  nfc_reader_stats stats[2];
+
+  nfc_reader_pool *pool = nfc_reader_pool_new(context, connstrings, 2, nmIso14443A, 0);
+  cut_assert_not_null(pool, cut_message("nfc_reader_pool_new"));
+
+  // A reader runs one job per target it selects, and each reader has one here
+  cut_assert_equal_int(NFC_SUCCESS, nfc_reader_pool_submit(pool, job, NULL, 0), cut_message("first job"));
+  cut_assert_equal_int(NFC_SUCCESS, nfc_reader_pool_submit(pool, job, NULL, 0), cut_message("second job"));
+  cut_assert_true(jobs_wait(&jobs.ran, 2), cut_message("jobs run"));
+  cut_assert_operator_int(jobs.last_res, >=, 0, cut_message("READ"));
+  cut_assert_equal_uint(0x04, jobs.last_uid, cut_message("target UID"));
+  cut_assert_equal_uint(0, nfc_reader_pool_pending(pool), cut_message("pending jobs"));
+
+  // Stats are accounted once the jobs returned
+  for (int n = 0; n < 5000; n++) {
+    cut_assert_equal_int(2, nfc_reader_pool_get_stats(pool, stats, 2), cut_message("nfc_reader_pool_get_stats"));
+    if (stats[0].jobs + stats[1].jobs == 2)
+      break;
+    usleep(1000);
+  }
+  cut_assert_equal_uint(2, stats[0].jobs + stats[1].jobs, cut_message("jobs in stats"));
+  cut_assert_equal_uint(0, stats[0].jobs_failed + stats[1].jobs_failed, cut_message("failed jobs in stats"));
+
+  nfc_reader_pool_free(pool);
+  cut_assert_equal_int(0, jobs.discarded, cut_message("jobs discarded"));
+}
+
+void
+test_reader_pool_free_waits_for_jobs(void)
+{
+  const nfc_connstring connstrings[2] = { "pn53x_sim:default", "pn53x_sim:default:50" };
+
+  nfc_reader_pool *pool = nfc_reader_pool_new(context, connstrings, 2, nmIso14443A, 0);
+  cut_assert_not_null(pool, cut_message("nfc_reader_pool_new"));
+
+  // The job is running when the pool is freed: it has to complete, its commands not being aborted
+  jobs.delay = 300000;
+  cut_assert_equal_int(NFC_SUCCESS, nfc_reader_pool_submit(pool, job, NULL, 0), cut_message("job"));
+  cut_assert_true(jobs_wait(&jobs.started, 1), cut_message("job started"));
+  nfc_reader_pool_free(pool);
+
+  cut_assert_equal_int(1, jobs.ran, cut_message("jobs run"));
+  cut_assert_operator_int(jobs.last_res, >=, 0, cut_message("READ after nfc_reader_pool_free()"));
+}
+
+void
+test_reader_pool_free_in_error_pause(void)
+{
+  // No select can succeed at this bit rate: the reader pauses after each error
+  const nfc_modulation nmInvalid = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_847,
+  };
+  const nfc_connstring connstrings[1] = { "pn53x_sim:default" };
+  nfc_reader_stats stats;
+
+  nfc_reader_pool *pool = nfc_reader_pool_new(context, connstrings, 1, nmInvalid, 0);
+  cut_assert_not_null(pool, cut_message("nfc_reader_pool_new"));
+  cut_assert_equal_int(NFC_SUCCESS, nfc_reader_pool_submit(pool, job, NULL, 0), cut_message("job"));
+  for (int n = 0; n < 5000; n++) {
+    cut_assert_equal_int(1, nfc_reader_pool_get_stats(pool, &stats, 1), cut_message("nfc_reader_pool_get_stats"));
+    if (stats.select_errors)
+      break;
+    usleep(1000);
+  }
+  cut_assert_operator_int(stats.select_errors, >, 0, cut_message("select errors"));
+
+  // The abort raised during the pause must not hit nfc_close()
+  nfc_set_log_level(context, 3);
+  nfc_set_log_callback(context, log_closing, NULL);
+  pthread_mutex_lock(&closing.mutex);
+  closing.bFreeing = true;
+  pthread_mutex_unlock(&closing.mutex);
+  nfc_reader_pool_free(pool);
+  nfc_set_log_callback(context, NULL, NULL);
+  nfc_set_log_level(context, 1);
+
+  cut_assert_equal_int(1, jobs.discarded, cut_message("jobs discarded"));
+  cut_assert_true(closing.bReleased, cut_message("InRelease on close"));
+  cut_assert_true(closing.bFieldOff, cut_message("field switched off on close"));
+}
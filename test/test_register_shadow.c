@@ -0,0 +1,148 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <nfc/nfc.h>
+
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#include "sim-fixture.h"
+
+/*
+ * The register shadow is checked from the commands which reach a device
+ * simulated by the pn53x_sim driver, which keeps its registers as they are
+ * written.
+ */
+void test_register_shadow_read(void);
+void test_register_shadow_timer(void);
+void test_register_shadow_writeback(void);
+
+static nfc_context *context;
+static nfc_device *pnd;
+
+void
+cut_setup(void)
+{
+  const nfc_connstring connstring = "pn53x_sim:default";
+
+  nfc_init(&context);
+  sim_fixture_setup(context);
+  pnd = nfc_open(context, connstring);
+  cut_assert_not_null(pnd, cut_message("nfc_open"));
+}
+
+void
+cut_teardown(void)
+{
+  if (pnd)
+    nfc_close(pnd);
+  pnd = NULL;
+  nfc_exit(context);
+}
+
+// Send a command the shadow does not know about, which may have changed any register
+static void
+shadow_invalidate(void)
+{
+  const uint8_t abtDiagnose[] = { Diagnose, 0x00, 0xca, 0xfe };
+  uint8_t abtRx[8];
+  cut_assert_equal_int(3, pn53x_transceive(pnd, abtDiagnose, sizeof(abtDiagnose), abtRx, sizeof(abtRx), -1), cut_message("Diagnose"));
+}
+
+// Value of a register as held by the chip
+static uint8_t
+chip_register(const uint16_t ui16RegisterAddress)
+{
+  const uint8_t abtReadRegister[] = { ReadRegister, ui16RegisterAddress >> 8, ui16RegisterAddress & 0xff };
+  uint8_t abtRx[2];
+  cut_assert_equal_int(1, pn53x_transceive(pnd, abtReadRegister, sizeof(abtReadRegister), abtRx, sizeof(abtRx), -1), cut_message("ReadRegister"));
+  return abtRx[0];
+}
+
+void
+test_register_shadow_read(void)
+{
+  uint8_t value;
+
+  shadow_invalidate();
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &value), cut_message("read TxMode"));
+  cut_assert_equal_uint(1, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister of a stale shadow"));
+
+  // Loaded with all the shadowed registers
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &value), cut_message("read TxMode"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_RxMode, &value), cut_message("read RxMode"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_SFR_P3, &value), cut_message("read P3"));
+  cut_assert_equal_uint(1, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister of a valid shadow"));
+
+  // Volatile registers are always read from the chip
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_Status2, &value), cut_message("read Status2"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_Status2, &value), cut_message("read Status2"));
+  cut_assert_equal_uint(3, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister of a volatile register"));
+}
+
+void
+test_register_shadow_timer(void)
+{
+  const nfc_modulation nmIso14443A = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_106,
+  };
+  const uint8_t abtCommunicateThru[] = { InCommunicateThru, 0x30, 0x00 };
+  uint8_t abtRx[8];
+  nfc_target nt;
+  uint8_t value;
+
+  cut_assert_equal_int(0, nfc_initiator_init(pnd), cut_message("nfc_initiator_init"));
+  cut_assert_equal_int(1, nfc_initiator_select_passive_target(pnd, nmIso14443A, NULL, 0, &nt), cut_message("nfc_initiator_select_passive_target"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TMode, &value), cut_message("read TMode"));
+
+  // Some firmwares reset the timer on InCommunicateThru: only the timer registers are read again
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(3, pn53x_transceive(pnd, abtCommunicateThru, sizeof(abtCommunicateThru), abtRx, sizeof(abtRx), -1), cut_message("InCommunicateThru"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &value), cut_message("read TxMode"));
+  cut_assert_equal_uint(0, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister of a configuration register"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TReloadVal_lo, &value), cut_message("read TReloadVal_lo"));
+  cut_assert_equal_uint(1, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister of a timer register"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TMode, &value), cut_message("read TMode"));
+  cut_assert_equal_uint(1, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister of a timer register"));
+}
+
+void
+test_register_shadow_writeback(void)
+{
+  uint8_t abtCommands[8];
+  uint8_t value;
+
+  // Pending full write to a valid entry: the shadow already holds the value the chip is about to get
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &value), cut_message("read TxMode"));
+  const uint8_t btTxMode = value ^ 0x70;
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(0, pn53x_write_register(pnd, PN53X_REG_CIU_TxMode, 0xff, btTxMode), cut_message("write TxMode"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &value), cut_message("read TxMode"));
+  cut_assert_equal_uint(btTxMode, value, cut_message("TxMode"));
+  cut_assert_equal_uint(0, sim_fixture_commands(pnd, abtCommands, sizeof(abtCommands)), cut_message("commands before write-back"));
+  cut_assert_equal_uint(btTxMode, chip_register(PN53X_REG_CIU_TxMode), cut_message("chip TxMode"));
+  cut_assert_equal_uint(2, sim_fixture_commands(pnd, abtCommands, sizeof(abtCommands)), cut_message("commands"));
+  cut_assert_equal_uint(WriteRegister, abtCommands[0], cut_message("write-back first"));
+
+  // Pending masked write to a stale entry: the write-back is done before the shadow is loaded again
+  shadow_invalidate();
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(0, pn53x_write_register(pnd, PN53X_REG_CIU_TxMode, 0x0f, ~btTxMode), cut_message("masked write TxMode"));
+  cut_assert_equal_uint(0, sim_fixture_commands(pnd, abtCommands, sizeof(abtCommands)), cut_message("commands before write-back"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &value), cut_message("read TxMode"));
+  const uint8_t btExpected = (btTxMode & 0xf0) | (~btTxMode & 0x0f);
+  cut_assert_equal_uint(btExpected, value, cut_message("TxMode"));
+  cut_assert_equal_uint(2, sim_fixture_commands(pnd, abtCommands, sizeof(abtCommands)), cut_message("commands"));
+  cut_assert_equal_uint(ReadRegister, abtCommands[0], cut_message("write-back ReadRegister"));
+  cut_assert_equal_uint(WriteRegister, abtCommands[1], cut_message("write-back WriteRegister"));
+  cut_assert_equal_uint(btExpected, chip_register(PN53X_REG_CIU_TxMode), cut_message("chip TxMode"));
+
+  // The ReadRegister of the write-back loaded the other stale entries
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_RxMode, &value), cut_message("read RxMode"));
+  cut_assert_equal_uint(2, sim_fixture_command_count(pnd, ReadRegister), cut_message("ReadRegister"));
+}
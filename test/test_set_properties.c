@@ -0,0 +1,151 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#include "sim-fixture.h"
+
+/*
+ * nfc_device_set_properties() on a device simulated by the pn53x_sim driver,
+ * checked from the commands it sends. The driver is wrapped to see the
+ * properties it is given.
+ */
+void test_set_properties_merged(void);
+
+static nfc_context *context;
+static nfc_device *pnd;
+static const struct nfc_driver *pndDriver;
+static struct nfc_driver *pndHooked;
+// NP_ACTIVATE_FIELD values given to the driver
+static int aiField[4];
+static size_t szField;
+
+static int
+hooked_set_property_bool(struct nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  if ((property == NP_ACTIVATE_FIELD) && (szField < sizeof(aiField) / sizeof(aiField[0])))
+    aiField[szField++] = bEnable;
+  return pndDriver->device_set_property_bool(pnd, property, bEnable);
+}
+
+void
+cut_setup(void)
+{
+  const nfc_connstring connstring = "pn53x_sim:default";
+
+  szField = 0;
+  nfc_init(&context);
+  sim_fixture_setup(context);
+  pnd = nfc_open(context, connstring);
+  cut_assert_not_null(pnd, cut_message("nfc_open"));
+  cut_assert_equal_int(0, nfc_initiator_init(pnd), cut_message("nfc_initiator_init"));
+
+  // Copied as a whole, some of its members are const
+  pndDriver = pnd->driver;
+  pndHooked = malloc(sizeof(*pndHooked));
+  cut_assert_not_null(pndHooked, cut_message("malloc"));
+  memcpy(pndHooked, pndDriver, sizeof(*pndHooked));
+  pndHooked->device_set_property_bool = hooked_set_property_bool;
+  pnd->driver = pndHooked;
+}
+
+void
+cut_teardown(void)
+{
+  if (pnd) {
+    pnd->driver = pndDriver;
+    nfc_close(pnd);
+  }
+  pnd = NULL;
+  free(pndHooked);
+  pndHooked = NULL;
+  nfc_exit(context);
+}
+
+// Value written to a register by a WriteRegister frame, -1 if it is not written, -2 if written twice
+static int
+frame_register(const struct nfc_trace_frame *frame, const uint16_t ui16RegisterAddress)
+{
+  int value = -1;
+  for (size_t n = 0; n + 3 <= frame->caplen; n += 3) {
+    if (((frame->data[n] << 8) | frame->data[n + 1]) == ui16RegisterAddress)
+      value = (value == -1) ? frame->data[n + 2] : -2;
+  }
+  return value;
+}
+
+void
+test_set_properties_merged(void)
+{
+  // nfc_initiator_init() left CRC, parity, infinite select, auto ISO14443-4 and the field on
+  const nfc_property_setting settings[] = {
+    { NP_HANDLE_CRC, false },
+    { NP_ACTIVATE_FIELD, false },
+    { NP_HANDLE_PARITY, false },
+    { NP_AUTO_ISO14443_4, false },
+    { NP_INFINITE_SELECT, false },
+    { NP_HANDLE_CRC, true },
+    { NP_AUTO_ISO14443_4, true },
+    { NP_INFINITE_SELECT, true },
+    { NP_TIMEOUT_COMMAND, 500 },
+    { NP_AUTO_ISO14443_4, false },
+    { NP_INFINITE_SELECT, false },
+    { NP_HANDLE_CRC, false },
+  };
+  uint8_t abtCommands[16];
+  uint8_t btTxMode, btRxMode, btManualRCV;
+
+  // Out of what is traced: the register writes nfc_initiator_init() left pending, then a whole shadow
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_Status2, &btTxMode), cut_message("read Status2"));
+  cut_assert_equal_int(0, pn53x_shadow_resync(pnd), cut_message("pn53x_shadow_resync"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &btTxMode), cut_message("read TxMode"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_RxMode, &btRxMode), cut_message("read RxMode"));
+  cut_assert_equal_int(0, pn53x_read_register(pnd, PN53X_REG_CIU_ManualRCV, &btManualRCV), cut_message("read ManualRCV"));
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(0, nfc_device_set_properties(pnd, settings, sizeof(settings) / sizeof(settings[0])), cut_message("nfc_device_set_properties"));
+
+  // The shadow is loaded: the register writes need no ReadRegister
+  const size_t szCommands = sim_fixture_commands(pnd, abtCommands, sizeof(abtCommands));
+  cut_assert_equal_uint(4, szCommands, cut_message("commands"));
+  cut_assert_equal_uint(1, sim_fixture_command_count(pnd, SetParameters), cut_message("SetParameters"));
+  cut_assert_equal_uint(2, sim_fixture_command_count(pnd, RFConfiguration), cut_message("RFConfiguration"));
+  cut_assert_equal_uint(1, sim_fixture_command_count(pnd, WriteRegister), cut_message("WriteRegister"));
+
+  for (size_t n = 0; n < szCommands; n++) {
+    const struct nfc_trace_frame *frame = sim_fixture_command(pnd, n);
+    switch (frame->command) {
+      case SetParameters:
+        cut_assert_equal_uint(0, frame->data[0] & PARAM_AUTO_RATS, cut_message("SetParameters: no automatic RATS"));
+        break;
+      case RFConfiguration:
+        if (frame->data[0] == RFCI_FIELD) {
+          // Last, after the register writes
+          cut_assert_equal_uint(szCommands - 1, n, cut_message("RFConfiguration field position"));
+          cut_assert_equal_memory("\x01\x00", 2, frame->data, frame->caplen, cut_message("RFConfiguration field"));
+        } else {
+          cut_assert_equal_memory("\x05\x00\x01\x02", 4, frame->data, frame->caplen, cut_message("RFConfiguration retries"));
+        }
+        break;
+      case WriteRegister:
+        // Each register once, with its final value
+        cut_assert_equal_int(btTxMode & ~SYMBOL_TX_CRC_ENABLE, frame_register(frame, PN53X_REG_CIU_TxMode), cut_message("TxMode"));
+        cut_assert_equal_int(btRxMode & ~SYMBOL_RX_CRC_ENABLE, frame_register(frame, PN53X_REG_CIU_RxMode), cut_message("RxMode"));
+        cut_assert_equal_int(btManualRCV | SYMBOL_PARITY_DISABLE, frame_register(frame, PN53X_REG_CIU_ManualRCV), cut_message("ManualRCV"));
+        break;
+    }
+  }
+
+  // The driver still sees the field switched
+  cut_assert_equal_uint(1, szField, cut_message("NP_ACTIVATE_FIELD given to the driver"));
+  cut_assert_equal_int(false, aiField[0], cut_message("NP_ACTIVATE_FIELD value"));
+}
@@ -0,0 +1,293 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "trace.h"
+
+/*
+ * The frame trace ring, read back from the pcapng files it is saved to.
+ */
+void test_trace_pcapng(void);
+void test_trace_wrap(void);
+void test_trace_snapshot(void);
+
+#define PCAPNG_MAX_LEN (256 * 1024)
+#define TRACE_NAME "test"
+
+struct pcapng_packet {
+  uint64_t timestamp;
+  uint32_t flags;
+  uint32_t caplen;
+  uint32_t len;
+  const uint8_t *data;
+};
+
+static char acFile[32];
+static uint8_t *pbtPcapng;
+static struct nfc_trace *trace;
+
+void
+cut_setup(void)
+{
+  strcpy(acFile, "/tmp/test_trace.XXXXXX");
+  const int fd = mkstemp(acFile);
+  cut_assert_operator_int(fd, >=, 0, cut_message("mkstemp"));
+  close(fd);
+  pbtPcapng = malloc(PCAPNG_MAX_LEN);
+  cut_assert_not_null(pbtPcapng, cut_message("malloc"));
+}
+
+void
+cut_teardown(void)
+{
+  nfc_trace_free(trace);
+  trace = NULL;
+  free(pbtPcapng);
+  pbtPcapng = NULL;
+  if (acFile[0])
+    unlink(acFile);
+  acFile[0] = '\0';
+}
+
+static uint32_t
+pcapng_u32(const uint8_t *p)
+{
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint16_t
+pcapng_u16(const uint8_t *p)
+{
+  uint16_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Check the block at offset off whose type is expected, return its length
+static uint32_t
+pcapng_block(const size_t szFile, const size_t off, const uint32_t type)
+{
+  cut_assert_true(off + 12 <= szFile, cut_message("block header at %d", (int) off));
+  cut_assert_equal_uint(type, pcapng_u32(pbtPcapng + off), cut_message("block type at %d", (int) off));
+  const uint32_t len = pcapng_u32(pbtPcapng + off + 4);
+  cut_assert_equal_uint(0, len % 4, cut_message("block length at %d", (int) off));
+  cut_assert_true((len >= 12) && (off + len <= szFile), cut_message("block length at %d", (int) off));
+  cut_assert_equal_uint(len, pcapng_u32(pbtPcapng + off + len - 4), cut_message("trailing block length at %d", (int) off));
+  return len;
+}
+
+// Point *ppbtValue to the value of option code in the options from off to end, return its length
+static uint16_t
+pcapng_option(const size_t off, const size_t end, const uint16_t code, const uint8_t **ppbtValue)
+{
+  size_t n = off;
+  while (n + 4 <= end) {
+    const uint16_t option = pcapng_u16(pbtPcapng + n);
+    const uint16_t len = pcapng_u16(pbtPcapng + n + 2);
+    if (option == 0)
+      break;
+    if (option == code) {
+      *ppbtValue = pbtPcapng + n + 4;
+      return len;
+    }
+    n += 4 + ((len + 3) & ~3);
+  }
+  cut_fail("option %d missing", code);
+  return 0;
+}
+
+// Save the trace, check the pcapng layout and return its packets
+static size_t
+pcapng_load(struct pcapng_packet *packets, const size_t max)
+{
+  const int res = nfc_trace_save(trace, acFile, TRACE_NAME);
+  cut_assert_operator_int(res, >=, 0, cut_message("nfc_trace_save"));
+  FILE *f = fopen(acFile, "rb");
+  cut_assert_not_null(f, cut_message("fopen"));
+  const size_t szFile = fread(pbtPcapng, 1, PCAPNG_MAX_LEN, f);
+  fclose(f);
+  cut_assert_true(szFile < PCAPNG_MAX_LEN, cut_message("file size"));
+
+  // Section Header Block: byte order magic, version 1.0, unknown section length
+  size_t off = 0;
+  uint32_t len = pcapng_block(szFile, off, 0x0A0D0D0A);
+  cut_assert_equal_uint(28, len, cut_message("SHB length"));
+  cut_assert_equal_uint(0x1A2B3C4D, pcapng_u32(pbtPcapng + 8), cut_message("byte order magic"));
+  cut_assert_equal_uint(1, pcapng_u16(pbtPcapng + 12), cut_message("major version"));
+  cut_assert_equal_uint(0, pcapng_u16(pbtPcapng + 14), cut_message("minor version"));
+  cut_assert_equal_memory("\xff\xff\xff\xff\xff\xff\xff\xff", 8, pbtPcapng + 16, 8, cut_message("section length"));
+  off += len;
+
+  // Interface Description Block: LINKTYPE_USER0, its name, nanosecond resolution
+  len = pcapng_block(szFile, off, 0x00000001);
+  cut_assert_equal_uint(147, pcapng_u16(pbtPcapng + off + 8), cut_message("link type"));
+  const uint8_t *pbtValue;
+  const uint16_t szName = pcapng_option(off + 16, off + len - 4, 2, &pbtValue);
+  cut_assert_equal_memory(TRACE_NAME, strlen(TRACE_NAME), pbtValue, szName, cut_message("if_name"));
+  cut_assert_equal_uint(1, pcapng_option(off + 16, off + len - 4, 9, &pbtValue), cut_message("if_tsresol length"));
+  cut_assert_equal_uint(9, pbtValue[0], cut_message("if_tsresol"));
+  off += len;
+
+  // Enhanced Packet Blocks
+  size_t count = 0;
+  while (off < szFile) {
+    len = pcapng_block(szFile, off, 0x00000006);
+    cut_assert_true(count < max, cut_message("packet count"));
+    struct pcapng_packet *packet = &packets[count++];
+    cut_assert_equal_uint(0, pcapng_u32(pbtPcapng + off + 8), cut_message("interface"));
+    packet->timestamp = ((uint64_t) pcapng_u32(pbtPcapng + off + 12) << 32) | pcapng_u32(pbtPcapng + off + 16);
+    packet->caplen = pcapng_u32(pbtPcapng + off + 20);
+    packet->len = pcapng_u32(pbtPcapng + off + 24);
+    packet->data = pbtPcapng + off + 28;
+    const size_t options = off + 28 + ((packet->caplen + 3) & ~3);
+    cut_assert_true(options + 4 <= off + len, cut_message("packet data length"));
+    cut_assert_equal_uint(4, pcapng_option(options, off + len - 4, 2, &pbtValue), cut_message("epb_flags length"));
+    packet->flags = pcapng_u32(pbtValue);
+    off += len;
+  }
+  cut_assert_equal_int(res, count, cut_message("saved frames"));
+  return count;
+}
+
+void
+test_trace_pcapng(void)
+{
+  const uint8_t abtCommand[] = { 0x01, 0x00 };
+  uint8_t abtResponse[300];
+  struct pcapng_packet packets[2];
+
+  for (size_t n = 0; n < sizeof(abtResponse); n++)
+    abtResponse[n] = (uint8_t) n;
+  trace = nfc_trace_new(8);
+  cut_assert_not_null(trace, cut_message("nfc_trace_new"));
+
+  const uint64_t before = realtime_time_ns();
+  nfc_trace_put(trace, NFC_TRACE_HOST_TO_CHIP, 0x4a, abtCommand, sizeof(abtCommand));
+  nfc_trace_put(trace, NFC_TRACE_CHIP_TO_HOST, 0x4b, abtResponse, sizeof(abtResponse));
+  const uint64_t after = realtime_time_ns();
+  cut_assert_equal_uint(2, pcapng_load(packets, 2), cut_message("packets"));
+
+  cut_assert_equal_uint(2, packets[0].flags, cut_message("outbound"));
+  cut_assert_equal_uint(2 + sizeof(abtCommand), packets[0].caplen, cut_message("captured length"));
+  cut_assert_equal_uint(2 + sizeof(abtCommand), packets[0].len, cut_message("original length"));
+  cut_assert_equal_memory("\xd4\x4a\x01\x00", 4, packets[0].data, packets[0].caplen, cut_message("command"));
+
+  // Truncated, with its original length
+  cut_assert_equal_uint(1, packets[1].flags, cut_message("inbound"));
+  cut_assert_equal_uint(2 + NFC_TRACE_DATA_MAX_LEN, packets[1].caplen, cut_message("captured length"));
+  cut_assert_equal_uint(2 + sizeof(abtResponse), packets[1].len, cut_message("original length"));
+  cut_assert_equal_memory("\xd5\x4b", 2, packets[1].data, 2, cut_message("response"));
+  cut_assert_equal_memory(abtResponse, NFC_TRACE_DATA_MAX_LEN, packets[1].data + 2, NFC_TRACE_DATA_MAX_LEN, cut_message("response data"));
+
+  // Counted from the Unix epoch; the two clocks may drift apart a little since nfc_trace_new()
+  const uint64_t slack = 10000000;
+  cut_assert_true(packets[0].timestamp + slack >= before, cut_message("timestamp before the frame"));
+  cut_assert_true(packets[0].timestamp <= packets[1].timestamp, cut_message("timestamps in order"));
+  cut_assert_true(packets[1].timestamp <= after + slack, cut_message("timestamp after the frame"));
+}
+
+void
+test_trace_wrap(void)
+{
+  struct pcapng_packet packets[4];
+
+  trace = nfc_trace_new(4);
+  cut_assert_not_null(trace, cut_message("nfc_trace_new"));
+  cut_assert_equal_uint(0, pcapng_load(packets, 4), cut_message("empty trace"));
+
+  for (uint8_t n = 0; n < 10; n++)
+    nfc_trace_put(trace, NFC_TRACE_HOST_TO_CHIP, n, &n, 1);
+
+  // The last four, oldest first
+  cut_assert_equal_uint(4, pcapng_load(packets, 4), cut_message("packets"));
+  for (size_t n = 0; n < 4; n++) {
+    cut_assert_equal_uint(3, packets[n].caplen, cut_message("packet %d length", (int) n));
+    cut_assert_equal_uint(6 + n, packets[n].data[1], cut_message("packet %d command", (int) n));
+    cut_assert_equal_uint(6 + n, packets[n].data[2], cut_message("packet %d data", (int) n));
+  }
+}
+
+// The writer records frames n = 0, 1... of 4 + n % 64 bytes: n, then (uint8_t) n as filler
+struct writer_data {
+  uint32_t count;
+  volatile bool stop;
+};
+
+static void *
+writer_thread(void *arg)
+{
+  struct writer_data *data = arg;
+  uint8_t abtData[4 + 64];
+
+  while (!data->stop) {
+    const uint32_t n = data->count;
+    memcpy(abtData, &n, sizeof(n));
+    memset(abtData + 4, (uint8_t) n, 64);
+    nfc_trace_put(trace, NFC_TRACE_CHIP_TO_HOST, (uint8_t) n, abtData, 4 + n % 64);
+    data->count = n + 1;
+  }
+  return NULL;
+}
+
+// Every packet is a whole frame, packets in recording order
+static void
+check_snapshot(const struct pcapng_packet *packets, const size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    const struct pcapng_packet *packet = &packets[i];
+    uint32_t n;
+    cut_assert_true(packet->caplen >= 6, cut_message("packet length"));
+    memcpy(&n, packet->data + 2, sizeof(n));
+    cut_assert_equal_uint(6 + n % 64, packet->caplen, cut_message("frame %u length", n));
+    cut_assert_equal_uint(packet->caplen, packet->len, cut_message("frame %u original length", n));
+    cut_assert_equal_uint((uint8_t) n, packet->data[1], cut_message("frame %u command", n));
+    for (size_t k = 6; k < packet->caplen; k++)
+      cut_assert_equal_uint((uint8_t) n, packet->data[k], cut_message("frame %u data", n));
+    if (i > 0) {
+      uint32_t previous;
+      memcpy(&previous, packets[i - 1].data + 2, sizeof(previous));
+      cut_assert_true(previous < n, cut_message("frame %u after frame %u", n, previous));
+    }
+  }
+}
+
+void
+test_trace_snapshot(void)
+{
+  struct pcapng_packet packets[16];
+  struct writer_data data = { 0, false };
+  pthread_t thread;
+
+  trace = nfc_trace_new(16);
+  cut_assert_not_null(trace, cut_message("nfc_trace_new"));
+  cut_assert_equal_int(0, pthread_create(&thread, NULL, writer_thread, &data), cut_message("pthread_create"));
+  for (int i = 0; i < 200; i++) {
+    const size_t count = pcapng_load(packets, 16);
+    if (count == 0)
+      continue;
+    check_snapshot(packets, count);
+  }
+  data.stop = true;
+  pthread_join(thread, NULL);
+  cut_assert_operator_int(data.count, >, 16, cut_message("frames written while saving"));
+
+  // Once the writer stopped, the whole ring
+  cut_assert_equal_uint(16, pcapng_load(packets, 16), cut_message("packets"));
+  check_snapshot(packets, 16);
+  uint32_t n;
+  memcpy(&n, packets[15].data + 2, sizeof(n));
+  cut_assert_equal_uint(data.count - 1, n, cut_message("last frame"));
+}
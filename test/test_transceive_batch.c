@@ -0,0 +1,121 @@
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <cutter.h>
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "chips/pn53x-internal.h"
+
+#include "sim-fixture.h"
+
+/*
+ * Batches of exchanges with the target of a device simulated by the
+ * pn53x_sim driver, whose answers come from the reply lines of its script.
+ */
+void test_transceive_batch_all(void);
+void test_transceive_batch_stop_on_error(void);
+
+// Untouched op result
+#define OP_NOT_RUN 0x7fff
+
+static const char acScript[] =
+  "target 0044 00 04a1b2c3d4e5f6\n"
+  // READ: one full block, then a short answer
+  "reply 3004 000102030405060708090a0b0c0d0e0f\n"
+  "reply 3008 deadbeef\n"
+  // WRITE: ACK
+  "reply a20511223344 0a\n";
+
+static const uint8_t abtRead4[] = { 0x30, 0x04 };
+static const uint8_t abtRead8[] = { 0x30, 0x08 };
+static const uint8_t abtWrite5[] = { 0xa2, 0x05, 0x11, 0x22, 0x33, 0x44 };
+// Not in the script: echoed back
+static const uint8_t abtEcho[] = { 0x60, 0x00 };
+
+static nfc_context *context;
+static nfc_device *pnd;
+static uint8_t abtRx[5][16];
+static nfc_transceive_op ops[5];
+
+void
+cut_setup(void)
+{
+  const nfc_modulation nmIso14443A = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_106,
+  };
+  nfc_connstring connstring;
+  nfc_target nt;
+
+  nfc_init(&context);
+  sim_fixture_setup(context);
+  sim_fixture_script(connstring, acScript, 0);
+  pnd = nfc_open(context, connstring);
+  cut_assert_not_null(pnd, cut_message("nfc_open"));
+  cut_assert_equal_int(0, nfc_initiator_init(pnd), cut_message("nfc_initiator_init"));
+  cut_assert_equal_int(1, nfc_initiator_select_passive_target(pnd, nmIso14443A, NULL, 0, &nt), cut_message("nfc_initiator_select_passive_target"));
+
+  const nfc_transceive_op batch[5] = {
+    { abtRead4, sizeof(abtRead4), abtRx[0], sizeof(abtRx[0]), 16, OP_NOT_RUN },
+    { abtWrite5, sizeof(abtWrite5), abtRx[1], sizeof(abtRx[1]), 1, OP_NOT_RUN },
+    // A short answer
+    { abtRead8, sizeof(abtRead8), abtRx[2], sizeof(abtRx[2]), 16, OP_NOT_RUN },
+    // Any answer length, discarded
+    { abtEcho, sizeof(abtEcho), NULL, 0, 0, OP_NOT_RUN },
+    // A too small buffer
+    { abtRead4, sizeof(abtRead4), abtRx[4], 8, 0, OP_NOT_RUN },
+  };
+  memcpy(ops, batch, sizeof(ops));
+  memset(abtRx, 0x00, sizeof(abtRx));
+}
+
+void
+cut_teardown(void)
+{
+  if (pnd)
+    nfc_close(pnd);
+  pnd = NULL;
+  nfc_exit(context);
+  sim_fixture_teardown();
+}
+
+void
+test_transceive_batch_all(void)
+{
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(3, nfc_initiator_transceive_batch(pnd, ops, 5, 0, -1), cut_message("successful exchanges"));
+  cut_assert_equal_uint(5, sim_fixture_command_count(pnd, InDataExchange), cut_message("InDataExchange"));
+
+  cut_assert_equal_int(16, ops[0].res, cut_message("READ 4"));
+  cut_assert_equal_memory("\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f", 16, abtRx[0], 16, cut_message("READ 4"));
+  cut_assert_equal_int(1, ops[1].res, cut_message("WRITE 5"));
+  cut_assert_equal_uint(0x0a, abtRx[1][0], cut_message("WRITE 5 ACK"));
+  cut_assert_equal_int(NFC_ERFTRANS, ops[2].res, cut_message("READ 8, 4 bytes instead of 16"));
+  cut_assert_equal_int(sizeof(abtEcho), ops[3].res, cut_message("echo"));
+  cut_assert_equal_int(NFC_EOVFLOW, ops[4].res, cut_message("READ 4 in 8 bytes"));
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_device_get_last_error(pnd), cut_message("last error"));
+}
+
+void
+test_transceive_batch_stop_on_error(void)
+{
+  sim_fixture_trace(pnd);
+  cut_assert_equal_int(2, nfc_initiator_transceive_batch(pnd, ops, 5, NFC_BATCH_STOP_ON_ERROR, -1), cut_message("successful exchanges"));
+  cut_assert_equal_uint(3, sim_fixture_command_count(pnd, InDataExchange), cut_message("InDataExchange"));
+
+  cut_assert_equal_int(16, ops[0].res, cut_message("READ 4"));
+  cut_assert_equal_int(1, ops[1].res, cut_message("WRITE 5"));
+  cut_assert_equal_int(NFC_ERFTRANS, ops[2].res, cut_message("READ 8, 4 bytes instead of 16"));
+  cut_assert_equal_int(NFC_ERFTRANS, nfc_device_get_last_error(pnd), cut_message("last error"));
+  // Left untouched
+  cut_assert_equal_int(OP_NOT_RUN, ops[3].res, cut_message("echo"));
+  cut_assert_equal_int(OP_NOT_RUN, ops[4].res, cut_message("READ 4 in 8 bytes"));
+
+  // The target still answers
+  cut_assert_equal_int(1, nfc_initiator_transceive_batch(pnd, ops, 1, NFC_BATCH_STOP_ON_ERROR, -1), cut_message("successful exchanges"));
+  cut_assert_equal_int(0, nfc_device_get_last_error(pnd), cut_message("last error"));
+}
@@ -234,13 +234,12 @@ authenticate(uint32_t uiBlock)
 static bool
 unlock_card(void)
 {
-  // Configure the CRC
-  if (nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false) < 0) {
-    nfc_perror(pnd, "nfc_configure");
-    return false;
-  }
-  // Use raw send/receive methods
-  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false) < 0) {
+  // Configure the CRC and use raw send/receive methods
+  const nfc_property_setting raw[] = {
+    { NP_HANDLE_CRC, false },
+    { NP_EASY_FRAMING, false },
+  };
+  if (nfc_device_set_properties(pnd, raw, sizeof(raw) / sizeof(raw[0])) < 0) {
     nfc_perror(pnd, "nfc_configure");
     return false;
   }
@@ -260,14 +259,13 @@ unlock_card(void)
   }
 
   // reset reader
-  // Configure the CRC
-  if (nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true) < 0) {
-    nfc_perror(pnd, "nfc_device_set_property_bool");
-    return false;
-  }
-  // Switch off raw send/receive methods
-  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
-    nfc_perror(pnd, "nfc_device_set_property_bool");
+  // Configure the CRC and switch off raw send/receive methods
+  const nfc_property_setting easy[] = {
+    { NP_HANDLE_CRC, true },
+    { NP_EASY_FRAMING, true },
+  };
+  if (nfc_device_set_properties(pnd, easy, sizeof(easy) / sizeof(easy[0])) < 0) {
+    nfc_perror(pnd, "nfc_device_set_properties");
     return false;
   }
   return true;
@@ -286,11 +284,11 @@ get_rats(void)
   res = nfc_initiator_transceive_bytes(pnd, abtRats, sizeof(abtRats), abtRx, sizeof(abtRx), 0);
   if (res > 0) {
     // ISO14443-4 card, turn RF field off/on to access ISO14443-3 again
-    if (nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false) < 0) {
-      nfc_perror(pnd, "nfc_configure");
-      return -1;
-    }
-    if (nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true) < 0) {
+    const nfc_property_setting field_cycle[] = {
+      { NP_ACTIVATE_FIELD, false },
+      { NP_ACTIVATE_FIELD, true },
+    };
+    if (nfc_device_set_properties(pnd, field_cycle, sizeof(field_cycle) / sizeof(field_cycle[0])) < 0) {
       nfc_perror(pnd, "nfc_configure");
       return -1;
     }
@@ -0,0 +1,218 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+
+/**
+ * @file nfc-trace.c
+ * @brief Record the frames exchanged with a NFC device while polling targets and save them as pcapng
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+#define MAX_TARGET_COUNT 16
+
+static nfc_device *pnd = NULL;
+static volatile sig_atomic_t interrupted = 0;
+
+static void
+stop_tracing(int sig)
+{
+  (void) sig;
+  interrupted = 1;
+  if (pnd != NULL)
+    nfc_abort_command(pnd);
+}
+
+static void
+print_usage(const char *argv[])
+{
+  printf("Usage: %s [OPTIONS]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-h\t\tPrint this help message.\n");
+  printf("\t-o FILE\t\tWrite the trace to FILE (default: nfc-trace.pcapng).\n");
+  printf("\t-n FRAMES\tKeep the last FRAMES frames (default: 1024).\n");
+  printf("\t-c COUNT\tPoll COUNT times, 0 for until interrupted (default: 1).\n");
+  printf("\t-s\t\tPrint per-command statistics.\n");
+}
+
+static void
+print_stats(void)
+{
+  nfc_command_stats stats[NFC_STATS_MAX_COMMANDS];
+  int n;
+
+  if ((n = nfc_device_get_stats(pnd, stats, NFC_STATS_MAX_COMMANDS)) < 0) {
+    nfc_perror(pnd, "nfc_device_get_stats");
+    return;
+  }
+  printf("cmd   count  timeouts  io_err  chip_err  bytes_tx  bytes_rx  avg_us    max_us\n");
+  for (int i = 0; i < n; i++) {
+    printf("0x%02x  %5lu  %8lu  %6lu  %8lu  %8llu  %8llu  %-8llu  %llu\n", stats[i].command,
+           (unsigned long) stats[i].count, (unsigned long) stats[i].timeouts,
+           (unsigned long) stats[i].io_errors, (unsigned long) stats[i].chip_errors,
+           (unsigned long long) stats[i].bytes_sent, (unsigned long long) stats[i].bytes_received,
+           (unsigned long long)(stats[i].total_us / stats[i].count), (unsigned long long) stats[i].max_us);
+  }
+}
+
+static int
+poll_targets(void)
+{
+  const nfc_modulation_type *nmt;
+  int res;
+
+  if ((res = nfc_device_get_supported_modulation(pnd, N_INITIATOR, &nmt)) < 0)
+    return res;
+  for (int i = 0; nmt[i] && !interrupted; i++) {
+    const nfc_baud_rate *nbr;
+    if ((res = nfc_device_get_supported_baud_rate(pnd, nmt[i], &nbr)) < 0)
+      return res;
+    for (int j = 0; nbr[j] && !interrupted; j++) {
+      const nfc_modulation nm = { .nmt = nmt[i], .nbr = nbr[j] };
+      nfc_target ant[MAX_TARGET_COUNT];
+      if (nmt[i] == NMT_DEP)
+        continue;
+      if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) < 0)
+        return res;
+      if (res > 0)
+        printf("%d %s (%s) passive target(s) found.\n", res, str_nfc_modulation_type(nm.nmt), str_nfc_baud_rate(nm.nbr));
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *filename = "nfc-trace.pcapng";
+  unsigned long frames = 1024;
+  unsigned long count = 1;
+  bool verbose_stats = false;
+  int res;
+
+  // Get commandline options
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv);
+      exit(EXIT_SUCCESS);
+    } else if ((0 == strcmp(argv[arg], "-o")) && (arg + 1 < argc)) {
+      filename = argv[++arg];
+    } else if ((0 == strcmp(argv[arg], "-n")) && (arg + 1 < argc)) {
+      frames = strtoul(argv[++arg], NULL, 10);
+    } else if ((0 == strcmp(argv[arg], "-c")) && (arg + 1 < argc)) {
+      count = strtoul(argv[++arg], NULL, 10);
+    } else if (0 == strcmp(argv[arg], "-s")) {
+      verbose_stats = true;
+    } else {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (frames == 0) {
+    ERR("Trace must hold at least one frame.");
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%s uses libnfc %s\n", argv[0], nfc_version());
+
+  pnd = nfc_open(context, NULL);
+  if (pnd == NULL) {
+    ERR("Unable to open NFC device.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
+
+  if (nfc_device_set_trace(pnd, frames) < 0) {
+    nfc_perror(pnd, "nfc_device_set_trace");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGINT, stop_tracing);
+
+  // Whatever happens, the trace is saved so that failures can be analysed
+  if ((res = nfc_initiator_init(pnd)) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+  } else {
+    for (unsigned long n = 0; ((count == 0) || (n < count)) && !interrupted; n++) {
+      if ((res = poll_targets()) < 0) {
+        if (!interrupted)
+          nfc_perror(pnd, "nfc_initiator_list_passive_targets");
+        break;
+      }
+    }
+    if (interrupted)
+      res = NFC_SUCCESS;
+  }
+
+  if (verbose_stats)
+    print_stats();
+
+  const int saved = nfc_device_save_trace(pnd, filename);
+  if (saved < 0) {
+    ERR("Unable to save trace to %s", filename);
+    res = saved;
+  } else {
+    printf("%d frame(s) saved to %s\n", saved, filename);
+  }
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  exit((res < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
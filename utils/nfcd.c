@@ -0,0 +1,710 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfcd.c
+ * @brief Broker daemon: keeps PN53x devices open and relays the commands of the broker driver
+ *
+ * Each client connection is a session bound to one device. A device serves
+ * one session at a time, from its OPEN to its CLOSE (or disconnection), and
+ * executes the requests of that session in order, in a thread of its own.
+ * Requests are read as soon as they arrive, so that clients may pipeline
+ * them, and aborts reach the device while it is busy.
+ *
+ * Client sockets are non-blocking: replies go to an output buffer of the
+ * session, which the main loop flushes as the client reads, so a slow client
+ * never stalls a device or the other sessions. A client which lets more than
+ * NFCD_TX_MAX bytes of replies pile up is disconnected.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "drivers/broker.h"
+
+#define MAX_SESSION_COUNT 64
+// Replies a session may have pending, beyond which its client is disconnected
+#define NFCD_TX_MAX (64 * 1024)
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+// Queued by the main loop when a client goes away, it gives the device back
+#define NFCD_DISCONNECT 0
+
+struct nfcd_session;
+
+struct nfcd_request {
+  struct nfcd_request *next;
+  struct nfcd_session *session;
+  struct broker_header hdr;
+  uint8_t abtData[];
+};
+
+struct nfcd_device {
+  struct nfcd_device *next;
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  pthread_t thread;
+  // Protects the fields below, as well as the refs, closed and abort fields of the sessions of the device
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct nfcd_request *queue;
+  struct nfcd_request **queue_tail;
+  struct nfcd_session *owner;
+  struct nfcd_session *running;
+  uint32_t running_tag;
+  bool stop;
+};
+
+struct nfcd_session {
+  int fd;
+  struct nfcd_device *device;
+  // Held by the main loop until disconnection and by each queued request
+  unsigned int refs;
+  bool closed;
+  bool bAbort;
+  uint32_t uiAbortTag;
+  // Protects the output buffer, which replies fill and the main loop flushes
+  pthread_mutex_t write_mutex;
+  uint8_t abtTx[NFCD_TX_MAX];
+  size_t szTx;
+  bool bOverflow;
+  uint8_t abtRx[sizeof(struct broker_header) + BROKER_PAYLOAD_MAX];
+  size_t szRx;
+};
+
+static nfc_context *context;
+static struct nfcd_device *devices = NULL;
+static volatile sig_atomic_t quit = 0;
+// Written by device threads to have the main loop look at the output buffers again
+static int aiWake[2] = { -1, -1 };
+
+static void
+stop_serving(int sig)
+{
+  (void) sig;
+  quit = 1;
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("Usage: %s [-s SOCKET] [CONNSTRING...]\n", progname);
+  printf("Options:\n");
+  printf("\t-h\tPrint this help message.\n");
+  printf("\t-s\tListen on SOCKET (default: %s).\n", BROKER_DEFAULT_SOCKET);
+  printf("The devices given are opened at once, the first one is the default device.\n");
+  printf("Without any, the default device is the first one libnfc finds.\n");
+}
+
+// Send what the client socket takes without blocking, called with the write mutex held; returns false when the client is gone
+static bool
+session_flush(struct nfcd_session *s)
+{
+  size_t szDone = 0;
+  while (szDone < s->szTx) {
+    ssize_t res = send(s->fd, s->abtTx + szDone, s->szTx - szDone, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
+      s->szTx = 0;
+      return false;
+    }
+    szDone += res;
+  }
+  memmove(s->abtTx, s->abtTx + szDone, s->szTx - szDone);
+  s->szTx -= szDone;
+  return true;
+}
+
+static void
+session_reply(struct nfcd_session *s, const struct broker_header *req, const int32_t arg, const void *pData, const size_t szData)
+{
+  struct broker_header hdr = { .op = req->op, .version = BROKER_PROTOCOL_VERSION, .len = szData, .tag = req->tag, .arg = arg };
+  bool bWake = false;
+
+  pthread_mutex_lock(&s->write_mutex);
+  if (s->bOverflow) {
+    // Being disconnected
+  } else if (s->szTx + sizeof(hdr) + szData > sizeof(s->abtTx)) {
+    s->bOverflow = true;
+    bWake = true;
+  } else {
+    memcpy(s->abtTx + s->szTx, &hdr, sizeof(hdr));
+    if (szData)
+      memcpy(s->abtTx + s->szTx + sizeof(hdr), pData, szData);
+    s->szTx += sizeof(hdr) + szData;
+    // The main loop notices a client gone by itself
+    session_flush(s);
+    bWake = (s->szTx > 0);
+  }
+  pthread_mutex_unlock(&s->write_mutex);
+  if (bWake) {
+    const uint8_t btWake = 0;
+    if (write(aiWake[1], &btWake, sizeof(btWake)) < 0) {
+      // A full pipe already wakes the main loop up
+    }
+  }
+}
+
+// Called with the device mutex held when the session has one
+static void
+session_release(struct nfcd_session *s)
+{
+  if (--s->refs > 0)
+    return;
+  close(s->fd);
+  pthread_mutex_destroy(&s->write_mutex);
+  free(s);
+}
+
+// Next request the device may serve: those of the session it is given to, or of any session when it is free
+static struct nfcd_request *
+device_next_request(struct nfcd_device *dev)
+{
+  for (struct nfcd_request **pp = &dev->queue; *pp; pp = &((*pp)->next)) {
+    struct nfcd_request *r = *pp;
+    if (dev->owner && (r->session != dev->owner) && !r->session->closed)
+      continue;
+    *pp = r->next;
+    if (!*pp)
+      dev->queue_tail = pp;
+    return r;
+  }
+  return NULL;
+}
+
+static void
+device_open(struct nfcd_device *dev, struct nfcd_request *r)
+{
+  struct nfcd_session *s = r->session;
+  struct broker_session session;
+  int res;
+
+  if (!dev->pnd) {
+    pthread_mutex_unlock(&dev->mutex);
+    nfc_device *pnd = nfc_open(context, dev->connstring[0] ? dev->connstring : NULL);
+    if (pnd && (pnd->driver->strerror != pn53x_strerror)) {
+      // Only commands of PN53x chips can be relayed
+      ERR("%s is not a PN53x device", nfc_device_get_name(pnd));
+      nfc_close(pnd);
+      pnd = NULL;
+    }
+    pthread_mutex_lock(&dev->mutex);
+    if (!pnd) {
+      session_reply(s, &r->hdr, NFC_ENOTSUCHDEV, NULL, 0);
+      return;
+    }
+    dev->pnd = pnd;
+    printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
+  }
+
+  dev->owner = s;
+  pthread_mutex_unlock(&dev->mutex);
+  memset(&session, 0x00, sizeof(session));
+  snprintf(session.name, sizeof(session.name), "%s", nfc_device_get_name(dev->pnd));
+  if ((res = pn53x_state_export(dev->pnd, &session.state)) < 0) {
+    session_reply(s, &r->hdr, res, NULL, 0);
+  } else {
+    session_reply(s, &r->hdr, sizeof(session), &session, sizeof(session));
+  }
+  pthread_mutex_lock(&dev->mutex);
+  if (res < 0)
+    dev->owner = NULL;
+}
+
+static void
+device_transceive(struct nfcd_device *dev, struct nfcd_request *r)
+{
+  struct nfcd_session *s = r->session;
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  int res;
+
+  if (dev->owner != s) {
+    session_reply(s, &r->hdr, NFC_EINVARG, NULL, 0);
+    return;
+  }
+  if (s->bAbort && (s->uiAbortTag == r->hdr.tag)) {
+    // Aborted before it was started
+    s->bAbort = false;
+    session_reply(s, &r->hdr, NFC_EOPABORTED, NULL, 0);
+    return;
+  }
+  // An abort may have come too late for the previous command
+  nfc_cancel_take(&dev->pnd->cancel);
+  dev->running = s;
+  dev->running_tag = r->hdr.tag;
+  pthread_mutex_unlock(&dev->mutex);
+
+  res = pn53x_relay(dev->pnd, r->abtData, r->hdr.len, abtRx, sizeof(abtRx), r->hdr.arg);
+  session_reply(s, &r->hdr, res, abtRx, (res > 0) ? (size_t) res : 0);
+
+  pthread_mutex_lock(&dev->mutex);
+  dev->running = NULL;
+}
+
+static void
+device_release(struct nfcd_device *dev, bool bIdle)
+{
+  struct pn53x_state state;
+
+  dev->owner = NULL;
+  pthread_mutex_unlock(&dev->mutex);
+  if (bIdle)
+    nfc_idle(dev->pnd);
+  // Bring the chip back to its initial state now rather than on the next
+  // open, which then costs the next session a single exchange
+  pn53x_state_export(dev->pnd, &state);
+  pthread_mutex_lock(&dev->mutex);
+}
+
+static void *
+device_thread(void *arg)
+{
+  struct nfcd_device *dev = (struct nfcd_device *) arg;
+
+  pthread_mutex_lock(&dev->mutex);
+  while (!dev->stop) {
+    struct nfcd_request *r = device_next_request(dev);
+    if (!r) {
+      pthread_cond_wait(&dev->cond, &dev->mutex);
+      continue;
+    }
+    struct nfcd_session *s = r->session;
+    if (r->hdr.op == NFCD_DISCONNECT) {
+      // Given back without CLOSE: leave the device idle for the next session
+      if (dev->owner == s)
+        device_release(dev, true);
+    } else if (!s->closed) {
+      switch (r->hdr.op) {
+        case BROKER_OPEN:
+          device_open(dev, r);
+          break;
+        case BROKER_TRANSCEIVE:
+          device_transceive(dev, r);
+          break;
+        case BROKER_CLOSE:
+          session_reply(s, &r->hdr, NFC_SUCCESS, NULL, 0);
+          if (dev->owner == s)
+            device_release(dev, false);
+          break;
+      }
+    }
+    session_release(s);
+    free(r);
+  }
+  pthread_mutex_unlock(&dev->mutex);
+  return NULL;
+}
+
+static struct nfcd_device *
+device_get(const char *connstring)
+{
+  struct nfcd_device *dev;
+
+  for (dev = devices; dev; dev = dev->next) {
+    if (strcmp(dev->connstring, connstring) == 0)
+      return dev;
+  }
+  if (!(dev = calloc(1, sizeof(*dev))))
+    return NULL;
+  snprintf(dev->connstring, sizeof(dev->connstring), "%s", connstring);
+  dev->queue_tail = &dev->queue;
+  pthread_mutex_init(&dev->mutex, NULL);
+  pthread_cond_init(&dev->cond, NULL);
+  if (pthread_create(&dev->thread, NULL, device_thread, dev) != 0) {
+    pthread_cond_destroy(&dev->cond);
+    pthread_mutex_destroy(&dev->mutex);
+    free(dev);
+    return NULL;
+  }
+  dev->next = devices;
+  devices = dev;
+  return dev;
+}
+
+static void
+device_enqueue(struct nfcd_session *s, const struct broker_header *hdr, const uint8_t *pbtData)
+{
+  struct nfcd_device *dev = s->device;
+  struct nfcd_request *r = malloc(sizeof(*r) + hdr->len);
+  if (!r) {
+    session_reply(s, hdr, NFC_ESOFT, NULL, 0);
+    return;
+  }
+  r->next = NULL;
+  r->session = s;
+  r->hdr = *hdr;
+  if (hdr->len)
+    memcpy(r->abtData, pbtData, hdr->len);
+
+  pthread_mutex_lock(&dev->mutex);
+  s->refs++;
+  *(dev->queue_tail) = r;
+  dev->queue_tail = &(r->next);
+  pthread_cond_signal(&dev->cond);
+  pthread_mutex_unlock(&dev->mutex);
+}
+
+static void
+session_abort(struct nfcd_session *s, const uint32_t tag)
+{
+  struct nfcd_device *dev = s->device;
+
+  pthread_mutex_lock(&dev->mutex);
+  if ((dev->running == s) && (dev->running_tag == tag)) {
+    nfc_abort_command(dev->pnd);
+  } else {
+    s->bAbort = true;
+    s->uiAbortTag = tag;
+  }
+  pthread_mutex_unlock(&dev->mutex);
+}
+
+static void
+session_disconnect(struct nfcd_session *s)
+{
+  struct nfcd_device *dev = s->device;
+
+  if (!dev) {
+    session_release(s);
+    return;
+  }
+  const struct broker_header hdr = { .op = NFCD_DISCONNECT, .version = BROKER_PROTOCOL_VERSION };
+  pthread_mutex_lock(&dev->mutex);
+  s->closed = true;
+  if (dev->running == s)
+    nfc_abort_command(dev->pnd);
+  pthread_mutex_unlock(&dev->mutex);
+  device_enqueue(s, &hdr, NULL);
+  pthread_mutex_lock(&dev->mutex);
+  session_release(s);
+  pthread_mutex_unlock(&dev->mutex);
+}
+
+// Handle one request, returns false when the client has to be disconnected
+static bool
+session_dispatch(struct nfcd_session *s, const struct broker_header *hdr, const uint8_t *pbtData, const char *pcDefault)
+{
+  if (hdr->version != BROKER_PROTOCOL_VERSION)
+    return false;
+  switch (hdr->op) {
+    case BROKER_OPEN: {
+      char acConnstring[NFC_BUFSIZE_CONNSTRING];
+      if (s->device || (hdr->len >= sizeof(acConnstring))) {
+        session_reply(s, hdr, NFC_EINVARG, NULL, 0);
+        break;
+      }
+      memcpy(acConnstring, pbtData, hdr->len);
+      acConnstring[hdr->len] = '\0';
+      if (!(s->device = device_get(acConnstring[0] ? acConnstring : pcDefault))) {
+        session_reply(s, hdr, NFC_ESOFT, NULL, 0);
+        break;
+      }
+      device_enqueue(s, hdr, pbtData);
+    }
+    break;
+    case BROKER_TRANSCEIVE:
+    case BROKER_CLOSE:
+      if (!s->device) {
+        session_reply(s, hdr, NFC_EINVARG, NULL, 0);
+        break;
+      }
+      device_enqueue(s, hdr, pbtData);
+      break;
+    case BROKER_ABORT:
+      if (s->device)
+        session_abort(s, hdr->tag);
+      break;
+    default:
+      session_reply(s, hdr, NFC_ENOTIMPL, NULL, 0);
+      break;
+  }
+  return true;
+}
+
+// Read what the client sent and dispatch every whole request, returns false when the client has to be disconnected
+static bool
+session_read(struct nfcd_session *s, const char *pcDefault)
+{
+  ssize_t res = recv(s->fd, s->abtRx + s->szRx, sizeof(s->abtRx) - s->szRx, 0);
+  if (res <= 0)
+    return (res < 0) && ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK));
+  s->szRx += res;
+
+  size_t szPos = 0;
+  struct broker_header hdr;
+  while (s->szRx - szPos >= sizeof(hdr)) {
+    memcpy(&hdr, s->abtRx + szPos, sizeof(hdr));
+    if (hdr.len > BROKER_PAYLOAD_MAX)
+      return false;
+    if (s->szRx - szPos < sizeof(hdr) + hdr.len)
+      break;
+    if (!session_dispatch(s, &hdr, s->abtRx + szPos + sizeof(hdr), pcDefault))
+      return false;
+    szPos += sizeof(hdr) + hdr.len;
+  }
+  memmove(s->abtRx, s->abtRx + szPos, s->szRx - szPos);
+  s->szRx -= szPos;
+  return true;
+}
+
+// Connect to the socket, returns 0 when someone listens on it, otherwise connect()'s errno
+static int
+socket_probe(const struct sockaddr_un *psun)
+{
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return errno;
+  const int res = (connect(fd, (const struct sockaddr *) psun, sizeof(*psun)) < 0) ? errno : 0;
+  close(fd);
+  return res;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *pcSocket = BROKER_DEFAULT_SOCKET;
+  const char *pcDefault = "";
+  struct nfcd_session *sessions[MAX_SESSION_COUNT];
+  size_t szSessions = 0;
+  int arg;
+
+  // Keep the log readable when redirected to a file
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  for (arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if ((0 == strcmp(argv[arg], "-s")) && (arg + 1 < argc)) {
+      pcSocket = argv[++arg];
+    } else if (argv[arg][0] == '-') {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    } else {
+      break;
+    }
+  }
+
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  struct sockaddr_un sun;
+  memset(&sun, 0x00, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  if (strlen(pcSocket) >= sizeof(sun.sun_path)) {
+    ERR("Socket path too long: %s", pcSocket);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(sun.sun_path, pcSocket);
+  // Before opening any device, which a running instance would share
+  const int iProbe = socket_probe(&sun);
+  if (iProbe == 0) {
+    ERR("nfcd is already running on %s", pcSocket);
+    exit(EXIT_FAILURE);
+  } else if ((iProbe != ECONNREFUSED) && (iProbe != ENOENT)) {
+    ERR("Unable to use %s: %s", pcSocket, strerror(iProbe));
+    exit(EXIT_FAILURE);
+  }
+
+  // Devices given on the command line are opened at once
+  for (int n = arg; n < argc; n++) {
+    nfc_device *pnd = nfc_open(context, argv[n]);
+    struct nfcd_device *dev;
+    if (!pnd || !(dev = device_get(argv[n]))) {
+      ERR("Unable to open NFC device: %s", argv[n]);
+      exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&dev->mutex);
+    dev->pnd = pnd;
+    pthread_mutex_unlock(&dev->mutex);
+    printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
+  }
+  if (arg < argc)
+    pcDefault = argv[arg];
+
+  int iListen = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (iListen < 0) {
+    ERR("socket: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  // Only a socket left over by a previous instance is replaced
+  unlink(pcSocket);
+  if ((bind(iListen, (struct sockaddr *) &sun, sizeof(sun)) < 0) || (listen(iListen, 16) < 0)) {
+    ERR("Unable to listen on %s: %s", pcSocket, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  printf("Listening on %s\n", pcSocket);
+
+  if (pipe(aiWake) < 0) {
+    ERR("pipe: %s", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < 2; i++)
+    fcntl(aiWake[i], F_SETFL, fcntl(aiWake[i], F_GETFL) | O_NONBLOCK);
+
+  signal(SIGINT, stop_serving);
+  signal(SIGTERM, stop_serving);
+  signal(SIGPIPE, SIG_IGN);
+
+  while (!quit) {
+    struct pollfd pfds[2 + MAX_SESSION_COUNT];
+    pfds[0].fd = iListen;
+    pfds[0].events = (szSessions < MAX_SESSION_COUNT) ? POLLIN : 0;
+    pfds[1].fd = aiWake[0];
+    pfds[1].events = POLLIN;
+    for (size_t n = szSessions; n > 0; n--) {
+      struct nfcd_session *s = sessions[n - 1];
+      pthread_mutex_lock(&s->write_mutex);
+      const bool bOverflow = s->bOverflow;
+      pfds[1 + n].fd = s->fd;
+      pfds[1 + n].events = POLLIN | (s->szTx ? POLLOUT : 0);
+      pthread_mutex_unlock(&s->write_mutex);
+      if (bOverflow) {
+        ERR("%s", "Client does not read its replies, disconnected");
+        session_disconnect(s);
+        sessions[n - 1] = sessions[--szSessions];
+        pfds[1 + n] = pfds[2 + szSessions];
+      }
+    }
+    if (poll(pfds, 2 + szSessions, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      ERR("poll: %s", strerror(errno));
+      break;
+    }
+
+    if (pfds[1].revents & POLLIN) {
+      uint8_t abtWake[64];
+      while (read(aiWake[0], abtWake, sizeof(abtWake)) > 0)
+        ;
+    }
+    // Sessions are served first, a new one is appended to the array
+    for (size_t n = szSessions; n > 0; n--) {
+      const short revents = pfds[1 + n].revents;
+      struct nfcd_session *s = sessions[n - 1];
+      bool bConnected = true;
+      if (revents & POLLOUT) {
+        pthread_mutex_lock(&s->write_mutex);
+        bConnected = session_flush(s);
+        pthread_mutex_unlock(&s->write_mutex);
+      }
+      if (bConnected && (revents & ~POLLOUT))
+        bConnected = session_read(s, pcDefault);
+      if (!bConnected) {
+        session_disconnect(s);
+        sessions[n - 1] = sessions[--szSessions];
+      }
+    }
+    if (pfds[0].revents & POLLIN) {
+      int fd = accept(iListen, NULL, NULL);
+      if (fd < 0)
+        continue;
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      struct nfcd_session *s = calloc(1, sizeof(*s));
+      if (!s) {
+        close(fd);
+        continue;
+      }
+      s->fd = fd;
+      s->refs = 1;
+      pthread_mutex_init(&s->write_mutex, NULL);
+      sessions[szSessions++] = s;
+    }
+  }
+
+  for (size_t n = 0; n < szSessions; n++)
+    session_disconnect(sessions[n]);
+  close(iListen);
+  unlink(pcSocket);
+  close(aiWake[0]);
+  close(aiWake[1]);
+
+  while (devices) {
+    struct nfcd_device *dev = devices;
+    devices = dev->next;
+    pthread_mutex_lock(&dev->mutex);
+    dev->stop = true;
+    if (dev->running)
+      nfc_abort_command(dev->pnd);
+    pthread_cond_signal(&dev->cond);
+    pthread_mutex_unlock(&dev->mutex);
+    pthread_join(dev->thread, NULL);
+    while (dev->queue) {
+      struct nfcd_request *r = dev->queue;
+      dev->queue = r->next;
+      session_release(r->session);
+      free(r);
+    }
+    if (dev->pnd)
+      nfc_close(dev->pnd);
+    pthread_cond_destroy(&dev->cond);
+    pthread_mutex_destroy(&dev->mutex);
+    free(dev);
+  }
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}